@@ -0,0 +1,308 @@
+/**
+ * @file allocator.c
+ * @brief Pluggable memory allocation for every jminus subsystem
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The slab and arena allocators put an 8-byte header before each block, holding
+ * its size, so realloc and free need no size from the caller. Blocks stay
+ * 8-byte aligned, which is all jminus needs: object pointers keep their
+ * low three bits free for the value tag, and the SIMD kernels use
+ * unaligned loads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "allocator.h"
+
+#define HEADER sizeof(size_t)
+
+// Chunks the slab allocator carves its blocks from
+#define SLAB_CHUNK (64 * 1024)
+
+static size_t align8(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+// ----------------------------
+// Slab allocator
+// ----------------------------
+static const size_t class_sizes[JM_SLAB_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+// Smallest class holding block bytes (block <= JM_SLAB_MAX_BLOCK)
+static int size_class(size_t block) {
+    if (block <= 128) return block <= 16 ? 0 : (int)((block - 1) / 16);
+    int index = 8;
+    while (class_sizes[index] < block) index++;
+    return index;
+}
+
+typedef struct Chunk {
+    struct Chunk* next;
+} Chunk;
+
+// Blocks too big for a class are linked before their header, so release can free live ones
+typedef struct Large {
+    struct Large* prev;
+    struct Large* next;
+} Large;
+
+void jm_slab_init(jm_slab* slab, size_t limit) {
+    memset(slab, 0, sizeof(*slab));
+    slab->limit = limit;
+}
+
+static void* slab_alloc(void* context, size_t size) {
+    jm_slab* slab = context;
+    size_t block = HEADER + align8(size ? size : 1);
+    if (block > JM_SLAB_MAX_BLOCK) {
+        if (slab->limit && slab->in_use + block > slab->limit) return NULL;
+        Large* large = malloc(sizeof(Large) + block);
+        if (!large) return NULL;
+        large->prev = NULL;
+        large->next = slab->large;
+        if (large->next) large->next->prev = large;
+        slab->large = large;
+        size_t* header = (size_t*)(large + 1);
+        *header = block;
+        slab->in_use += block;
+        return header + 1;
+    }
+
+    int index = size_class(block);
+    block = class_sizes[index];
+    if (slab->limit && slab->in_use + block > slab->limit) return NULL;
+
+    size_t* header = slab->free_lists[index];
+    if (header) {
+        slab->free_lists[index] = *(void**)(header + 1);
+    } else {
+        if ((size_t)(slab->bump_end - slab->bump) < block) {
+            Chunk* chunk = malloc(SLAB_CHUNK);
+            if (!chunk) return NULL;
+            chunk->next = slab->chunks;
+            slab->chunks = chunk;
+            slab->bump = (char*)chunk + align8(sizeof(Chunk));
+            slab->bump_end = (char*)chunk + SLAB_CHUNK;
+        }
+        header = (size_t*)slab->bump;
+        slab->bump += block;
+    }
+    *header = block;
+    slab->in_use += block;
+    return header + 1;
+}
+
+static void slab_free(void* context, void* pointer) {
+    if (!pointer) return;
+    jm_slab* slab = context;
+    size_t* header = (size_t*)pointer - 1;
+    size_t block = *header;
+    slab->in_use -= block;
+    if (block > JM_SLAB_MAX_BLOCK) {
+        Large* large = (Large*)header - 1;
+        if (large->prev) large->prev->next = large->next;
+        else slab->large = large->next;
+        if (large->next) large->next->prev = large->prev;
+        free(large);
+        return;
+    }
+    // The free list link lives where the caller's data was
+    int index = size_class(block);
+    *(void**)pointer = slab->free_lists[index];
+    slab->free_lists[index] = header;
+}
+
+static void* slab_realloc(void* context, void* pointer, size_t size) {
+    if (!pointer) return slab_alloc(context, size);
+    size_t* header = (size_t*)pointer - 1;
+    size_t old_size = *header - HEADER;
+    if (size <= old_size && *header <= JM_SLAB_MAX_BLOCK) return pointer;
+
+    void* moved = slab_alloc(context, size);
+    if (!moved) return NULL;
+    memcpy(moved, pointer, old_size < size ? old_size : size);
+    slab_free(context, pointer);
+    return moved;
+}
+
+jm_allocator jm_slab_allocator(jm_slab* slab) {
+    jm_allocator allocator = { slab_alloc, slab_realloc, slab_free, slab };
+    return allocator;
+}
+
+void jm_slab_release(jm_slab* slab) {
+    Chunk* chunk = slab->chunks;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    Large* large = slab->large;
+    while (large) {
+        Large* next = large->next;
+        free(large);
+        large = next;
+    }
+    jm_slab_init(slab, slab->limit);
+}
+
+// ----------------------------
+// Arena allocator
+// ----------------------------
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t capacity;  // Bytes of data
+    size_t used;      // Bytes of data handed out
+    char* last;       // Most recent allocation, which can grow in place
+} ArenaBlock;
+
+void jm_arena_init(jm_arena* arena, size_t limit) {
+    arena->blocks = NULL;
+    arena->used = 0;
+    arena->limit = limit;
+}
+
+static char* block_data(ArenaBlock* block) {
+    return (char*)block + align8(sizeof(ArenaBlock));
+}
+
+static void* arena_alloc(void* context, size_t size) {
+    jm_arena* arena = context;
+    size_t needed = HEADER + align8(size ? size : 1);
+    if (arena->limit && arena->used + needed > arena->limit) return NULL;
+
+    ArenaBlock* block = arena->blocks;
+    if (!block || block->capacity - block->used < needed) {
+        size_t capacity = needed > JM_ARENA_BLOCK ? needed : JM_ARENA_BLOCK;
+        block = malloc(align8(sizeof(ArenaBlock)) + capacity);
+        if (!block) return NULL;
+        block->next = arena->blocks;
+        block->capacity = capacity;
+        block->used = 0;
+        arena->blocks = block;
+    }
+    size_t* header = (size_t*)(block_data(block) + block->used);
+    *header = needed - HEADER;
+    block->used += needed;
+    block->last = (char*)(header + 1);
+    arena->used += needed;
+    return header + 1;
+}
+
+static void arena_free(void* context, void* pointer) {
+    (void)context;
+    (void)pointer;
+}
+
+static void* arena_realloc(void* context, void* pointer, size_t size) {
+    if (!pointer) return arena_alloc(context, size);
+    jm_arena* arena = context;
+    size_t* header = (size_t*)pointer - 1;
+    size_t old_size = *header;
+    if (size <= old_size) return pointer;
+
+    // The newest allocation grows in place while its block has room
+    ArenaBlock* block = arena->blocks;
+    size_t growth = align8(size) - old_size;
+    if (block->last == pointer && block->capacity - block->used >= growth &&
+        (!arena->limit || arena->used + growth <= arena->limit)) {
+        *header += growth;
+        block->used += growth;
+        arena->used += growth;
+        return pointer;
+    }
+
+    void* moved = arena_alloc(context, size);
+    if (!moved) return NULL;
+    memcpy(moved, pointer, old_size);
+    return moved;
+}
+
+jm_allocator jm_arena_allocator(jm_arena* arena) {
+    jm_allocator allocator = { arena_alloc, arena_realloc, arena_free, arena };
+    return allocator;
+}
+
+void jm_arena_release(jm_arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    jm_arena_init(arena, arena->limit);
+}
+
+// ----------------------------
+// System allocator
+// ----------------------------
+static void* system_alloc(void* context, size_t size) {
+    (void)context;
+    return malloc(size ? size : 1);
+}
+
+static void* system_realloc(void* context, void* pointer, size_t size) {
+    (void)context;
+    return realloc(pointer, size ? size : 1);
+}
+
+static void system_free(void* context, void* pointer) {
+    (void)context;
+    free(pointer);
+}
+
+jm_allocator jm_system_allocator(void) {
+    jm_allocator allocator = { system_alloc, system_realloc, system_free, NULL };
+    return allocator;
+}
+
+// ----------------------------
+// Current allocator
+// ----------------------------
+#ifdef JM_SYSTEM_ALLOCATOR
+static const jm_allocator default_allocator = { system_alloc, system_realloc, system_free, NULL };
+#else
+static jm_slab default_slab;
+static const jm_allocator default_allocator = { slab_alloc, slab_realloc, slab_free, &default_slab };
+#endif
+
+static jm_allocator current = default_allocator;
+
+void jm_set_allocator(const jm_allocator* allocator) {
+    current = allocator ? *allocator : default_allocator;
+}
+
+const jm_allocator* jm_get_allocator(void) {
+    return &current;
+}
+
+void* jm_alloc(size_t size) {
+    return current.alloc(current.context, size);
+}
+
+void* jm_calloc(size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* memory = current.alloc(current.context, count * size);
+    if (memory) memset(memory, 0, count * size);
+    return memory;
+}
+
+void* jm_realloc(void* pointer, size_t size) {
+    return current.realloc(current.context, pointer, size);
+}
+
+void jm_free(void* pointer) {
+    current.free(current.context, pointer);
+}
+
+char* jm_strdup(const char* text) {
+    size_t length = strlen(text) + 1;
+    char* copy = jm_alloc(length);
+    if (copy) memcpy(copy, text, length);
+    return copy;
+}
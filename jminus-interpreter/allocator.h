@@ -0,0 +1,162 @@
+/**
+ * @file allocator.h
+ * @brief Pluggable memory allocation for every jminus subsystem
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * All memory jminus allocates (tokens, AST nodes, bytecode, environments,
+ * heap objects and their buffers, the nursery) goes through the current
+ * jm_allocator, so an embedder can route it into its own arenas, pools
+ * or allocator, and cap it.
+ *
+ * Usage:
+ * - jm_set_allocator() installs an allocator; it is copied, and its
+ *   context is passed back to every call
+ * - Only switch allocators while jminus holds no memory: before first
+ *   use, or after free_objects() once every token list, AST and
+ *   bytecode has been freed. Memory must be freed by the allocator that
+ *   allocated it
+ * - Memory jminus hands out (such as bigint_to_string() results) is
+ *   released with jm_free(), not free()
+ *
+ * Allocators Shipped:
+ * - The slab allocator (the default): blocks of up to JM_SLAB_MAX_BLOCK
+ *   bytes come from per-size-class free lists carved out of large chunks,
+ *   so small allocations and frees are a few instructions and never reach
+ *   malloc once warm; larger blocks go to malloc
+ * - The arena allocator: bump allocation in large blocks, where freeing
+ *   does nothing and jm_arena_release() frees everything at once, for
+ *   memory that lives exactly as long as one run
+ * - The system allocator: malloc, realloc and free themselves. Building
+ *   with -DJM_SYSTEM_ALLOCATOR makes it the default, so tools such as
+ *   AddressSanitizer see every block
+ * The slab and arena allocators can be given a byte limit; past it, allocations fail as if the
+ * system were out of memory.
+ *
+ * Error Handling:
+ * - Like malloc, the allocator functions return NULL on failure; the
+ *   subsystems report "Memory allocation failed" and exit
+ */
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+/**
+ * @brief A memory allocator
+ *
+ * The functions follow malloc, realloc and free (realloc(NULL, n)
+ * allocates, and free(NULL) does nothing), with context passed first.
+ */
+typedef struct jm_allocator {
+    void* (*alloc)(void* context, size_t size);                   ///< Allocates size bytes
+    void* (*realloc)(void* context, void* pointer, size_t size);  ///< Resizes a block, moving it if needed
+    void (*free)(void* context, void* pointer);                   ///< Frees a block
+    void* context;                                                ///< User data for the functions
+} jm_allocator;
+
+/**
+ * @brief Installs an allocator, or the default one for NULL
+ */
+void jm_set_allocator(const jm_allocator* allocator);
+
+/**
+ * @brief Returns the allocator in use
+ */
+const jm_allocator* jm_get_allocator(void);
+
+// ----------------------------
+// Allocation through the current allocator
+// ----------------------------
+void* jm_alloc(size_t size);
+void* jm_calloc(size_t count, size_t size);
+void* jm_realloc(void* pointer, size_t size);
+void jm_free(void* pointer);
+char* jm_strdup(const char* text);
+
+/**
+ * @brief Returns the allocator that calls malloc, realloc and free
+ */
+jm_allocator jm_system_allocator(void);
+
+// ----------------------------
+// Slab allocator
+// ----------------------------
+/// Largest block (header included) served from a size class
+#define JM_SLAB_MAX_BLOCK 4096
+
+/// Size classes: 16-byte steps up to 128 bytes, then 192, 256, 384, ... 4096
+#define JM_SLAB_CLASSES 18
+
+/**
+ * @brief State of a slab allocator
+ *
+ * Zero-initialize it (or call jm_slab_init) before use.
+ */
+typedef struct jm_slab {
+    void* free_lists[JM_SLAB_CLASSES];  ///< Freed blocks of each class
+    char* bump;                         ///< Unused part of the newest chunk
+    char* bump_end;                     ///< End of the newest chunk
+    void* chunks;                       ///< Every chunk, for jm_slab_release
+    void* large;                        ///< Live blocks too big for a class, for jm_slab_release
+    size_t in_use;                      ///< Bytes in blocks handed out
+    size_t limit;                       ///< Cap on in_use (0 for none)
+} jm_slab;
+
+/**
+ * @brief Initializes a slab allocator
+ * @param limit Most bytes it may hand out at once, or 0 for no limit
+ */
+void jm_slab_init(jm_slab* slab, size_t limit);
+
+/**
+ * @brief Returns an allocator using the given slab state
+ */
+jm_allocator jm_slab_allocator(jm_slab* slab);
+
+/**
+ * @brief Returns every chunk and large block to the system
+ *
+ * Every block must have been freed (or be unused from now on).
+ */
+void jm_slab_release(jm_slab* slab);
+
+// ----------------------------
+// Arena allocator
+// ----------------------------
+/// Default arena block size
+#define JM_ARENA_BLOCK (64 * 1024)
+
+/**
+ * @brief State of an arena allocator
+ */
+typedef struct jm_arena {
+    void* blocks;     ///< Blocks, newest first
+    size_t used;      ///< Bytes handed out (headers included)
+    size_t limit;     ///< Cap on used (0 for none)
+} jm_arena;
+
+/**
+ * @brief Initializes an arena
+ * @param limit Most bytes it may hand out in total, or 0 for no limit
+ */
+void jm_arena_init(jm_arena* arena, size_t limit);
+
+/**
+ * @brief Returns an allocator using the given arena
+ *
+ * Its free does nothing; memory is only reclaimed by jm_arena_release.
+ */
+jm_allocator jm_arena_allocator(jm_arena* arena);
+
+/**
+ * @brief Frees everything the arena has handed out, at once
+ *
+ * For a per-run arena: run, then call free_objects() and free the
+ * tokens, AST and bytecode as usual (their frees cost nothing), then
+ * release the arena. The arena can be used again afterwards.
+ */
+void jm_arena_release(jm_arena* arena);
+
+#endif // ALLOCATOR_H
@@ -0,0 +1,172 @@
+/**
+ * @file array.c
+ * @brief Dynamic arrays for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "array.h"
+#include "simd.h"
+#include "gc.h"
+#include "allocator.h"
+
+// ----------------------------
+// Elements
+// ----------------------------
+int is_array(Value value) {
+    return IS_ARRAY_OBJ(value);
+}
+
+// Validates an indexing operation and returns the element position
+static int checked_index(Value array, Value index) {
+    if (!IS_ARRAY_OBJ(array)) {
+        fprintf(stderr, "Runtime error: only arrays and maps can be indexed\n");
+        exit(1);
+    }
+    if (!IS_INT(index)) {
+        fprintf(stderr, "Runtime error: array index must be an integer\n");
+        exit(1);
+    }
+    int count = AS_ARRAY_OBJ(array)->count;
+    if (AS_INT(index) < 0 || AS_INT(index) >= count) {
+        fprintf(stderr, "Runtime error: index %lld out of bounds for array of length %d\n",
+                (long long)AS_INT(index), count);
+        exit(1);
+    }
+    return (int)AS_INT(index);
+}
+
+Value array_get(Value array, Value index) {
+    int position = checked_index(array, index);
+    return AS_ARRAY_OBJ(array)->items[position];
+}
+
+void array_set(Value array, Value index, Value value) {
+    int position = checked_index(array, index);
+    gc_array_barrier(AS_ARRAY_OBJ(array), position, value);
+    AS_ARRAY_OBJ(array)->items[position] = value;
+}
+
+void array_push(ObjArray* array, Value value) {
+    if (array->count >= array->capacity) {
+        int old_capacity = array->capacity;
+        array->capacity = array->capacity < 8 ? 8 : array->capacity * 2;
+        array->items = jm_realloc(array->items, sizeof(Value) * array->capacity);
+        if (!array->items) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        gc_array_resized(array, old_capacity);
+    }
+    gc_array_barrier(array, array->count, value);
+    array->items[array->count++] = value;
+}
+
+// ----------------------------
+// Aggregates
+// ----------------------------
+// Each loop hands one block at a time to a kernel and redoes the block
+// with the generic value functions if the kernel declines it.
+
+static int block_length(int start, int count) {
+    return count - start < SIMD_BLOCK ? count - start : SIMD_BLOCK;
+}
+
+Value array_sum(ObjArray* array) {
+    const SimdKernels* kernels = simd_kernels();
+    Value total = INT_VAL(0);
+    for (int start = 0; start < array->count; start += SIMD_BLOCK) {
+        int length = block_length(start, array->count);
+        int64_t partial;
+        if (kernels->sum(array->items + start, length, &partial)) {
+            total = add_values(total, int64_value(partial));
+            continue;
+        }
+        for (int i = start; i < start + length; i++) {
+            total = add_values(total, array->items[i]);
+        }
+    }
+    return total;
+}
+
+static Value array_extreme(ObjArray* array, int want_max) {
+    if (array->count == 0) {
+        fprintf(stderr, "Runtime error: %s() of an empty array\n", want_max ? "max" : "min");
+        exit(1);
+    }
+    const SimdKernels* kernels = simd_kernels();
+    int (*kernel)(const Value*, int, Value*) = want_max ? kernels->max : kernels->min;
+    int better = want_max ? 1 : -1;
+    Value best = array->items[0];
+    for (int start = 0; start < array->count; start += SIMD_BLOCK) {
+        int length = block_length(start, array->count);
+        Value candidate;
+        if (kernel(array->items + start, length, &candidate)) {
+            if (compare_values(candidate, best) == better) best = candidate;
+            continue;
+        }
+        for (int i = start; i < start + length; i++) {
+            if (compare_values(array->items[i], best) == better) best = array->items[i];
+        }
+    }
+    return best;
+}
+
+Value array_min(ObjArray* array) {
+    return array_extreme(array, 0);
+}
+
+Value array_max(ObjArray* array) {
+    return array_extreme(array, 1);
+}
+
+Value array_dot(ObjArray* a, ObjArray* b) {
+    if (a->count != b->count) {
+        fprintf(stderr, "Runtime error: dot() of arrays of length %d and %d\n", a->count, b->count);
+        exit(1);
+    }
+    const SimdKernels* kernels = simd_kernels();
+    Value total = INT_VAL(0);
+    for (int start = 0; start < a->count; start += SIMD_BLOCK) {
+        int length = block_length(start, a->count);
+        int64_t partial;
+        if (kernels->dot(a->items + start, b->items + start, length, &partial)) {
+            total = add_values(total, int64_value(partial));
+            continue;
+        }
+        for (int i = start; i < start + length; i++) {
+            total = add_values(total, multiply_values(a->items[i], b->items[i]));
+        }
+    }
+    return total;
+}
+
+// Shared by scale and add: kernel applies to int constants, op otherwise
+static ObjArray* array_map(ObjArray* array, Value constant,
+                           int (*kernel)(const Value*, int, int64_t, Value*),
+                           Value (*op)(Value, Value)) {
+    ObjArray* result = new_array(array->count);
+    for (int start = 0; start < array->count; start += SIMD_BLOCK) {
+        int length = block_length(start, array->count);
+        if (IS_INT(constant) &&
+            kernel(array->items + start, length, AS_INT(constant), result->items + start)) {
+            result->count = start + length;
+            continue;
+        }
+        for (int i = start; i < start + length; i++) {
+            result->items[i] = op(array->items[i], constant);
+            result->count = i + 1;
+        }
+    }
+    return result;
+}
+
+ObjArray* array_scale(ObjArray* array, Value factor) {
+    return array_map(array, factor, simd_kernels()->scale, multiply_values);
+}
+
+ObjArray* array_add(ObjArray* array, Value addend) {
+    return array_map(array, addend, simd_kernels()->add, add_values);
+}
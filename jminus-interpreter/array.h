@@ -0,0 +1,81 @@
+/**
+ * @file array.h
+ * @brief Dynamic arrays for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Arrays are heap objects (OBJ_ARRAY, see object.h) holding their elements
+ * in one contiguous, growable buffer of values. They are references:
+ * assigning an array to another variable shares it.
+ *
+ * Indexing:
+ * - Indices are integers from 0 to len - 1
+ * - The checked operations here report a runtime error and exit for a
+ *   non-array, a non-integer index or an index out of bounds
+ * - The VM skips these checks where the compiler proved them redundant
+ *   (see BC_INDEX_GET_UNCHECKED in compiler.h)
+ *
+ * Growth:
+ * - push() appends in amortized constant time by doubling the capacity
+ *
+ * Aggregates:
+ * - sum, min, max, dot, scale and add run over the buffer block by block
+ *   with the vector kernels of simd.h, and fall back to the generic value
+ *   functions for blocks the kernels do not handle
+ * - Results are those of the equivalent jminus loop, including bigint
+ *   promotion, doubles and type errors
+ */
+
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "value.h"
+#include "object.h"
+
+/**
+ * @brief Checks whether a value is an array
+ */
+int is_array(Value value);
+
+/**
+ * @brief Reads array[index], checking the operands and bounds
+ */
+Value array_get(Value array, Value index);
+
+/**
+ * @brief Stores value into array[index], checking the operands and bounds
+ */
+void array_set(Value array, Value index, Value value);
+
+/**
+ * @brief Appends a value, growing the buffer if needed
+ */
+void array_push(ObjArray* array, Value value);
+
+/**
+ * @brief Sum of the elements (0 for an empty array)
+ */
+Value array_sum(ObjArray* array);
+
+/**
+ * @brief Smallest or largest element; the first one wins ties
+ *
+ * Reports a runtime error for an empty array.
+ */
+Value array_min(ObjArray* array);
+Value array_max(ObjArray* array);
+
+/**
+ * @brief Sum of the products of corresponding elements
+ *
+ * Reports a runtime error if the lengths differ.
+ */
+Value array_dot(ObjArray* a, ObjArray* b);
+
+/**
+ * @brief New array with every element multiplied by / added to a number
+ */
+ObjArray* array_scale(ObjArray* array, Value factor);
+ObjArray* array_add(ObjArray* array, Value addend);
+
+#endif // ARRAY_H
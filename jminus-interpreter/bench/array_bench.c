@@ -0,0 +1,97 @@
+// bench/array_bench.c
+//
+// Sums an int array three ways and reports nanoseconds per element:
+//   checked  - jminus loop over len(v) whose start the compiler cannot see
+//              (j = n - n), so v[j] stays BC_INDEX_GET
+//   proven   - the same loop starting at j = 0, so v[j] is
+//              BC_INDEX_GET_UNCHECKED
+//   C        - the equivalent loop over an int64_t array
+// Run with `make bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+
+#define ELEMENTS 1000000
+#define REPEATS 20
+
+static Value result;
+
+static void capture_output(Value value) {
+    result = value;
+}
+
+static double seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Runs a program that fills a with 0..ELEMENTS-1 and yaps the sum REPEATS times
+static double run_jminus(const char* sum_fn) {
+    char src[2048];
+    snprintf(src, sizeof(src),
+             "%s"
+             "fn fill(v, n) { let k = 0; while (k < n) { push(v, k); k = k + 1; } return v; }"
+             "fn repeat(v, n, r) { let t = 0; while (r > 0) { t = sum(v, n); r = r - 1; } return t; }"
+             "let a = fill([], %d); yap(repeat(a, %d, %d));",
+             sum_fn, ELEMENTS, ELEMENTS, REPEATS);
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    double start = seconds();
+    run(bc);
+    double elapsed = seconds() - start;
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    return elapsed;
+}
+
+static int64_t sum_c(const int64_t* v, int n) {
+    int64_t t = 0;
+    for (int j = 0; j < n; j++) t += v[j];
+    return t;
+}
+
+int main(void) {
+    vm_output = capture_output;
+    const int64_t expected = (int64_t)ELEMENTS * (ELEMENTS - 1) / 2;
+
+    double checked = run_jminus(
+        "fn sum(v, n) { let t = 0; let j = n - n; while (j < len(v)) { t = t + v[j]; j = j + 1; } return t; }");
+    if (!IS_INT(result) || AS_INT(result) != expected) {
+        fprintf(stderr, "checked sum is wrong\n");
+        return 1;
+    }
+    double proven = run_jminus(
+        "fn sum(v, n) { let t = 0; let j = 0; while (j < len(v)) { t = t + v[j]; j = j + 1; } return t; }");
+    if (!IS_INT(result) || AS_INT(result) != expected) {
+        fprintf(stderr, "proven sum is wrong\n");
+        return 1;
+    }
+
+    int64_t* v = malloc(sizeof(int64_t) * ELEMENTS);
+    for (int k = 0; k < ELEMENTS; k++) v[k] = k;
+    double start = seconds();
+    volatile int64_t total = 0;
+    for (int r = 0; r < REPEATS; r++) total += sum_c(v, ELEMENTS);
+    double native = seconds() - start;
+    free(v);
+    if (total != expected * REPEATS) {
+        fprintf(stderr, "C sum is wrong\n");
+        return 1;
+    }
+
+    // The jminus timings include filling the array once
+    double per_element = 1e9 / ((double)ELEMENTS * REPEATS);
+    printf("array sum, %d elements x %d\n", ELEMENTS, REPEATS);
+    printf("  checked  %8.2f ns/element\n", checked * per_element);
+    printf("  proven   %8.2f ns/element\n", proven * per_element);
+    printf("  C loop   %8.2f ns/element\n", native * per_element);
+    return 0;
+}
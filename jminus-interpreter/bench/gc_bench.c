@@ -0,0 +1,108 @@
+// bench/gc_bench.c
+//
+// Allocates short-lived two-field records in a jminus loop and reports
+// nanoseconds per allocation under three heap settings:
+//   malloc       - no nursery: every record is malloc'd into the old space
+//                  and freed by major collections
+//   generational - the default nursery, emptied by minor collections
+//   bump         - a nursery big enough to hold every record, so the cost
+//                  is bump allocation alone, with no collection at all
+//                  (though the records no longer stay in cache)
+// Each timing subtracts the same loop storing an int instead of a record,
+// which leaves out the loop itself.
+//
+// It then keeps 300k arrays live while churning through objects that
+// survive the nursery but die soon after, which forces major collections,
+// and reports the collector's pauses with every major collection run in
+// one pause (step budget 0) and incrementally (the default budget).
+// Run with `make bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../gc.h"
+
+#define ALLOCATIONS 2000000
+
+static Value result;
+
+static void capture_output(Value value) {
+    result = value;
+}
+
+static double seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Seconds to run a loop storing value into a local ALLOCATIONS times
+static double time_loop(const char* value, size_t nursery) {
+    char src[512];
+    snprintf(src, sizeof(src),
+             "fn churn(n) { let last = 0; let i = 0;"
+             " while (i < n) { last = %s; i = i + 1; } return last; }"
+             "yap(churn(%d));",
+             value, ALLOCATIONS);
+    gc_set_nursery_size(nursery);
+    if (gc_nursery) memset(gc_nursery, 0, gc_nursery_capacity);  // Fault the pages in outside the timing
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    double start = seconds();
+    run(bc);
+    double elapsed = seconds() - start;
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    free_objects();
+    return elapsed;
+}
+
+// Runs the live-heap program and prints its pause statistics
+static void report_pauses(const char* label, long budget) {
+    const char* src =
+        "let live = []; let i = 0;"
+        "while (i < 300000) { push(live, [i, i]); i = i + 1; }"
+        "let window = []; i = 0;"
+        "while (i < 1000) { push(window, 0); i = i + 1; }"
+        "i = 0;"
+        "while (i < 3000000) { window[i - i / 1000 * 1000] = [i, i + 1]; i = i + 1; }"
+        "yap(len(live));";
+    gc_set_step_budget(budget);
+    gc_set_nursery_size(GC_NURSERY_SIZE);
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    run(bc);
+    printf("  %-12s %3ld major   %7ld pauses   p99 < %6.0f us   longest %8.0f us\n",
+           label, gc_stats.major_collections, gc_stats.pauses,
+           gc_pause_percentile(0.99), gc_stats.max_pause_micros);
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    free_objects();
+}
+
+int main(void) {
+    vm_output = capture_output;
+    double base = time_loop("i", GC_NURSERY_SIZE);
+    const char* record = "{x: i, y: i}";
+    double malloced = time_loop(record, 0) - base;
+    double generational = time_loop(record, GC_NURSERY_SIZE) - base;
+    double bump = time_loop(record, (size_t)ALLOCATIONS * 64) - base;
+    printf("short-lived record allocation (ns per allocation, loop overhead removed)\n");
+    printf("  malloc %6.2f   generational %6.2f   bump %6.2f\n",
+           malloced * 1e9 / ALLOCATIONS, generational * 1e9 / ALLOCATIONS, bump * 1e9 / ALLOCATIONS);
+
+    printf("collector pauses with 300k live arrays\n");
+    report_pauses("whole", 0);
+    report_pauses("incremental", GC_STEP_BUDGET);
+    gc_set_step_budget(GC_STEP_BUDGET);
+    return 0;
+}
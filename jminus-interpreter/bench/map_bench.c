@@ -0,0 +1,113 @@
+// bench/map_bench.c
+//
+// Looks up string keys ("k0", "k1", ...) at 10, 100 and 10k keys two
+// ways and reports nanoseconds per lookup:
+//   if-chain - fn chain(code) { if (code == "k0") { return 0; } ... },
+//              one BC_EQUAL/BC_JUMP_IF_FALSE pair per key tried
+//   map      - m[code] on a map built with the same keys (BC_MAP_GET)
+// Keys are queried round-robin, so the chain tries half its keys on
+// average. Each timing subtracts a run of the same program with no
+// queries, which leaves out building the map and compiling the chain
+// (bodies compile on their first call). Run with `make bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../object.h"
+
+typedef struct {
+    int keys;
+    long queries;
+} Size;
+
+static const Size sizes[] = {
+    { 10, 2000000 },
+    { 100, 2000000 },
+    { 10000, 20000 },
+};
+
+static Value result;
+
+static void capture_output(Value value) {
+    result = value;
+}
+
+static double seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static double run_source(const char* src) {
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    double start = seconds();
+    run(bc);
+    double elapsed = seconds() - start;
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    return elapsed;
+}
+
+// Builds the chain function plus a loop of queries, each open + key + close
+static char* program(int keys, long queries, const char* open, const char* close) {
+    size_t size = (size_t)keys * 48 + 512;
+    char* src = malloc(size);
+    size_t length = snprintf(src, size, "fn chain(code) {");
+    for (int k = 0; k < keys; k++) {
+        length += snprintf(src + length, size - length,
+                           " if (code == \"k%d\") { return %d; }", k, k);
+    }
+    snprintf(src + length, size - length,
+             " return 0 - 1; }"
+             "yap(chain(\"k0\"));"
+             "let t = 0; let j = 0;"
+             "while (j < %ld) { t = t + %sks[j - j / %d * %d]%s; j = j + 1; }"
+             "yap(t);",
+             queries, open, keys, keys, close);
+    return src;
+}
+
+// Seconds per lookup, less the cost of the same program without queries
+static double time_lookups(int keys, long queries, const char* open, const char* close, Value* total) {
+    char* src = program(keys, queries, open, close);
+    double elapsed = run_source(src);
+    *total = result;
+    free(src);
+    src = program(keys, 0, open, close);
+    elapsed -= run_source(src);
+    free(src);
+    return elapsed / queries;
+}
+
+int main(void) {
+    vm_output = capture_output;
+    printf("string-key lookups, if-chain vs map (ns per lookup)\n");
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        int keys = sizes[i].keys;
+        char setup[256];
+        snprintf(setup, sizeof(setup),
+                 "let m = map(); let ks = []; let i = 0;"
+                 "while (i < %d) { m[\"k\" + i] = i; push(ks, \"k\" + i); i = i + 1; }",
+                 keys);
+        run_source(setup);
+
+        Value chained, mapped;
+        double chain = time_lookups(keys, sizes[i].queries, "chain(", ")", &chained);
+        double map = time_lookups(keys, sizes[i].queries, "m[", "]", &mapped);
+        if (!values_equal(chained, mapped)) {
+            fprintf(stderr, "%d keys: if-chain and map disagree\n", keys);
+            return 1;
+        }
+        printf("  %6d keys   if-chain %9.1f   map %6.1f   %7.1fx\n",
+               keys, chain * 1e9, map * 1e9, map > 0 ? chain / map : 0.0);
+        free_objects();
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+// bench/simd_bench.c
+//
+// Times each vectorized array builtin against the equivalent interpreted
+// jminus loop on arrays of 1e6, 1e7 and 1e8 ints (values 0..999), and
+// checks that both give the same answer. Run with `make bench`; pass a
+// smaller maximum size as the first argument for a quicker run.
+//
+// Until the runtime collects garbage, every array a map builds stays
+// allocated, so scale and add are only measured up to MAP_MAX elements.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../object.h"
+#include "../simd.h"
+
+#define MAP_MAX 10000000
+
+typedef struct {
+    const char* name;
+    const char* loop;     // fn f(v) computing the same as call on v
+    const char* call;
+    int is_map;
+} Case;
+
+static const Case cases[] = {
+    { "sum",
+      "fn f(v) { let t = 0; let j = 0; while (j < len(v)) { t = t + v[j]; j = j + 1; } return t; }",
+      "sum(a)", 0 },
+    { "min",
+      "fn f(v) { let t = v[0]; let j = 0; while (j < len(v)) { if (v[j] < t) { t = v[j]; } j = j + 1; } return t; }",
+      "min(a)", 0 },
+    { "max",
+      "fn f(v) { let t = v[0]; let j = 0; while (j < len(v)) { if (v[j] > t) { t = v[j]; } j = j + 1; } return t; }",
+      "max(a)", 0 },
+    { "dot",
+      "fn f(v) { let t = 0; let j = 0; while (j < len(v)) { t = t + v[j] * v[j]; j = j + 1; } return t; }",
+      "dot(a, a)", 0 },
+    { "scale",
+      "fn f(v) { let r = []; let j = 0; while (j < len(v)) { push(r, v[j] * 3); j = j + 1; } return r; }",
+      "scale(a, 3)", 1 },
+    { "add",
+      "fn f(v) { let r = []; let j = 0; while (j < len(v)) { push(r, v[j] + 3); j = j + 1; } return r; }",
+      "add(a, 3)", 1 },
+};
+
+static Value result;
+
+static void capture_output(Value value) {
+    result = value;
+}
+
+static double seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Compiles and runs src, returning the CPU time and leaving its last yap in result
+static double run_source(const char* src) {
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    double start = seconds();
+    run(bc);
+    double elapsed = seconds() - start;
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    return elapsed;
+}
+
+int main(int argc, char** argv) {
+    long max_size = argc > 1 ? atol(argv[1]) : 100000000;
+    vm_output = capture_output;
+    printf("array builtins (%s kernels) vs interpreted loops\n", simd_kernels()->name);
+
+    char src[1024];
+    for (long size = 1000000; size <= max_size; size *= 10) {
+        // Globals outlive a run, so a stays defined for the timed programs
+        snprintf(src, sizeof(src),
+                 "fn fill(v, n) { let k = 0; while (k < n) { push(v, k - k / 1000 * 1000); k = k + 1; } return v; }"
+                 "let a = fill([], %ld);", size);
+        run_source(src);
+
+        printf("  %ld elements\n", size);
+        for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+            const Case* c = &cases[i];
+            if (c->is_map && size > MAP_MAX) {
+                printf("    %-6s skipped above %d elements\n", c->name, MAP_MAX);
+                continue;
+            }
+            // Maps are compared on their last element
+            const char* pick = c->is_map ? "[len(a) - 1]" : "";
+            snprintf(src, sizeof(src), "%s yap(f(a)%s);", c->loop, pick);
+            double loop = run_source(src);
+            Value expected = result;
+            snprintf(src, sizeof(src), "yap(%s%s);", c->call, pick);
+            double builtin = run_source(src);
+            if (!values_equal(result, expected)) {
+                fprintf(stderr, "%s: builtin and loop disagree\n", c->name);
+                return 1;
+            }
+            printf("    %-6s loop %9.2f ms   builtin %8.2f ms   %6.1fx\n",
+                   c->name, loop * 1e3, builtin * 1e3, builtin > 0 ? loop / builtin : 0.0);
+        }
+        free_objects();
+    }
+    return 0;
+}
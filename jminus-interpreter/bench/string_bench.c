@@ -0,0 +1,84 @@
+// bench/string_bench.c
+//
+// Times s = s + "ab" in a jminus loop for growing n and reports the cost
+// per append. Ropes make each append O(1), so the cost should stay flat
+// as n grows; for comparison, the same appends done the way flat
+// immutable strings would (a fresh buffer and a full copy each time)
+// grow linearly. The length of the yapped result is checked.
+// Run with `make bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../object.h"
+#include "../str.h"
+
+// Flat copies are quadratic; stop them before they take minutes
+#define FLAT_MAX 100000
+
+static Value result;
+
+static void capture_output(Value value) {
+    result = value;
+}
+
+static double seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static double run_appends(long n) {
+    char src[256];
+    snprintf(src, sizeof(src),
+             "let s = \"\"; let i = 0; while (i < %ld) { s = s + \"ab\"; i = i + 1; } yap(s);", n);
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    double start = seconds();
+    run(bc);
+    double elapsed = seconds() - start;
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    return elapsed;
+}
+
+// What each append costs without ropes: allocate the result, copy both sides
+static double flat_appends(long n) {
+    double start = seconds();
+    char* s = calloc(1, 1);
+    size_t length = 0;
+    for (long i = 0; i < n; i++) {
+        char* next = malloc(length + 3);
+        memcpy(next, s, length);
+        memcpy(next + length, "ab", 3);
+        free(s);
+        s = next;
+        length += 2;
+    }
+    double elapsed = seconds() - start;
+    free(s);
+    return elapsed;
+}
+
+int main(void) {
+    vm_output = capture_output;
+    printf("s = s + \"ab\", n times (ns per append)\n");
+    for (long n = 10000; n <= 10000000; n *= 10) {
+        double rope = run_appends(n);
+        if (!IS_STRING_OBJ(result) || AS_STRING_OBJ(result)->length != 2 * n) {
+            fprintf(stderr, "wrong result for n = %ld\n", n);
+            return 1;
+        }
+        printf("  n = %8ld   rope %8.1f", n, rope * 1e9 / n);
+        if (n <= FLAT_MAX) printf("   flat copies %10.1f", flat_appends(n) * 1e9 / n);
+        printf("\n");
+        free_objects();
+    }
+    return 0;
+}
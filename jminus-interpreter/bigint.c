@@ -0,0 +1,757 @@
+/**
+ * @file bigint.c
+ * @brief Arbitrary-precision integers for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The arithmetic works on magnitudes (limb arrays) and is wrapped by the
+ * signed, Value-level functions at the bottom. Tagged int operands are
+ * viewed as one- or two-limb magnitudes, so mixed operations need no
+ * conversion, and results are demoted to tagged ints when they fit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bigint.h"
+#include "object.h"
+#include "allocator.h"
+
+#define LIMB_BITS 32
+#define LIMB_BASE ((uint64_t)1 << LIMB_BITS)
+
+// Largest power of ten in a limb, used to convert nine digits at a time
+#define DECIMAL_CHUNK 1000000000u
+#define DECIMAL_CHUNK_DIGITS 9
+
+static uint32_t* allocate_limbs(int count) {
+    // At least one limb, so callers never depend on jm_alloc(0)
+    uint32_t* limbs = jm_calloc(count > 0 ? count : 1, sizeof(uint32_t));
+    if (!limbs) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return limbs;
+}
+
+// Drops leading zero limbs
+static int trim(const uint32_t* limbs, int length) {
+    while (length > 0 && limbs[length - 1] == 0) length--;
+    return length;
+}
+
+// ----------------------------
+// Magnitudes
+// ----------------------------
+static int magnitude_compare(const uint32_t* a, int an, const uint32_t* b, int bn) {
+    if (an != bn) return an < bn ? -1 : 1;
+    for (int i = an - 1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// out = a + b; out has room for max(an, bn) + 1 limbs. Returns the length.
+static int magnitude_add(const uint32_t* a, int an, const uint32_t* b, int bn, uint32_t* out) {
+    if (an < bn) {
+        const uint32_t* t = a; a = b; b = t;
+        int n = an; an = bn; bn = n;
+    }
+    uint64_t carry = 0;
+    for (int i = 0; i < an; i++) {
+        uint64_t sum = (uint64_t)a[i] + (i < bn ? b[i] : 0) + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+    out[an] = (uint32_t)carry;
+    return an + 1;
+}
+
+// out = a - b for a >= b; out has room for an limbs. Returns the length.
+static int magnitude_subtract(const uint32_t* a, int an, const uint32_t* b, int bn, uint32_t* out) {
+    int64_t borrow = 0;
+    for (int i = 0; i < an; i++) {
+        int64_t difference = (int64_t)a[i] - (i < bn ? b[i] : 0) - borrow;
+        borrow = difference < 0;
+        out[i] = (uint32_t)(difference + (borrow ? (int64_t)LIMB_BASE : 0));
+    }
+    return an;
+}
+
+// target[0..length) += x[0..xn), carrying into the rest of target
+static void add_into(uint32_t* target, int length, const uint32_t* x, int xn) {
+    uint64_t carry = 0;
+    int i = 0;
+    for (; i < xn && i < length; i++) {
+        uint64_t sum = (uint64_t)target[i] + x[i] + carry;
+        target[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+    for (; carry && i < length; i++) {
+        uint64_t sum = (uint64_t)target[i] + carry;
+        target[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+}
+
+// target[0..length) -= x[0..xn); the result must not be negative
+static void subtract_from(uint32_t* target, int length, const uint32_t* x, int xn) {
+    uint64_t borrow = 0;
+    int i = 0;
+    for (; i < xn && i < length; i++) {
+        uint64_t subtrahend = (uint64_t)x[i] + borrow;
+        borrow = target[i] < subtrahend;
+        target[i] = (uint32_t)((uint64_t)target[i] - subtrahend);
+    }
+    for (; borrow && i < length; i++) {
+        borrow = target[i] == 0;
+        target[i]--;
+    }
+}
+
+static void schoolbook_multiply(const uint32_t* a, int an, const uint32_t* b, int bn, uint32_t* out) {
+    memset(out, 0, sizeof(uint32_t) * (an + bn));
+    for (int i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < bn; j++) {
+            uint64_t product = (uint64_t)a[i] * b[j] + out[i + j] + carry;
+            out[i + j] = (uint32_t)product;
+            carry = product >> LIMB_BITS;
+        }
+        out[i + bn] = (uint32_t)carry;
+    }
+}
+
+/*
+ * out = a * b, writing all an + bn limbs of out. Operands may have
+ * leading zero limbs (the halves of a split usually do).
+ *
+ * Karatsuba splits both operands at m limbs, a = a1*B^m + a0 and
+ * b = b1*B^m + b0, and gets the middle term from one product:
+ *   a0*b1 + a1*b0 = (a0 + a1)(b0 + b1) - a0*b0 - a1*b1
+ * so three half-size multiplications replace four.
+ */
+static void magnitude_multiply(const uint32_t* a, int an, const uint32_t* b, int bn, uint32_t* out) {
+    if (an < bn) {
+        const uint32_t* t = a; a = b; b = t;
+        int n = an; an = bn; bn = n;
+    }
+    if (bn < BIGINT_KARATSUBA_THRESHOLD) {
+        schoolbook_multiply(a, an, b, bn, out);
+        return;
+    }
+
+    int m = (an + 1) / 2;
+    if (bn <= m) {
+        // Too unbalanced to split b: multiply b by bn-limb slices of a
+        uint32_t* part = allocate_limbs(2 * bn);
+        memset(out, 0, sizeof(uint32_t) * (an + bn));
+        for (int i = 0; i < an; i += bn) {
+            int length = an - i < bn ? an - i : bn;
+            magnitude_multiply(a + i, length, b, bn, part);
+            add_into(out + i, an + bn - i, part, length + bn);
+        }
+        jm_free(part);
+        return;
+    }
+
+    int a1n = an - m;
+    int b1n = bn - m;
+
+    // z0 = a0*b0 and z2 = a1*b1 go straight to their places in out
+    magnitude_multiply(a, m, b, m, out);
+    magnitude_multiply(a + m, a1n, b + m, b1n, out + 2 * m);
+
+    // z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    int sum_length = m + 1;
+    uint32_t* a_sum = allocate_limbs(sum_length);
+    uint32_t* b_sum = allocate_limbs(sum_length);
+    magnitude_add(a, m, a + m, a1n, a_sum);
+    magnitude_add(b, m, b + m, b1n, b_sum);
+    uint32_t* z1 = allocate_limbs(2 * sum_length);
+    magnitude_multiply(a_sum, sum_length, b_sum, sum_length, z1);
+    subtract_from(z1, 2 * sum_length, out, 2 * m);
+    subtract_from(z1, 2 * sum_length, out + 2 * m, a1n + b1n);
+
+    add_into(out + m, an + bn - m, z1, 2 * sum_length);
+    jm_free(a_sum);
+    jm_free(b_sum);
+    jm_free(z1);
+}
+
+// Divides a magnitude in place by a single limb, returning the remainder
+static uint32_t divide_small(uint32_t* limbs, int length, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (int i = length - 1; i >= 0; i--) {
+        uint64_t current = (remainder << LIMB_BITS) | limbs[i];
+        limbs[i] = (uint32_t)(current / divisor);
+        remainder = current % divisor;
+    }
+    return (uint32_t)remainder;
+}
+
+/*
+ * q = u / v (Knuth, TAOCP vol. 2, 4.3.1, algorithm D) for normalized
+ * magnitudes with un >= vn >= 2; q has room for un - vn + 1 limbs.
+ * Both operands are shifted so the divisor's top bit is set, which keeps
+ * each estimated quotient limb at most two too large.
+ */
+static void magnitude_divide(const uint32_t* u, int un, const uint32_t* v, int vn, uint32_t* q) {
+    int shift = __builtin_clz(v[vn - 1]);
+    uint32_t* vs = allocate_limbs(vn);
+    uint32_t* us = allocate_limbs(un + 1);
+    for (int i = vn - 1; i > 0; i--) {
+        vs[i] = (v[i] << shift) | (uint32_t)((uint64_t)v[i - 1] >> (LIMB_BITS - shift));
+    }
+    vs[0] = v[0] << shift;
+    us[un] = (uint32_t)((uint64_t)u[un - 1] >> (LIMB_BITS - shift));
+    for (int i = un - 1; i > 0; i--) {
+        us[i] = (u[i] << shift) | (uint32_t)((uint64_t)u[i - 1] >> (LIMB_BITS - shift));
+    }
+    us[0] = u[0] << shift;
+
+    for (int j = un - vn; j >= 0; j--) {
+        // Estimate the quotient limb from the top two limbs
+        uint64_t numerator = ((uint64_t)us[j + vn] << LIMB_BITS) | us[j + vn - 1];
+        uint64_t qhat = numerator / vs[vn - 1];
+        uint64_t rhat = numerator % vs[vn - 1];
+        while (qhat >= LIMB_BASE ||
+               qhat * vs[vn - 2] > ((rhat << LIMB_BITS) | us[j + vn - 2])) {
+            qhat--;
+            rhat += vs[vn - 1];
+            if (rhat >= LIMB_BASE) break;
+        }
+
+        // Multiply and subtract
+        int64_t borrow = 0;
+        int64_t t;
+        for (int i = 0; i < vn; i++) {
+            uint64_t product = qhat * vs[i];
+            t = (int64_t)us[i + j] - borrow - (int64_t)(product & 0xFFFFFFFFu);
+            us[i + j] = (uint32_t)t;
+            borrow = (int64_t)(product >> LIMB_BITS) - (t >> LIMB_BITS);
+        }
+        t = (int64_t)us[j + vn] - borrow;
+        us[j + vn] = (uint32_t)t;
+
+        // The estimate was one too large: add the divisor back
+        q[j] = (uint32_t)qhat;
+        if (t < 0) {
+            q[j]--;
+            uint64_t carry = 0;
+            for (int i = 0; i < vn; i++) {
+                uint64_t sum = (uint64_t)us[i + j] + vs[i] + carry;
+                us[i + j] = (uint32_t)sum;
+                carry = sum >> LIMB_BITS;
+            }
+            us[j + vn] += (uint32_t)carry;
+        }
+    }
+    jm_free(vs);
+    jm_free(us);
+}
+
+// ----------------------------
+// Values
+// ----------------------------
+
+/**
+ * A signed magnitude for either kind of integer. Tagged ints are viewed
+ * through the two-limb small buffer; bigints through their own limbs.
+ */
+typedef struct {
+    int sign;               // -1, 0 or 1
+    int length;
+    const uint32_t* limbs;
+    uint32_t small[2];
+} IntView;
+
+static void view_int64(int64_t number, IntView* view) {
+    uint64_t magnitude = number < 0 ? -(uint64_t)number : (uint64_t)number;
+    view->sign = (number > 0) - (number < 0);
+    view->small[0] = (uint32_t)magnitude;
+    view->small[1] = (uint32_t)(magnitude >> LIMB_BITS);
+    view->length = trim(view->small, 2);
+    view->limbs = view->small;
+}
+
+static void view_integer(Value value, IntView* view) {
+    if (IS_INT(value)) {
+        view_int64(AS_INT(value), view);
+        return;
+    }
+    ObjBigInt* number = AS_BIGINT_OBJ(value);
+    view->sign = number->sign;
+    view->length = number->length;
+    view->limbs = number->limbs;
+}
+
+// Builds the value for a signed magnitude, demoting it to a tagged int if it fits
+static Value make_integer(int sign, const uint32_t* limbs, int length) {
+    length = trim(limbs, length);
+    if (length == 0) return INT_VAL(0);
+    if (length <= 2) {
+        uint64_t magnitude = limbs[0] | (length == 2 ? (uint64_t)limbs[1] << LIMB_BITS : 0);
+        if (sign > 0 && magnitude <= (uint64_t)INT_VALUE_MAX) return INT_VAL((int64_t)magnitude);
+        if (sign < 0 && magnitude <= (uint64_t)INT_VALUE_MAX + 1) return INT_VAL(-(int64_t)(magnitude - 1) - 1);
+    }
+    ObjBigInt* number = new_bigint(length);
+    number->sign = sign;
+    memcpy(number->limbs, limbs, sizeof(uint32_t) * length);
+    return OBJ_VAL(number);
+}
+
+int is_bigint(Value value) {
+    return IS_BIGINT_OBJ(value);
+}
+
+Value bigint_from_int64(int64_t number) {
+    IntView view;
+    view_int64(number, &view);
+    return make_integer(view.sign, view.limbs, view.length);
+}
+
+Value bigint_parse(const char* digits) {
+    int sign = 1;
+    if (*digits == '-') {
+        sign = -1;
+        digits++;
+    }
+    size_t count = strlen(digits);
+
+    // log2(10) < 3.33 bits per digit
+    int capacity = (int)(count * 10 / 3 / LIMB_BITS) + 2;
+    uint32_t* limbs = allocate_limbs(capacity);
+    int length = 0;
+
+    // Fold in up to nine digits at a time: limbs = limbs * 10^k + chunk
+    size_t position = 0;
+    while (position < count) {
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for (int k = 0; k < DECIMAL_CHUNK_DIGITS && position < count; k++, position++) {
+            chunk = chunk * 10 + (uint32_t)(digits[position] - '0');
+            scale *= 10;
+        }
+        uint64_t carry = chunk;
+        for (int i = 0; i < length; i++) {
+            uint64_t product = (uint64_t)limbs[i] * scale + carry;
+            limbs[i] = (uint32_t)product;
+            carry = product >> LIMB_BITS;
+        }
+        if (carry) limbs[length++] = (uint32_t)carry;
+    }
+
+    Value result = make_integer(sign, limbs, length);
+    jm_free(limbs);
+    return result;
+}
+
+// a + sign_b * |b|, shared by addition and subtraction
+static Value add_signed(const IntView* a, int b_sign, const IntView* b) {
+    if (b_sign == 0) return make_integer(a->sign, a->limbs, a->length);
+    if (a->sign == 0) return make_integer(b_sign, b->limbs, b->length);
+
+    int length = (a->length > b->length ? a->length : b->length) + 1;
+    uint32_t* limbs = allocate_limbs(length);
+    Value result;
+    if (a->sign == b_sign) {
+        magnitude_add(a->limbs, a->length, b->limbs, b->length, limbs);
+        result = make_integer(a->sign, limbs, length);
+    } else if (magnitude_compare(a->limbs, a->length, b->limbs, b->length) >= 0) {
+        magnitude_subtract(a->limbs, a->length, b->limbs, b->length, limbs);
+        result = make_integer(a->sign, limbs, a->length);
+    } else {
+        magnitude_subtract(b->limbs, b->length, a->limbs, a->length, limbs);
+        result = make_integer(b_sign, limbs, b->length);
+    }
+    jm_free(limbs);
+    return result;
+}
+
+Value bigint_add(Value a, Value b) {
+    IntView x, y;
+    view_integer(a, &x);
+    view_integer(b, &y);
+    return add_signed(&x, y.sign, &y);
+}
+
+Value bigint_subtract(Value a, Value b) {
+    IntView x, y;
+    view_integer(a, &x);
+    view_integer(b, &y);
+    return add_signed(&x, -y.sign, &y);
+}
+
+Value bigint_multiply(Value a, Value b) {
+    IntView x, y;
+    view_integer(a, &x);
+    view_integer(b, &y);
+    if (x.sign == 0 || y.sign == 0) return INT_VAL(0);
+
+    int length = x.length + y.length;
+    uint32_t* limbs = allocate_limbs(length);
+    magnitude_multiply(x.limbs, x.length, y.limbs, y.length, limbs);
+    Value result = make_integer(x.sign * y.sign, limbs, length);
+    jm_free(limbs);
+    return result;
+}
+
+Value bigint_divide(Value a, Value b) {
+    IntView x, y;
+    view_integer(a, &x);
+    view_integer(b, &y);
+    if (magnitude_compare(x.limbs, x.length, y.limbs, y.length) < 0) return INT_VAL(0);
+
+    int length = x.length - y.length + 1;
+    uint32_t* quotient = allocate_limbs(length);
+    if (y.length == 1) {
+        memcpy(quotient, x.limbs, sizeof(uint32_t) * x.length);
+        length = x.length;
+        divide_small(quotient, length, y.limbs[0]);
+    } else {
+        magnitude_divide(x.limbs, x.length, y.limbs, y.length, quotient);
+    }
+    Value result = make_integer(x.sign * y.sign, quotient, length);
+    jm_free(quotient);
+    return result;
+}
+
+int bigint_compare(Value a, Value b) {
+    IntView x, y;
+    view_integer(a, &x);
+    view_integer(b, &y);
+    if (x.sign != y.sign) return x.sign < y.sign ? -1 : 1;
+    return x.sign * magnitude_compare(x.limbs, x.length, y.limbs, y.length);
+}
+
+// ----------------------------
+// Bitwise operations
+// ----------------------------
+
+// Writes a signed magnitude as length limbs of two's complement (length leaves room for the sign)
+static void to_twos_complement(const IntView* view, uint32_t* out, int length) {
+    memset(out, 0, sizeof(uint32_t) * length);
+    memcpy(out, view->limbs, sizeof(uint32_t) * view->length);
+    if (view->sign >= 0) return;
+    uint64_t carry = 1;
+    for (int i = 0; i < length; i++) {
+        uint64_t sum = (uint64_t)(uint32_t)~out[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+}
+
+// Reads length limbs of two's complement back, negating them in place if the top bit is set
+static Value from_twos_complement(uint32_t* limbs, int length) {
+    if (!(limbs[length - 1] >> (LIMB_BITS - 1))) return make_integer(1, limbs, length);
+    uint64_t carry = 1;
+    for (int i = 0; i < length; i++) {
+        uint64_t sum = (uint64_t)(uint32_t)~limbs[i] + carry;
+        limbs[i] = (uint32_t)sum;
+        carry = sum >> LIMB_BITS;
+    }
+    return make_integer(-1, limbs, length);
+}
+
+// a & b, a | b or a ^ b on the two's complement of both, sign-extended to a common length
+static Value bitwise(Value a, Value b, char op) {
+    IntView x, y;
+    view_integer(a, &x);
+    view_integer(b, &y);
+    int length = (x.length > y.length ? x.length : y.length) + 1;
+    uint32_t* u = allocate_limbs(length);
+    uint32_t* v = allocate_limbs(length);
+    to_twos_complement(&x, u, length);
+    to_twos_complement(&y, v, length);
+    for (int i = 0; i < length; i++) {
+        u[i] = op == '&' ? u[i] & v[i] : op == '|' ? u[i] | v[i] : u[i] ^ v[i];
+    }
+    Value result = from_twos_complement(u, length);
+    jm_free(u);
+    jm_free(v);
+    return result;
+}
+
+Value bigint_and(Value a, Value b) {
+    return bitwise(a, b, '&');
+}
+
+Value bigint_or(Value a, Value b) {
+    return bitwise(a, b, '|');
+}
+
+Value bigint_xor(Value a, Value b) {
+    return bitwise(a, b, '^');
+}
+
+Value bigint_shift_left(Value a, int count) {
+    IntView x;
+    view_integer(a, &x);
+    if (x.sign == 0) return INT_VAL(0);
+    int whole = count / LIMB_BITS;
+    int bits = count % LIMB_BITS;
+    int length = x.length + whole + 1;
+    uint32_t* limbs = allocate_limbs(length);
+    for (int i = 0; i < x.length; i++) {
+        uint64_t part = (uint64_t)x.limbs[i] << bits;
+        limbs[i + whole] |= (uint32_t)part;
+        limbs[i + whole + 1] |= (uint32_t)(part >> LIMB_BITS);
+    }
+    Value result = make_integer(x.sign, limbs, length);
+    jm_free(limbs);
+    return result;
+}
+
+Value bigint_shift_right(Value a, int count) {
+    IntView x;
+    view_integer(a, &x);
+    if (x.sign == 0) return INT_VAL(0);
+    int whole = count / LIMB_BITS;
+    int bits = count % LIMB_BITS;
+    if (whole >= x.length) return INT_VAL(x.sign < 0 ? -1 : 0);
+
+    // Shift the magnitude, noting whether any set bit falls off the end
+    int length = x.length - whole;
+    uint32_t* limbs = allocate_limbs(length + 1);
+    int dropped = bits && (x.limbs[whole] & ((1u << bits) - 1)) != 0;
+    for (int i = 0; i < whole; i++) dropped |= x.limbs[i] != 0;
+    for (int i = 0; i < length; i++) {
+        uint64_t pair = x.limbs[i + whole];
+        if (i + whole + 1 < x.length) pair |= (uint64_t)x.limbs[i + whole + 1] << LIMB_BITS;
+        limbs[i] = (uint32_t)(pair >> bits);
+    }
+
+    // Like >> on ints this rounds down, so a negative value that lost bits grows by one
+    if (x.sign < 0 && dropped) {
+        uint32_t one = 1;
+        add_into(limbs, length + 1, &one, 1);
+    }
+    Value result = make_integer(x.sign, limbs, length + 1);
+    jm_free(limbs);
+    return result;
+}
+
+double bigint_to_double(Value value) {
+    ObjBigInt* number = AS_BIGINT_OBJ(value);
+    double result = 0.0;
+    for (int i = number->length - 1; i >= 0; i--) {
+        result = result * (double)LIMB_BASE + number->limbs[i];
+    }
+    return number->sign * result;
+}
+
+/*
+ * Writes x (xn limbs, below 10^digits, digits a multiple of nine) as
+ * exactly digits decimal digits, zero-padded, nine per division by 10^9.
+ * Overwrites x.
+ */
+static void write_chunks(uint32_t* x, int xn, char* out, int digits) {
+    char* end = out + digits;
+    xn = trim(x, xn);
+    while (xn > 0) {
+        uint32_t chunk = divide_small(x, xn, DECIMAL_CHUNK);
+        xn = trim(x, xn);
+        for (int k = 0; k < DECIMAL_CHUNK_DIGITS; k++) {
+            *--end = (char)('0' + chunk % 10);
+            chunk /= 10;
+        }
+    }
+    memset(out, '0', (size_t)(end - out));
+}
+
+/*
+ * out = floor(B^(2n) / d) for d of n limbs (top limb nonzero, B = 2^32);
+ * out has room for n + 2 limbs.
+ *
+ * Small divisors go through algorithm D. Larger ones start from the
+ * reciprocal of their top m limbs, R0 = (floor(B^(2m) / d_hi) - B^2) * B^k,
+ * which is below the true reciprocal R by less than B^(k+3); one Newton
+ * step from below,
+ *   R1 = R0 + floor(R0 * (B^(2n) - d * R0) / B^(2n))
+ * squares the relative error and never overshoots, and with 2m >= n + 5
+ * leaves R1 a few units short of R, which the last loop adds back.
+ */
+static void reciprocal(const uint32_t* d, int n, uint32_t* out) {
+    static const uint32_t one = 1;
+    memset(out, 0, sizeof(uint32_t) * (n + 2));
+    if (n < BIGINT_KARATSUBA_THRESHOLD) {
+        uint32_t* power = allocate_limbs(2 * n + 1);
+        power[2 * n] = 1;
+        if (n == 1) {
+            memcpy(out, power, sizeof(uint32_t) * 3);
+            divide_small(out, 3, d[0]);
+        } else {
+            magnitude_divide(power, 2 * n + 1, d, n, out);
+        }
+        jm_free(power);
+        return;
+    }
+
+    int k = (n - 5) / 2;
+    int m = n - k;
+    reciprocal(d + k, m, out + k);
+    subtract_from(out + k + 2, m, &one, 1);
+
+    // e = B^(2n) - d * R0
+    uint32_t* product = allocate_limbs(2 * n + 2);
+    uint32_t* e = allocate_limbs(2 * n + 2);
+    magnitude_multiply(d, n, out, n + 2, product);
+    e[2 * n] = 1;
+    subtract_from(e, 2 * n + 2, product, trim(product, 2 * n + 2));
+    int en = trim(e, 2 * n + 2);
+
+    if (en > 0) {
+        uint32_t* step = allocate_limbs(n + 2 + en);
+        magnitude_multiply(out, n + 2, e, en, step);
+        if (n + 2 + en > 2 * n) {
+            add_into(out, n + 2, step + 2 * n, trim(step + 2 * n, n + 2 + en - 2 * n));
+        }
+        jm_free(step);
+
+        magnitude_multiply(d, n, out, n + 2, product);
+        memset(e, 0, sizeof(uint32_t) * (2 * n + 2));
+        e[2 * n] = 1;
+        subtract_from(e, 2 * n + 2, product, trim(product, 2 * n + 2));
+        en = trim(e, 2 * n + 2);
+    }
+    while (magnitude_compare(e, en, d, n) >= 0) {
+        subtract_from(e, en, d, n);
+        en = trim(e, en);
+        add_into(out, n + 2, &one, 1);
+    }
+    jm_free(product);
+    jm_free(e);
+}
+
+// 10^(9 * 2^k), the splitting points of write_decimal, with its reciprocal
+typedef struct {
+    uint32_t* limbs;
+    int length;
+    uint32_t* inverse;  // floor(B^(2 * length) / limbs), length + 2 limbs
+} DecimalPower;
+
+/*
+ * Writes x (xn limbs, below powers[level]) as exactly 9 * 2^level decimal
+ * digits, zero-padded. Overwrites x.
+ *
+ * Peeling nine digits at a time divides the whole number once per nine
+ * digits, which is quadratic in its length. Above the threshold the
+ * number is split instead, x = q * p + r with p = powers[level - 1], and
+ * both halves are written the same way. Large powers come with their
+ * reciprocal, and q = floor(x * inverse / B^(2n)) is at most one short,
+ * so the split costs two Karatsuba products rather than a long division.
+ */
+static void write_decimal(uint32_t* x, int xn, const DecimalPower* powers, int level, char* out) {
+    static const uint32_t one = 1;
+    int digits = DECIMAL_CHUNK_DIGITS << level;
+    xn = trim(x, xn);
+    if (level == 0 || xn < BIGINT_DECIMAL_THRESHOLD) {
+        write_chunks(x, xn, out, digits);
+        return;
+    }
+
+    const DecimalPower* half = &powers[level - 1];
+    int n = half->length;
+    int half_digits = digits / 2;
+    if (magnitude_compare(x, xn, half->limbs, n) < 0) {
+        memset(out, '0', (size_t)half_digits);
+        write_decimal(x, xn, powers, level - 1, out + half_digits);
+        return;
+    }
+
+    // x >= p >= B^(BIGINT_DECIMAL_THRESHOLD / 2), far more than the two
+    // limbs algorithm D needs; x < p^2 < B^(2n)
+    int qn = xn - n + 2;
+    uint32_t* q = allocate_limbs(qn + 1);
+    if (half->inverse) {
+        uint32_t* product = allocate_limbs(xn + n + 2);
+        magnitude_multiply(x, xn, half->inverse, n + 2, product);
+        memcpy(q, product + 2 * n, sizeof(uint32_t) * qn);
+        jm_free(product);
+    } else {
+        magnitude_divide(x, xn, half->limbs, n, q);
+    }
+    qn = trim(q, qn);
+
+    // x -= q * p, then add back what the estimate missed
+    if (qn > 0) {
+        uint32_t* product = allocate_limbs(qn + n);
+        magnitude_multiply(q, qn, half->limbs, n, product);
+        subtract_from(x, xn, product, trim(product, qn + n));
+        jm_free(product);
+        xn = trim(x, xn);
+    }
+    while (magnitude_compare(x, xn, half->limbs, n) >= 0) {
+        subtract_from(x, xn, half->limbs, n);
+        xn = trim(x, xn);
+        add_into(q, qn + 1, &one, 1);
+        qn = trim(q, qn + 1);
+    }
+
+    write_decimal(q, qn, powers, level - 1, out);
+    write_decimal(x, xn, powers, level - 1, out + half_digits);
+    jm_free(q);
+}
+
+static char* allocate_text(size_t size) {
+    char* text = jm_alloc(size);
+    if (!text) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return text;
+}
+
+char* bigint_to_string(Value value) {
+    IntView view;
+    view_integer(value, &view);
+    uint32_t* work = allocate_limbs(view.length);
+    memcpy(work, view.limbs, sizeof(uint32_t) * view.length);
+
+    char* digits;
+    int digit_count;
+    if (view.length < BIGINT_DECIMAL_THRESHOLD) {
+        // Nine digits per chunk; 32 bits hold fewer than ten digits
+        digit_count = (view.length * 32 / 29 + 1) * DECIMAL_CHUNK_DIGITS;
+        digits = allocate_text((size_t)digit_count);
+        write_chunks(work, view.length, digits, digit_count);
+    } else {
+        // Square 10^9 until the power exceeds the number
+        DecimalPower powers[32];
+        int level = 0;
+        powers[0].limbs = allocate_limbs(1);
+        powers[0].limbs[0] = DECIMAL_CHUNK;
+        powers[0].length = 1;
+        while (magnitude_compare(view.limbs, view.length, powers[level].limbs, powers[level].length) >= 0) {
+            DecimalPower* power = &powers[level];
+            powers[level + 1].limbs = allocate_limbs(2 * power->length);
+            magnitude_multiply(power->limbs, power->length, power->limbs, power->length, powers[level + 1].limbs);
+            powers[level + 1].length = trim(powers[level + 1].limbs, 2 * power->length);
+            level++;
+        }
+        for (int i = 0; i < level; i++) {
+            powers[i].inverse = NULL;
+            if (powers[i].length < BIGINT_RECIPROCAL_THRESHOLD) continue;
+            powers[i].inverse = allocate_limbs(powers[i].length + 2);
+            reciprocal(powers[i].limbs, powers[i].length, powers[i].inverse);
+        }
+        digit_count = DECIMAL_CHUNK_DIGITS << level;
+        digits = allocate_text((size_t)digit_count);
+        write_decimal(work, view.length, powers, level, digits);
+        for (int i = 0; i <= level; i++) jm_free(powers[i].limbs);
+        for (int i = 0; i < level; i++) jm_free(powers[i].inverse);
+    }
+    jm_free(work);
+
+    // Drop the padding, keeping one digit for zero
+    int skip = 0;
+    while (skip < digit_count - 1 && digits[skip] == '0') skip++;
+    char* text = allocate_text((size_t)(digit_count - skip) + 2);
+    char* out = text;
+    if (view.sign < 0) *out++ = '-';
+    memcpy(out, digits + skip, (size_t)(digit_count - skip));
+    out[digit_count - skip] = '\0';
+    jm_free(digits);
+    return text;
+}
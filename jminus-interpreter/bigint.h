@@ -0,0 +1,106 @@
+/**
+ * @file bigint.h
+ * @brief Arbitrary-precision integers for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Integers that do not fit in a tagged value (see value.h) are stored as
+ * heap bigints, so integer arithmetic never overflows or loses precision.
+ * The functions here take any mix of tagged ints and bigints and return
+ * a tagged int whenever the result fits, so a value that shrinks back
+ * into range goes back onto the fast paths.
+ *
+ * Representation:
+ * - Sign plus magnitude; the magnitude is an array of 32-bit limbs,
+ *   least significant first, without leading zero limbs
+ * - A bigint is never zero and never within the tagged int range
+ *
+ * Algorithms:
+ * - Addition and subtraction: limb-by-limb with carry
+ * - Multiplication: schoolbook below BIGINT_KARATSUBA_THRESHOLD limbs,
+ *   Karatsuba above it (about n^1.58 instead of n^2)
+ * - Division: Knuth's algorithm D, truncating toward zero like ints
+ * - Bitwise operations: limb by limb on two's complement, one limb wider
+ *   than the wider operand so the sign survives
+ * - Formatting: peels nine decimal digits per pass (one division by 10^9)
+ *   below BIGINT_DECIMAL_THRESHOLD limbs. Above it, splits the number at
+ *   a power 10^(9*2^k) near its square root and writes both halves the
+ *   same way; from BIGINT_RECIPROCAL_THRESHOLD limbs the split multiplies
+ *   by the power's reciprocal (Newton's method) instead of dividing, so
+ *   the conversion costs Karatsuba products (about n^1.58 log n) instead
+ *   of n^2
+ *
+ * Memory Management:
+ * - Bigints are heap objects (OBJ_BIGINT) and are freed by free_objects()
+ * - Scratch space used during an operation is freed before it returns
+ */
+
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include <stdint.h>
+#include "value.h"
+
+/// Operand size (in limbs) from which multiplication switches to Karatsuba
+#define BIGINT_KARATSUBA_THRESHOLD 32
+
+/// Magnitude size (in limbs) from which formatting splits by powers of ten
+#define BIGINT_DECIMAL_THRESHOLD 64
+
+/// Power size (in limbs) from which formatting divides by multiplying by a reciprocal
+#define BIGINT_RECIPROCAL_THRESHOLD 1024
+
+/**
+ * @brief Converts a 64-bit integer to a value without losing precision
+ * @return Tagged int if it fits in 63 bits, otherwise a bigint
+ */
+Value bigint_from_int64(int64_t number);
+
+/**
+ * @brief Parses a string of decimal digits (optionally preceded by '-')
+ * @return Tagged int if it fits in 63 bits, otherwise a bigint
+ */
+Value bigint_parse(const char* digits);
+
+/**
+ * @brief Exact integer arithmetic
+ * @param a Tagged int or bigint
+ * @param b Tagged int or bigint (nonzero for bigint_divide)
+ * @return The result, as a tagged int whenever it fits
+ *
+ * Division truncates toward zero, matching int division.
+ */
+Value bigint_add(Value a, Value b);
+Value bigint_subtract(Value a, Value b);
+Value bigint_multiply(Value a, Value b);
+Value bigint_divide(Value a, Value b);
+
+/**
+ * @brief Bitwise operations and shifts on integers of any size
+ * @param a Tagged int or bigint
+ * @param b Tagged int or bigint
+ * @param count Bits to shift by (0 or more)
+ * @return The result, as a tagged int whenever it fits
+ *
+ * Bitwise operations act on the infinite two's complement of their
+ * operands, and shifting right rounds down, both as on tagged ints.
+ */
+Value bigint_and(Value a, Value b);
+Value bigint_or(Value a, Value b);
+Value bigint_xor(Value a, Value b);
+Value bigint_shift_left(Value a, int count);
+Value bigint_shift_right(Value a, int count);
+
+/**
+ * @brief Orders two integers (tagged ints or bigints)
+ * @return -1, 0 or 1
+ */
+int bigint_compare(Value a, Value b);
+
+/**
+ * @brief Formats an integer (tagged int or bigint) in decimal
+ * @return Newly allocated string; the caller frees it with jm_free()
+ */
+char* bigint_to_string(Value value);
+
+#endif // BIGINT_H
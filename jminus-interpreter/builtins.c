@@ -0,0 +1,139 @@
+/**
+ * @file builtins.c
+ * @brief Built-in functions of the jminus language
+ * @author Joey Zhang
+ * @version 1.0.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "builtins.h"
+#include "array.h"
+#include "map.h"
+
+static ObjArray* array_argument(Value value, const char* builtin) {
+    if (!is_array(value)) {
+        fprintf(stderr, "Runtime error: %s() expects an array\n", builtin);
+        exit(1);
+    }
+    return AS_ARRAY_OBJ(value);
+}
+
+// ----------------------------
+// Arrays
+// ----------------------------
+static Value builtin_len(Value* args) {
+    return INT_VAL(array_argument(args[0], "len")->count);
+}
+
+static Value builtin_push(Value* args) {
+    ObjArray* array = array_argument(args[0], "push");
+    array_push(array, args[1]);
+    return INT_VAL(array->count);
+}
+
+// ----------------------------
+// Aggregates (vectorized, see simd.h)
+// ----------------------------
+static Value number_argument(Value value, const char* builtin) {
+    if (!is_number(value)) {
+        fprintf(stderr, "Runtime error: %s() expects a number\n", builtin);
+        exit(1);
+    }
+    return value;
+}
+
+static Value builtin_sum(Value* args) {
+    return array_sum(array_argument(args[0], "sum"));
+}
+
+static Value builtin_min(Value* args) {
+    return array_min(array_argument(args[0], "min"));
+}
+
+static Value builtin_max(Value* args) {
+    return array_max(array_argument(args[0], "max"));
+}
+
+static Value builtin_dot(Value* args) {
+    return array_dot(array_argument(args[0], "dot"), array_argument(args[1], "dot"));
+}
+
+static Value builtin_scale(Value* args) {
+    ObjArray* array = array_argument(args[0], "scale");
+    return OBJ_VAL(array_scale(array, number_argument(args[1], "scale")));
+}
+
+static Value builtin_add(Value* args) {
+    ObjArray* array = array_argument(args[0], "add");
+    return OBJ_VAL(array_add(array, number_argument(args[1], "add")));
+}
+
+// ----------------------------
+// Numeric intrinsics
+// ----------------------------
+// The compiler emits BC_MIN, BC_MAX and BC_ABS instead; these serve the interpreter
+static Value builtin_min2(Value* args) {
+    return min_values(args[0], args[1]);
+}
+
+static Value builtin_max2(Value* args) {
+    return max_values(args[0], args[1]);
+}
+
+static Value builtin_abs(Value* args) {
+    return abs_value(args[0]);
+}
+
+// ----------------------------
+// Maps
+// ----------------------------
+static Value builtin_map(Value* args) {
+    (void)args;
+    return OBJ_VAL(new_map());
+}
+
+// The compiler emits BC_MAP_HAS instead; this serves the interpreter
+static Value builtin_has(Value* args) {
+    if (!is_map(args[0])) {
+        fprintf(stderr, "Runtime error: has() expects a map\n");
+        exit(1);
+    }
+    return INT_VAL(map_contains(AS_MAP_OBJ(args[0]), args[1]));
+}
+
+// ----------------------------
+// Table
+// ----------------------------
+const Builtin builtins[] = {
+    { "len", 1, builtin_len },
+    { "push", 2, builtin_push },
+    { "sum", 1, builtin_sum },
+    { "min", 1, builtin_min },
+    { "max", 1, builtin_max },
+    { "dot", 2, builtin_dot },
+    { "scale", 2, builtin_scale },
+    { "add", 2, builtin_add },
+    { "map", 0, builtin_map },
+    { "has", 2, builtin_has },
+    { "min", 2, builtin_min2 },
+    { "max", 2, builtin_max2 },
+    { "abs", 1, builtin_abs },
+};
+
+const int builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+int find_builtin(const char* name) {
+    for (int i = 0; i < builtin_count; i++) {
+        if (strcmp(builtins[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int find_builtin_call(const char* name, int arg_count) {
+    for (int i = 0; i < builtin_count; i++) {
+        if (builtins[i].arity == arg_count && strcmp(builtins[i].name, name) == 0) return i;
+    }
+    return find_builtin(name);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file builtins.h
+ * @brief Built-in functions of the jminus language
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Built-in functions are called like user functions but are implemented
+ * in C. The compiler resolves a call to a builtin when no user function
+ * of that name exists and emits BC_CALL_BUILTIN with the builtin's index;
+ * the VM passes the arguments as a window on its operand stack.
+ *
+ * Builtins:
+ * - len(a): Number of elements of array a
+ * - push(a, x): Appends x to array a and returns the new length
+ * - sum, min, max, dot, scale, add: Whole-array operations (see array.h)
+ * - min(a, b), max(a, b), abs(x): Numeric intrinsics (compiled to BC_MIN,
+ *   BC_MAX and BC_ABS)
+ * - map(): A new empty map
+ * - has(m, k): 1 if map m contains key k, else 0 (compiled to BC_MAP_HAS)
+ *
+ * A name may have builtins of different arities (min of an array, min of
+ * two numbers); a call resolves to the one matching its argument count.
+ *
+ * Error Handling:
+ * - Arguments of the wrong type are a runtime error
+ */
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "value.h"
+
+/// Largest arity of any builtin
+#define BUILTIN_MAX_ARITY 2
+
+/**
+ * @brief Signature of a builtin: receives its arguments in order
+ */
+typedef Value (*BuiltinFn)(Value* args);
+
+/**
+ * @brief An entry of the builtin table
+ */
+typedef struct {
+    const char* name;    ///< Name used in calls
+    int arity;           ///< Number of arguments
+    BuiltinFn function;  ///< Implementation
+} Builtin;
+
+extern const Builtin builtins[];
+extern const int builtin_count;
+
+/**
+ * @brief Looks up a builtin by name
+ * @return Index into builtins, or -1 if there is none
+ */
+int find_builtin(const char* name);
+
+/**
+ * @brief Looks up the builtin a call resolves to
+ * @return Index of the builtin named name taking arg_count arguments, else
+ *         of the first builtin of that name (so its arity check reports the
+ *         mismatch), or -1 if there is none
+ */
+int find_builtin_call(const char* name, int arg_count);
+
+#endif // BUILTINS_H
@@ -0,0 +1,355 @@
+/**
+ * @file capture.c
+ * @brief Capture and escape analysis for nested functions
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The analysis runs in four passes over a top-level function and the
+ * functions nested in it:
+ * 1. Declarations: number every function and every variable (parameters
+ *    and lets) by the function declaring it
+ * 2. Uses: resolve each name in each body, recording outer variables used
+ *    directly, assignments, nested functions called, and functions used
+ *    as values (which escape)
+ * 3. Flattening: a function also captures what the functions it calls or
+ *    uses as values capture, except its own variables; repeated until
+ *    nothing changes, since nested functions may be mutually recursive
+ * 4. Modes: each variable's mode follows from whether it is assigned and
+ *    whether an escaping function captures it
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "allocator.h"
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IndexList;
+
+// A parameter or let of one of the functions
+typedef struct {
+    const char* name;
+    int owner;       // Function declaring it
+    int assigned;    // Assigned anywhere after its declaration
+    int escaping;    // Captured by an escaping function
+} Variable;
+
+// Per-function working state
+typedef struct {
+    FnStmt* decl;
+    int parent;
+    int escapes;
+    IndexList children;  // Nested functions
+    IndexList captures;  // Variables used from enclosing functions
+    IndexList calls;     // Functions called or used as values
+} Scope;
+
+static Scope* scopes;
+static int scope_count;
+static int scope_capacity;
+static Variable* variables;
+static int variable_count;
+static int variable_capacity;
+
+static void* grow(void* items, int* capacity, size_t size) {
+    *capacity = *capacity ? *capacity * 2 : 8;
+    items = jm_realloc(items, size * *capacity);
+    if (!items) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return items;
+}
+
+static int list_contains(IndexList* list, int value) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->items[i] == value) return 1;
+    }
+    return 0;
+}
+
+// Appends value unless present; returns whether it was added
+static int list_add(IndexList* list, int value) {
+    if (list_contains(list, value)) return 0;
+    if (list->count >= list->capacity) list->items = grow(list->items, &list->capacity, sizeof(int));
+    list->items[list->count++] = value;
+    return 1;
+}
+
+// ----------------------------
+// Declarations
+// ----------------------------
+static int find_variable(int owner, const char* name) {
+    for (int i = 0; i < variable_count; i++) {
+        if (variables[i].owner == owner && strcmp(variables[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void declare_variable(int owner, const char* name) {
+    if (find_variable(owner, name) >= 0) return;
+    if (variable_count >= variable_capacity) variables = grow(variables, &variable_capacity, sizeof(Variable));
+    variables[variable_count++] = (Variable){ name, owner, 0, 0 };
+}
+
+static int declare_scope(FnStmt* fn, int parent);
+
+static void declare_stmt(Stmt* stmt, int owner) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_LET:
+            declare_variable(owner, stmt->let.name.lexeme);
+            break;
+        case STMT_IF:
+            declare_stmt(stmt->if_stmt.then_branch, owner);
+            declare_stmt(stmt->if_stmt.else_branch, owner);
+            break;
+        case STMT_WHILE:
+            declare_stmt(stmt->while_stmt.body, owner);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) declare_stmt(stmt->block.statements[i], owner);
+            break;
+        case STMT_FN: {
+            int child = declare_scope(&stmt->fn, owner);
+            list_add(&scopes[owner].children, child);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static int declare_scope(FnStmt* fn, int parent) {
+    if (!fn->body && !parse_function_body(fn)) {
+        fprintf(stderr, "Syntax error in function '%s'\n", fn->name.lexeme);
+        exit(1);
+    }
+    if (scope_count >= scope_capacity) scopes = grow(scopes, &scope_capacity, sizeof(Scope));
+    int index = scope_count++;
+    memset(&scopes[index], 0, sizeof(Scope));
+    scopes[index].decl = fn;
+    scopes[index].parent = parent;
+    for (int i = 0; i < fn->param_count; i++) declare_variable(index, fn->params[i].lexeme);
+    declare_stmt(fn->body, index);
+    return index;
+}
+
+// ----------------------------
+// Uses
+// ----------------------------
+/*
+ * Resolves name as seen from function scope: the innermost variable, or
+ * failing that a nested function (*function), else neither (a top-level
+ * function, builtin or global, none of which is captured).
+ */
+static int resolve(int scope, const char* name, int* function) {
+    *function = -1;
+    for (int level = scope; level >= 0; level = scopes[level].parent) {
+        int variable = find_variable(level, name);
+        if (variable >= 0) return variable;
+        IndexList* children = &scopes[level].children;
+        for (int i = 0; i < children->count; i++) {
+            if (strcmp(scopes[children->items[i]].decl->name.lexeme, name) == 0) {
+                *function = children->items[i];
+                return -1;
+            }
+        }
+    }
+    return -1;
+}
+
+// A read of name; as_value is zero when it is the callee of a call
+static void use_name(int scope, const char* name, int as_value) {
+    int function;
+    int variable = resolve(scope, name, &function);
+    if (variable >= 0 && variables[variable].owner != scope) list_add(&scopes[scope].captures, variable);
+    if (function >= 0) {
+        list_add(&scopes[scope].calls, function);
+        if (as_value) scopes[function].escapes = 1;
+    }
+}
+
+static void assign_name(int scope, const char* name) {
+    int function;
+    int variable = resolve(scope, name, &function);
+    if (variable < 0) return;
+    variables[variable].assigned = 1;
+    if (variables[variable].owner != scope) list_add(&scopes[scope].captures, variable);
+}
+
+static void use_stmt(Stmt* stmt, int scope);
+
+static void use_expr(Expr* expr, int scope) {
+    if (!expr) return;
+    switch (expr->type) {
+        case EXPR_VARIABLE:
+            use_name(scope, expr->variable.name.lexeme, 1);
+            break;
+        case EXPR_BINARY:
+            if (strcmp(expr->binary.op.lexeme, "=") == 0 && expr->binary.left->type == EXPR_VARIABLE) {
+                assign_name(scope, expr->binary.left->variable.name.lexeme);
+            } else {
+                use_expr(expr->binary.left, scope);
+            }
+            use_expr(expr->binary.right, scope);
+            break;
+        case EXPR_CALL:
+            if (expr->call.callee->type == EXPR_VARIABLE) {
+                use_name(scope, expr->call.callee->variable.name.lexeme, 0);
+            } else {
+                use_expr(expr->call.callee, scope);
+            }
+            for (int i = 0; i < expr->call.arg_count; i++) use_expr(expr->call.args[i], scope);
+            break;
+        case EXPR_INLINE:
+            // The body belongs to a top-level function; only the arguments are ours
+            for (int i = 0; i < expr->inlined.arg_count; i++) use_expr(expr->inlined.args[i], scope);
+            break;
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) use_expr(expr->array.elements[i], scope);
+            break;
+        case EXPR_INDEX:
+            use_expr(expr->index.object, scope);
+            use_expr(expr->index.index, scope);
+            break;
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) use_expr(expr->record.values[i], scope);
+            break;
+        case EXPR_FIELD:
+            use_expr(expr->field.object, scope);
+            break;
+        case EXPR_UNARY:
+            use_expr(expr->unary.operand, scope);
+            break;
+        default:
+            break;
+    }
+}
+
+static void use_stmt(Stmt* stmt, int scope) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_EXPR: use_expr(stmt->expr.expression, scope); break;
+        case STMT_LET: use_expr(stmt->let.initializer, scope); break;
+        case STMT_YAP: use_expr(stmt->yap.expression, scope); break;
+        case STMT_RETURN: use_expr(stmt->return_stmt.value, scope); break;
+        case STMT_IF:
+            use_expr(stmt->if_stmt.condition, scope);
+            use_stmt(stmt->if_stmt.then_branch, scope);
+            use_stmt(stmt->if_stmt.else_branch, scope);
+            break;
+        case STMT_WHILE:
+            use_expr(stmt->while_stmt.condition, scope);
+            use_stmt(stmt->while_stmt.body, scope);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) use_stmt(stmt->block.statements[i], scope);
+            break;
+        case STMT_FN:
+            break;  // Nested bodies are scopes of their own
+    }
+}
+
+// ----------------------------
+// Flattening and modes
+// ----------------------------
+static void flatten(void) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int scope = 0; scope < scope_count; scope++) {
+            IndexList* calls = &scopes[scope].calls;
+            for (int i = 0; i < calls->count; i++) {
+                IndexList* needed = &scopes[calls->items[i]].captures;
+                for (int j = 0; j < needed->count; j++) {
+                    int variable = needed->items[j];
+                    if (variables[variable].owner == scope) continue;
+                    if (list_add(&scopes[scope].captures, variable)) changed = 1;
+                }
+            }
+        }
+    }
+}
+
+static CaptureMode mode_of(Variable* variable) {
+    if (!variable->assigned) return CAPTURE_VALUE;
+    return variable->escaping ? CAPTURE_UPVALUE : CAPTURE_REF;
+}
+
+CaptureAnalysis analyze_captures(FnStmt* root) {
+    scopes = NULL;
+    scope_count = scope_capacity = 0;
+    variables = NULL;
+    variable_count = variable_capacity = 0;
+
+    declare_scope(root, -1);
+    for (int scope = 0; scope < scope_count; scope++) use_stmt(scopes[scope].decl->body, scope);
+    flatten();
+    for (int scope = 0; scope < scope_count; scope++) {
+        if (!scopes[scope].escapes) continue;
+        IndexList* captures = &scopes[scope].captures;
+        for (int i = 0; i < captures->count; i++) variables[captures->items[i]].escaping = 1;
+    }
+
+    CaptureAnalysis analysis;
+    analysis.count = scope_count;
+    analysis.functions = jm_calloc(scope_count, sizeof(CaptureInfo));
+    if (!analysis.functions) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int scope = 0; scope < scope_count; scope++) {
+        CaptureInfo* info = &analysis.functions[scope];
+        IndexList* captures = &scopes[scope].captures;
+        info->decl = scopes[scope].decl;
+        info->parent = scopes[scope].parent;
+        info->escapes = scopes[scope].escapes;
+        info->captures = jm_alloc(sizeof(Capture) * (captures->count > 0 ? captures->count : 1));
+        info->captured = jm_alloc(sizeof(Capture) * (variable_count > 0 ? variable_count : 1));
+        if (!info->captures || !info->captured) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (int i = 0; i < captures->count; i++) {
+            Variable* variable = &variables[captures->items[i]];
+            info->captures[info->capture_count++] = (Capture){ variable->name, mode_of(variable) };
+        }
+    }
+
+    // A variable is captured if some function lists it
+    for (int variable = 0; variable < variable_count; variable++) {
+        int captured = 0;
+        for (int scope = 0; scope < scope_count && !captured; scope++) {
+            captured = list_contains(&scopes[scope].captures, variable);
+        }
+        if (!captured) continue;
+        CaptureInfo* owner = &analysis.functions[variables[variable].owner];
+        owner->captured[owner->captured_count++] = (Capture){ variables[variable].name, mode_of(&variables[variable]) };
+    }
+
+    for (int scope = 0; scope < scope_count; scope++) {
+        jm_free(scopes[scope].children.items);
+        jm_free(scopes[scope].captures.items);
+        jm_free(scopes[scope].calls.items);
+    }
+    jm_free(scopes);
+    jm_free(variables);
+    scopes = NULL;
+    variables = NULL;
+    return analysis;
+}
+
+void free_capture_analysis(CaptureAnalysis* analysis) {
+    for (int i = 0; i < analysis->count; i++) {
+        jm_free(analysis->functions[i].captures);
+        jm_free(analysis->functions[i].captured);
+    }
+    jm_free(analysis->functions);
+    analysis->functions = NULL;
+    analysis->count = 0;
+}
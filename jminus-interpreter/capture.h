@@ -0,0 +1,102 @@
+/**
+ * @file capture.h
+ * @brief Capture and escape analysis for nested functions
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Functions may be declared inside other functions and use their
+ * parameters and locals. Rather than keeping every enclosing scope alive
+ * in a chain of environments, the compiler works out, for each top-level
+ * function and everything nested in it, which outer variables each nested
+ * function uses and how each must be passed to it.
+ *
+ * Captures:
+ * - A nested function captures every outer variable its body uses, plus
+ *   every outer variable needed by the nested functions it calls or uses
+ *   as values (captures are flat, so no call walks a chain of frames)
+ * - Captures are passed in hidden frame slots after the arguments
+ *
+ * Escape Analysis:
+ * - A function escapes if it is used as a value (returned, stored, passed
+ *   as an argument); only then can it run after the frames it captured
+ *   from have returned
+ * - A function that is only ever called directly never escapes: no
+ *   closure object is created for it
+ *
+ * Capture Modes (per variable):
+ * - CAPTURE_VALUE: The variable is never assigned, only initialized, so
+ *   its value is copied. Nothing is allocated
+ * - CAPTURE_REF: The variable is assigned, but no escaping function
+ *   captures it, so its frame outlives every function using it: they get
+ *   the stack index of its slot. Nothing is allocated
+ * - CAPTURE_UPVALUE: The variable is assigned and an escaping function
+ *   captures it, so it lives in a heap cell (ObjUpvalue) shared by its
+ *   own function and every capture, Lua-style. Only these allocate
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "parser.h"
+
+/**
+ * @brief How a captured variable is passed and accessed
+ */
+typedef enum {
+    CAPTURE_VALUE,   ///< The value itself (never assigned)
+    CAPTURE_REF,     ///< Stack index of the owner's slot (assigned, never escapes)
+    CAPTURE_UPVALUE  ///< An ObjUpvalue cell (assigned and escapes)
+} CaptureMode;
+
+/**
+ * @brief A variable and how it is captured
+ */
+typedef struct {
+    const char* name;  ///< Variable name (points into token lexemes)
+    CaptureMode mode;  ///< How it is captured
+} Capture;
+
+/**
+ * @brief What the analysis found for one function
+ */
+typedef struct {
+    FnStmt* decl;        ///< Declaration (owned by the AST)
+    int parent;          ///< Index of the enclosing function, -1 for the root
+    int escapes;         ///< Nonzero if the function is used as a value
+    Capture* captures;   ///< Outer variables it needs, in hidden slot order
+    int capture_count;   ///< Number of captures
+    Capture* captured;   ///< Own parameters and locals that nested functions capture
+    int captured_count;  ///< Number of captured own variables
+} CaptureInfo;
+
+/**
+ * @brief Result of analyzing a top-level function
+ */
+typedef struct {
+    CaptureInfo* functions;  ///< The root, then every nested function, parents first
+    int count;               ///< Number of functions
+} CaptureAnalysis;
+
+/**
+ * @brief Analyzes a top-level function and every function nested in it
+ * @param root A top-level function declaration whose body has been parsed
+ * @return The analysis (free with free_capture_analysis())
+ *
+ * Nested function bodies are parsed here (exiting on a syntax error),
+ * since their captures decide how the functions around them compile.
+ * Variables are scoped to the function declaring them, as everywhere in
+ * jminus; inside a function, a name means its innermost declaration: a
+ * parameter or let of the function itself or of an enclosing function
+ * (nearest first), or else a function nested in one of them.
+ */
+CaptureAnalysis analyze_captures(FnStmt* root);
+
+/**
+ * @brief Frees an analysis, including capture arrays not taken over
+ *
+ * Callers that keep a captures or captured array set the pointer in the
+ * analysis to NULL first.
+ */
+void free_capture_analysis(CaptureAnalysis* analysis);
+
+#endif // CAPTURE_H
@@ -2,71 +2,892 @@
 #include <stdlib.h>
 #include <string.h>
 #include "compiler.h"
+#include "ir.h"
+#include "passes.h"
+#include "optimizer.h"
+#include "builtins.h"
+#include "native.h"
 #include "vm.h"
+#include "str.h"
+#include "record.h"
+#include "allocator.h"
 
 static Bytecode* bytecode;
 
+#define MAX_LOCALS 256
+#define MAX_INLINE_RETURNS 64
+#define MAX_PROVEN_LOOPS 16
+
+// How a frame slot holds its variable
+typedef enum {
+    SLOT_VALUE,    // The value itself
+    SLOT_REF,      // The stack index of the owner's slot (a CAPTURE_REF capture)
+    SLOT_UPVALUE   // An ObjUpvalue cell holding the value
+} SlotKind;
+
+/**
+ * Compile-time state for the frame being compiled: a function body, or
+ * the top-level script, whose frame holds the locals of its blocks and
+ * the slots of inlined calls. Parameters occupy the first slots, then
+ * captures and captured locals, which live as long as the frame; above
+ * them, each block's locals get slots in declaration order that are
+ * released when the block ends, so the frame size is the deepest nesting
+ * of blocks rather than the number of lets.
+ */
+typedef struct {
+    const char* locals[MAX_LOCALS]; // Slot names (point into token lexemes)
+    unsigned char kinds[MAX_LOCALS]; // SlotKind of each slot
+    int local_count;                // Slots in use
+    int max_count;                  // Peak slots in use (the frame size)
+    int floor;                      // Lowest slot visible to name lookups
+    int scope_start;                // First slot of the innermost block
+    int block_depth;                // Blocks entered (top-level lets outside any are globals)
+    int function;                   // Index in the functions table, -1 for the script
+} FunctionState;
+
+/**
+ * State for an inlined body being compiled. Its returns jump to the end of
+ * the inlined code with the result on top of the stack.
+ */
+typedef struct InlineState {
+    int jumps[MAX_INLINE_RETURNS];  // BC_JUMP placeholders to patch
+    int jump_count;
+    struct InlineState* enclosing;
+} InlineState;
+
+/**
+ * An array/index variable pair for which a[i] is known to be in bounds
+ * throughout the body of the loop being compiled (see prove_bounds).
+ */
+typedef struct {
+    const char* array;
+    const char* index;
+} BoundsProof;
+
+static FunctionState script;                  // Frame of top-level code
+static FunctionState* current_fn = &script;   // Frame being compiled
+static InlineState* current_inline = NULL;    // Innermost inlined body
+static BoundsProof proofs[MAX_PROVEN_LOOPS];  // Enclosing loops with proven bounds
+static int proof_count = 0;
+static const char** known_globals = NULL;     // Defined by the top-level lets compiled so far
+static int known_count = 0;
+static int known_capacity = 0;
+
+static int in_function(void) {
+    return current_fn != &script;
+}
+
+void bytecode_emit(Bytecode* bc, OpCode opcode, int operand) {
+    if (bc->count >= bc->capacity) {
+        bc->capacity *= 2;
+        bc->instructions = jm_realloc(bc->instructions, sizeof(Instruction) * bc->capacity);
+    }
+    bc->instructions[bc->count++] = (Instruction){ opcode, operand };
+}
+
+int bytecode_constant(Bytecode* bc, Value value) {
+    if (bc->const_count >= bc->const_capacity) {
+        bc->const_capacity *= 2;
+        bc->constants = jm_realloc(bc->constants, sizeof(Value) * bc->const_capacity);
+    }
+    bc->constants[bc->const_count] = value;
+    return bc->const_count++;
+}
+
+int bytecode_name(Bytecode* bc, const char* name) {
+    Value key = OBJ_VAL(intern_name(name));
+    for (int i = 0; i < bc->const_count; i++) {
+        if (bc->constants[i] == key) return i;
+    }
+    return bytecode_constant(bc, key);
+}
+
 static void emit(OpCode opcode, int operand) {
-    if (bytecode->count >= bytecode->capacity) {
-        bytecode->capacity *= 2;
-        bytecode->instructions = realloc(bytecode->instructions, sizeof(Instruction) * bytecode->capacity);
+    bytecode_emit(bytecode, opcode, operand);
+}
+
+static int add_constant(Value value) {
+    return bytecode_constant(bytecode, value);
+}
+
+static int name_constant(const char* name) {
+    return bytecode_name(bytecode, name);
+}
+
+// A fresh inline cache for one field access site
+static int add_field_cache(const char* name) {
+    if (bytecode->field_cache_count >= bytecode->field_cache_capacity) {
+        bytecode->field_cache_capacity *= 2;
+        bytecode->field_caches = jm_realloc(bytecode->field_caches, sizeof(FieldCache) * bytecode->field_cache_capacity);
+    }
+    bytecode->field_caches[bytecode->field_cache_count] = (FieldCache){ intern_name(name), NULL, 0 };
+    return bytecode->field_cache_count++;
+}
+
+// Constant index of the shape of records built by a literal, shared by
+// every literal with the same fields in the same order
+static int shape_constant(RecordExpr* record) {
+    ObjShape* shape = root_shape();
+    for (int i = 0; i < record->count; i++) {
+        shape = shape_add_field(shape, intern_name(record->names[i].lexeme));
     }
-    bytecode->instructions[bytecode->count++] = (Instruction){ opcode, operand };
+    Value key = OBJ_VAL(shape);
+    for (int i = 0; i < bytecode->const_count; i++) {
+        if (bytecode->constants[i] == key) return i;
+    }
+    return add_constant(key);
+}
+
+/*
+ * Looks a function up as seen from inside function scope (-1 for
+ * top-level code): functions nested in it, then in each enclosing
+ * function outward, then top-level functions.
+ */
+static int find_function_in(int scope, const char* name) {
+    while (1) {
+        for (int i = 0; i < bytecode->function_count; i++) {
+            if (bytecode->functions[i].parent == scope && strcmp(bytecode->functions[i].name, name) == 0) return i;
+        }
+        if (scope < 0) return -1;
+        scope = bytecode->functions[scope].parent;
+    }
+}
+
+// Inlined bodies are top-level functions, so they only see top-level names
+static int find_function(const char* name) {
+    return find_function_in(current_inline ? -1 : current_fn->function, name);
+}
+
+static int resolve_local(const char* name) {
+    for (int i = current_fn->local_count - 1; i >= current_fn->floor; i--) {
+        if (strcmp(current_fn->locals[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static int add_local(const char* name) {
+    if (current_fn->local_count >= MAX_LOCALS) {
+        fprintf(stderr, "Too many local variables in function\n");
+        exit(1);
+    }
+    current_fn->locals[current_fn->local_count] = name;
+    current_fn->kinds[current_fn->local_count] = SLOT_VALUE;
+    current_fn->local_count++;
+    if (current_fn->local_count > current_fn->max_count) {
+        current_fn->max_count = current_fn->local_count;
+    }
+    return current_fn->local_count - 1;
+}
+
+// Slot of a local declared in the innermost block, or -1
+static int resolve_in_block(const char* name) {
+    int start = current_fn->scope_start > current_fn->floor ? current_fn->scope_start : current_fn->floor;
+    for (int i = current_fn->local_count - 1; i >= start; i--) {
+        if (strcmp(current_fn->locals[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Returns nonzero if a function nested in the one being compiled captures its variable name
+static int captured_local(const char* name) {
+    if (current_inline || current_fn->function < 0) return 0;
+    Function* function = &bytecode->functions[current_fn->function];
+    for (int i = 0; i < function->captured_count; i++) {
+        if (strcmp(function->captured[i].name, name) == 0) return 1;
+    }
+    return 0;
 }
 
-static int add_constant(int value) {
-    if (bytecode->const_count >= bytecode->const_capacity) {
-        bytecode->const_capacity *= 2;
-        bytecode->constants = realloc(bytecode->constants, sizeof(int) * bytecode->const_capacity);
+static void emit_load(int slot) {
+    switch (current_fn->kinds[slot]) {
+        case SLOT_REF: emit(BC_LOAD_REF, slot); break;
+        case SLOT_UPVALUE: emit(BC_LOAD_UPVALUE, slot); break;
+        default: emit(BC_LOAD_LOCAL, slot); break;
     }
-    bytecode->constants[bytecode->const_count] = value;
-    return bytecode->const_count++;
+}
+
+static void emit_store(int slot) {
+    switch (current_fn->kinds[slot]) {
+        case SLOT_REF: emit(BC_SET_REF, slot); break;
+        case SLOT_UPVALUE: emit(BC_SET_UPVALUE, slot); break;
+        default: emit(BC_SET_LOCAL, slot); break;
+    }
+}
+
+// Declares a function inside function parent (-1 at top level)
+static int declare_function(FnStmt* fn, int parent) {
+    for (int i = 0; i < bytecode->function_count; i++) {
+        if (bytecode->functions[i].parent == parent && strcmp(bytecode->functions[i].name, fn->name.lexeme) == 0) {
+            fprintf(stderr, "Function '%s' is already defined\n", fn->name.lexeme);
+            exit(1);
+        }
+    }
+    if (bytecode->function_count >= bytecode->function_capacity) {
+        bytecode->function_capacity *= 2;
+        bytecode->functions = jm_realloc(bytecode->functions, sizeof(Function) * bytecode->function_capacity);
+    }
+    size_t length = strlen(fn->name.lexeme) + 1;
+    Function* function = &bytecode->functions[bytecode->function_count++];
+    function->name = jm_alloc(length);
+    memcpy(function->name, fn->name.lexeme, length);
+    function->arity = fn->param_count;
+    function->entry = -1;
+    function->local_count = fn->param_count;
+    function->max_stack = 0;
+    function->decl = fn;
+    function->parent = parent;
+    function->captures = NULL;
+    function->capture_count = 0;
+    function->captured = NULL;
+    function->captured_count = 0;
+    function->constant = -1;
+    return bytecode->function_count - 1;
+}
+
+/*
+ * Runs capture analysis for top-level function root, declaring every
+ * function nested in it and recording what each captures.
+ */
+static void analyze_nested(int root) {
+    CaptureAnalysis analysis = analyze_captures(bytecode->functions[root].decl);
+    int* indices = jm_alloc(sizeof(int) * analysis.count);
+    for (int i = 0; i < analysis.count; i++) {
+        CaptureInfo* info = &analysis.functions[i];
+        // Parents come first, so their index is known
+        indices[i] = i == 0 ? root : declare_function(info->decl, indices[info->parent]);
+        Function* function = &bytecode->functions[indices[i]];
+        function->captures = info->captures;
+        function->capture_count = info->capture_count;
+        function->captured = info->captured;
+        function->captured_count = info->captured_count;
+        info->captures = NULL;
+        info->captured = NULL;
+    }
+    jm_free(indices);
+    free_capture_analysis(&analysis);
+}
+
+// Returns nonzero if the statement declares name with let, outside nested functions
+static int stmt_declares(Stmt* stmt, const char* name) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case STMT_LET: return strcmp(stmt->let.name.lexeme, name) == 0;
+        case STMT_IF:
+            return stmt_declares(stmt->if_stmt.then_branch, name) || stmt_declares(stmt->if_stmt.else_branch, name);
+        case STMT_WHILE: return stmt_declares(stmt->while_stmt.body, name);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (stmt_declares(stmt->block.statements[i], name)) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Returns nonzero if name is a parameter or local of scope or a function enclosing it
+static int variable_in_scope(int scope, const char* name) {
+    for (; scope >= 0; scope = bytecode->functions[scope].parent) {
+        FnStmt* fn = bytecode->functions[scope].decl;
+        for (int i = 0; i < fn->param_count; i++) {
+            if (strcmp(fn->params[i].lexeme, name) == 0) return 1;
+        }
+        if (stmt_declares(fn->body, name)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Runs the AST optimizer over stmts of function scope (-1 for top-level
+ * code) with the top-level functions it sees available for inlining:
+ * those not shadowed by a nested function or a variable in scope.
+ */
+static void optimize(Stmt** stmts, int stmt_count, int scope) {
+    FnStmt** fns = jm_alloc(sizeof(FnStmt*) * (bytecode->function_count > 0 ? bytecode->function_count : 1));
+    int count = 0;
+    for (int i = 0; i < bytecode->function_count; i++) {
+        Function* function = &bytecode->functions[i];
+        if (function->parent >= 0 || find_function_in(scope, function->name) != i) continue;
+        if (variable_in_scope(scope, function->name)) continue;
+        fns[count++] = function->decl;
+    }
+    optimize_ast(stmts, stmt_count, fns, count);
+    jm_free(fns);
+}
+
+static void compile_expr(Expr* expr);
+static void compile_stmt(Stmt* stmt);
+static void compile_sequence(Stmt** stmts, int count);
+
+/*
+ * Pushes the captures function index expects, as the frame being compiled
+ * holds them. Returns nonzero if one is the stack index of a slot of
+ * this frame, which must then outlive the call.
+ */
+static int push_captures(int index) {
+    int frame_refs = 0;
+    for (int i = 0; i < bytecode->functions[index].capture_count; i++) {
+        Capture* capture = &bytecode->functions[index].captures[i];
+        int slot = resolve_local(capture->name);
+        if (slot < 0) {
+            fprintf(stderr, "Cannot capture '%s' in function '%s'\n", capture->name, bytecode->functions[index].name);
+            exit(1);
+        }
+        if (capture->mode == CAPTURE_REF && current_fn->kinds[slot] != SLOT_REF) {
+            emit(BC_REF_LOCAL, slot);
+            frame_refs = 1;
+        } else {
+            // A value, a cell, or a stack index passed along as is
+            emit(BC_LOAD_LOCAL, slot);
+        }
+    }
+    return frame_refs;
+}
+
+/*
+ * Pushes function index as a value. Functions capturing nothing have one
+ * closure, made at compile time; the others get a new closure each time.
+ */
+static void compile_function_value(int index) {
+    Function* function = &bytecode->functions[index];
+    if (function->capture_count == 0) {
+        if (function->constant < 0) {
+            ObjClosure* closure = new_closure(bytecode->id, index, intern_name(function->name), 0);
+            function->constant = add_constant(OBJ_VAL(closure));
+        }
+        emit(BC_CONST, function->constant);
+        return;
+    }
+    if (function->constant < 0) function->constant = name_constant(function->name);
+    push_captures(index);
+    emit(BC_CLOSURE, index);
+}
+
+// Opcode of an arithmetic, bitwise or comparison operator, or -1
+static int binary_opcode(const char* op) {
+    static const struct { const char* op; OpCode opcode; } table[] = {
+        { "+", BC_ADD }, { "-", BC_SUB }, { "*", BC_MUL }, { "/", BC_DIV }, { "%", BC_MOD },
+        { "&", BC_BIT_AND }, { "|", BC_BIT_OR }, { "^", BC_BIT_XOR },
+        { "<<", BC_SHIFT_LEFT }, { ">>", BC_SHIFT_RIGHT },
+        { "==", BC_EQUAL }, { "!=", BC_NOT_EQUAL }, { "<", BC_LESS }, { "<=", BC_LESS_EQUAL },
+        { ">", BC_GREATER }, { ">=", BC_GREATER_EQUAL }
+    };
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        if (strcmp(table[i].op, op) == 0) return table[i].opcode;
+    }
+    return -1;
+}
+
+// Map membership and the numeric intrinsics have opcodes of their own
+static OpCode builtin_opcode(const Builtin* builtin) {
+    if (strcmp(builtin->name, "has") == 0) return BC_MAP_HAS;
+    if (strcmp(builtin->name, "min") == 0 && builtin->arity == 2) return BC_MIN;
+    if (strcmp(builtin->name, "max") == 0 && builtin->arity == 2) return BC_MAX;
+    if (strcmp(builtin->name, "abs") == 0) return BC_ABS;
+    return BC_CALL_BUILTIN;
+}
+
+static void compile_builtin_call(CallExpr* call, int index) {
+    const Builtin* builtin = &builtins[index];
+    if (builtin->arity != call->arg_count) {
+        fprintf(stderr, "Function '%s' expects %d arguments but got %d\n",
+                builtin->name, builtin->arity, call->arg_count);
+        exit(1);
+    }
+    OpCode opcode = builtin_opcode(builtin);
+
+    // Intrinsics of constant numbers are evaluated here
+    if (opcode == BC_MIN || opcode == BC_MAX || opcode == BC_ABS) {
+        Value args[BUILTIN_MAX_ARITY];
+        int constant = 1;
+        for (int i = 0; i < call->arg_count && constant; i++) {
+            constant = call->args[i]->type == EXPR_LITERAL &&
+                       is_number(args[i] = literal_value(call->args[i]->literal.value));
+        }
+        if (constant) {
+            emit(BC_CONST, add_constant(builtin->function(args)));
+            return;
+        }
+    }
+
+    for (int i = 0; i < call->arg_count; i++) {
+        compile_expr(call->args[i]);
+    }
+    emit(opcode, opcode == BC_CALL_BUILTIN ? index : 0);
+}
+
+// Results a folded call may share between runs: anything but a mutable object
+static int immutable_result(Value value) {
+    return !IS_OBJ(value) || IS_STRING_OBJ(value) || is_bigint(value) || is_boxed_double(value);
+}
+
+static void compile_native_call(CallExpr* call, int index) {
+    const Native* native = &natives[index];
+    if (native->arity != call->arg_count) {
+        fprintf(stderr, "Function '%s' expects %d arguments but got %d\n",
+                native->name, native->arity, call->arg_count);
+        exit(1);
+    }
+
+    // A pure native with constant arguments is called once, here
+    if (native->flags & JM_NATIVE_PURE) {
+        Value args[NATIVE_MAX_ARITY];
+        int constant = 1;
+        for (int i = 0; i < call->arg_count && constant; i++) {
+            constant = call->args[i]->type == EXPR_LITERAL;
+            if (constant) args[i] = literal_value(call->args[i]->literal.value);
+        }
+        if (constant) {
+            Value result = native->function(args);
+            if (immutable_result(result)) {
+                emit(BC_CONST, add_constant(result));
+                return;
+            }
+        }
+    }
+
+    for (int i = 0; i < call->arg_count; i++) {
+        compile_expr(call->args[i]);
+    }
+    emit(BC_CALL_NATIVE, index);
+}
+
+/**
+ * Pushes the arguments and emits a BC_CALL or BC_TAIL_CALL to the named
+ * function, or BC_CALL_NATIVE or BC_CALL_BUILTIN if the name is a native
+ * or builtin no user function shadows. The arguments, then the captures, become the first slots of
+ * the callee's frame. A callee held in a variable, or computed, is called
+ * through its closure with BC_CALL_CLOSURE.
+ */
+static void compile_call(CallExpr* call, OpCode opcode) {
+    if (call->callee->type == EXPR_VARIABLE) {
+        const char* name = call->callee->variable.name.lexeme;
+        int local = resolve_local(name) >= 0;
+        int index = local ? -1 : find_function(name);
+        if (!local && index < 0 && find_native(name) >= 0) {
+            compile_native_call(call, find_native(name));
+            return;
+        }
+        if (!local && index < 0 && find_builtin(name) >= 0) {
+            // Builtins never take over the frame, so a tail call is a plain call
+            compile_builtin_call(call, find_builtin_call(name, call->arg_count));
+            return;
+        }
+        if (index >= 0) {
+            if (bytecode->functions[index].arity != call->arg_count) {
+                fprintf(stderr, "Function '%s' expects %d arguments but got %d\n",
+                        name, bytecode->functions[index].arity, call->arg_count);
+                exit(1);
+            }
+            for (int i = 0; i < call->arg_count; i++) {
+                compile_expr(call->args[i]);
+            }
+            // A frame whose slots the callee refers to cannot be replaced
+            int frame_refs = push_captures(index);
+            emit(opcode == BC_TAIL_CALL && frame_refs ? BC_CALL : opcode, index);
+            return;
+        }
+    }
+    compile_expr(call->callee);
+    for (int i = 0; i < call->arg_count; i++) {
+        compile_expr(call->args[i]);
+    }
+    emit(BC_CALL_CLOSURE, call->arg_count);
+}
+
+// ----------------------------
+// Bounds check elimination
+// ----------------------------
+
+static int same_name(const char* a, const char* b) {
+    return strcmp(a, b) == 0;
+}
+
+static int is_variable(Expr* expr, const char* name) {
+    return expr && expr->type == EXPR_VARIABLE && strcmp(expr->variable.name.lexeme, name) == 0;
+}
+
+static int is_nonnegative_int(Expr* expr) {
+    if (!expr || expr->type != EXPR_LITERAL || expr->literal.value.type != TOKEN_INT) return 0;
+    Value value = literal_value(expr->literal.value);
+    return IS_INT(value) && AS_INT(value) >= 0;
+}
+
+// Matches `name = <value>` as an expression
+static Expr* assigned_value(Expr* expr, const char* name) {
+    if (!expr || expr->type != EXPR_BINARY || strcmp(expr->binary.op.lexeme, "=") != 0) return NULL;
+    return is_variable(expr->binary.left, name) ? expr->binary.right : NULL;
+}
+
+/*
+ * Returns nonzero if a loop body can neither rebind the array or index
+ * variable nor run code that could: calls other than builtins (which never
+ * shrink an array) and inlined bodies are ruled out.
+ */
+static int stmt_keeps_bounds(Stmt* stmt, const char* array, const char* index);
+
+static int expr_keeps_bounds(Expr* expr, const char* array, const char* index) {
+    if (!expr) return 1;
+    switch (expr->type) {
+        case EXPR_BINARY:
+            if (strcmp(expr->binary.op.lexeme, "=") == 0 && expr->binary.left->type == EXPR_VARIABLE) {
+                const char* name = expr->binary.left->variable.name.lexeme;
+                if (same_name(name, array) || same_name(name, index)) return 0;
+            }
+            return expr_keeps_bounds(expr->binary.left, array, index) &&
+                   expr_keeps_bounds(expr->binary.right, array, index);
+        case EXPR_CALL:
+            if (expr->call.callee->type != EXPR_VARIABLE) return 0;
+            if (resolve_local(expr->call.callee->variable.name.lexeme) >= 0 ||
+                find_function(expr->call.callee->variable.name.lexeme) >= 0 ||
+                find_native(expr->call.callee->variable.name.lexeme) >= 0 ||
+                find_builtin(expr->call.callee->variable.name.lexeme) < 0) {
+                return 0;
+            }
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                if (!expr_keeps_bounds(expr->call.args[i], array, index)) return 0;
+            }
+            return 1;
+        case EXPR_INLINE:
+            return 0;
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                if (!expr_keeps_bounds(expr->array.elements[i], array, index)) return 0;
+            }
+            return 1;
+        case EXPR_INDEX:
+            return expr_keeps_bounds(expr->index.object, array, index) &&
+                   expr_keeps_bounds(expr->index.index, array, index);
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                if (!expr_keeps_bounds(expr->record.values[i], array, index)) return 0;
+            }
+            return 1;
+        case EXPR_FIELD:
+            return expr_keeps_bounds(expr->field.object, array, index);
+        case EXPR_UNARY:
+            return expr_keeps_bounds(expr->unary.operand, array, index);
+        default:
+            return 1;
+    }
+}
+
+static int stmt_keeps_bounds(Stmt* stmt, const char* array, const char* index) {
+    if (!stmt) return 1;
+    switch (stmt->type) {
+        case STMT_EXPR: return expr_keeps_bounds(stmt->expr.expression, array, index);
+        case STMT_YAP: return expr_keeps_bounds(stmt->yap.expression, array, index);
+        case STMT_RETURN: return expr_keeps_bounds(stmt->return_stmt.value, array, index);
+        case STMT_LET:
+            if (same_name(stmt->let.name.lexeme, array) || same_name(stmt->let.name.lexeme, index)) return 0;
+            return expr_keeps_bounds(stmt->let.initializer, array, index);
+        case STMT_IF:
+            return expr_keeps_bounds(stmt->if_stmt.condition, array, index) &&
+                   stmt_keeps_bounds(stmt->if_stmt.then_branch, array, index) &&
+                   stmt_keeps_bounds(stmt->if_stmt.else_branch, array, index);
+        case STMT_WHILE:
+            return expr_keeps_bounds(stmt->while_stmt.condition, array, index) &&
+                   stmt_keeps_bounds(stmt->while_stmt.body, array, index);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (!stmt_keeps_bounds(stmt->block.statements[i], array, index)) return 0;
+            }
+            return 1;
+        case STMT_FN:
+            return 0;
+    }
+    return 0;
+}
+
+/*
+ * Proves that a[i] is in bounds everywhere in the body of a loop shaped
+ *     i = <non-negative int>;      (or let i = ...)
+ *     while (i < len(a)) { ...; i = i + <non-negative int>; }
+ * where the body changes neither i nor a before the final increment.
+ * i starts as a non-negative int and only grows, so it stays an int in
+ * [0, len(a)) until the increment, and arrays never shrink. On success
+ * the pair is recorded in *proof.
+ */
+static int prove_bounds(Stmt* preceding, WhileStmt* loop, BoundsProof* proof) {
+    // Condition: i < len(a), with len being the builtin
+    Expr* condition = loop->condition;
+    if (condition->type != EXPR_BINARY || strcmp(condition->binary.op.lexeme, "<") != 0) return 0;
+    Expr* limit = condition->binary.right;
+    if (condition->binary.left->type != EXPR_VARIABLE || limit->type != EXPR_CALL ||
+        !is_variable(limit->call.callee, "len") || find_function("len") >= 0 ||
+        limit->call.arg_count != 1 || limit->call.args[0]->type != EXPR_VARIABLE) {
+        return 0;
+    }
+    const char* index = condition->binary.left->variable.name.lexeme;
+    const char* array = limit->call.args[0]->variable.name.lexeme;
+    if (same_name(index, array)) return 0;
+
+    // Entry: i was just set to a non-negative int
+    if (!preceding) return 0;
+    Expr* start = NULL;
+    if (preceding->type == STMT_LET && strcmp(preceding->let.name.lexeme, index) == 0) {
+        start = preceding->let.initializer;
+    } else if (preceding->type == STMT_EXPR) {
+        start = assigned_value(preceding->expr.expression, index);
+    }
+    if (!is_nonnegative_int(start)) return 0;
+
+    // Body: ends with i = i + <non-negative int>, and nothing else touches i or a
+    Stmt* body = loop->body;
+    if (body->type != STMT_BLOCK || body->block.count == 0) return 0;
+    Stmt* last = body->block.statements[body->block.count - 1];
+    if (last->type != STMT_EXPR) return 0;
+    Expr* step = assigned_value(last->expr.expression, index);
+    if (!step || step->type != EXPR_BINARY || strcmp(step->binary.op.lexeme, "+") != 0 ||
+        !is_variable(step->binary.left, index) || !is_nonnegative_int(step->binary.right)) {
+        return 0;
+    }
+    for (int i = 0; i < body->block.count - 1; i++) {
+        if (!stmt_keeps_bounds(body->block.statements[i], array, index)) return 0;
+    }
+
+    proof->array = array;
+    proof->index = index;
+    return 1;
+}
+
+// Returns nonzero if an enclosing loop proved this access in bounds
+static int index_proven(IndexExpr* access) {
+    if (access->object->type != EXPR_VARIABLE || access->index->type != EXPR_VARIABLE) return 0;
+    for (int i = 0; i < proof_count; i++) {
+        if (is_variable(access->object, proofs[i].array) && is_variable(access->index, proofs[i].index)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ----------------------------
+// Conditions
+// ----------------------------
+
+/*
+ * Forward jumps whose target is not known yet are chained through their
+ * operands: each holds the index of the jump added before it, and the
+ * first holds -1. A chain is named by its last jump, or -1 when empty.
+ */
+static void emit_chained(OpCode opcode, int* chain) {
+    int site = bytecode->count;
+    emit(opcode, *chain);
+    *chain = site;
+}
+
+static void patch_chain(int chain, int target) {
+    while (chain >= 0) {
+        int next = bytecode->instructions[chain].operand;
+        bytecode->instructions[chain].operand = target;
+        chain = next;
+    }
+}
+
+static int is_logical(Expr* expr) {
+    if (expr->type != EXPR_BINARY) return 0;
+    const char* op = expr->binary.op.lexeme;
+    return strcmp(op, "&&") == 0 || strcmp(op, "||") == 0;
+}
+
+/*
+ * Compiles expr for its truth alone: control continues at a jump added
+ * to *chain when the truth equals when, and falls through otherwise.
+ * &&, || and ! only steer jumps, so they never push a value; every
+ * other expression pushes its value for one conditional jump to pop.
+ */
+static void compile_branch(Expr* expr, int when, int* chain) {
+    if (expr->type == EXPR_UNARY) {
+        compile_branch(expr->unary.operand, !when, chain);
+        return;
+    }
+    if (is_logical(expr)) {
+        int is_or = expr->binary.op.lexeme[0] == '|';
+        if (is_or == when) {
+            // Either side alone decides: a || b is true if a is
+            compile_branch(expr->binary.left, when, chain);
+            compile_branch(expr->binary.right, when, chain);
+        } else {
+            // The left side deciding the other way skips the right side
+            int skip = -1;
+            compile_branch(expr->binary.left, !when, &skip);
+            compile_branch(expr->binary.right, when, chain);
+            patch_chain(skip, bytecode->count);
+        }
+        return;
+    }
+    compile_expr(expr);
+    emit_chained(when ? BC_JUMP_IF_TRUE : BC_JUMP_IF_FALSE, chain);
+}
+
+/**
+ * Compiles an inlined call. Arguments are evaluated in order in the
+ * caller's scope, then bound to fresh slots named after the parameters;
+ * raising the floor hides the caller's locals from the body. The slots
+ * are released afterwards, so later inlines reuse them.
+ */
+static void compile_inline(InlineExpr* inlined) {
+    FnStmt* fn = inlined->callee;
+    int saved_count = current_fn->local_count;
+    int saved_floor = current_fn->floor;
+
+    for (int i = 0; i < fn->param_count; i++) {
+        if (inlined->args[i]) compile_expr(inlined->args[i]);
+    }
+
+    int saved_start = current_fn->scope_start;
+    current_fn->floor = current_fn->local_count;
+    current_fn->scope_start = current_fn->floor;
+    int slots[MAX_LOCALS];
+    for (int i = 0; i < fn->param_count; i++) {
+        if (inlined->args[i]) slots[i] = add_local(fn->params[i].lexeme);
+    }
+    for (int i = fn->param_count - 1; i >= 0; i--) {
+        if (inlined->args[i]) emit(BC_SET_LOCAL, slots[i]);
+    }
+
+    InlineState state;
+    state.jump_count = 0;
+    state.enclosing = current_inline;
+    current_inline = &state;
+
+    // A trailing return falls through to the end instead of jumping there
+    Stmt* body = inlined->body;
+    int count = body->block.count;
+    int ends_with_return = count > 0 && body->block.statements[count - 1]->type == STMT_RETURN;
+    compile_sequence(body->block.statements, ends_with_return ? count - 1 : count);
+    Expr* value = ends_with_return ? body->block.statements[count - 1]->return_stmt.value : NULL;
+    if (value) compile_expr(value);
+    else emit(BC_CONST, add_constant(INT_VAL(0)));
+
+    for (int i = 0; i < state.jump_count; i++) {
+        bytecode->instructions[state.jumps[i]].operand = bytecode->count;
+    }
+    current_inline = state.enclosing;
+    current_fn->local_count = saved_count;
+    current_fn->floor = saved_floor;
+    current_fn->scope_start = saved_start;
 }
 
 static void compile_expr(Expr* expr) {
     switch (expr->type) {
         case EXPR_LITERAL: {
-            int value = atoi(expr->literal.value.lexeme);
-            int idx = add_constant(value);
+            int idx = add_constant(literal_value(expr->literal.value));
             emit(BC_CONST, idx);
             break;
         }
         case EXPR_VARIABLE: {
-            int var_id = expr->variable.name.lexeme[0];
-            emit(BC_LOAD_VAR, var_id);
+            int slot = resolve_local(expr->variable.name.lexeme);
+            if (slot >= 0) {
+                emit_load(slot);
+                break;
+            }
+            int index = find_function(expr->variable.name.lexeme);
+            if (index >= 0) {
+                compile_function_value(index);
+                break;
+            }
+            emit(BC_LOAD_VAR, name_constant(expr->variable.name.lexeme));
             break;
         }
         case EXPR_BINARY: {
             const char* op = expr->binary.op.lexeme;
 
+            if (strcmp(op, "=") == 0 && expr->binary.left->type == EXPR_INDEX) {
+                IndexExpr* target = &expr->binary.left->index;
+                compile_expr(target->object);
+                compile_expr(target->index);
+                compile_expr(expr->binary.right);
+                emit(index_proven(target) ? BC_INDEX_SET_UNCHECKED : BC_INDEX_SET, 0);
+                return;
+            }
+            if (strcmp(op, "=") == 0 && expr->binary.left->type == EXPR_FIELD) {
+                FieldExpr* target = &expr->binary.left->field;
+                compile_expr(target->object);
+                compile_expr(expr->binary.right);
+                emit(BC_SET_FIELD, add_field_cache(target->name.lexeme));
+                return;
+            }
+            if (is_logical(expr)) {
+                // Materialize the 1 or 0 only at the very end
+                int when_false = -1;
+                compile_branch(expr, 0, &when_false);
+                emit(BC_CONST, add_constant(INT_VAL(1)));
+                int jump_end = bytecode->count;
+                emit(BC_JUMP, 0); // Placeholder
+                patch_chain(when_false, bytecode->count);
+                emit(BC_CONST, add_constant(INT_VAL(0)));
+                bytecode->instructions[jump_end].operand = bytecode->count;
+                return;
+            }
             if (strcmp(op, "=") == 0) {
                 if (expr->binary.left->type != EXPR_VARIABLE) {
                     fprintf(stderr, "Invalid assignment target\n");
                     exit(1);
                 }
+                const char* name = expr->binary.left->variable.name.lexeme;
                 compile_expr(expr->binary.right);
-                int var_id = expr->binary.left->variable.name.lexeme[0];
-                emit(BC_SET_VAR, var_id);
+                int slot = resolve_local(name);
+                if (slot >= 0) {
+                    emit_store(slot);
+                    return;
+                }
+                if (find_function(name) >= 0) {
+                    fprintf(stderr, "Cannot assign to function '%s'\n", name);
+                    exit(1);
+                }
+                emit(BC_SET_VAR, name_constant(name));
                 return;
             }
 
             compile_expr(expr->binary.left);
             compile_expr(expr->binary.right);
 
-            if (strcmp(op, "+") == 0) emit(BC_ADD, 0);
-            else if (strcmp(op, "-") == 0) emit(BC_SUB, 0);
-            else if (strcmp(op, "*") == 0) emit(BC_MUL, 0);
-            else if (strcmp(op, "/") == 0) emit(BC_DIV, 0);
-            else if (strcmp(op, "==") == 0) emit(BC_EQUAL, 0);
-            else if (strcmp(op, "!=") == 0) emit(BC_NOT_EQUAL, 0);
-            else if (strcmp(op, "<") == 0) emit(BC_LESS, 0);
-            else if (strcmp(op, "<=") == 0) emit(BC_LESS_EQUAL, 0);
-            else if (strcmp(op, ">") == 0) emit(BC_GREATER, 0);
-            else if (strcmp(op, ">=") == 0) emit(BC_GREATER_EQUAL, 0);
-            else {
+            int opcode = binary_opcode(op);
+            if (opcode < 0) {
                 fprintf(stderr, "Unknown binary operator: %s\n", op);
                 exit(1);
             }
+            emit((OpCode)opcode, 0);
+            break;
+        }
+        case EXPR_CALL: {
+            compile_call(&expr->call, BC_CALL);
+            break;
+        }
+        case EXPR_INLINE: {
+            compile_inline(&expr->inlined);
+            break;
+        }
+        case EXPR_ARRAY: {
+            for (int i = 0; i < expr->array.count; i++) {
+                compile_expr(expr->array.elements[i]);
+            }
+            emit(BC_ARRAY, expr->array.count);
+            break;
+        }
+        case EXPR_INDEX: {
+            compile_expr(expr->index.object);
+            compile_expr(expr->index.index);
+            emit(index_proven(&expr->index) ? BC_INDEX_GET_UNCHECKED : BC_INDEX_GET, 0);
+            break;
+        }
+        case EXPR_RECORD: {
+            for (int i = 0; i < expr->record.count; i++) {
+                compile_expr(expr->record.values[i]);
+            }
+            emit(BC_RECORD, shape_constant(&expr->record));
+            break;
+        }
+        case EXPR_FIELD: {
+            compile_expr(expr->field.object);
+            emit(BC_GET_FIELD, add_field_cache(expr->field.name.lexeme));
+            break;
+        }
+        case EXPR_UNARY: {
+            compile_expr(expr->unary.operand);
+            emit(BC_NOT, 0);
             break;
         }
         default:
@@ -75,12 +896,637 @@ static void compile_expr(Expr* expr) {
     }
 }
 
+// ----------------------------
+// Regions
+// ----------------------------
+
+/*
+ * A run of statements with an if or while in it, or with an operation
+ * that repeats, is built into a control flow graph (see ir.h), put in SSA
+ * form and lowered back to bytecode.
+ * The run ends at the first statement the IR does not model: calls of
+ * script functions and closures, inlined bodies, records, returns and
+ * functions, assignments inside expressions, variables nested functions
+ * capture, and globals inside functions or not yet defined by an earlier
+ * top-level let. Those are left to the tree walk.
+ *
+ * Variables of the code around the run are read and written in the IR;
+ * lets of blocks inside the run are variables of the IR alone.
+ */
+typedef struct {
+    IrFunction* fn;
+    int block;                      // Block being filled
+    int depth;                      // Blocks entered inside the run
+    const char* names[MAX_LOCALS];  // Lets of those blocks in scope, innermost last
+    int vars[MAX_LOCALS];           // Their IR variables
+    int name_count;
+    int scope_start;                // First let of the innermost block
+} Region;
+
+static Region* region = NULL;
+
+static int global_known(const char* name) {
+    for (int i = 0; i < known_count; i++) {
+        if (strcmp(known_globals[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void remember_global(const char* name) {
+    if (global_known(name)) return;
+    if (known_count >= known_capacity) {
+        known_capacity = known_capacity ? known_capacity * 2 : 16;
+        known_globals = jm_realloc(known_globals, sizeof(const char*) * known_capacity);
+    }
+    known_globals[known_count++] = name;
+}
+
+static void region_enter(int block) {
+    ir_start(region->fn, block);
+    region->block = block;
+}
+
+static int region_temp(const char* name) {
+    for (int i = region->name_count - 1; i >= 0; i--) {
+        if (strcmp(region->names[i], name) == 0) return region->vars[i];
+    }
+    return -1;
+}
+
+// The IR variable for a frame slot or global, made on first use
+static int home_var(IrVarKind kind, const char* name, int slot) {
+    IrFunction* fn = region->fn;
+    for (int i = 0; i < fn->var_count; i++) {
+        IrVar* var = &fn->vars[i];
+        if (var->kind == kind && (kind == IR_VAR_LOCAL ? var->slot == slot : strcmp(var->name, name) == 0)) return i;
+    }
+    return ir_var(fn, kind, name, slot);
+}
+
+// The variable name refers to, or -1 if the IR cannot hold it
+static int region_var(const char* name) {
+    int temp = region_temp(name);
+    if (temp >= 0) return temp;
+    int slot = resolve_local(name);
+    if (slot >= 0) {
+        if (current_fn->kinds[slot] != SLOT_VALUE || captured_local(name)) return -1;
+        return home_var(IR_VAR_LOCAL, name, slot);
+    }
+    if (in_function() || find_function(name) >= 0 || !global_known(name)) return -1;
+    return home_var(IR_VAR_GLOBAL, name, -1);
+}
+
+static int build_expr(Expr* expr);
+
+/*
+ * Builds expr for its truth alone, ending the current block with branches
+ * to if_true or if_false; like compile_branch, && || and ! only steer.
+ */
+static int build_cond(Expr* expr, int if_true, int if_false) {
+    if (expr->type == EXPR_UNARY) return build_cond(expr->unary.operand, if_false, if_true);
+    if (is_logical(expr)) {
+        int right = ir_block(region->fn);
+        int is_or = expr->binary.op.lexeme[0] == '|';
+        if (!build_cond(expr->binary.left, is_or ? if_true : right, is_or ? right : if_false)) return 0;
+        region_enter(right);
+        return build_cond(expr->binary.right, if_true, if_false);
+    }
+    int cond = build_expr(expr);
+    if (cond < 0) return 0;
+    ir_branch(region->fn, region->block, cond, if_true, if_false);
+    return 1;
+}
+
+// Natives and builtins, folded like compile_native_call and compile_builtin_call do
+static int build_call(CallExpr* call) {
+    IrFunction* fn = region->fn;
+    if (call->callee->type != EXPR_VARIABLE) return -1;
+    const char* name = call->callee->variable.name.lexeme;
+    if (region_temp(name) >= 0 || resolve_local(name) >= 0 || find_function(name) >= 0) return -1;
+    int native = find_native(name);
+    int builtin = native < 0 && find_builtin(name) >= 0 ? find_builtin_call(name, call->arg_count) : -1;
+    if (native >= 0 ? natives[native].arity != call->arg_count :
+        builtin < 0 || builtins[builtin].arity != call->arg_count) {
+        return -1;
+    }
+
+    int args[NATIVE_MAX_ARITY];
+    Value values[NATIVE_MAX_ARITY];
+    int constant = 1;
+    for (int i = 0; i < call->arg_count; i++) {
+        args[i] = build_expr(call->args[i]);
+        if (args[i] < 0) return -1;
+        constant = constant && fn->instrs[args[i]].kind == IR_CONST;
+        if (constant) values[i] = fn->instrs[args[i]].value;
+    }
+    if (native >= 0) {
+        if ((natives[native].flags & JM_NATIVE_PURE) && constant) {
+            Value result = natives[native].function(values);
+            if (immutable_result(result)) return ir_const(fn, region->block, result);
+        }
+        return ir_op(fn, region->block, BC_CALL_NATIVE, native, args, call->arg_count);
+    }
+    OpCode opcode = builtin_opcode(&builtins[builtin]);
+    if (opcode == BC_MIN || opcode == BC_MAX || opcode == BC_ABS) {
+        for (int i = 0; i < call->arg_count && constant; i++) constant = is_number(values[i]);
+        if (constant) return ir_const(fn, region->block, builtins[builtin].function(values));
+    }
+    return ir_op(fn, region->block, opcode, opcode == BC_CALL_BUILTIN ? builtin : 0, args, call->arg_count);
+}
+
+// The value of expr, or -1 if the IR cannot hold it
+static int build_expr(Expr* expr) {
+    IrFunction* fn = region->fn;
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            return ir_const(fn, region->block, literal_value(expr->literal.value));
+        case EXPR_VARIABLE: {
+            int var = region_var(expr->variable.name.lexeme);
+            return var < 0 ? -1 : ir_get_var(fn, region->block, var);
+        }
+        case EXPR_UNARY: {
+            int operand = build_expr(expr->unary.operand);
+            return operand < 0 ? -1 : ir_op(fn, region->block, BC_NOT, 0, &operand, 1);
+        }
+        case EXPR_BINARY: {
+            if (is_logical(expr)) {
+                // The 1 or 0 is a variable of its own, assigned on each side
+                int result = ir_var(fn, IR_VAR_TEMP, expr->binary.op.lexeme, -1);
+                int when_true = ir_block(fn);
+                int when_false = ir_block(fn);
+                int end = ir_block(fn);
+                if (!build_cond(expr, when_true, when_false)) return -1;
+                region_enter(when_true);
+                ir_set_var(fn, when_true, result, ir_const(fn, when_true, INT_VAL(1)));
+                ir_jump(fn, when_true, end);
+                region_enter(when_false);
+                ir_set_var(fn, when_false, result, ir_const(fn, when_false, INT_VAL(0)));
+                ir_jump(fn, when_false, end);
+                region_enter(end);
+                return ir_get_var(fn, end, result);
+            }
+            // Assignments are only built as statements
+            int opcode = binary_opcode(expr->binary.op.lexeme);
+            if (opcode < 0) return -1;
+            int args[2];
+            if ((args[0] = build_expr(expr->binary.left)) < 0) return -1;
+            if ((args[1] = build_expr(expr->binary.right)) < 0) return -1;
+            return ir_op(fn, region->block, (OpCode)opcode, 0, args, 2);
+        }
+        case EXPR_CALL:
+            return build_call(&expr->call);
+        case EXPR_ARRAY: {
+            int* args = jm_alloc(sizeof(int) * (expr->array.count > 0 ? expr->array.count : 1));
+            for (int i = 0; i < expr->array.count; i++) {
+                if ((args[i] = build_expr(expr->array.elements[i])) < 0) {
+                    jm_free(args);
+                    return -1;
+                }
+            }
+            int array = ir_op(fn, region->block, BC_ARRAY, expr->array.count, args, expr->array.count);
+            jm_free(args);
+            return array;
+        }
+        case EXPR_INDEX: {
+            int args[2];
+            if ((args[0] = build_expr(expr->index.object)) < 0) return -1;
+            if ((args[1] = build_expr(expr->index.index)) < 0) return -1;
+            OpCode opcode = index_proven(&expr->index) ? BC_INDEX_GET_UNCHECKED : BC_INDEX_GET;
+            return ir_op(fn, region->block, opcode, 0, args, 2);
+        }
+        default:
+            return -1;
+    }
+}
+
+static int build_let(LetStmt* let) {
+    IrFunction* fn = region->fn;
+    const char* name = let->name.lexeme;
+    int value = build_expr(let->initializer);
+    if (value < 0) return 0;
+    int var = -1;
+    if (region->depth > 0) {
+        // Redefinition in the same block is the same variable
+        for (int i = region->name_count - 1; i >= region->scope_start && var < 0; i--) {
+            if (strcmp(region->names[i], name) == 0) var = region->vars[i];
+        }
+        if (var < 0) {
+            if (region->name_count >= MAX_LOCALS) return 0;
+            var = ir_var(fn, IR_VAR_TEMP, name, -1);
+            region->names[region->name_count] = name;
+            region->vars[region->name_count++] = var;
+        }
+    } else if (in_function() || current_fn->block_depth > 0) {
+        // A let of the enclosing block: its slot outlives the run
+        if (captured_local(name)) return 0;
+        int slot = resolve_in_block(name);
+        if (slot < 0) {
+            if (current_fn->local_count >= MAX_LOCALS) return 0;
+            slot = add_local(name);
+        }
+        if (current_fn->kinds[slot] != SLOT_VALUE) return 0;
+        var = home_var(IR_VAR_LOCAL, name, slot);
+    } else {
+        var = home_var(IR_VAR_GLOBAL, name, -1);
+        fn->vars[var].defined = 1;
+        remember_global(name);
+    }
+    ir_set_var(fn, region->block, var, value);
+    return 1;
+}
+
+static int build_assignment(BinaryExpr* assign) {
+    IrFunction* fn = region->fn;
+    Expr* target = assign->left;
+    if (target->type == EXPR_INDEX) {
+        int args[3];
+        if ((args[0] = build_expr(target->index.object)) < 0) return 0;
+        if ((args[1] = build_expr(target->index.index)) < 0) return 0;
+        if ((args[2] = build_expr(assign->right)) < 0) return 0;
+        ir_op(fn, region->block, index_proven(&target->index) ? BC_INDEX_SET_UNCHECKED : BC_INDEX_SET, 0, args, 3);
+        return 1;
+    }
+    if (target->type != EXPR_VARIABLE) return 0;
+    int value = build_expr(assign->right);
+    int var = value < 0 ? -1 : region_var(target->variable.name.lexeme);
+    if (var < 0) return 0;
+    ir_set_var(fn, region->block, var, value);
+    return 1;
+}
+
+static int build_stmt(Stmt* stmt, Stmt* preceding);
+
+// The body of an if or while; a bare let there would define a global on one path only
+static int build_branch(Stmt* stmt) {
+    return stmt->type != STMT_LET && build_stmt(stmt, NULL);
+}
+
+static int build_while(WhileStmt* loop, Stmt* preceding) {
+    IrFunction* fn = region->fn;
+    int proven = proof_count < MAX_PROVEN_LOOPS && prove_bounds(preceding, loop, &proofs[proof_count]);
+    if (proven) proof_count++;
+
+    int header = ir_block(fn);
+    int body = ir_block(fn);
+    int end = ir_block(fn);
+    ir_jump(fn, region->block, header);
+    region_enter(header);
+    int built = build_cond(loop->condition, body, end);
+    if (built) {
+        region_enter(body);
+        built = build_branch(loop->body);
+    }
+    if (built) {
+        ir_jump(fn, region->block, header);
+        region_enter(end);
+    }
+    if (proven) proof_count--;
+    return built;
+}
+
+// Returns 0 if the IR cannot hold the statement (the region is then rebuilt without it)
+static int build_stmt(Stmt* stmt, Stmt* preceding) {
+    IrFunction* fn = region->fn;
+    switch (stmt->type) {
+        case STMT_LET:
+            return build_let(&stmt->let);
+        case STMT_YAP: {
+            int value = build_expr(stmt->yap.expression);
+            if (value < 0) return 0;
+            ir_op(fn, region->block, BC_PRINT, 0, &value, 1);
+            return 1;
+        }
+        case STMT_EXPR: {
+            Expr* expr = stmt->expr.expression;
+            if (expr->type == EXPR_BINARY && strcmp(expr->binary.op.lexeme, "=") == 0) {
+                return build_assignment(&expr->binary);
+            }
+            // The value is dropped; SSA construction keeps what has effects
+            return build_expr(expr) >= 0;
+        }
+        case STMT_IF: {
+            int then_block = ir_block(fn);
+            int else_block = stmt->if_stmt.else_branch ? ir_block(fn) : -1;
+            int end = ir_block(fn);
+            if (!build_cond(stmt->if_stmt.condition, then_block, else_block >= 0 ? else_block : end)) return 0;
+            region_enter(then_block);
+            if (!build_branch(stmt->if_stmt.then_branch)) return 0;
+            ir_jump(fn, region->block, end);
+            if (else_block >= 0) {
+                region_enter(else_block);
+                if (!build_branch(stmt->if_stmt.else_branch)) return 0;
+                ir_jump(fn, region->block, end);
+            }
+            region_enter(end);
+            return 1;
+        }
+        case STMT_WHILE:
+            return build_while(&stmt->while_stmt, preceding);
+        case STMT_BLOCK: {
+            int saved_count = region->name_count;
+            int saved_start = region->scope_start;
+            region->scope_start = saved_count;
+            region->depth++;
+            int built = 1;
+            for (int i = 0; i < stmt->block.count && built; i++) {
+                built = build_stmt(stmt->block.statements[i], i > 0 ? stmt->block.statements[i - 1] : NULL);
+            }
+            region->depth--;
+            region->scope_start = saved_start;
+            region->name_count = saved_count;
+            return built;
+        }
+        default:
+            return 0;
+    }
+}
+
+// Builds stmts from start on until one cannot be built; returns where that stopped
+static int build_run(Region* state, Stmt** stmts, int start, int limit) {
+    state->fn = ir_new();
+    state->block = 0;
+    state->depth = 0;
+    state->name_count = 0;
+    state->scope_start = 0;
+    region = state;
+    int end = start;
+    while (end < limit && build_stmt(stmts[end], end > 0 ? stmts[end - 1] : NULL)) end++;
+    return end;
+}
+
+// Returns nonzero if name occurs anywhere in the expression
+static int expr_mentions(Expr* expr, const char* name);
+
+static int stmt_mentions(Stmt* stmt, const char* name) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case STMT_EXPR: return expr_mentions(stmt->expr.expression, name);
+        case STMT_LET: return same_name(stmt->let.name.lexeme, name) || expr_mentions(stmt->let.initializer, name);
+        case STMT_YAP: return expr_mentions(stmt->yap.expression, name);
+        case STMT_RETURN: return expr_mentions(stmt->return_stmt.value, name);
+        case STMT_IF:
+            return expr_mentions(stmt->if_stmt.condition, name) || stmt_mentions(stmt->if_stmt.then_branch, name) ||
+                   stmt_mentions(stmt->if_stmt.else_branch, name);
+        case STMT_WHILE:
+            return expr_mentions(stmt->while_stmt.condition, name) || stmt_mentions(stmt->while_stmt.body, name);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (stmt_mentions(stmt->block.statements[i], name)) return 1;
+            }
+            return 0;
+        default:
+            // A function's body may not be parsed yet
+            return 1;
+    }
+}
+
+static int expr_mentions(Expr* expr, const char* name) {
+    if (!expr) return 0;
+    switch (expr->type) {
+        case EXPR_VARIABLE: return same_name(expr->variable.name.lexeme, name);
+        case EXPR_BINARY: return expr_mentions(expr->binary.left, name) || expr_mentions(expr->binary.right, name);
+        case EXPR_UNARY: return expr_mentions(expr->unary.operand, name);
+        case EXPR_CALL:
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                if (expr_mentions(expr->call.args[i], name)) return 1;
+            }
+            return expr_mentions(expr->call.callee, name);
+        case EXPR_INLINE:
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                if (expr_mentions(expr->inlined.args[i], name)) return 1;
+            }
+            return stmt_mentions(expr->inlined.body, name);
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                if (expr_mentions(expr->array.elements[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_INDEX: return expr_mentions(expr->index.object, name) || expr_mentions(expr->index.index, name);
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                if (expr_mentions(expr->record.values[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_FIELD: return expr_mentions(expr->field.object, name);
+        default:
+            return 0;
+    }
+}
+
+/*
+ * The block's locals die with it (for a function body, every slot does):
+ * the exit stores none that the rest of the block, stmts[end] to
+ * stmts[count - 1], never mentions. A run that ends its block needs no
+ * slots for its own lets at all.
+ */
+static void end_block(IrFunction* fn, int first_new, Stmt** stmts, int end, int count) {
+    int first_dead = in_function() && current_fn->block_depth == 1 ? 0 : current_fn->scope_start;
+    for (int i = 0; i < fn->var_count; i++) {
+        IrVar* var = &fn->vars[i];
+        if (var->kind != IR_VAR_LOCAL || var->slot < first_dead) continue;
+        int mentioned = 0;
+        for (int k = end; k < count && !mentioned; k++) mentioned = stmt_mentions(stmts[k], var->name);
+        if (mentioned) continue;
+        if (end == count && var->slot >= first_new) var->kind = IR_VAR_TEMP;
+        else var->dead = 1;
+    }
+    if (end == count) current_fn->local_count = first_new;
+}
+
+// Nonzero if both apply the same operators to the same variables and literals
+static int same_expr(Expr* a, Expr* b) {
+    if (!a || !b || a->type != b->type) return 0;
+    switch (a->type) {
+        case EXPR_LITERAL:
+            return a->literal.value.type == b->literal.value.type &&
+                   same_name(a->literal.value.lexeme, b->literal.value.lexeme);
+        case EXPR_VARIABLE: return same_name(a->variable.name.lexeme, b->variable.name.lexeme);
+        case EXPR_BINARY: {
+            const char* op = a->binary.op.lexeme;
+            if (!same_name(op, b->binary.op.lexeme)) return 0;
+            if (same_expr(a->binary.left, b->binary.left) && same_expr(a->binary.right, b->binary.right)) return 1;
+            // The operators value numbering takes in either order
+            int commutes = same_name(op, "*") || same_name(op, "&") || same_name(op, "|") || same_name(op, "^") ||
+                           same_name(op, "==") || same_name(op, "!=");
+            return commutes && same_expr(a->binary.left, b->binary.right) && same_expr(a->binary.right, b->binary.left);
+        }
+        case EXPR_UNARY: return same_name(a->unary.op.lexeme, b->unary.op.lexeme) && same_expr(a->unary.operand, b->unary.operand);
+        case EXPR_INDEX: return same_expr(a->index.object, b->index.object) && same_expr(a->index.index, b->index.index);
+        default:
+            return 0;
+    }
+}
+
+#define MAX_OPERATIONS 64
+
+// Operations met so far in a run, in order
+typedef struct {
+    Expr* seen[MAX_OPERATIONS];
+    int count;
+} Operations;
+
+// Nonzero if an operation in expr repeats one met before it
+static int repeats_expr(Expr* expr, Operations* ops) {
+    if (!expr) return 0;
+    switch (expr->type) {
+        case EXPR_BINARY:
+            if (same_name(expr->binary.op.lexeme, "=")) return repeats_expr(expr->binary.right, ops);
+            if (repeats_expr(expr->binary.left, ops) || repeats_expr(expr->binary.right, ops)) return 1;
+            break;
+        case EXPR_UNARY:
+            if (repeats_expr(expr->unary.operand, ops)) return 1;
+            break;
+        case EXPR_INDEX:
+            if (repeats_expr(expr->index.object, ops) || repeats_expr(expr->index.index, ops)) return 1;
+            break;
+        case EXPR_CALL:
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                if (repeats_expr(expr->call.args[i], ops)) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+    for (int i = 0; i < ops->count; i++) {
+        if (same_expr(ops->seen[i], expr)) return 1;
+    }
+    if (ops->count < MAX_OPERATIONS) ops->seen[ops->count++] = expr;
+    return 0;
+}
+
+static int repeats_stmt(Stmt* stmt, Operations* ops) {
+    switch (stmt->type) {
+        case STMT_EXPR: return repeats_expr(stmt->expr.expression, ops);
+        case STMT_LET: return repeats_expr(stmt->let.initializer, ops);
+        case STMT_YAP: return repeats_expr(stmt->yap.expression, ops);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (repeats_stmt(stmt->block.statements[i], ops)) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Compiles the statements from stmts[start] on through the IR while they
+ * can be built, if there is control flow among them or an operation
+ * repeats. Returns how many it compiled; *plain is how many statements
+ * from there on the tree walk should compile (those starting a run would
+ * stop at the same place).
+ */
+static int compile_region(Stmt** stmts, int start, int count, int* plain) {
+    *plain = 1;
+    if (current_inline) return 0;
+    int saved_locals = current_fn->local_count;
+    int saved_max = current_fn->max_count;
+    int saved_known = known_count;
+    int saved_proofs = proof_count;
+
+    Region state;
+    int end = build_run(&state, stmts, start, count);
+    if (end < count) {
+        // The statement that failed may have left blocks half built
+        ir_free(state.fn);
+        current_fn->local_count = saved_locals;
+        current_fn->max_count = saved_max;
+        known_count = saved_known;
+        proof_count = saved_proofs;
+        build_run(&state, stmts, start, end);
+    }
+
+    int flow = 0;
+    for (int i = start; i < end; i++) flow |= stmts[i]->type == STMT_IF || stmts[i]->type == STMT_WHILE;
+    // Straight-line code is worth it when value numbering has work to do
+    Operations ops;
+    ops.count = 0;
+    for (int i = start; i < end && !flow; i++) flow = repeats_stmt(stmts[i], &ops);
+    int compiled = 0;
+    if (flow) {
+        if (in_function() || current_fn->block_depth > 0) {
+            end_block(state.fn, saved_locals, stmts, end, count);
+            if (end == count) current_fn->max_count = saved_max;
+        }
+        ir_exit(state.fn, state.block);
+        ir_build_ssa(state.fn);
+        ir_optimize(state.fn);
+        int first = current_fn->local_count;
+        int slots = ir_lower(state.fn, bytecode, first, MAX_LOCALS);
+        if (slots >= 0) {
+            compiled = end - start;
+            if (first + slots > current_fn->max_count) current_fn->max_count = first + slots;
+        }
+    }
+    if (!compiled) {
+        current_fn->local_count = saved_locals;
+        current_fn->max_count = saved_max;
+        known_count = saved_known;
+        *plain = end - start + (end < count);
+        if (*plain < 1) *plain = 1;
+    }
+    proof_count = saved_proofs;
+    ir_free(state.fn);
+    region = NULL;
+    return compiled;
+}
+
+/**
+ * Compiles a loop. preceding is the statement just before it in the same
+ * sequence (or NULL), which may establish the loop's bounds proof.
+ */
+static void compile_while(WhileStmt* loop, Stmt* preceding) {
+    int proven = proof_count < MAX_PROVEN_LOOPS && prove_bounds(preceding, loop, &proofs[proof_count]);
+    if (proven) proof_count++;
+
+    int loop_start = bytecode->count;
+    int jump_out = -1;
+    compile_branch(loop->condition, 0, &jump_out);
+
+    compile_stmt(loop->body);
+
+    emit(BC_JUMP, loop_start);
+    patch_chain(jump_out, bytecode->count);
+    if (proven) proof_count--;
+}
+
+// Compiles stmts[i] by the tree walk
+static void compile_plain(Stmt** stmts, int i) {
+    if (stmts[i]->type == STMT_WHILE) {
+        compile_while(&stmts[i]->while_stmt, i > 0 ? stmts[i - 1] : NULL);
+        return;
+    }
+    compile_stmt(stmts[i]);
+    // Top-level lets run unconditionally, so later regions may use the global
+    if (stmts[i]->type == STMT_LET && !in_function() && !current_inline && current_fn->block_depth == 0) {
+        remember_global(stmts[i]->let.name.lexeme);
+    }
+}
+
+static void compile_sequence(Stmt** stmts, int count) {
+    int i = 0;
+    while (i < count) {
+        int plain;
+        i += compile_region(stmts, i, count, &plain);
+        for (int end = i + plain; i < end && i < count; i++) compile_plain(stmts, i);
+    }
+}
+
 static void compile_stmt(Stmt* stmt) {
     switch (stmt->type) {
         case STMT_LET: {
+            const char* name = stmt->let.name.lexeme;
             compile_expr(stmt->let.initializer);
-            int var_id = stmt->let.name.lexeme[0];
-            emit(BC_DEFINE_VAR, var_id);
+            if (in_function() || current_inline || current_fn->block_depth > 0) {
+                // Variables nested functions capture have one slot for the
+                // whole function; redefinition in the same block reuses
+                // the slot; anything else gets a slot of this block
+                int slot = captured_local(name) ? resolve_local(name) : resolve_in_block(name);
+                if (slot < 0) slot = add_local(name);
+                emit_store(slot);
+                break;
+            }
+            emit(BC_DEFINE_VAR, name_constant(stmt->let.name.lexeme));
             break;
         }
         case STMT_YAP: {
@@ -89,43 +1535,86 @@ static void compile_stmt(Stmt* stmt) {
             break;
         }
         case STMT_EXPR: {
-            compile_expr(stmt->expr.expression);
+            Expr* expr = stmt->expr.expression;
+            compile_expr(expr);
+            // Assignments consume their value; anything else leaves one behind
+            if (!(expr->type == EXPR_BINARY && strcmp(expr->binary.op.lexeme, "=") == 0)) {
+                emit(BC_POP, 0);
+            }
             break;
         }
         case STMT_IF: {
-            compile_expr(stmt->if_stmt.condition);
-            int jump_if_false = bytecode->count;
-            emit(BC_JUMP_IF_FALSE, 0); // Placeholder
+            int jump_if_false = -1;
+            compile_branch(stmt->if_stmt.condition, 0, &jump_if_false);
 
             compile_stmt(stmt->if_stmt.then_branch);
 
             if (stmt->if_stmt.else_branch) {
                 int jump_end = bytecode->count;
                 emit(BC_JUMP, 0); // Placeholder
-                bytecode->instructions[jump_if_false].operand = bytecode->count;
+                patch_chain(jump_if_false, bytecode->count);
                 compile_stmt(stmt->if_stmt.else_branch);
                 bytecode->instructions[jump_end].operand = bytecode->count;
             } else {
-                bytecode->instructions[jump_if_false].operand = bytecode->count;
+                patch_chain(jump_if_false, bytecode->count);
             }
             break;
         }
         case STMT_WHILE: {
-            int loop_start = bytecode->count;
-            compile_expr(stmt->while_stmt.condition);
-            int jump_out = bytecode->count;
-            emit(BC_JUMP_IF_FALSE, 0); // Placeholder
-
-            compile_stmt(stmt->while_stmt.body);
-
-            emit(BC_JUMP, loop_start);
-            bytecode->instructions[jump_out].operand = bytecode->count;
+            compile_while(&stmt->while_stmt, NULL);
             break;
         }
         case STMT_BLOCK: {
-            for (int i = 0; i < stmt->block.count; i++) {
-                compile_stmt(stmt->block.statements[i]);
+            // The block's locals are released at its end for later blocks
+            // (and the next iteration of a loop body) to reuse
+            int saved_count = current_fn->local_count;
+            int saved_start = current_fn->scope_start;
+            current_fn->scope_start = saved_count;
+            current_fn->block_depth++;
+            compile_sequence(stmt->block.statements, stmt->block.count);
+            current_fn->block_depth--;
+            current_fn->scope_start = saved_start;
+            current_fn->local_count = saved_count;
+            break;
+        }
+        case STMT_FN: {
+            // Nested functions were declared by capture analysis
+            if (in_function()) break;
+            // Functions inside top-level blocks are declared when reached;
+            // no code is emitted, bodies are compiled on their first call
+            if (find_function(stmt->fn.name.lexeme) < 0) {
+                declare_function(&stmt->fn, -1);
+            }
+            break;
+        }
+        case STMT_RETURN: {
+            Expr* value = stmt->return_stmt.value;
+            if (current_inline) {
+                // Leave the result on the stack and jump to the end of the inlined body
+                if (value) compile_expr(value);
+                else emit(BC_CONST, add_constant(INT_VAL(0)));
+                if (current_inline->jump_count >= MAX_INLINE_RETURNS) {
+                    fprintf(stderr, "Too many returns in inlined function\n");
+                    exit(1);
+                }
+                current_inline->jumps[current_inline->jump_count++] = bytecode->count;
+                emit(BC_JUMP, 0); // Placeholder
+                break;
+            }
+            if (!in_function()) {
+                fprintf(stderr, "Cannot return from top-level code\n");
+                exit(1);
             }
+            if (value && value->type == EXPR_CALL) {
+                // Tail position: the callee takes over this frame and
+                // its BC_RETURN goes straight back to our caller
+                compile_call(&value->call, BC_TAIL_CALL);
+            } else if (value) {
+                compile_expr(value);
+            } else {
+                emit(BC_CONST, add_constant(INT_VAL(0)));
+            }
+            emit(BC_RETURN, 0);
             break;
         }
         default:
@@ -134,26 +1623,232 @@ static void compile_stmt(Stmt* stmt) {
     }
 }
 
+/*
+ * Change in operand stack depth made by instr, read from what the VM's
+ * case for it pops and pushes.
+ */
+static int stack_effect(Instruction instr) {
+    switch (instr.opcode) {
+        case BC_CONST:
+        case BC_LOAD_CONST:
+        case BC_LOAD_VAR:
+        case BC_LOAD_LOCAL:
+        case BC_LOAD_UPVALUE:
+        case BC_REF_LOCAL:
+        case BC_LOAD_REF:
+            return 1;
+        case BC_ABS:
+        case BC_NOT:
+        case BC_IS_INTEGER:
+        case BC_NEW_UPVALUE:
+        case BC_GET_FIELD:
+        case BC_JUMP:
+        case BC_LOOP:
+        case BC_TAIL_CALL:
+        case BC_HALT:
+            return 0;
+        case BC_SET_FIELD:
+            return -2;
+        case BC_INDEX_SET:
+        case BC_INDEX_SET_UNCHECKED:
+        case BC_MAP_SET:
+            return -3;
+        case BC_CALL: {
+            Function* fn = &bytecode->functions[instr.operand];
+            return 1 - fn->arity - fn->capture_count;
+        }
+        case BC_CALL_BUILTIN:
+            return 1 - builtins[instr.operand].arity;
+        case BC_CALL_NATIVE:
+            return 1 - natives[instr.operand].arity;
+        case BC_CLOSURE:
+            return 1 - bytecode->functions[instr.operand].capture_count;
+        case BC_CALL_CLOSURE:
+            return -instr.operand;
+        case BC_ARRAY:
+            return 1 - instr.operand;
+        case BC_RECORD:
+            return 1 - ((ObjShape*)AS_OBJ(bytecode->constants[instr.operand]))->field_count;
+        default:
+            // Binary operators, stores, pops, prints, conditional jumps
+            // and returns each pop one value
+            return -1;
+    }
+}
+
+/*
+ * Deepest the operand stack gets above the frame slots in the code from
+ * start to the end of the instructions, following every path from start.
+ * The compiler leaves each instruction at one depth whichever way it is
+ * reached, so each is visited once.
+ */
+static int max_stack(int start) {
+    int count = bytecode->count - start;
+    int* depth = jm_alloc(sizeof(int) * count);
+    int* work = jm_alloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++) depth[i] = -1;
+    int pending = 0;
+    int peak = 0;
+    depth[0] = 0;
+    work[pending++] = 0;
+    while (pending > 0) {
+        int i = work[--pending];
+        Instruction instr = bytecode->instructions[start + i];
+        int after = depth[i] + stack_effect(instr);
+        if (after > peak) peak = after;
+
+        int next[2];
+        int next_count = 0;
+        switch (instr.opcode) {
+            case BC_JUMP:
+            case BC_LOOP:
+                next[next_count++] = instr.operand - start;
+                break;
+            case BC_JUMP_IF_FALSE:
+            case BC_JUMP_IF_TRUE:
+                next[next_count++] = instr.operand - start;
+                next[next_count++] = i + 1;
+                break;
+            case BC_TAIL_CALL:
+            case BC_RETURN:
+            case BC_HALT:
+                break;
+            default:
+                next[next_count++] = i + 1;
+        }
+        for (int k = 0; k < next_count; k++) {
+            if (next[k] >= count || depth[next[k]] >= 0) continue;
+            depth[next[k]] = after;
+            work[pending++] = next[k];
+        }
+    }
+    jm_free(depth);
+    jm_free(work);
+    return peak;
+}
+
 Bytecode* compile(Stmt** stmts, int stmt_count) {
-    bytecode = malloc(sizeof(Bytecode));
-    bytecode->instructions = malloc(sizeof(Instruction) * 128);
+    static int next_id = 1;
+    bytecode = jm_alloc(sizeof(Bytecode));
+    bytecode->id = next_id++;
+    bytecode->instructions = jm_alloc(sizeof(Instruction) * 128);
     bytecode->capacity = 128;
     bytecode->count = 0;
 
-    bytecode->constants = malloc(sizeof(int) * 128);
+    bytecode->constants = jm_alloc(sizeof(Value) * 128);
     bytecode->const_capacity = 128;
     bytecode->const_count = 0;
 
+    bytecode->functions = jm_alloc(sizeof(Function) * 8);
+    bytecode->function_capacity = 8;
+    bytecode->function_count = 0;
+
+    bytecode->field_caches = jm_alloc(sizeof(FieldCache) * 8);
+    bytecode->field_cache_capacity = 8;
+    bytecode->field_cache_count = 0;
+
+    // Declare every top-level function first so calls may precede definitions
     for (int i = 0; i < stmt_count; i++) {
-        compile_stmt(stmts[i]);
+        if (stmts[i]->type == STMT_FN) declare_function(&stmts[i]->fn, -1);
     }
 
+    // Inline small functions and fold constants before generating code
+    optimize(stmts, stmt_count, -1);
+
+    script.local_count = 0;
+    script.max_count = 0;
+    script.floor = 0;
+    script.scope_start = 0;
+    script.block_depth = 0;
+    script.function = -1;
+    current_fn = &script;
+    current_inline = NULL;
+
+    proof_count = 0;
+    known_count = 0;
+    memset(&ir_stats, 0, sizeof(ir_stats));
+    compile_sequence(stmts, stmt_count);
+
+    // Function bodies never read the list, and the next program may be
+    // compiled under another allocator
+    jm_free(known_globals);
+    known_globals = NULL;
+    known_capacity = 0;
+
     emit(BC_HALT, 0);
+    bytecode->local_count = script.max_count;
+    bytecode->max_stack = max_stack(0);
     return bytecode;
 }
 
+void compile_function(Bytecode* bc, int index) {
+    bytecode = bc;
+    FnStmt* fn = bc->functions[index].decl;
+
+    // Parse the body on first use and optimize it like top-level code;
+    // functions nested in a top-level function are analyzed together first
+    if (!fn->body && !parse_function_body(fn)) {
+        fprintf(stderr, "Syntax error in function '%s'\n", fn->name.lexeme);
+        exit(1);
+    }
+    if (bc->functions[index].parent < 0) analyze_nested(index);
+    optimize(&fn->body, 1, index);
+
+    // Bodies are appended after everything compiled so far
+    Function* function = &bc->functions[index];
+    function->entry = bc->count;
+
+    FunctionState state;
+    state.local_count = 0;
+    state.max_count = 0;
+    state.floor = 0;
+    state.scope_start = 0;
+    state.block_depth = 0;
+    state.function = index;
+    current_fn = &state;
+    current_inline = NULL;
+    proof_count = 0;
+    for (int i = 0; i < fn->param_count; i++) {
+        add_local(fn->params[i].lexeme);
+    }
+    for (int i = 0; i < function->capture_count; i++) {
+        int slot = add_local(function->captures[i].name);
+        if (function->captures[i].mode == CAPTURE_REF) state.kinds[slot] = SLOT_REF;
+        if (function->captures[i].mode == CAPTURE_UPVALUE) state.kinds[slot] = SLOT_UPVALUE;
+    }
+    // Captured locals get their slots up front, since a nested function
+    // may be called before their let; boxed ones start with a cell
+    for (int i = 0; i < function->captured_count; i++) {
+        Capture* variable = &function->captured[i];
+        int slot = resolve_local(variable->name);
+        if (slot < 0) slot = add_local(variable->name);
+        if (variable->mode != CAPTURE_UPVALUE) continue;
+        if (slot < fn->param_count) emit(BC_LOAD_LOCAL, slot);
+        else emit(BC_CONST, add_constant(INT_VAL(0)));
+        emit(BC_NEW_UPVALUE, 0);
+        emit(BC_SET_LOCAL, slot);
+        state.kinds[slot] = SLOT_UPVALUE;
+    }
+    compile_stmt(fn->body);
+
+    // Falling off the end of the body returns 0
+    emit(BC_CONST, add_constant(INT_VAL(0)));
+    emit(BC_RETURN, 0);
+    current_fn = &script;
+
+    bc->functions[index].local_count = state.max_count;
+    bc->functions[index].max_stack = max_stack(bc->functions[index].entry);
+}
+
 void free_bytecode(Bytecode* bc) {
-    free(bc->instructions);
-    free(bc->constants);
-    free(bc);
+    for (int i = 0; i < bc->function_count; i++) {
+        jm_free(bc->functions[i].name);
+        jm_free(bc->functions[i].captures);
+        jm_free(bc->functions[i].captured);
+    }
+    jm_free(bc->functions);
+    jm_free(bc->instructions);
+    jm_free(bc->constants);
+    jm_free(bc->field_caches);
+    jm_free(bc);
 }
@@ -26,9 +26,11 @@
  * - Operand: Additional data (constant index, jump target, etc.)
  * 
  * Compilation Process:
+ * 0. Run AST optimizations (inlining, constant folding; see optimizer.h)
  * 1. Traverse AST nodes in post-order
  * 2. Generate instructions for each node type
- * 3. Resolve jump targets for control flow
+ * 3. Resolve jump targets for control flow; in counted loops over
+ *    len(a), prove a[i] in bounds and emit the unchecked index ops
  * 4. Build constant table for literals
  * 5. Produce linear bytecode sequence
  * 
@@ -43,6 +45,10 @@
 #define COMPILER_H
 
 #include "parser.h"
+#include "capture.h"
+#include "value.h"
+#include "object.h"
+#include "str.h"
 
 /**
  * @brief Enumeration of all bytecode instruction types
@@ -65,6 +71,17 @@ typedef enum {
     BC_SUB,          ///< Subtract top two stack values: b - a
     BC_MUL,          ///< Multiply top two stack values: b * a
     BC_DIV,          ///< Divide top two stack values: b / a
+    BC_MOD,          ///< Remainder of top two stack values: b % a
+    BC_BIT_AND,      ///< Bitwise and of top two ints: b & a
+    BC_BIT_OR,       ///< Bitwise or of top two ints: b | a
+    BC_BIT_XOR,      ///< Bitwise xor of top two ints: b ^ a
+    BC_SHIFT_LEFT,   ///< Shift int b left by a bits
+    BC_SHIFT_RIGHT,  ///< Shift int b right by a bits (arithmetic)
+
+    // Intrinsics - Calls to min, max and abs compiled to single ops
+    BC_MIN,          ///< Smaller of top two numbers (b when equal)
+    BC_MAX,          ///< Larger of top two numbers (b when equal)
+    BC_ABS,          ///< Absolute value of top number
     
     // I/O Operations - Input and output
     BC_PRINT,        ///< Print top stack value to stdout
@@ -74,6 +91,8 @@ typedef enum {
     BC_SET_VAR,      ///< Store top stack value into variable
     BC_DEFINE_VAR,   ///< Define new variable with top stack value
     BC_STORE_VAR,    ///< Alias for BC_SET_VAR (legacy)
+    BC_LOAD_LOCAL,   ///< Push frame slot (base + operand) onto stack
+    BC_SET_LOCAL,    ///< Pop top stack value into frame slot (base + operand)
     
     // Comparison Operations - Boolean comparisons
     BC_EQUAL,        ///< Compare top two values: b == a
@@ -82,15 +101,76 @@ typedef enum {
     BC_LESS_EQUAL,   ///< Compare top two values: b <= a
     BC_GREATER,      ///< Compare top two values: b > a
     BC_GREATER_EQUAL, ///< Compare top two values: b >= a
+    BC_NOT,          ///< Replace top value with 1 if it is falsy, else 0
+    BC_IS_INTEGER,   ///< Replace top value with 1 if it is an int or bigint, else 0 (guards of passes.h)
+    
+    // Quickened Operations - Written by the VM over the generic op at a
+    // site (never emitted by the compiler); each guards its operand types
+    // and rewrites itself back to the generic op on a miss
+    BC_ADD_INT,      ///< BC_ADD on two ints
+    BC_ADD_FLOAT,    ///< BC_ADD on numbers, at least one a double
+    BC_SUB_INT,      ///< BC_SUB on two ints
+    BC_SUB_FLOAT,    ///< BC_SUB on numbers, at least one a double
+    BC_MUL_INT,      ///< BC_MUL on two ints
+    BC_MUL_FLOAT,    ///< BC_MUL on numbers, at least one a double
+    BC_DIV_INT,      ///< BC_DIV on two ints
+    BC_DIV_FLOAT,    ///< BC_DIV on numbers, at least one a double
+    BC_EQUAL_INT,    ///< BC_EQUAL on two ints
+    BC_EQUAL_FLOAT,  ///< BC_EQUAL on numbers, at least one a double
+    BC_NOT_EQUAL_INT,   ///< BC_NOT_EQUAL on two ints
+    BC_NOT_EQUAL_FLOAT, ///< BC_NOT_EQUAL on numbers, at least one a double
+    BC_LESS_INT,     ///< BC_LESS on two ints
+    BC_LESS_FLOAT,   ///< BC_LESS on numbers, at least one a double
+    BC_LESS_EQUAL_INT,     ///< BC_LESS_EQUAL on two ints
+    BC_LESS_EQUAL_FLOAT,   ///< BC_LESS_EQUAL on numbers, at least one a double
+    BC_GREATER_INT,        ///< BC_GREATER on two ints
+    BC_GREATER_FLOAT,      ///< BC_GREATER on numbers, at least one a double
+    BC_GREATER_EQUAL_INT,   ///< BC_GREATER_EQUAL on two ints
+    BC_GREATER_EQUAL_FLOAT, ///< BC_GREATER_EQUAL on numbers, at least one a double
     
     // Constants (legacy)
     BC_LOAD_CONST,   ///< Alias for BC_CONST (legacy)
     
     // Control Flow - Jumps and conditional execution
     BC_JUMP_IF_FALSE, ///< Jump if top stack value is false
+    BC_JUMP_IF_TRUE, ///< Jump if top stack value is true
     BC_JUMP,         ///< Unconditional jump to target
     BC_LOOP,         ///< Jump back to loop start (legacy)
     
+    // Functions - Calls and returns on the frame stack
+    BC_CALL,         ///< Call function at index operand in functions table
+    BC_TAIL_CALL,    ///< Call function at index operand, reusing the current frame
+    BC_RETURN,       ///< Return top stack value to the caller's frame
+    BC_CALL_BUILTIN, ///< Call builtin at index operand (see builtins.h)
+    BC_CALL_NATIVE,  ///< Call host function at index operand (see native.h)
+
+    // Closures - Function values and captured variables (see capture.h)
+    BC_CLOSURE,      ///< Pop the function's captures into a new closure of function operand, push it
+    BC_CALL_CLOSURE, ///< Call the closure below operand arguments
+    BC_NEW_UPVALUE,  ///< Replace top stack value with a new cell holding it
+    BC_LOAD_UPVALUE, ///< Push the value in the cell in frame slot operand
+    BC_SET_UPVALUE,  ///< Pop top stack value into the cell in frame slot operand
+    BC_REF_LOCAL,    ///< Push the stack index of frame slot operand
+    BC_LOAD_REF,     ///< Push the stack slot whose index is in frame slot operand
+    BC_SET_REF,      ///< Pop top stack value into the stack slot whose index is in frame slot operand
+    
+    // Arrays - Creation and element access (maps share the checked ops)
+    BC_ARRAY,        ///< Pop operand values into a new array, push it
+    BC_INDEX_GET,    ///< Pop index and array (or key and map), push the element (checked)
+    BC_INDEX_SET,    ///< Pop value, index and array (or key and map), store the element (checked)
+    BC_INDEX_GET_UNCHECKED, ///< BC_INDEX_GET where the compiler proved the index in bounds
+    BC_INDEX_SET_UNCHECKED, ///< BC_INDEX_SET where the compiler proved the index in bounds
+
+    // Maps - Keyed access (see map.h)
+    BC_MAP_GET,      ///< BC_INDEX_GET on a map; quickened by the VM, never emitted
+    BC_MAP_SET,      ///< BC_INDEX_SET on a map; quickened by the VM, never emitted
+    BC_MAP_HAS,      ///< Pop key and map, push 1 if the map has the key, else 0
+
+    // Records - Creation and field access (see record.h)
+    BC_RECORD,       ///< Pop one value per field of the shape in constant operand into a new record, push it
+    BC_GET_FIELD,    ///< Pop a record, push the field named by inline cache operand
+    BC_SET_FIELD,    ///< Pop value and record, store the field named by inline cache operand
+    
     // Stack Operations - Stack manipulation
     BC_POP,          ///< Remove top value from stack
     
@@ -104,8 +184,21 @@ typedef enum {
  * Each instruction consists of an opcode and an optional operand.
  * The operand meaning depends on the opcode:
  * - BC_CONST: Index into constants table
- * - BC_LOAD_VAR/BC_SET_VAR/BC_DEFINE_VAR: Variable name (ASCII code)
- * - BC_JUMP/BC_JUMP_IF_FALSE: Target instruction index
+ * - BC_LOAD_VAR/BC_SET_VAR/BC_DEFINE_VAR: Index of the constant holding
+ *   the interned variable name (see str.h)
+ * - BC_LOAD_LOCAL/BC_SET_LOCAL: Slot offset from the current frame base
+ * - BC_JUMP/BC_JUMP_IF_FALSE/BC_JUMP_IF_TRUE: Target instruction index
+ * - BC_CALL/BC_TAIL_CALL/BC_CLOSURE: Index into functions table
+ * - BC_CALL_BUILTIN: Index into the builtins table
+ * - BC_CALL_NATIVE: Index into the natives table
+ * - BC_CALL_CLOSURE: Number of arguments
+ * - BC_LOAD_UPVALUE/BC_SET_UPVALUE/BC_REF_LOCAL/BC_LOAD_REF/BC_SET_REF:
+ *   Slot offset from the current frame base
+ * - BC_ARRAY: Number of elements
+ * - BC_RECORD: Index of the constant holding the record's shape
+ * - BC_GET_FIELD/BC_SET_FIELD: Index into the field cache table
+ * - Arithmetic, comparisons and checked indexing (generic and quickened):
+ *   Number of times the site was deoptimized, maintained by the VM
  * - Other instructions: Unused (typically 0)
  */
 typedef struct {
@@ -113,6 +206,65 @@ typedef struct {
     int operand;   ///< Additional data for the operation
 } Instruction;
 
+/**
+ * @brief Describes one compiled function
+ * 
+ * Function bodies live in the same instruction array as top-level code.
+ * A call reserves a window of local_count slots on the operand stack,
+ * starting at the first argument, so calls never allocate memory.
+ * 
+ * Bodies are compiled lazily: entry stays -1 until the first call, when
+ * the VM asks compile_function() to append the body to the instructions.
+ * 
+ * Functions declared inside other functions are entries of their own,
+ * found from their parent's body; capture analysis (see capture.h) runs
+ * when their top-level function is first compiled and fills in what
+ * each one captures. A direct call pushes the captures after the
+ * arguments; a closure carries them and the call copies them in.
+ * 
+ * Frame Layout (slots relative to the frame base):
+ * - 0 .. arity-1: Arguments, pushed by the caller
+ * - arity .. arity+capture_count-1: Captures, in capture order
+ * - Then variables captured by nested functions, which live as long as
+ *   the frame, then the locals of each block, zero-initialized
+ * 
+ * A let declares its variable in the innermost enclosing block. A block's
+ * slots are released when it ends and reused by the blocks after it, so
+ * local_count is the deepest nesting of live locals, known statically.
+ * The temporaries of expressions go above them, at most max_stack deep,
+ * so a call fits when local_count + max_stack slots are free.
+ */
+typedef struct {
+    char* name;       ///< Function name (owned copy)
+    int arity;        ///< Number of parameters
+    int entry;        ///< Instruction index of the first body instruction, -1 until compiled
+    int local_count;  ///< Slots reserved per frame (parameters + captures + locals)
+    int max_stack;    ///< Deepest the body's temporaries get above those slots
+    FnStmt* decl;     ///< Declaration compiled on first call (owned by the AST)
+    int parent;       ///< Index of the enclosing function, -1 at top level
+    Capture* captures;   ///< Outer variables passed in (owned)
+    int capture_count;   ///< Number of captures
+    Capture* captured;   ///< Own variables nested functions capture (owned)
+    int captured_count;  ///< Number of captured own variables
+    int constant;     ///< Constant holding the closure of a capture-free function, or the
+                      ///< name of one that captures, -1 until used as a value
+} Function;
+
+/**
+ * @brief Inline cache of one obj.field site
+ * 
+ * Every BC_GET_FIELD or BC_SET_FIELD instruction has a cache of its own.
+ * It remembers the shape of the last record the site accessed and where
+ * the field is in that shape, so a record of the same shape is accessed
+ * without a lookup. The cache is monomorphic: a record of another shape
+ * looks the field up and replaces the entry.
+ */
+typedef struct {
+    ObjString* name;  ///< Interned field name
+    ObjShape* shape;  ///< Shape seen last, NULL until the site first runs
+    int offset;       ///< Offset of the field in records of that shape
+} FieldCache;
+
 /**
  * @brief Complete bytecode representation of a compiled program
  * 
@@ -131,9 +283,21 @@ typedef struct {
     int count;                 ///< Number of instructions
     int capacity;              ///< Allocated instruction capacity
     
-    int* constants;            ///< Table of constant values
+    Value* constants;          ///< Table of constant values
     int const_count;           ///< Number of constants
     int const_capacity;        ///< Allocated constant capacity
+    
+    Function* functions;       ///< Table of compiled functions
+    int function_count;        ///< Number of functions
+    int function_capacity;     ///< Allocated function capacity
+    
+    FieldCache* field_caches;  ///< One inline cache per field access site
+    int field_cache_count;     ///< Number of field access sites
+    int field_cache_capacity;  ///< Allocated cache capacity
+    
+    int local_count;           ///< Slots reserved for top-level code (block locals and inlined calls)
+    int max_stack;             ///< Deepest the temporaries of top-level code get above those slots
+    int id;                    ///< Identifies the program's closures (see ObjClosure)
 } Bytecode;
 
 /**
@@ -143,7 +307,7 @@ typedef struct {
  * @return Compiled bytecode (caller must free with free_bytecode())
  * 
  * This function is the main entry point for compilation. It:
- * 1. Initializes the bytecode structure
+ * 1. Initializes the bytecode structure and optimizes the AST in place
  * 2. Compiles each statement in the AST
  * 3. Resolves jump targets for control flow
  * 4. Builds the constant table
@@ -159,12 +323,21 @@ typedef struct {
  * - Expressions: Generate code to compute values on stack
  * - Statements: Generate code for side effects and control flow
  * - Variables: Use ASCII codes for single-character names
+ * - Function parameters and locals: Use frame slot offsets
+ * - Calls: Resolved at compile time to a functions table index, or
+ *   through a closure when the callee is a value
  * - Constants: Store in table, reference by index
  * 
  * Control Flow:
  * - If statements: conditional jumps around branches
  * - While loops: conditional jumps with backward references
  * - Blocks: sequential execution of contained statements
+ * - Functions: only declared; see compile_function() for their bodies.
+ *   Naming a function as a value makes a closure
+ * - Tail calls: `return f(...)` emits BC_TAIL_CALL, which reuses the frame
+ * - Inlined calls: arguments are stored into fresh slots of the current
+ *   frame (top-level code gets a frame of its own for this), and returns
+ *   jump to the end of the inlined body with the result on the stack
  * 
  * Memory Management:
  * - Returns dynamically allocated Bytecode structure
@@ -178,6 +351,38 @@ typedef struct {
  */
 Bytecode* compile(Stmt** stmts, int stmt_count);
 
+/**
+ * @brief Compiles the body of a function on its first call
+ * @param bytecode Bytecode the function belongs to
+ * @param index Index of the function in bytecode->functions
+ * 
+ * Parses the body if needed, analyzes the captures of the functions
+ * nested in a top-level function, optimizes it, and appends its instructions
+ * (ending in BC_RETURN) to the instruction array, then records the entry
+ * point and frame size in the function table. Each function is compiled
+ * at most once; the VM calls this when it finds entry == -1.
+ * 
+ * The instruction and constant arrays may be reallocated, so the AST and
+ * the tokens it was parsed from must stay alive while the program runs.
+ */
+void compile_function(Bytecode* bytecode, int index);
+
+/**
+ * @brief Appends an instruction, growing the instruction array as needed
+ */
+void bytecode_emit(Bytecode* bytecode, OpCode opcode, int operand);
+
+/**
+ * @brief Adds a value to the constant table
+ * @return Index of the new constant
+ */
+int bytecode_constant(Bytecode* bytecode, Value value);
+
+/**
+ * @brief Constant index of a global's interned name, shared by every use of the name
+ */
+int bytecode_name(Bytecode* bytecode, const char* name);
+
 /**
  * @brief Frees all memory allocated for bytecode
  * @param bytecode The bytecode structure to free
@@ -185,6 +390,8 @@ Bytecode* compile(Stmt** stmts, int stmt_count);
  * This function deallocates all memory used by the bytecode:
  * - Instruction array
  * - Constants table
+ * - Functions table and function names
+ * - Field caches
  * - Bytecode structure itself
  * 
  * Memory is freed in the correct order to avoid
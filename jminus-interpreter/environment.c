@@ -8,9 +8,9 @@
  * Environments support nested scopes via parent pointers, enabling block scoping.
  *
  * Features:
- * - Fixed-size array for variable entries (128 per environment)
- * - Linear search for variable lookup and assignment
- * - Variable names are duplicated (strdup) for safe storage
+ * - Growable array for variable entries, doubling when full
+ * - Linear search for variable lookup and assignment, comparing interned
+ *   name pointers
  * - Parent pointer enables lexical scoping (block scope)
  *
  * Error Handling:
@@ -20,9 +20,10 @@
  */
 
 #include <stdlib.h>
-#include <string.h>
 #include <stdio.h>
 #include "environment.h"
+#include "gc.h"
+#include "allocator.h"
 
 /**
  * @brief Creates a new environment with an optional parent
@@ -30,8 +31,10 @@
  * @return Pointer to the new environment (caller must free)
  */
 Environment* new_environment(Environment* parent) {
-    Environment* env = malloc(sizeof(Environment));
+    Environment* env = jm_alloc(sizeof(Environment));
+    env->entries = NULL;
     env->count = 0;
+    env->capacity = 0;
     env->parent = parent;
     return env;
 }
@@ -40,32 +43,54 @@ Environment* new_environment(Environment* parent) {
  * @brief Frees all memory used by an environment
  * @param env Pointer to the environment to free
  *
- * Only frees the environment structure itself (not parent).
- * Variable names are not freed (assumed to be managed elsewhere).
+ * Frees the environment and its entries (not the parent). Names are
+ * interned strings and belong to the collector.
  */
 void free_environment(Environment* env) {
-    free(env);
+    jm_free(env->entries);
+    jm_free(env);
+}
+
+/**
+ * @brief Traces the names and values of an environment as collector roots
+ * @param env Pointer to the environment (not its parent)
+ */
+void trace_environment(Environment* env) {
+    for (int i = 0; i < env->count; i++) {
+        Obj* name = &env->entries[i].name->obj;
+        gc_trace_object(&name);
+        env->entries[i].name = (ObjString*)name;
+        gc_trace(&env->entries[i].value);
+    }
 }
 
 /**
  * @brief Defines a new variable in the environment
  * @param env Pointer to the environment
- * @param name Variable name (string is duplicated)
+ * @param name Variable name (interned string)
  * @param value Initial value
  *
  * If the variable already exists in this scope, its value is updated.
  */
-void define_var(Environment* env, const char* name, int value) {
+void define_var(Environment* env, ObjString* name, Value value) {
     // Check if variable already exists in this scope
     for (int i = env->count - 1; i >= 0; i--) {
-        if (strcmp(env->entries[i].name, name) == 0) {
+        if (env->entries[i].name == name) {
             // Variable exists, just update its value
             env->entries[i].value = value;
             return;
         }
     }
     // Variable doesn't exist, add it to this scope
-    env->entries[env->count].name = strdup(name);  // Duplicate the name
+    if (env->count == env->capacity) {
+        env->capacity = env->capacity ? env->capacity * 2 : 16;
+        env->entries = jm_realloc(env->entries, sizeof(EnvEntry) * env->capacity);
+        if (!env->entries) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    env->entries[env->count].name = name;
     env->entries[env->count].value = value;
     env->count++;
 }
@@ -73,37 +98,37 @@ void define_var(Environment* env, const char* name, int value) {
 /**
  * @brief Looks up the value of a variable by name
  * @param env Pointer to the environment
- * @param name Variable name (null-terminated string)
+ * @param name Variable name (interned string)
  * @return Value of the variable
  *
  * Searches the current environment and all parents.
  * Exits with error if variable is not found.
  */
-int lookup_var(Environment* env, const char* name) {
+Value lookup_var(Environment* env, ObjString* name) {
     for (int i = env->count - 1; i >= 0; i--) {
-        if (strcmp(env->entries[i].name, name) == 0) {
+        if (env->entries[i].name == name) {
             return env->entries[i].value;
         }
     }
     if (env->parent) {
         return lookup_var(env->parent, name);
     }
-    fprintf(stderr, "Undefined variable: %s\n", name);
+    fprintf(stderr, "Undefined variable: %s\n", name->chars);
     exit(1);
 }
 
 /**
  * @brief Assigns a value to an existing variable
  * @param env Pointer to the environment
- * @param name Variable name (null-terminated string)
+ * @param name Variable name (interned string)
  * @param value Value to assign
  *
  * Searches the current environment and all parents.
  * Exits with error if variable is not found.
  */
-void assign_var(Environment* env, const char* name, int value) {
+void assign_var(Environment* env, ObjString* name, Value value) {
     for (int i = env->count - 1; i >= 0; i--) {
-        if (strcmp(env->entries[i].name, name) == 0) {
+        if (env->entries[i].name == name) {
             env->entries[i].value = value;
             return;
         }
@@ -112,6 +137,6 @@ void assign_var(Environment* env, const char* name, int value) {
         assign_var(env->parent, name, value);
         return;
     }
-    fprintf(stderr, "Undefined variable: %s\n", name);
+    fprintf(stderr, "Undefined variable: %s\n", name->chars);
     exit(1);
 } 
\ No newline at end of file
@@ -14,9 +14,10 @@
  * - Used by both the interpreter and VM
  *
  * Design Decisions:
- * - Fixed-size array for variable storage (128 entries)
+ * - Growable array for variable storage
+ * - Names are interned strings (see str.h), so lookup compares pointers
+ *   rather than text
  * - Linear search for variable lookup (sufficient for small programs)
- * - Variable names are stored as dynamically allocated strings
  * - Parent pointer enables lexical scoping (block scope)
  *
  * Error Handling:
@@ -29,15 +30,17 @@
 #define ENVIRONMENT_H
 
 #include "parser.h"
+#include "value.h"
+#include "str.h"
 
 /**
  * @brief Represents a single variable entry in the environment
  *
- * Each entry stores a variable name and its integer value.
+ * Each entry stores a variable name and its tagged value.
  */
 typedef struct EnvEntry {
-    const char* name; ///< Variable name (dynamically allocated string)
-    int value;       ///< Variable value
+    ObjString* name; ///< Variable name (interned string)
+    Value value;     ///< Variable value
 } EnvEntry;
 
 /**
@@ -47,8 +50,9 @@ typedef struct EnvEntry {
  * to a parent environment (for nested scopes).
  */
 typedef struct Environment {
-    EnvEntry entries[128]; ///< Array of variable entries (fixed size)
+    EnvEntry* entries;    ///< Array of variable entries (grows as needed)
     int count;            ///< Number of variables in this environment
+    int capacity;         ///< Allocated entries
     struct Environment* parent; ///< Pointer to parent environment (NULL for global)
 } Environment;
 
@@ -63,41 +67,49 @@ Environment* new_environment(Environment* parent);
  * @brief Frees all memory used by an environment
  * @param env Pointer to the environment to free
  *
- * Only frees the environment structure itself (not parent).
- * Variable names are not freed (assumed to be managed elsewhere).
+ * Frees the environment and its entries (not the parent). Names are
+ * interned strings and belong to the collector.
  */
 void free_environment(Environment* env);
 
+/**
+ * @brief Traces the names and values of an environment as collector roots
+ * @param env Pointer to the environment (not its parent)
+ *
+ * Called by root providers during a collection (see gc.h).
+ */
+void trace_environment(Environment* env);
+
 /**
  * @brief Defines a new variable in the environment
  * @param env Pointer to the environment
- * @param name Variable name (string is duplicated)
+ * @param name Variable name (interned string)
  * @param value Initial value
  *
  * If the variable already exists in this scope, its value is updated.
  */
-void define_var(Environment* env, const char* name, int value);
+void define_var(Environment* env, ObjString* name, Value value);
 
 /**
  * @brief Looks up the value of a variable by name
  * @param env Pointer to the environment
- * @param name Variable name (null-terminated string)
+ * @param name Variable name (interned string)
  * @return Value of the variable
  *
  * Searches the current environment and all parents.
  * Exits with error if variable is not found.
  */
-int lookup_var(Environment* env, const char* name);
+Value lookup_var(Environment* env, ObjString* name);
 
 /**
  * @brief Assigns a value to an existing variable
  * @param env Pointer to the environment
- * @param name Variable name (null-terminated string)
+ * @param name Variable name (interned string)
  * @param value Value to assign
  *
  * Searches the current environment and all parents.
  * Exits with error if variable is not found.
  */
-void assign_var(Environment* env, const char* name, int value);
+void assign_var(Environment* env, ObjString* name, Value value);
 
 #endif 
\ No newline at end of file
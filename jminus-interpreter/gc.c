@@ -0,0 +1,715 @@
+/**
+ * @file gc.c
+ * @brief Generational garbage collector for jminus heap objects
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * A minor collection promotes every live nursery object: it copies the
+ * object into a fresh old-space allocation, leaves a forwarding pointer
+ * behind, and queues the copy so its references are traced in turn (a
+ * Cheney scan, with a worklist standing in for the to-space). Nursery
+ * objects owning malloc'd buffers are also listed when allocated, so the
+ * buffers of the dead ones can be freed without walking the nursery.
+ *
+ * Marking uses an explicit gray stack rather than recursion, since ropes
+ * and nested arrays can be arbitrarily deep. Marking is incremental and
+ * keeps the invariant that no marked object whose references have been
+ * traced (black) points to an unmarked old object (white):
+ * - The write barrier shades every old object stored while marking
+ * - Objects allocated old or promoted while marking start out gray
+ * - Roots and nursery objects are not barriered, so marking ends with a
+ *   minor collection (promoting the nursery gray) and a rescan of the
+ *   roots, before anything is swept
+ * Large arrays and maps are traced a slice at a time, so a single object
+ * cannot exceed the step budget. The sweep works through a detached copy
+ * of the old space list, so objects allocated meanwhile are left alone.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#define _POSIX_C_SOURCE 199309L  // clock_gettime
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "gc.h"
+#include "str.h"
+#include "map.h"
+#include "record.h"
+#include "vm.h"
+#include "interpreter.h"
+#include "allocator.h"
+
+// Values of Obj.remembered
+#define REMEMBERED_ALL 1    // Trace every reference of the object
+#define REMEMBERED_CARDS 2  // An array: trace the elements of its dirty cards
+
+// Copies a traced pointer field of any object type back after tracing it
+#define TRACE_FIELD(field) do { \
+        Obj* traced = (Obj*)(field); \
+        gc_trace_object(&traced); \
+        (field) = (void*)traced; \
+    } while (0)
+
+GCStats gc_stats;
+GCKind gc_requested = GC_NONE;
+GCPhase gc_phase = GC_IDLE;
+char* gc_nursery = NULL;
+size_t gc_nursery_capacity = 0;
+
+static size_t nursery_used = 0;
+static size_t nursery_size = GC_NURSERY_SIZE;  // Capacity to use once the nursery is empty
+static Obj* old_objects = NULL;                // The old space, most recent first
+static size_t next_major = GC_MIN_HEAP;        // Old space size that requests a major collection
+static GCKind tracing = GC_NONE;               // GC_MINOR while copying, GC_MAJOR while marking
+static long step_budget = GC_STEP_BUDGET;
+
+// Incremental marking and sweeping state
+static Obj* partial = NULL;       // Array or map being traced a slice at a time
+static int partial_index = 0;     // Next element or slot of partial to trace
+static int partial_capacity = 0;  // Slot count of a partial map when its scan began
+static Obj* unswept = NULL;       // Old objects the sweep has yet to visit
+static size_t swept_bytes = 0;    // Bytes of the live objects swept so far
+static size_t sweep_base = 0;     // old_bytes when the sweep began
+
+// ----------------------------
+// Object lists
+// ----------------------------
+typedef struct {
+    Obj** items;
+    int count;
+    int capacity;
+} ObjList;
+
+static ObjList remembered;    // Old objects that may point into the nursery
+static ObjList young_owners;  // Nursery objects that own malloc'd buffers
+static ObjList copied;        // Promoted objects whose references are still to be copied
+static ObjList gray;          // Marked objects whose references are still to be traced
+static ObjList rekeyed;       // Maps to rehash once a minor collection ends
+
+static void* checked_malloc(size_t size) {
+    void* memory = jm_alloc(size);
+    if (!memory) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return memory;
+}
+
+static void push_object(ObjList* list, Obj* object) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items = jm_realloc(list->items, sizeof(Obj*) * list->capacity);
+        if (!list->items) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    list->items[list->count++] = object;
+}
+
+static void free_list(ObjList* list) {
+    jm_free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+// ----------------------------
+// Object layout
+// ----------------------------
+static size_t align(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+// Size of the object itself, as allocated
+static size_t object_size(Obj* object) {
+    switch (object->type) {
+        case OBJ_FLOAT: return align(sizeof(ObjFloat));
+        case OBJ_BIGINT: return align(sizeof(ObjBigInt) + sizeof(uint32_t) * ((ObjBigInt*)object)->length);
+        case OBJ_ARRAY: return align(sizeof(ObjArray));
+        case OBJ_STRING: return align(sizeof(ObjString));
+        case OBJ_MAP: return align(sizeof(ObjMap));
+        case OBJ_SHAPE: return align(sizeof(ObjShape));
+        case OBJ_RECORD: return align(sizeof(ObjRecord) + sizeof(Value) * ((ObjRecord*)object)->shape->field_count);
+        case OBJ_UPVALUE: return align(sizeof(ObjUpvalue));
+        case OBJ_CLOSURE: return align(sizeof(ObjClosure) + sizeof(Value) * ((ObjClosure*)object)->upvalue_count);
+    }
+    return 0;
+}
+
+// Size of the object and the buffers it owns, for heap accounting
+static size_t object_bytes(Obj* object) {
+    size_t bytes = object_size(object);
+    switch (object->type) {
+        case OBJ_ARRAY:
+            bytes += sizeof(Value) * ((ObjArray*)object)->capacity;
+            break;
+        case OBJ_STRING:
+            if (((ObjString*)object)->chars) bytes += ((ObjString*)object)->length + 1;
+            break;
+        case OBJ_MAP:
+            bytes += (1 + 2 * sizeof(Value)) * ((ObjMap*)object)->capacity;
+            break;
+        case OBJ_SHAPE:
+            bytes += sizeof(ObjString*) * ((ObjShape*)object)->field_count +
+                     sizeof(ObjShape*) * ((ObjShape*)object)->transition_capacity;
+            break;
+        default:
+            break;
+    }
+    return bytes;
+}
+
+static int owns_buffers(ObjType type) {
+    return type == OBJ_ARRAY || type == OBJ_STRING || type == OBJ_MAP || type == OBJ_SHAPE;
+}
+
+static int holds_references(ObjType type) {
+    return type == OBJ_ARRAY || type == OBJ_STRING || type == OBJ_MAP || type == OBJ_RECORD || type == OBJ_SHAPE ||
+           type == OBJ_UPVALUE || type == OBJ_CLOSURE;
+}
+
+static void free_buffers(Obj* object) {
+    switch (object->type) {
+        case OBJ_ARRAY:
+            jm_free(((ObjArray*)object)->items);
+            jm_free(((ObjArray*)object)->cards);
+            break;
+        case OBJ_STRING:
+            jm_free(((ObjString*)object)->chars);
+            break;
+        case OBJ_MAP:
+            jm_free(((ObjMap*)object)->control);
+            jm_free(((ObjMap*)object)->keys);
+            jm_free(((ObjMap*)object)->values);
+            break;
+        case OBJ_SHAPE:
+            jm_free(((ObjShape*)object)->fields);
+            jm_free(((ObjShape*)object)->transitions);
+            break;
+        default:
+            break;
+    }
+}
+
+// Maps hash these by address (see hash_value), so moving them changes their hash
+static int hashed_by_address(Value value) {
+    if (!IS_OBJ(value)) return 0;
+    ObjType type = OBJ_TYPE(value);
+    return type == OBJ_ARRAY || type == OBJ_MAP || type == OBJ_RECORD || type == OBJ_SHAPE || type == OBJ_CLOSURE;
+}
+
+static int card_count(int capacity) {
+    return (capacity + GC_CARD_SIZE - 1) / GC_CARD_SIZE;
+}
+
+// ----------------------------
+// Allocation
+// ----------------------------
+static void init_header(Obj* object, ObjType type) {
+    object->type = type;
+    object->marked = 0;
+    object->remembered = 0;
+    object->forwarded = 0;
+    object->next = NULL;
+}
+
+// Replaces the (empty) nursery with one of the configured size
+static void resize_nursery(void) {
+    jm_free(gc_nursery);
+    gc_nursery = nursery_size > 0 ? checked_malloc(nursery_size) : NULL;
+    gc_nursery_capacity = nursery_size;
+    nursery_used = 0;
+}
+
+static Obj* allocate_old(size_t size, ObjType type) {
+    Obj* object = checked_malloc(size);
+    init_header(object, type);
+    object->next = old_objects;
+    old_objects = object;
+    gc_stats.old_bytes += size;
+    if (gc_phase == GC_MARKING) {
+        // Filled in without barriers, so traced once it is
+        object->marked = 1;
+        push_object(&gray, object);
+    } else if (gc_phase == GC_IDLE && gc_stats.old_bytes >= next_major) {
+        gc_requested = GC_MAJOR;
+    }
+    return object;
+}
+
+Obj* allocate_tenured_object(size_t size, ObjType type) {
+    return allocate_old(align(size), type);
+}
+
+// Allocates old when the nursery cannot take the object
+static Obj* allocate_slow(size_t size, ObjType type) {
+    if (nursery_used == 0 && gc_nursery_capacity != nursery_size) {
+        resize_nursery();
+        if (size <= gc_nursery_capacity) return allocate_object(size, type);
+    }
+    // Large objects always go old; anything else means the nursery is full
+    if (size * 8 <= gc_nursery_capacity && gc_requested < GC_MINOR) gc_requested = GC_MINOR;
+
+    Obj* object = allocate_old(size, type);
+    if (gc_nursery_capacity > 0 && holds_references(type)) {
+        // It will be filled in without barriers
+        object->remembered = REMEMBERED_ALL;
+        push_object(&remembered, object);
+    }
+    return object;
+}
+
+Obj* allocate_object(size_t size, ObjType type) {
+    size = align(size);
+    if (size > gc_nursery_capacity - nursery_used) return allocate_slow(size, type);
+
+    Obj* object = (Obj*)(gc_nursery + nursery_used);
+    nursery_used += size;
+    gc_stats.nursery_bytes += size;
+    init_header(object, type);
+    if (owns_buffers(type)) push_object(&young_owners, object);
+    return object;
+}
+
+void gc_set_nursery_size(size_t bytes) {
+    nursery_size = align(bytes);
+    if (nursery_used == 0) resize_nursery();
+}
+
+// ----------------------------
+// Write barrier
+// ----------------------------
+void gc_remember(Obj* object) {
+    object->remembered = REMEMBERED_ALL;
+    push_object(&remembered, object);
+}
+
+void gc_remember_element(ObjArray* array, int index) {
+    if (array->obj.remembered == REMEMBERED_ALL) return;
+    if (!array->cards) array->cards = jm_calloc(card_count(array->capacity), 1);
+    if (!array->cards) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    array->cards[index / GC_CARD_SIZE] = 1;
+    if (!array->obj.remembered) {
+        array->obj.remembered = REMEMBERED_CARDS;
+        push_object(&remembered, &array->obj);
+    }
+}
+
+void gc_array_resized(ObjArray* array, int old_capacity) {
+    if (!array->cards) return;
+    int old_count = card_count(old_capacity);
+    int count = card_count(array->capacity);
+    array->cards = jm_realloc(array->cards, count);
+    if (!array->cards) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    if (count > old_count) memset(array->cards + old_count, 0, count - old_count);
+}
+
+// ----------------------------
+// Tracing
+// ----------------------------
+// Copies a nursery object into the old space, once
+static Obj* evacuate(Obj* object) {
+    if (object->forwarded) return object->next;
+
+    size_t size = object_size(object);
+    Obj* copy = checked_malloc(size);
+    memcpy(copy, object, size);
+    copy->next = old_objects;
+    old_objects = copy;
+
+    object->forwarded = 1;
+    object->next = copy;
+    gc_stats.promoted_bytes += size;
+    gc_stats.old_bytes += object_bytes(copy);
+    push_object(&copied, copy);
+    if (gc_phase == GC_MARKING) {
+        copy->marked = 1;
+        push_object(&gray, copy);
+    }
+    return copy;
+}
+
+void gc_shade(Obj* object) {
+    // Nursery objects are shaded when they are promoted
+    if (!object || object->marked || gc_is_young(object)) return;
+    object->marked = 1;
+    push_object(&gray, object);
+}
+
+void gc_trace_object(Obj** slot) {
+    Obj* object = *slot;
+    if (!object) return;
+    if (tracing == GC_MINOR) {
+        if (gc_is_young(object)) *slot = evacuate(object);
+        return;
+    }
+    gc_shade(object);
+}
+
+void gc_trace(Value* slot) {
+    if (!IS_OBJ(*slot)) return;
+    Obj* object = AS_OBJ(*slot);
+    gc_trace_object(&object);
+    *slot = OBJ_VAL(object);
+}
+
+static void trace_map_slots(ObjMap* map, int start, int end) {
+    int moved = 0;
+    for (int i = start; i < end; i++) {
+        if (map->control[i] == MAP_EMPTY) continue;
+        Value key = map->keys[i];
+        gc_trace(&map->keys[i]);
+        if (map->keys[i] != key && hashed_by_address(key)) moved = 1;
+        gc_trace(&map->values[i]);
+    }
+    if (moved) push_object(&rekeyed, &map->obj);
+}
+
+static void trace_map(ObjMap* map) {
+    trace_map_slots(map, 0, map->capacity);
+}
+
+// Traces every reference an object holds
+static void trace_references(Obj* object) {
+    switch (object->type) {
+        case OBJ_ARRAY: {
+            ObjArray* array = (ObjArray*)object;
+            for (int i = 0; i < array->count; i++) gc_trace(&array->items[i]);
+            break;
+        }
+        case OBJ_STRING: {
+            ObjString* string = (ObjString*)object;
+            TRACE_FIELD(string->left);
+            TRACE_FIELD(string->right);
+            break;
+        }
+        case OBJ_MAP:
+            trace_map((ObjMap*)object);
+            break;
+        case OBJ_SHAPE: {
+            ObjShape* shape = (ObjShape*)object;
+            for (int i = 0; i < shape->field_count; i++) TRACE_FIELD(shape->fields[i]);
+            for (int i = 0; i < shape->transition_count; i++) TRACE_FIELD(shape->transitions[i]);
+            break;
+        }
+        case OBJ_RECORD: {
+            ObjRecord* record = (ObjRecord*)object;
+            TRACE_FIELD(record->shape);
+            for (int i = 0; i < record->shape->field_count; i++) gc_trace(&record->fields[i]);
+            break;
+        }
+        case OBJ_UPVALUE:
+            gc_trace(&((ObjUpvalue*)object)->value);
+            break;
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            TRACE_FIELD(closure->name);
+            for (int i = 0; i < closure->upvalue_count; i++) gc_trace(&closure->upvalues[i]);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Traces what a remembered object may hold into the nursery
+static void trace_remembered(Obj* object) {
+    if (object->remembered == REMEMBERED_CARDS) {
+        ObjArray* array = (ObjArray*)object;
+        int cards = card_count(array->capacity);
+        for (int card = 0; card < cards; card++) {
+            if (!array->cards[card]) continue;
+            array->cards[card] = 0;
+            int end = (card + 1) * GC_CARD_SIZE;
+            if (end > array->count) end = array->count;
+            for (int i = card * GC_CARD_SIZE; i < end; i++) gc_trace(&array->items[i]);
+        }
+    } else {
+        trace_references(object);
+        if (object->type == OBJ_ARRAY && ((ObjArray*)object)->cards) {
+            memset(((ObjArray*)object)->cards, 0, card_count(((ObjArray*)object)->capacity));
+        }
+    }
+    object->remembered = 0;
+}
+
+static void trace_roots(void) {
+    vm_trace_roots();
+    interpreter_trace_roots();
+    trace_shapes();
+}
+
+static void drain_copied(void) {
+    while (copied.count > 0) trace_references(copied.items[--copied.count]);
+}
+
+// ----------------------------
+// Minor collection
+// ----------------------------
+static void minor_collect(void) {
+    tracing = GC_MINOR;
+    trace_roots();
+    for (int i = 0; i < remembered.count; i++) trace_remembered(remembered.items[i]);
+    remembered.count = 0;
+    drain_copied();
+    tracing = GC_NONE;
+
+    // Whatever was not copied is dead
+    for (int i = 0; i < young_owners.count; i++) {
+        if (!young_owners.items[i]->forwarded) free_buffers(young_owners.items[i]);
+    }
+    young_owners.count = 0;
+    for (int i = 0; i < rekeyed.count; i++) map_rehash((ObjMap*)rekeyed.items[i]);
+    rekeyed.count = 0;
+
+    nursery_used = 0;
+    if (gc_nursery_capacity != nursery_size) resize_nursery();
+    gc_stats.minor_collections++;
+    if (gc_phase == GC_IDLE && gc_stats.old_bytes >= next_major) gc_requested = GC_MAJOR;
+}
+
+// ----------------------------
+// Incremental marking
+// ----------------------------
+// Traces up to limit elements or slots of the partial object; returns the work done
+static long trace_partial(long limit) {
+    int end;
+    if (partial->type == OBJ_ARRAY) {
+        ObjArray* array = (ObjArray*)partial;
+        end = array->count;
+        if ((long)(end - partial_index) > limit) end = partial_index + (int)limit;
+        for (int i = partial_index; i < end; i++) gc_trace(&array->items[i]);
+        if (end >= array->count) partial = NULL;
+    } else {
+        ObjMap* map = (ObjMap*)partial;
+        // A resize reorders the slots, so the scan starts over
+        if (map->capacity != partial_capacity) {
+            partial_index = 0;
+            partial_capacity = map->capacity;
+        }
+        end = map->capacity;
+        if ((long)(end - partial_index) > limit) end = partial_index + (int)limit;
+        trace_map_slots(map, partial_index, end);
+        if (end >= map->capacity) partial = NULL;
+    }
+    long work = end - partial_index;
+    partial_index = end;
+    return work > 0 ? work : 1;
+}
+
+// Marks until budget units of work are done (0 for no limit); returns
+// whether the gray stack ran out
+static int mark(long budget) {
+    long work = 0;
+    tracing = GC_MAJOR;
+    while (budget == 0 || work < budget) {
+        if (partial) {
+            work += trace_partial(budget == 0 ? LONG_MAX : budget - work);
+            continue;
+        }
+        if (gray.count == 0) break;
+        Obj* object = gray.items[--gray.count];
+        if (object->type == OBJ_ARRAY || object->type == OBJ_MAP) {
+            partial = object;
+            partial_index = 0;
+            partial_capacity = object->type == OBJ_MAP ? ((ObjMap*)object)->capacity : 0;
+            continue;
+        }
+        trace_references(object);
+        work += object->type == OBJ_RECORD ? 1 + ((ObjRecord*)object)->shape->field_count : 1;
+    }
+    tracing = GC_NONE;
+    return !partial && gray.count == 0;
+}
+
+static void start_marking(void) {
+    gc_phase = GC_MARKING;
+    tracing = GC_MAJOR;
+    trace_roots();
+    tracing = GC_NONE;
+}
+
+// Ends marking atomically: nursery survivors and roots may still hold white objects
+static void finish_marking(void) {
+    minor_collect();
+    tracing = GC_MAJOR;
+    trace_roots();
+    tracing = GC_NONE;
+    mark(0);
+
+    gc_phase = GC_SWEEPING;
+    unswept = old_objects;
+    old_objects = NULL;
+    swept_bytes = 0;
+    sweep_base = gc_stats.old_bytes;
+}
+
+// ----------------------------
+// Incremental sweeping
+// ----------------------------
+// Frees unmarked objects and unmarks the rest, budget objects at a time
+static void sweep(long budget) {
+    long work = 0;
+    while (unswept && (budget == 0 || work < budget)) {
+        Obj* object = unswept;
+        unswept = object->next;
+        work++;
+        if (object->marked) {
+            object->marked = 0;
+            swept_bytes += object_bytes(object);
+            object->next = old_objects;
+            old_objects = object;
+            continue;
+        }
+        if (object->type == OBJ_STRING && ((ObjString*)object)->interned) {
+            remove_interned_string((ObjString*)object);
+        }
+        free_buffers(object);
+        jm_free(object);
+        gc_stats.freed_objects++;
+    }
+    if (unswept) return;
+
+    // Whatever was added to the old space during the sweep is live too
+    gc_stats.old_bytes = swept_bytes + (gc_stats.old_bytes - sweep_base);
+    next_major = gc_stats.old_bytes * GC_HEAP_GROWTH;
+    if (next_major < GC_MIN_HEAP) next_major = GC_MIN_HEAP;
+    gc_phase = GC_IDLE;
+    gc_stats.major_collections++;
+}
+
+// Does one budget of work on the current major collection
+static void step(long budget) {
+    if (gc_phase == GC_MARKING && mark(budget)) finish_marking();
+    else if (gc_phase == GC_SWEEPING) sweep(budget);
+    gc_stats.incremental_steps++;
+}
+
+// ----------------------------
+// Pauses
+// ----------------------------
+// Microseconds on a monotonic wall clock. clock() will not do: it is the
+// CPU time of every thread on Linux, and ticks in milliseconds on Windows
+static double now_micros(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e6 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+#endif
+}
+
+static void record_pause(double start) {
+    double micros = now_micros() - start;
+    int bucket = 0;
+    while (bucket < GC_PAUSE_BUCKETS - 1 && micros >= (double)(1L << bucket)) bucket++;
+    gc_stats.pause_histogram[bucket]++;
+    gc_stats.pauses++;
+    gc_stats.total_pause_micros += micros;
+    if (micros > gc_stats.max_pause_micros) gc_stats.max_pause_micros = micros;
+}
+
+double gc_pause_percentile(double fraction) {
+    if (gc_stats.pauses == 0) return 0;
+    long seen = 0;
+    for (int bucket = 0; bucket < GC_PAUSE_BUCKETS - 1; bucket++) {
+        seen += gc_stats.pause_histogram[bucket];
+        if (seen >= fraction * gc_stats.pauses) return (double)(1L << bucket);
+    }
+    return gc_stats.max_pause_micros;
+}
+
+// ----------------------------
+// Collection
+// ----------------------------
+void gc_set_step_budget(long units) {
+    step_budget = units;
+}
+
+void gc_collect(GCKind kind) {
+    double start = now_micros();
+    gc_requested = GC_NONE;
+    if (kind == GC_MINOR) {
+        minor_collect();
+    } else if (kind == GC_MAJOR) {
+        // Completes the collection in progress, or a whole new one
+        if (gc_phase == GC_IDLE) start_marking();
+        while (gc_phase != GC_IDLE) step(0);
+    }
+    if (gc_phase != GC_IDLE) gc_requested = GC_STEP;
+    record_pause(start);
+}
+
+void gc_safepoint(void) {
+    double start = now_micros();
+    GCKind kind = gc_requested;
+    gc_requested = GC_NONE;
+    if (kind >= GC_MINOR) minor_collect();
+    if (kind == GC_MAJOR && gc_phase == GC_IDLE) {
+        start_marking();
+        if (step_budget == 0) {
+            while (gc_phase != GC_IDLE) step(0);
+        }
+    } else if (gc_phase != GC_IDLE) {
+        step(step_budget);
+    }
+    // Keep stepping at every safepoint until the collection is done
+    if (gc_phase != GC_IDLE && gc_requested < GC_STEP) gc_requested = GC_STEP;
+    record_pause(start);
+}
+
+void free_objects(void) {
+    // Globals would otherwise refer to the freed objects
+    free_vm();
+    free_interpreter();
+
+    for (int i = 0; i < young_owners.count; i++) free_buffers(young_owners.items[i]);
+    Obj* lists[] = { old_objects, unswept };
+    for (int i = 0; i < 2; i++) {
+        Obj* object = lists[i];
+        while (object) {
+            Obj* next = object->next;
+            free_buffers(object);
+            jm_free(object);
+            object = next;
+        }
+    }
+    old_objects = NULL;
+    unswept = NULL;
+    partial = NULL;
+
+    jm_free(gc_nursery);
+    gc_nursery = NULL;
+    gc_nursery_capacity = 0;
+    nursery_used = 0;
+    free_list(&remembered);
+    free_list(&young_owners);
+    free_list(&copied);
+    free_list(&gray);
+    free_list(&rekeyed);
+
+    reset_interned_strings();
+    reset_shapes();
+    memset(&gc_stats, 0, sizeof(gc_stats));
+    gc_requested = GC_NONE;
+    gc_phase = GC_IDLE;
+    next_major = GC_MIN_HEAP;
+}
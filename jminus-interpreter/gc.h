@@ -0,0 +1,245 @@
+/**
+ * @file gc.h
+ * @brief Generational garbage collector for jminus heap objects
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Heap objects (see object.h) live in one of two generations:
+ * - The nursery: one fixed-size block that new objects are bump-allocated
+ *   from. A minor collection copies the live nursery objects into the old
+ *   space and resets the bump pointer, so it costs time in proportion to
+ *   the survivors, not to what was allocated
+ * - The old space: objects malloc'd one by one and linked into a list,
+ *   reclaimed by an incremental mark-sweep (a major collection)
+ *
+ * Some objects start out old: interned strings and shapes (which are
+ * long-lived), objects too large for the nursery, and objects allocated
+ * while a collection is pending.
+ *
+ * Safepoints:
+ * Collections only run at safepoints, where every live value is in a
+ * root. Allocation never collects: when the nursery is full it requests a
+ * collection (gc_requested) and allocates in the old space until the VM
+ * reaches its next safepoint, a jump or a call. C code may therefore hold
+ * object pointers in locals as long as it does not reach a safepoint.
+ *
+ * Incremental Major Collections:
+ * Once the old space outgrows its limit, a major collection starts. It
+ * marks and then sweeps the old space a step at a time: every safepoint
+ * does one step of at most the step budget's work (objects, elements or
+ * map slots visited) until the collection is done, so the pauses stay
+ * bounded however large the heap grows. Ending the marking takes one
+ * further pause, about as long as a minor collection. Every pause is
+ * timed on a monotonic wall clock into gc_stats.pause_histogram.
+ *
+ * Roots (precise):
+ * - The VM operand stack, which holds every frame's arguments and
+ *   locals, the VM globals, and the constants and field caches of the
+ *   running bytecode (see vm_trace_roots)
+ * - The interpreter's globals
+ * - The shape tree (see record.h)
+ * The intern table does not keep strings alive: strings that are only
+ * interned are removed from it by a major collection.
+ *
+ * Write Barrier:
+ * A minor collection must find old objects that point into the nursery
+ * without scanning the old space. Every store of a value into an existing
+ * object goes through a barrier, which adds the object to the remembered
+ * set the first time it receives a nursery pointer. Arrays are split into
+ * cards of GC_CARD_SIZE elements, and the barrier also marks the card,
+ * so a minor collection only rescans the cards written since the last
+ * one. Objects that start out old are remembered in full from birth,
+ * since they are filled in with plain stores. While a major collection
+ * is marking, the barrier also marks every old object stored, so that an
+ * object the marker has already traced never hides an unmarked one.
+ *
+ * Moving:
+ * Minor collections move objects, updating every root and reference.
+ * Maps hash arrays, maps and records by address, so a map that had such
+ * a key moved is rehashed at the end of the collection.
+ */
+
+#ifndef GC_H
+#define GC_H
+
+#include <stddef.h>
+#include "value.h"
+#include "object.h"
+
+/// Default nursery size in bytes (override with -D to stress the collector)
+#ifndef GC_NURSERY_SIZE
+#define GC_NURSERY_SIZE (1 << 20)
+#endif
+
+/// Old space size below which no major collection is requested
+#ifndef GC_MIN_HEAP
+#define GC_MIN_HEAP (4 << 20)
+#endif
+
+/// Factor the old space may grow by, after a major collection, before the next
+#define GC_HEAP_GROWTH 2
+
+/// Array elements per card (a power of two)
+#define GC_CARD_SIZE 64
+
+/// Default work per incremental step: objects, array elements or map slots
+#ifndef GC_STEP_BUDGET
+#define GC_STEP_BUDGET 4096
+#endif
+
+/// Pause histogram buckets: bucket i counts pauses under 2^i microseconds
+/// (the last one, every longer pause)
+#define GC_PAUSE_BUCKETS 16
+
+/**
+ * @brief Kinds of collection, as requested in gc_requested
+ */
+typedef enum {
+    GC_NONE,   ///< Nothing to do
+    GC_STEP,   ///< Continue the major collection in progress
+    GC_MINOR,  ///< Empty the nursery
+    GC_MAJOR   ///< Empty the nursery, then mark-sweep the old space
+} GCKind;
+
+/**
+ * @brief Progress of the major collection, as in gc_phase
+ */
+typedef enum {
+    GC_IDLE,      ///< No major collection in progress
+    GC_MARKING,   ///< Marking the objects reachable from the roots
+    GC_SWEEPING   ///< Freeing the old objects left unmarked
+} GCPhase;
+
+/**
+ * @brief Collector counters since the last free_objects()
+ */
+typedef struct {
+    long minor_collections;   ///< Minor collections run (including those of major ones)
+    long major_collections;   ///< Major collections run
+    size_t nursery_bytes;     ///< Bytes bump-allocated in the nursery
+    size_t promoted_bytes;    ///< Bytes copied out of the nursery
+    size_t old_bytes;         ///< Bytes in the old space (as of the last major collection, plus growth since)
+    long freed_objects;       ///< Old objects freed by major collections
+    long incremental_steps;   ///< Steps of major collections run at safepoints
+    long pauses;              ///< Safepoints (and gc_collect calls) that did collector work
+    long pause_histogram[GC_PAUSE_BUCKETS]; ///< Pauses by duration (see GC_PAUSE_BUCKETS)
+    double max_pause_micros;  ///< Longest pause
+    double total_pause_micros; ///< Sum of all pauses
+} GCStats;
+
+extern GCStats gc_stats;
+
+/// Collection to run at the next safepoint
+extern GCKind gc_requested;
+
+/// Major collection phase
+extern GCPhase gc_phase;
+
+// The nursery block, for the barriers below
+extern char* gc_nursery;
+extern size_t gc_nursery_capacity;
+
+/**
+ * @brief Checks whether an object is in the nursery
+ */
+static inline int gc_is_young(Obj* object) {
+    return (uintptr_t)object - (uintptr_t)gc_nursery < gc_nursery_capacity;
+}
+
+/**
+ * @brief Adds an object to the remembered set (use gc_write_barrier)
+ */
+void gc_remember(Obj* object);
+
+/**
+ * @brief Marks an array card dirty (use gc_array_barrier)
+ */
+void gc_remember_element(ObjArray* array, int index);
+
+/**
+ * @brief Marks an old object for the major collection in progress
+ *        (use the barriers below)
+ */
+void gc_shade(Obj* object);
+
+/**
+ * @brief Write barrier for a store of value into a field of object
+ */
+static inline void gc_write_barrier(Obj* object, Value value) {
+    if (!IS_OBJ(value)) return;
+    if (gc_is_young(AS_OBJ(value))) {
+        if (!object->remembered && !gc_is_young(object)) gc_remember(object);
+    } else if (gc_phase == GC_MARKING) {
+        gc_shade(AS_OBJ(value));
+    }
+}
+
+/**
+ * @brief Write barrier for a store of value into array->items[index]
+ */
+static inline void gc_array_barrier(ObjArray* array, int index, Value value) {
+    if (!IS_OBJ(value)) return;
+    if (gc_is_young(AS_OBJ(value))) {
+        if (!gc_is_young(&array->obj)) gc_remember_element(array, index);
+    } else if (gc_phase == GC_MARKING) {
+        gc_shade(AS_OBJ(value));
+    }
+}
+
+/**
+ * @brief Resizes the cards of an array whose buffer was reallocated
+ */
+void gc_array_resized(ObjArray* array, int old_capacity);
+
+/**
+ * @brief Runs the collection or step in gc_requested; called at VM safepoints
+ */
+void gc_safepoint(void);
+
+/**
+ * @brief Runs a collection now
+ * @param kind GC_MINOR, or GC_MAJOR to run a whole major collection
+ *             (finishing the one in progress, if any) in one pause
+ *
+ * Only call this where the roots hold every live value: at a safepoint,
+ * or between runs.
+ */
+void gc_collect(GCKind kind);
+
+/**
+ * @brief Sets the work done by each step of a major collection
+ * @param units Objects, array elements or map slots visited per step,
+ *              or 0 to run every major collection in a single pause
+ */
+void gc_set_step_budget(long units);
+
+/**
+ * @brief Estimates a pause-time percentile from gc_stats.pause_histogram
+ * @param fraction The percentile as a fraction, e.g. 0.99
+ * @return An upper bound on that percentile in microseconds (the top of
+ *         its histogram bucket), or 0 before the first pause
+ */
+double gc_pause_percentile(double fraction);
+
+/**
+ * @brief Sets the nursery size in bytes
+ *
+ * Takes effect once the nursery is empty (now, if it is). A size of 0
+ * allocates every object in the old space.
+ */
+void gc_set_nursery_size(size_t bytes);
+
+/**
+ * @brief Traces a root or reference holding a value
+ *
+ * Called by root providers (vm_trace_roots and the like) while a
+ * collection enumerates the roots. A minor collection may update *slot.
+ */
+void gc_trace(Value* slot);
+
+/**
+ * @brief Traces a root or reference holding an object pointer (or NULL)
+ */
+void gc_trace_object(Obj** slot);
+
+#endif // GC_H
@@ -29,29 +29,43 @@
 #include <string.h>
 #include "interpreter.h"
 #include "environment.h"
+#include "array.h"
+#include "map.h"
+#include "record.h"
+#include "builtins.h"
+#include "native.h"
 
 // Global environment for the interpreter (single scope for now)
 static Environment* global_env = NULL;
 
-int lookup_variable(const char* name) {
+Value lookup_variable(const char* name) {
     if (!global_env) {
         global_env = new_environment(NULL);
     }
-    return lookup_var(global_env, name);
+    return lookup_var(global_env, intern_name(name));
 }
 
-void assign_variable(const char* name, int value) {
+void assign_variable(const char* name, Value value) {
     if (!global_env) {
         global_env = new_environment(NULL);
     }
-    assign_var(global_env, name, value);
+    assign_var(global_env, intern_name(name), value);
 }
 
-void define_variable(const char* name, int value) {
+void define_variable(const char* name, Value value) {
     if (!global_env) {
         global_env = new_environment(NULL);
     }
-    define_var(global_env, name, value);
+    define_var(global_env, intern_name(name), value);
+}
+
+void interpreter_trace_roots(void) {
+    if (global_env) trace_environment(global_env);
+}
+
+void free_interpreter(void) {
+    if (global_env) free_environment(global_env);
+    global_env = NULL;
 }
 
 // ------------------
@@ -61,39 +75,130 @@ void define_variable(const char* name, int value) {
 /**
  * @brief Recursively evaluates an expression AST node
  * @param expr Pointer to the expression node
- * @return The computed integer value
+ * @return The computed value
  *
- * Handles literals, variables, and binary operations.
+ * Handles literals, variables, binary operations, arrays, and native and
+ * builtin calls.
+ * Comparisons and the logical operators yield the integers 1 and 0, as in
+ * the VM.
  * Exits on unknown expression types or errors.
  */
-int eval_expr(Expr* expr) {
+Value eval_expr(Expr* expr) {
     switch (expr->type) {
         case EXPR_LITERAL:
-            return atoi(expr->literal.value.lexeme);
+            return literal_value(expr->literal.value);
 
         case EXPR_VARIABLE:
             return lookup_variable(expr->variable.name.lexeme);
 
         case EXPR_BINARY: {
-            int left = eval_expr(expr->binary.left);
-            int right = eval_expr(expr->binary.right);
             const char* op = expr->binary.op.lexeme;
 
-            if (strcmp(op, "+") == 0) return left + right;
-            if (strcmp(op, "-") == 0) return left - right;
-            if (strcmp(op, "*") == 0) return left * right;
-            if (strcmp(op, "/") == 0) return left / right;
-            if (strcmp(op, "==") == 0) return left == right;
-            if (strcmp(op, "!=") == 0) return left != right;
-            if (strcmp(op, "<")  == 0) return left < right;
-            if (strcmp(op, "<=") == 0) return left <= right;
-            if (strcmp(op, ">")  == 0) return left > right;
-            if (strcmp(op, ">=") == 0) return left >= right;
+            // && and || evaluate the right side only when the left does not decide
+            if (strcmp(op, "&&") == 0 || strcmp(op, "||") == 0) {
+                int truth = is_truthy(eval_expr(expr->binary.left));
+                if (truth == (op[0] == '|')) return INT_VAL(truth);
+                return INT_VAL(is_truthy(eval_expr(expr->binary.right)));
+            }
+
+            Value left = eval_expr(expr->binary.left);
+            Value right = eval_expr(expr->binary.right);
+
+            if (strcmp(op, "+") == 0) return add_values(left, right);
+            if (strcmp(op, "-") == 0) return subtract_values(left, right);
+            if (strcmp(op, "*") == 0) return multiply_values(left, right);
+            if (strcmp(op, "/") == 0) return divide_values(left, right);
+            if (strcmp(op, "%") == 0) return modulo_values(left, right);
+            if (strcmp(op, "&") == 0) return and_values(left, right);
+            if (strcmp(op, "|") == 0) return or_values(left, right);
+            if (strcmp(op, "^") == 0) return xor_values(left, right);
+            if (strcmp(op, "<<") == 0) return shift_left_values(left, right);
+            if (strcmp(op, ">>") == 0) return shift_right_values(left, right);
+            if (strcmp(op, "==") == 0) return INT_VAL(values_equal(left, right));
+            if (strcmp(op, "!=") == 0) return INT_VAL(!values_equal(left, right));
+            if (strcmp(op, "<")  == 0) return INT_VAL(compare_values(left, right) == -1);
+            if (strcmp(op, "<=") == 0) return INT_VAL(compare_values(left, right) <= 0);
+            if (strcmp(op, ">")  == 0) return INT_VAL(compare_values(left, right) == 1);
+            if (strcmp(op, ">=") == 0) {
+                int order = compare_values(left, right);
+                return INT_VAL(order == 0 || order == 1);
+            }
 
             fprintf(stderr, "Unknown binary operator: %s\n", op);
             exit(1);
         }
 
+        case EXPR_CALL: {
+            const char* name = expr->call.callee->type == EXPR_VARIABLE
+                ? expr->call.callee->variable.name.lexeme : NULL;
+            int native = name ? find_native(name) : -1;
+            if (native >= 0) {
+                if (natives[native].arity != expr->call.arg_count) {
+                    fprintf(stderr, "Function '%s' expects %d arguments but got %d\n",
+                            natives[native].name, natives[native].arity, expr->call.arg_count);
+                    exit(1);
+                }
+                Value args[NATIVE_MAX_ARITY];
+                for (int i = 0; i < expr->call.arg_count; i++) {
+                    args[i] = eval_expr(expr->call.args[i]);
+                }
+                return natives[native].function(args);
+            }
+            int index = name ? find_builtin_call(name, expr->call.arg_count) : -1;
+            if (index < 0) {
+                fprintf(stderr, "Function calls are only supported in VM mode\n");
+                exit(1);
+            }
+            const Builtin* builtin = &builtins[index];
+            if (builtin->arity != expr->call.arg_count) {
+                fprintf(stderr, "Function '%s' expects %d arguments but got %d\n",
+                        builtin->name, builtin->arity, expr->call.arg_count);
+                exit(1);
+            }
+            Value args[BUILTIN_MAX_ARITY];
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                args[i] = eval_expr(expr->call.args[i]);
+            }
+            return builtin->function(args);
+        }
+
+        case EXPR_ARRAY: {
+            ObjArray* array = new_array(expr->array.count);
+            for (int i = 0; i < expr->array.count; i++) {
+                array->items[i] = eval_expr(expr->array.elements[i]);
+            }
+            array->count = expr->array.count;
+            return OBJ_VAL(array);
+        }
+
+        case EXPR_INDEX: {
+            Value object = eval_expr(expr->index.object);
+            Value index = eval_expr(expr->index.index);
+            if (IS_MAP_OBJ(object)) return map_get(AS_MAP_OBJ(object), index);
+            return array_get(object, index);
+        }
+
+        case EXPR_RECORD: {
+            ObjShape* shape = root_shape();
+            for (int i = 0; i < expr->record.count; i++) {
+                shape = shape_add_field(shape, intern_name(expr->record.names[i].lexeme));
+            }
+            ObjRecord* record = new_record(shape);
+            for (int i = 0; i < expr->record.count; i++) {
+                record->fields[i] = eval_expr(expr->record.values[i]);
+            }
+            return OBJ_VAL(record);
+        }
+
+        case EXPR_FIELD: {
+            Value object = eval_expr(expr->field.object);
+            return record_get(object, intern_name(expr->field.name.lexeme));
+        }
+
+        case EXPR_UNARY:
+            return INT_VAL(!is_truthy(eval_expr(expr->unary.operand)));
+
+
         default:
             fprintf(stderr, "Unknown expression type\n");
             exit(1);
@@ -117,15 +222,19 @@ void exec_stmt(Stmt* stmt) {
     switch (stmt->type) {
         case STMT_LET: {
             const char* name = stmt->let.name.lexeme;
-            int value = eval_expr(stmt->let.initializer);
+            Value value = eval_expr(stmt->let.initializer);
             define_variable(name, value);
-            printf("Defined variable %s = %d\n", name, value);  // Debugging output
+            printf("Defined variable %s = ", name);  // Debugging output
+            print_value(value);
+            printf("\n");
             break;
         }
 
         case STMT_YAP: {
-            int value = eval_expr(stmt->yap.expression);
-            printf("Yap output: %d\n", value);  // Debugging output
+            Value value = eval_expr(stmt->yap.expression);
+            printf("Yap output: ");  // Debugging output
+            print_value(value);
+            printf("\n");
             break;
         }
 
@@ -138,9 +247,27 @@ void exec_stmt(Stmt* stmt) {
                 expr->binary.left->type == EXPR_VARIABLE) {
 
                 const char* name = expr->binary.left->variable.name.lexeme;
-                int value = eval_expr(expr->binary.right);
+                Value value = eval_expr(expr->binary.right);
                 assign_variable(name, value);
-                printf("Re-assigned variable %s = %d\n", name, value);  // Debugging output
+                printf("Re-assigned variable %s = ", name);  // Debugging output
+                print_value(value);
+                printf("\n");
+            } else if (expr->type == EXPR_BINARY &&
+                       strcmp(expr->binary.op.lexeme, "=") == 0 &&
+                       expr->binary.left->type == EXPR_INDEX) {
+                // Element assignment: a[i] = ...
+                Value object = eval_expr(expr->binary.left->index.object);
+                Value index = eval_expr(expr->binary.left->index.index);
+                Value value = eval_expr(expr->binary.right);
+                if (IS_MAP_OBJ(object)) map_set(AS_MAP_OBJ(object), index, value);
+                else array_set(object, index, value);
+            } else if (expr->type == EXPR_BINARY &&
+                       strcmp(expr->binary.op.lexeme, "=") == 0 &&
+                       expr->binary.left->type == EXPR_FIELD) {
+                // Field assignment: r.x = ...
+                Value object = eval_expr(expr->binary.left->field.object);
+                Value value = eval_expr(expr->binary.right);
+                record_set(object, intern_name(expr->binary.left->field.name.lexeme), value);
             } else {
                 eval_expr(expr);  // Regular expression
             }
@@ -148,7 +275,7 @@ void exec_stmt(Stmt* stmt) {
         }
 
         case STMT_IF: {
-            int condition = eval_expr(stmt->if_stmt.condition);
+            int condition = is_truthy(eval_expr(stmt->if_stmt.condition));
             printf("If condition: %d\n", condition);  // Debugging output
             if (condition) {
                 exec_stmt(stmt->if_stmt.then_branch);
@@ -159,7 +286,7 @@ void exec_stmt(Stmt* stmt) {
         }
 
         case STMT_WHILE: {
-            while (eval_expr(stmt->while_stmt.condition)) {
+            while (is_truthy(eval_expr(stmt->while_stmt.condition))) {
                 printf("While condition true\n");  // Debugging output
                 exec_stmt(stmt->while_stmt.body);
             }
@@ -173,6 +300,11 @@ void exec_stmt(Stmt* stmt) {
             break;
         }
 
+        case STMT_FN:
+        case STMT_RETURN:
+            printf("Functions are only supported in VM mode\n");
+            break;
+
         default:
             printf("Unhandled statement type\n");
     }
@@ -13,6 +13,7 @@
  * - Evaluates expressions and executes statements
  * - Manages variables using an environment
  * - Supports let, assignment, if, while, blocks, and yap
+ * - Functions (fn/return/calls) are only supported by the VM
  *
  * Variable Management:
  * - Variables are stored in an environment structure
@@ -29,6 +30,7 @@
 #define INTERPRETER_H
 
 #include "parser.h"
+#include "value.h"
 
 /**
  * @brief Executes an array of AST statements directly
@@ -53,7 +55,7 @@ void interpret(Stmt** stmts, int count);
  *
  * Exits with error if variable is not defined.
  */
-int lookup_variable(const char* name);
+Value lookup_variable(const char* name);
 
 /**
  * @brief Assigns a value to an existing variable
@@ -62,7 +64,7 @@ int lookup_variable(const char* name);
  *
  * Exits with error if variable is not defined.
  */
-void assign_variable(const char* name, int value);
+void assign_variable(const char* name, Value value);
 
 /**
  * @brief Defines a new variable with a value
@@ -71,6 +73,22 @@ void assign_variable(const char* name, int value);
  *
  * If the variable already exists, its value is updated.
  */
-void define_variable(const char* name, int value);
+void define_variable(const char* name, Value value);
+
+/**
+ * @brief Traces the interpreter's globals for the collector (see gc.h)
+ *
+ * The interpreter has no safepoints, since it keeps values in C locals
+ * while it evaluates, so it never collects; its globals are roots for the
+ * collections the VM runs.
+ */
+void interpreter_trace_roots(void);
+
+/**
+ * @brief Frees the interpreter's globals
+ *
+ * Called by free_objects(), since the values they hold are freed too.
+ */
+void free_interpreter(void);
 
 #endif 
\ No newline at end of file
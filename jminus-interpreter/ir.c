@@ -0,0 +1,1183 @@
+/**
+ * @file ir.c
+ * @brief Control flow graphs, SSA construction and lowering to bytecode
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * See ir.h for the shape of the IR. Blocks and instructions are numbered
+ * in arrays that only grow; removing an instruction takes it out of its
+ * block's list and sets its block to -1, so numbers stay valid while a
+ * pass runs and per-instruction tables can be plain arrays.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "builtins.h"
+#include "native.h"
+#include "allocator.h"
+
+IrStats ir_stats;
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IndexList;
+
+static void* grow(void* items, int* capacity, size_t size) {
+    *capacity = *capacity ? *capacity * 2 : 8;
+    items = jm_realloc(items, size * *capacity);
+    if (!items) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return items;
+}
+
+static void list_push(IndexList* list, int value) {
+    if (list->count >= list->capacity) list->items = grow(list->items, &list->capacity, sizeof(int));
+    list->items[list->count++] = value;
+}
+
+// Appends value unless present
+static void list_add(IndexList* list, int value) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->items[i] == value) return;
+    }
+    list_push(list, value);
+}
+
+static void free_lists(IndexList* lists, int count) {
+    for (int i = 0; i < count; i++) jm_free(lists[i].items);
+    jm_free(lists);
+}
+
+// ----------------------------
+// Building
+// ----------------------------
+
+static int new_instr(IrFunction* fn, IrKind kind) {
+    if (fn->instr_count >= fn->instr_capacity) fn->instrs = grow(fn->instrs, &fn->instr_capacity, sizeof(IrInstr));
+    IrInstr* instr = &fn->instrs[fn->instr_count];
+    memset(instr, 0, sizeof(IrInstr));
+    instr->kind = kind;
+    instr->var = -1;
+    instr->block = -1;
+    return fn->instr_count++;
+}
+
+static void set_args(IrFunction* fn, int instr, const int* args, int count) {
+    IrInstr* in = &fn->instrs[instr];
+    jm_free(in->args);
+    in->args = count > 0 ? jm_alloc(sizeof(int) * count) : NULL;
+    for (int i = 0; i < count; i++) in->args[i] = args ? args[i] : -1;
+    in->arg_count = count;
+}
+
+static void insert_at(IrFunction* fn, int block, int position, int instr) {
+    IrBlock* b = &fn->blocks[block];
+    if (b->count >= b->capacity) b->instrs = grow(b->instrs, &b->capacity, sizeof(int));
+    memmove(&b->instrs[position + 1], &b->instrs[position], sizeof(int) * (b->count - position));
+    b->instrs[position] = instr;
+    b->count++;
+    fn->instrs[instr].block = block;
+}
+
+void ir_append(IrFunction* fn, int block, int instr) {
+    IrBlock* b = &fn->blocks[block];
+    int position = b->count;
+    while (position > 0 && fn->instrs[b->instrs[position - 1]].kind == IR_STORE) position--;
+    insert_at(fn, block, position, instr);
+}
+
+// Phis go after the block's other phis, before everything else
+static void insert_phi(IrFunction* fn, int block, int instr) {
+    IrBlock* b = &fn->blocks[block];
+    int position = 0;
+    while (position < b->count && fn->instrs[b->instrs[position]].kind == IR_PHI) position++;
+    insert_at(fn, block, position, instr);
+}
+
+IrFunction* ir_new(void) {
+    IrFunction* fn = jm_calloc(1, sizeof(IrFunction));
+    fn->exit = -1;
+    ir_start(fn, ir_block(fn));
+    return fn;
+}
+
+void ir_free(IrFunction* fn) {
+    if (!fn) return;
+    for (int i = 0; i < fn->instr_count; i++) jm_free(fn->instrs[i].args);
+    for (int i = 0; i < fn->block_count; i++) {
+        jm_free(fn->blocks[i].instrs);
+        jm_free(fn->blocks[i].preds);
+    }
+    jm_free(fn->instrs);
+    jm_free(fn->blocks);
+    jm_free(fn->vars);
+    jm_free(fn->rpo);
+    jm_free(fn);
+}
+
+int ir_block(IrFunction* fn) {
+    if (fn->block_count >= fn->block_capacity) fn->blocks = grow(fn->blocks, &fn->block_capacity, sizeof(IrBlock));
+    IrBlock* block = &fn->blocks[fn->block_count];
+    memset(block, 0, sizeof(IrBlock));
+    block->term = IR_JUMP;
+    block->cond = -1;
+    block->idom = -1;
+    block->order = -1;
+    block->rpo = -1;
+    return fn->block_count++;
+}
+
+void ir_start(IrFunction* fn, int block) {
+    if (fn->blocks[block].order < 0) fn->blocks[block].order = fn->next_order++;
+}
+
+int ir_var(IrFunction* fn, IrVarKind kind, const char* name, int slot) {
+    if (fn->var_count >= fn->var_capacity) fn->vars = grow(fn->vars, &fn->var_capacity, sizeof(IrVar));
+    fn->vars[fn->var_count] = (IrVar){ kind, name, slot, 0, 0, 0 };
+    return fn->var_count++;
+}
+
+int ir_const(IrFunction* fn, int block, Value value) {
+    int instr = new_instr(fn, IR_CONST);
+    fn->instrs[instr].value = value;
+    ir_append(fn, block, instr);
+    return instr;
+}
+
+int ir_op(IrFunction* fn, int block, OpCode opcode, int operand, const int* args, int arg_count) {
+    int instr = new_instr(fn, IR_OP);
+    fn->instrs[instr].opcode = opcode;
+    fn->instrs[instr].operand = operand;
+    set_args(fn, instr, args, arg_count);
+    ir_append(fn, block, instr);
+    return instr;
+}
+
+int ir_phi(IrFunction* fn, int block, const int* args, int arg_count) {
+    int instr = new_instr(fn, IR_PHI);
+    set_args(fn, instr, args, arg_count);
+    insert_phi(fn, block, instr);
+    return instr;
+}
+
+int ir_get_var(IrFunction* fn, int block, int var) {
+    int instr = new_instr(fn, IR_GET_VAR);
+    fn->instrs[instr].var = var;
+    ir_append(fn, block, instr);
+    return instr;
+}
+
+void ir_set_var(IrFunction* fn, int block, int var, int value) {
+    int instr = new_instr(fn, IR_SET_VAR);
+    fn->instrs[instr].var = var;
+    set_args(fn, instr, &value, 1);
+    ir_append(fn, block, instr);
+    fn->vars[var].assigned = 1;
+}
+
+void ir_jump(IrFunction* fn, int block, int target) {
+    IrBlock* b = &fn->blocks[block];
+    b->term = IR_JUMP;
+    b->succ[0] = target;
+    b->succ_count = 1;
+}
+
+void ir_branch(IrFunction* fn, int block, int cond, int if_true, int if_false) {
+    IrBlock* b = &fn->blocks[block];
+    b->term = IR_BRANCH;
+    b->cond = cond;
+    b->succ[0] = if_true;
+    b->succ[1] = if_false;
+    b->succ_count = 2;
+}
+
+void ir_exit(IrFunction* fn, int block) {
+    fn->blocks[block].term = IR_EXIT;
+    fn->blocks[block].succ_count = 0;
+    fn->exit = block;
+}
+
+// ----------------------------
+// Analysis
+// ----------------------------
+
+int ir_effects(IrFunction* fn, int instr) {
+    IrInstr* in = &fn->instrs[instr];
+    if (in->kind == IR_STORE || in->kind == IR_SET_VAR) return IR_WRITES;
+    if (in->kind != IR_OP) return 0;
+    switch (in->opcode) {
+        case BC_EQUAL:
+        case BC_NOT_EQUAL:
+        case BC_NOT:
+        case BC_IS_INTEGER:
+            return 0;
+        case BC_ARRAY:
+            return IR_ALLOCS;
+        case BC_PRINT:
+            return IR_OUTPUT;
+        case BC_INDEX_GET_UNCHECKED:
+            return IR_READS;
+        case BC_INDEX_GET:
+        case BC_MAP_HAS:
+            return IR_READS | IR_TRAPS;
+        case BC_INDEX_SET:
+        case BC_INDEX_SET_UNCHECKED:
+            return IR_WRITES | IR_TRAPS;
+        case BC_CALL_NATIVE:
+            // Pure natives never fail, but may return a new array each time
+            if (natives[in->operand].flags & JM_NATIVE_PURE) return IR_ALLOCS;
+            return IR_WRITES | IR_OUTPUT | IR_TRAPS;
+        case BC_CALL_BUILTIN: {
+            const char* name = builtins[in->operand].name;
+            if (strcmp(name, "push") == 0) return IR_WRITES | IR_TRAPS;
+            if (strcmp(name, "map") == 0) return IR_ALLOCS;
+            if (strcmp(name, "scale") == 0 || strcmp(name, "add") == 0) return IR_ALLOCS | IR_READS | IR_TRAPS;
+            return IR_READS | IR_TRAPS;
+        }
+        default:
+            // Arithmetic, ordering and the intrinsics reject some operand types
+            return IR_TRAPS;
+    }
+}
+
+int ir_has_value(IrFunction* fn, int instr) {
+    IrInstr* in = &fn->instrs[instr];
+    switch (in->kind) {
+        case IR_SET_VAR:
+        case IR_STORE:
+            return 0;
+        case IR_OP:
+            return in->opcode != BC_PRINT && in->opcode != BC_INDEX_SET && in->opcode != BC_INDEX_SET_UNCHECKED;
+        default:
+            return 1;
+    }
+}
+
+void ir_remove(IrFunction* fn, int instr) {
+    int block = fn->instrs[instr].block;
+    if (block < 0) return;
+    IrBlock* b = &fn->blocks[block];
+    for (int i = 0; i < b->count; i++) {
+        if (b->instrs[i] != instr) continue;
+        memmove(&b->instrs[i], &b->instrs[i + 1], sizeof(int) * (b->count - i - 1));
+        b->count--;
+        break;
+    }
+    fn->instrs[instr].block = -1;
+}
+
+void ir_replace_uses(IrFunction* fn, int old, int replacement) {
+    for (int i = 0; i < fn->instr_count; i++) {
+        IrInstr* in = &fn->instrs[i];
+        if (in->block < 0) continue;
+        for (int k = 0; k < in->arg_count; k++) {
+            if (in->args[k] == old) in->args[k] = replacement;
+        }
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].term == IR_BRANCH && fn->blocks[b].cond == old) fn->blocks[b].cond = replacement;
+    }
+}
+
+// Walks up the dominator tree from a and b until they meet
+static int intersect(IrFunction* fn, int* idom, int a, int b) {
+    while (a != b) {
+        while (fn->blocks[a].rpo > fn->blocks[b].rpo) a = idom[a];
+        while (fn->blocks[b].rpo > fn->blocks[a].rpo) b = idom[b];
+    }
+    return a;
+}
+
+void ir_analyze(IrFunction* fn) {
+    int n = fn->block_count;
+
+    // Reverse postorder of the blocks reachable from the entry
+    int* state = jm_calloc(n, sizeof(int));
+    int* next = jm_calloc(n, sizeof(int));
+    int* stack = jm_alloc(sizeof(int) * n);
+    int* post = jm_alloc(sizeof(int) * n);
+    int top = 0;
+    int post_count = 0;
+    stack[top++] = 0;
+    state[0] = 1;
+    while (top > 0) {
+        IrBlock* block = &fn->blocks[stack[top - 1]];
+        if (next[stack[top - 1]] < block->succ_count) {
+            int succ = block->succ[next[stack[top - 1]]++];
+            if (!state[succ]) {
+                state[succ] = 1;
+                stack[top++] = succ;
+            }
+        } else {
+            post[post_count++] = stack[--top];
+        }
+    }
+    jm_free(fn->rpo);
+    fn->rpo = jm_alloc(sizeof(int) * (post_count > 0 ? post_count : 1));
+    fn->rpo_count = post_count;
+    for (int b = 0; b < n; b++) fn->blocks[b].rpo = -1;
+    for (int i = 0; i < post_count; i++) {
+        fn->rpo[i] = post[post_count - 1 - i];
+        fn->blocks[fn->rpo[i]].rpo = i;
+    }
+
+    // Unreachable blocks are emptied and lose their edges
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &fn->blocks[b];
+        if (block->rpo >= 0) continue;
+        for (int i = 0; i < block->count; i++) fn->instrs[block->instrs[i]].block = -1;
+        block->count = 0;
+        block->succ_count = 0;
+        block->pred_count = 0;
+        block->idom = -1;
+        if (fn->exit == b) fn->exit = -1;
+    }
+
+    // Predecessors in block order; phi inputs follow their edges
+    int** old_preds = jm_alloc(sizeof(int*) * n);
+    int* old_counts = jm_alloc(sizeof(int) * n);
+    for (int b = 0; b < n; b++) {
+        old_preds[b] = fn->blocks[b].preds;
+        old_counts[b] = fn->blocks[b].pred_count;
+        fn->blocks[b].preds = NULL;
+        fn->blocks[b].pred_count = 0;
+    }
+    int* capacity = jm_calloc(n, sizeof(int));
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &fn->blocks[b];
+        for (int k = 0; k < block->succ_count; k++) {
+            IrBlock* succ = &fn->blocks[block->succ[k]];
+            if (succ->pred_count >= capacity[block->succ[k]]) {
+                succ->preds = grow(succ->preds, &capacity[block->succ[k]], sizeof(int));
+            }
+            succ->preds[succ->pred_count++] = b;
+        }
+    }
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &fn->blocks[b];
+        if (old_preds[b]) {
+            char* taken = jm_calloc(old_counts[b] > 0 ? old_counts[b] : 1, 1);
+            int* from = jm_alloc(sizeof(int) * (block->pred_count > 0 ? block->pred_count : 1));
+            for (int j = 0; j < block->pred_count; j++) {
+                from[j] = -1;
+                for (int i = 0; i < old_counts[b]; i++) {
+                    if (!taken[i] && old_preds[b][i] == block->preds[j]) {
+                        taken[i] = 1;
+                        from[j] = i;
+                        break;
+                    }
+                }
+            }
+            for (int i = 0; i < block->count; i++) {
+                IrInstr* phi = &fn->instrs[block->instrs[i]];
+                if (phi->kind != IR_PHI) break;
+                int* args = jm_alloc(sizeof(int) * (block->pred_count > 0 ? block->pred_count : 1));
+                for (int j = 0; j < block->pred_count; j++) {
+                    args[j] = from[j] >= 0 && from[j] < phi->arg_count ? phi->args[from[j]] : -1;
+                }
+                jm_free(phi->args);
+                phi->args = args;
+                phi->arg_count = block->pred_count;
+            }
+            jm_free(taken);
+            jm_free(from);
+        }
+        jm_free(old_preds[b]);
+    }
+    jm_free(old_preds);
+    jm_free(old_counts);
+    jm_free(capacity);
+
+    // Dominators (Cooper, Harvey and Kennedy)
+    int* idom = jm_alloc(sizeof(int) * n);
+    for (int b = 0; b < n; b++) idom[b] = -1;
+    idom[0] = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < fn->rpo_count; i++) {
+            int b = fn->rpo[i];
+            int dom = -1;
+            for (int j = 0; j < fn->blocks[b].pred_count; j++) {
+                int pred = fn->blocks[b].preds[j];
+                if (idom[pred] < 0) continue;
+                dom = dom < 0 ? pred : intersect(fn, idom, pred, dom);
+            }
+            if (idom[b] != dom) {
+                idom[b] = dom;
+                changed = 1;
+            }
+        }
+    }
+    for (int b = 0; b < n; b++) fn->blocks[b].idom = b == 0 ? -1 : idom[b];
+
+    jm_free(idom);
+    jm_free(state);
+    jm_free(next);
+    jm_free(stack);
+    jm_free(post);
+}
+
+int ir_dominates(IrFunction* fn, int a, int b) {
+    for (; b >= 0; b = fn->blocks[b].idom) {
+        if (b == a) return 1;
+    }
+    return 0;
+}
+
+void ir_remove_dead(IrFunction* fn) {
+    // Phis with one distinct input besides themselves are that input
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < fn->instr_count; i++) {
+            IrInstr* phi = &fn->instrs[i];
+            if (phi->kind != IR_PHI || phi->block < 0) continue;
+            int same = -1;
+            int trivial = 1;
+            for (int k = 0; k < phi->arg_count && trivial; k++) {
+                if (phi->args[k] == i || phi->args[k] == same) continue;
+                if (same >= 0) trivial = 0;
+                else same = phi->args[k];
+            }
+            if (!trivial || same < 0) continue;
+            ir_replace_uses(fn, i, same);
+            ir_remove(fn, i);
+            changed = 1;
+        }
+    }
+
+    // Mark what effects and control flow need, sweep the rest
+    char* live = jm_calloc(fn->instr_count > 0 ? fn->instr_count : 1, 1);
+    IndexList work = { NULL, 0, 0 };
+    for (int i = 0; i < fn->instr_count; i++) {
+        if (fn->instrs[i].block >= 0 && (ir_effects(fn, i) & (IR_TRAPS | IR_WRITES | IR_OUTPUT))) {
+            live[i] = 1;
+            list_push(&work, i);
+        }
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        int cond = fn->blocks[b].cond;
+        if (fn->blocks[b].term == IR_BRANCH && fn->blocks[b].succ_count > 0 && cond >= 0 && !live[cond]) {
+            live[cond] = 1;
+            list_push(&work, cond);
+        }
+    }
+    while (work.count > 0) {
+        IrInstr* in = &fn->instrs[work.items[--work.count]];
+        for (int k = 0; k < in->arg_count; k++) {
+            int arg = in->args[k];
+            if (arg >= 0 && !live[arg]) {
+                live[arg] = 1;
+                list_push(&work, arg);
+            }
+        }
+    }
+    for (int i = 0; i < fn->instr_count; i++) {
+        if (!live[i] && fn->instrs[i].block >= 0) ir_remove(fn, i);
+    }
+    jm_free(work.items);
+    jm_free(live);
+}
+
+// ----------------------------
+// SSA construction
+// ----------------------------
+
+typedef struct {
+    IrFunction* fn;
+    IndexList* stacks;    // Per variable: its values along the dominator tree path
+    IndexList* children;  // Per block: blocks it immediately dominates
+    int* replace;         // Per IR_GET_VAR: the value it read
+    int* entries;         // Per variable: its IR_ENTRY, or -1
+    int undef;            // The IR_UNDEF
+} Renamer;
+
+static int has_home(IrFunction* fn, int var) {
+    return fn->vars[var].kind != IR_VAR_TEMP;
+}
+
+static int current_value(Renamer* r, int var) {
+    IndexList* stack = &r->stacks[var];
+    if (stack->count > 0) return stack->items[stack->count - 1];
+    return has_home(r->fn, var) ? r->entries[var] : r->undef;
+}
+
+static int resolve(Renamer* r, int value) {
+    return value >= 0 && r->replace[value] >= 0 ? r->replace[value] : value;
+}
+
+static void rename_block(Renamer* r, int b) {
+    IrFunction* fn = r->fn;
+    int* heights = jm_alloc(sizeof(int) * (fn->var_count > 0 ? fn->var_count : 1));
+    for (int v = 0; v < fn->var_count; v++) heights[v] = r->stacks[v].count;
+
+    IrBlock* block = &fn->blocks[b];
+    int kept = 0;
+    for (int i = 0; i < block->count; i++) {
+        int id = block->instrs[i];
+        IrInstr* in = &fn->instrs[id];
+        if (in->kind == IR_GET_VAR) {
+            r->replace[id] = current_value(r, in->var);
+            in->block = -1;
+            continue;
+        }
+        for (int k = 0; k < in->arg_count && in->kind != IR_PHI; k++) in->args[k] = resolve(r, in->args[k]);
+        if (in->kind == IR_SET_VAR) {
+            list_push(&r->stacks[in->var], in->args[0]);
+            in->block = -1;
+            continue;
+        }
+        if (in->kind == IR_PHI) list_push(&r->stacks[in->var], id);
+        block->instrs[kept++] = id;
+    }
+    block->count = kept;
+    if (block->term == IR_BRANCH) block->cond = resolve(r, block->cond);
+
+    // Fill in this block's inputs to the phis of its successors
+    for (int k = 0; k < block->succ_count; k++) {
+        IrBlock* succ = &fn->blocks[block->succ[k]];
+        for (int j = 0; j < succ->pred_count; j++) {
+            if (succ->preds[j] != b) continue;
+            for (int i = 0; i < succ->count; i++) {
+                IrInstr* phi = &fn->instrs[succ->instrs[i]];
+                if (phi->kind != IR_PHI) break;
+                phi->args[j] = current_value(r, phi->var);
+            }
+        }
+    }
+
+    // Homes assigned anywhere get their final values at the exit
+    if (b == fn->exit) {
+        for (int v = 0; v < fn->var_count; v++) {
+            if (!has_home(fn, v) || !fn->vars[v].assigned || fn->vars[v].dead) continue;
+            int value = current_value(r, v);
+            if (value == r->entries[v]) continue;
+            int store = new_instr(fn, IR_STORE);
+            fn->instrs[store].var = v;
+            set_args(fn, store, &value, 1);
+            ir_append(fn, b, store);
+        }
+    }
+
+    for (int i = 0; i < r->children[b].count; i++) rename_block(r, r->children[b].items[i]);
+
+    for (int v = 0; v < fn->var_count; v++) r->stacks[v].count = heights[v];
+    jm_free(heights);
+}
+
+void ir_build_ssa(IrFunction* fn) {
+    ir_analyze(fn);
+    int n = fn->block_count;
+    int vars = fn->var_count;
+
+    // Dominance frontiers
+    IndexList* frontier = jm_calloc(n, sizeof(IndexList));
+    for (int i = 0; i < fn->rpo_count; i++) {
+        IrBlock* block = &fn->blocks[fn->rpo[i]];
+        if (block->pred_count < 2) continue;
+        for (int j = 0; j < block->pred_count; j++) {
+            for (int runner = block->preds[j]; runner >= 0 && runner != block->idom; runner = fn->blocks[runner].idom) {
+                list_add(&frontier[runner], fn->rpo[i]);
+            }
+        }
+    }
+
+    // Variables read before being assigned in some block need phis
+    // (semi-pruned form); the exit reads every assigned home
+    char* exposed = jm_calloc(vars > 0 ? vars : 1, 1);
+    char* killed = jm_alloc(vars > 0 ? vars : 1);
+    IndexList* defs = jm_calloc(vars > 0 ? vars : 1, sizeof(IndexList));
+    for (int i = 0; i < fn->rpo_count; i++) {
+        IrBlock* block = &fn->blocks[fn->rpo[i]];
+        memset(killed, 0, vars > 0 ? vars : 1);
+        for (int k = 0; k < block->count; k++) {
+            IrInstr* in = &fn->instrs[block->instrs[k]];
+            if (in->kind == IR_GET_VAR && !killed[in->var]) exposed[in->var] = 1;
+            if (in->kind == IR_SET_VAR) {
+                killed[in->var] = 1;
+                list_add(&defs[in->var], fn->rpo[i]);
+            }
+        }
+    }
+
+    // Phis at the iterated dominance frontier of each variable's definitions
+    int* placed = jm_calloc(n, sizeof(int));
+    int* queued = jm_calloc(n, sizeof(int));
+    IndexList work = { NULL, 0, 0 };
+    for (int v = 0; v < vars; v++) {
+        if (has_home(fn, v) && fn->vars[v].assigned && !fn->vars[v].dead) exposed[v] = 1;
+        if (!exposed[v]) continue;
+        // A home holds a value on entry, as if assigned there
+        if (has_home(fn, v)) list_add(&defs[v], 0);
+        work.count = 0;
+        for (int i = 0; i < defs[v].count; i++) {
+            queued[defs[v].items[i]] = v + 1;
+            list_push(&work, defs[v].items[i]);
+        }
+        while (work.count > 0) {
+            int b = work.items[--work.count];
+            for (int i = 0; i < frontier[b].count; i++) {
+                int d = frontier[b].items[i];
+                if (placed[d] == v + 1) continue;
+                placed[d] = v + 1;
+                int phi = new_instr(fn, IR_PHI);
+                fn->instrs[phi].var = v;
+                set_args(fn, phi, NULL, fn->blocks[d].pred_count);
+                insert_phi(fn, d, phi);
+                if (queued[d] != v + 1) {
+                    queued[d] = v + 1;
+                    list_push(&work, d);
+                }
+            }
+        }
+    }
+
+    // Renaming along the dominator tree
+    Renamer r;
+    r.fn = fn;
+    r.stacks = jm_calloc(vars > 0 ? vars : 1, sizeof(IndexList));
+    r.children = jm_calloc(n, sizeof(IndexList));
+    r.entries = jm_alloc(sizeof(int) * (vars > 0 ? vars : 1));
+    for (int v = 0; v < vars; v++) {
+        r.entries[v] = -1;
+        if (!has_home(fn, v)) continue;
+        r.entries[v] = new_instr(fn, IR_ENTRY);
+        fn->instrs[r.entries[v]].var = v;
+        insert_at(fn, 0, 0, r.entries[v]);
+    }
+    r.undef = new_instr(fn, IR_UNDEF);
+    insert_at(fn, 0, 0, r.undef);
+    r.replace = jm_alloc(sizeof(int) * fn->instr_count);
+    for (int i = 0; i < fn->instr_count; i++) r.replace[i] = -1;
+    for (int i = 1; i < fn->rpo_count; i++) {
+        list_push(&r.children[fn->blocks[fn->rpo[i]].idom], fn->rpo[i]);
+    }
+    rename_block(&r, 0);
+
+    ir_remove_dead(fn);
+    for (int i = 0; i < fn->instr_count; i++) {
+        if (fn->instrs[i].kind == IR_PHI && fn->instrs[i].block >= 0) ir_stats.phis++;
+    }
+
+    free_lists(r.stacks, vars > 0 ? vars : 1);
+    free_lists(r.children, n);
+    jm_free(r.entries);
+    jm_free(r.replace);
+    jm_free(work.items);
+    jm_free(placed);
+    jm_free(queued);
+    free_lists(defs, vars > 0 ? vars : 1);
+    jm_free(killed);
+    jm_free(exposed);
+    free_lists(frontier, n);
+}
+
+// ----------------------------
+// Lowering
+// ----------------------------
+
+typedef struct {
+    IrFunction* fn;
+    Bytecode* bc;
+    int first_slot;
+    int* layout;          // Blocks in emission order
+    int layout_count;
+    int* position;        // Per instruction: its linear position
+    int* block_start;     // Per block: position before its first instruction
+    int* block_end;       // Per block: position of its terminator
+    int* uses;            // Per instruction: inputs it feeds
+    int* use_block;       // Per instruction: block of its last use
+    char* stacked;        // Per instruction: stays on the operand stack until used
+    int* slot;            // Per instruction: frame slot above first_slot, or -1
+    IndexList* ends;      // Per block: values its terminator consumes
+    IndexList* targets;   // Per block: the phis or stores those values go to
+} Lowering;
+
+static int is_rematerialized(IrFunction* fn, int instr) {
+    IrKind kind = fn->instrs[instr].kind;
+    return kind == IR_CONST || kind == IR_UNDEF || kind == IR_ENTRY;
+}
+
+// Blocks the lowering emits: reachable, plus the edge blocks it adds
+static int is_live_block(IrFunction* fn, int b) {
+    return fn->blocks[b].rpo >= 0;
+}
+
+/*
+ * Gives every edge from a branch into a block with phis a block of its
+ * own, so the phi copies of the edge have somewhere to go.
+ */
+static void split_critical_edges(IrFunction* fn) {
+    int count = fn->block_count;
+    for (int b = 0; b < count; b++) {
+        if (!is_live_block(fn, b) || fn->blocks[b].term != IR_BRANCH) continue;
+        for (int k = 0; k < 2; k++) {
+            int target = fn->blocks[b].succ[k];
+            IrBlock* succ = &fn->blocks[target];
+            if (succ->pred_count < 2 || succ->count == 0 || fn->instrs[succ->instrs[0]].kind != IR_PHI) continue;
+            int edge = ir_block(fn);
+            succ = &fn->blocks[target];
+            ir_jump(fn, edge, target);
+            fn->blocks[edge].rpo = fn->blocks[b].rpo;
+            fn->blocks[edge].order = succ->order;
+            fn->blocks[edge].preds = jm_alloc(sizeof(int));
+            fn->blocks[edge].preds[0] = b;
+            fn->blocks[edge].pred_count = 1;
+            for (int j = 0; j < succ->pred_count; j++) {
+                if (succ->preds[j] == b) {
+                    succ->preds[j] = edge;
+                    break;
+                }
+            }
+            fn->blocks[b].succ[k] = edge;
+        }
+    }
+}
+
+/*
+ * Layout: the order the builder started blocks in, with edge blocks just
+ * before their targets (where they fall through) and the exit last.
+ */
+static long layout_key(IrFunction* fn, int b, int original_count) {
+    int target = b >= original_count ? fn->blocks[b].succ[0] : b;
+    long order = target == fn->exit || fn->blocks[target].order < 0 ? 1L << 40 : fn->blocks[target].order;
+    return order * 2 + (b < original_count);
+}
+
+static void lay_out(Lowering* l, int original_count) {
+    IrFunction* fn = l->fn;
+    l->layout = jm_alloc(sizeof(int) * fn->block_count);
+    l->layout_count = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        if (!is_live_block(fn, b)) continue;
+        long key = layout_key(fn, b, original_count);
+        int i = l->layout_count++;
+        while (i > 0 && layout_key(fn, l->layout[i - 1], original_count) > key) {
+            l->layout[i] = l->layout[i - 1];
+            i--;
+        }
+        l->layout[i] = b;
+    }
+}
+
+// Values the terminator of block b consumes, defined in b first, in order
+static void collect_ends(Lowering* l, int b) {
+    IrFunction* fn = l->fn;
+    IrBlock* block = &fn->blocks[b];
+    IndexList* ends = &l->ends[b];
+    IndexList* targets = &l->targets[b];
+    if (block->term == IR_BRANCH) {
+        list_push(ends, block->cond);
+        list_push(targets, -1);
+        return;
+    }
+    if (block->term == IR_EXIT) {
+        for (int i = 0; i < block->count; i++) {
+            IrInstr* store = &fn->instrs[block->instrs[i]];
+            if (store->kind != IR_STORE) continue;
+            list_push(ends, store->args[0]);
+            list_push(targets, block->instrs[i]);
+        }
+    } else {
+        IrBlock* succ = &fn->blocks[block->succ[0]];
+        int j = 0;
+        while (j < succ->pred_count && succ->preds[j] != b) j++;
+        for (int i = 0; i < succ->count && j < succ->pred_count; i++) {
+            IrInstr* phi = &fn->instrs[succ->instrs[i]];
+            if (phi->kind != IR_PHI) break;
+            list_push(ends, phi->args[j]);
+            list_push(targets, succ->instrs[i]);
+        }
+    }
+
+    // Stable sort: values computed in this block, by position, then the rest
+    for (int i = 1; i < ends->count; i++) {
+        int value = ends->items[i];
+        int target = targets->items[i];
+        long key = fn->instrs[value].block == b ? l->position[value] : 1L << 40;
+        int k = i;
+        while (k > 0) {
+            int other = ends->items[k - 1];
+            long other_key = fn->instrs[other].block == b ? l->position[other] : 1L << 40;
+            if (other_key <= key) break;
+            ends->items[k] = ends->items[k - 1];
+            targets->items[k] = targets->items[k - 1];
+            k--;
+        }
+        ends->items[k] = value;
+        targets->items[k] = target;
+    }
+}
+
+static void add_use(Lowering* l, int value, int block) {
+    l->uses[value]++;
+    l->use_block[value] = block;
+}
+
+/*
+ * Checks that a user finds its stacked inputs where it needs them: a
+ * prefix of its inputs, on top of the model stack in order. On a
+ * mismatch the inputs in the way go to slots instead and 0 is returned.
+ */
+static int consume(Lowering* l, const int* args, int count, IndexList* stack) {
+    int k = 0;
+    while (k < count && l->stacked[args[k]]) k++;
+    for (int i = k; i < count; i++) {
+        if (l->stacked[args[i]]) {
+            l->stacked[args[i]] = 0;
+            return 0;
+        }
+    }
+    int matches = stack->count >= k;
+    for (int i = 0; i < k && matches; i++) {
+        matches = stack->items[stack->count - k + i] == args[i];
+    }
+    if (!matches) {
+        for (int i = 0; i < k; i++) {
+            for (int s = 0; s < stack->count; s++) {
+                if (stack->items[s] != args[i]) continue;
+                for (int above = s; above < stack->count; above++) l->stacked[stack->items[above]] = 0;
+                break;
+            }
+            l->stacked[args[i]] = 0;
+        }
+        return 0;
+    }
+    stack->count -= k;
+    return 1;
+}
+
+// Emitted as instructions of their own (phis, stores and constants are not)
+static int is_emitted(IrFunction* fn, int instr) {
+    IrKind kind = fn->instrs[instr].kind;
+    return kind == IR_OP;
+}
+
+/*
+ * Decides which values stay on the operand stack: each is used once, by
+ * an instruction or terminator of its own block, and the simulation of
+ * each block must find them in order on top of the stack. Values that
+ * break the order are demoted to slots until every block checks out.
+ */
+static void stackify(Lowering* l) {
+    IrFunction* fn = l->fn;
+    for (int i = 0; i < fn->instr_count; i++) {
+        l->stacked[i] = fn->instrs[i].block >= 0 && is_emitted(fn, i) && ir_has_value(fn, i) &&
+                        l->uses[i] == 1 && l->use_block[i] == fn->instrs[i].block;
+    }
+    IndexList stack = { NULL, 0, 0 };
+    int settled = 0;
+    while (!settled) {
+        settled = 1;
+        for (int n = 0; n < l->layout_count && settled; n++) {
+            IrBlock* block = &fn->blocks[l->layout[n]];
+            stack.count = 0;
+            for (int i = 0; i < block->count && settled; i++) {
+                int id = block->instrs[i];
+                if (!is_emitted(fn, id)) continue;
+                settled = consume(l, fn->instrs[id].args, fn->instrs[id].arg_count, &stack);
+                if (settled && l->stacked[id]) list_push(&stack, id);
+            }
+            if (settled) settled = consume(l, l->ends[l->layout[n]].items, l->ends[l->layout[n]].count, &stack);
+        }
+    }
+    jm_free(stack.items);
+}
+
+// Values kept in frame slots
+static int needs_slot(Lowering* l, int instr) {
+    IrFunction* fn = l->fn;
+    if (fn->instrs[instr].block < 0 || is_rematerialized(fn, instr) || !ir_has_value(fn, instr)) return 0;
+    if (fn->instrs[instr].kind == IR_PHI) return 1;
+    return fn->instrs[instr].kind == IR_OP && !l->stacked[instr] && l->uses[instr] > 0;
+}
+
+static void extend(int* lo, int* hi, int value, int position) {
+    if (lo[value] < 0 || position < lo[value]) lo[value] = position;
+    if (position > hi[value]) hi[value] = position;
+}
+
+/*
+ * Assigns slots. Liveness by the usual backward dataflow gives each
+ * value the positions it must survive; the span from first to last is
+ * its interval, and values whose intervals do not overlap share a slot.
+ * A phi is written at the end of each predecessor, so those count too.
+ * Returns the number of slots.
+ */
+static int allocate_slots(Lowering* l) {
+    IrFunction* fn = l->fn;
+    int n = fn->block_count;
+    int count = fn->instr_count;
+    char** live_in = jm_alloc(sizeof(char*) * n);
+    char** live_out = jm_alloc(sizeof(char*) * n);
+    for (int b = 0; b < n; b++) {
+        live_in[b] = jm_calloc(count, 1);
+        live_out[b] = jm_calloc(count, 1);
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = l->layout_count - 1; i >= 0; i--) {
+            int b = l->layout[i];
+            IrBlock* block = &fn->blocks[b];
+            char* out = live_out[b];
+            for (int k = 0; k < block->succ_count; k++) {
+                int s = block->succ[k];
+                for (int v = 0; v < count; v++) {
+                    if (live_in[s][v] && !(fn->instrs[v].kind == IR_PHI && fn->instrs[v].block == s)) out[v] = 1;
+                }
+            }
+            for (int k = 0; k < l->ends[b].count; k++) {
+                if (needs_slot(l, l->ends[b].items[k])) out[l->ends[b].items[k]] = 1;
+            }
+            // live_in = uses before definitions in b, plus live_out minus b's definitions
+            char* in = jm_alloc(count);
+            memcpy(in, out, count);
+            for (int k = block->count - 1; k >= 0; k--) {
+                int id = block->instrs[k];
+                in[id] = 0;
+                if (fn->instrs[id].kind == IR_PHI || fn->instrs[id].kind == IR_STORE) continue;
+                for (int a = 0; a < fn->instrs[id].arg_count; a++) {
+                    if (needs_slot(l, fn->instrs[id].args[a])) in[fn->instrs[id].args[a]] = 1;
+                }
+            }
+            if (memcmp(in, live_in[b], count) != 0) {
+                memcpy(live_in[b], in, count);
+                changed = 1;
+            }
+            jm_free(in);
+        }
+    }
+
+    int* lo = jm_alloc(sizeof(int) * count);
+    int* hi = jm_alloc(sizeof(int) * count);
+    for (int v = 0; v < count; v++) {
+        lo[v] = -1;
+        hi[v] = -1;
+    }
+    for (int i = 0; i < l->layout_count; i++) {
+        int b = l->layout[i];
+        IrBlock* block = &fn->blocks[b];
+        for (int v = 0; v < count; v++) {
+            if (live_in[b][v]) extend(lo, hi, v, l->block_start[b]);
+            if (live_out[b][v]) extend(lo, hi, v, l->block_end[b]);
+        }
+        for (int k = 0; k < block->count; k++) {
+            int id = block->instrs[k];
+            if (needs_slot(l, id)) extend(lo, hi, id, l->position[id]);
+            if (fn->instrs[id].kind == IR_PHI) {
+                for (int j = 0; j < block->pred_count; j++) extend(lo, hi, id, l->block_end[block->preds[j]]);
+                continue;
+            }
+            for (int a = 0; a < fn->instrs[id].arg_count; a++) {
+                int arg = fn->instrs[id].args[a];
+                if (needs_slot(l, arg)) extend(lo, hi, arg, l->position[id]);
+            }
+        }
+        for (int k = 0; k < l->ends[b].count; k++) {
+            if (needs_slot(l, l->ends[b].items[k])) extend(lo, hi, l->ends[b].items[k], l->block_end[b]);
+        }
+    }
+
+    // Greedy: by interval start, into the first slot free by then
+    int* order = jm_alloc(sizeof(int) * count);
+    int values = 0;
+    for (int v = 0; v < count; v++) {
+        if (!needs_slot(l, v)) continue;
+        int i = values++;
+        while (i > 0 && lo[order[i - 1]] > lo[v]) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = v;
+    }
+    int* busy_until = jm_alloc(sizeof(int) * (values > 0 ? values : 1));
+    int slots = 0;
+    for (int i = 0; i < values; i++) {
+        int v = order[i];
+        int s = 0;
+        while (s < slots && busy_until[s] >= lo[v]) s++;
+        if (s == slots) slots++;
+        busy_until[s] = hi[v];
+        l->slot[v] = s;
+    }
+
+    jm_free(busy_until);
+    jm_free(order);
+    jm_free(lo);
+    jm_free(hi);
+    for (int b = 0; b < n; b++) {
+        jm_free(live_in[b]);
+        jm_free(live_out[b]);
+    }
+    jm_free(live_in);
+    jm_free(live_out);
+    return slots;
+}
+
+static void push_value(Lowering* l, int value) {
+    IrFunction* fn = l->fn;
+    Bytecode* bc = l->bc;
+    IrInstr* in = &fn->instrs[value];
+    switch (in->kind) {
+        case IR_CONST:
+            bytecode_emit(bc, BC_CONST, bytecode_constant(bc, in->value));
+            break;
+        case IR_UNDEF:
+            bytecode_emit(bc, BC_CONST, bytecode_constant(bc, INT_VAL(0)));
+            break;
+        case IR_ENTRY: {
+            // Homes keep their entry values until the exit stores
+            IrVar* var = &fn->vars[in->var];
+            if (var->kind == IR_VAR_LOCAL) bytecode_emit(bc, BC_LOAD_LOCAL, var->slot);
+            else bytecode_emit(bc, BC_LOAD_VAR, bytecode_name(bc, var->name));
+            break;
+        }
+        default:
+            bytecode_emit(bc, BC_LOAD_LOCAL, l->first_slot + l->slot[value]);
+            break;
+    }
+}
+
+// Pushes the inputs not already on the stack (those follow the stacked prefix)
+static void push_inputs(Lowering* l, const int* args, int count) {
+    int k = 0;
+    while (k < count && l->stacked[args[k]]) k++;
+    for (; k < count; k++) push_value(l, args[k]);
+}
+
+static void emit_jump(Lowering* l, OpCode opcode, int target, IndexList* fixups) {
+    list_push(fixups, l->bc->count);
+    list_push(fixups, target);
+    bytecode_emit(l->bc, opcode, 0);
+}
+
+static void emit_block(Lowering* l, int b, int next, IndexList* fixups) {
+    IrFunction* fn = l->fn;
+    Bytecode* bc = l->bc;
+    IrBlock* block = &fn->blocks[b];
+    for (int i = 0; i < block->count; i++) {
+        int id = block->instrs[i];
+        if (!is_emitted(fn, id)) continue;
+        IrInstr* in = &fn->instrs[id];
+        push_inputs(l, in->args, in->arg_count);
+        bytecode_emit(bc, in->opcode, in->operand);
+        if (!ir_has_value(fn, id) || l->stacked[id]) continue;
+        if (l->uses[id] > 0) bytecode_emit(bc, BC_SET_LOCAL, l->first_slot + l->slot[id]);
+        else bytecode_emit(bc, BC_POP, 0);
+    }
+
+    IndexList* ends = &l->ends[b];
+    IndexList* targets = &l->targets[b];
+    push_inputs(l, ends->items, ends->count);
+    switch (block->term) {
+        case IR_JUMP:
+            // A parallel copy: every input is pushed before any phi is written
+            for (int k = targets->count - 1; k >= 0; k--) {
+                bytecode_emit(bc, BC_SET_LOCAL, l->first_slot + l->slot[targets->items[k]]);
+            }
+            if (block->succ[0] != next) emit_jump(l, BC_JUMP, block->succ[0], fixups);
+            break;
+        case IR_BRANCH:
+            if (block->succ[0] == next) {
+                emit_jump(l, BC_JUMP_IF_FALSE, block->succ[1], fixups);
+            } else if (block->succ[1] == next) {
+                emit_jump(l, BC_JUMP_IF_TRUE, block->succ[0], fixups);
+            } else {
+                emit_jump(l, BC_JUMP_IF_FALSE, block->succ[1], fixups);
+                emit_jump(l, BC_JUMP, block->succ[0], fixups);
+            }
+            break;
+        case IR_EXIT:
+            for (int k = targets->count - 1; k >= 0; k--) {
+                IrVar* var = &fn->vars[fn->instrs[targets->items[k]].var];
+                if (var->kind == IR_VAR_LOCAL) bytecode_emit(bc, BC_SET_LOCAL, var->slot);
+                else bytecode_emit(bc, var->defined ? BC_DEFINE_VAR : BC_SET_VAR, bytecode_name(bc, var->name));
+            }
+            break;
+    }
+}
+
+int ir_lower(IrFunction* fn, Bytecode* bc, int first_slot, int max_slot) {
+    int original_count = fn->block_count;
+    split_critical_edges(fn);
+
+    Lowering l;
+    l.fn = fn;
+    l.bc = bc;
+    l.first_slot = first_slot;
+    lay_out(&l, original_count);
+    int n = fn->block_count;
+    int count = fn->instr_count > 0 ? fn->instr_count : 1;
+    l.position = jm_calloc(count, sizeof(int));
+    l.block_start = jm_calloc(n, sizeof(int));
+    l.block_end = jm_calloc(n, sizeof(int));
+    l.uses = jm_calloc(count, sizeof(int));
+    l.use_block = jm_calloc(count, sizeof(int));
+    l.stacked = jm_calloc(count, 1);
+    l.slot = jm_alloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++) l.slot[i] = -1;
+    l.ends = jm_calloc(n, sizeof(IndexList));
+    l.targets = jm_calloc(n, sizeof(IndexList));
+
+    int position = 0;
+    for (int i = 0; i < l.layout_count; i++) {
+        IrBlock* block = &fn->blocks[l.layout[i]];
+        l.block_start[l.layout[i]] = position++;
+        for (int k = 0; k < block->count; k++) l.position[block->instrs[k]] = position++;
+        l.block_end[l.layout[i]] = position++;
+    }
+    for (int i = 0; i < l.layout_count; i++) {
+        int b = l.layout[i];
+        IrBlock* block = &fn->blocks[b];
+        collect_ends(&l, b);
+        for (int k = 0; k < block->count; k++) {
+            IrInstr* in = &fn->instrs[block->instrs[k]];
+            if (in->kind == IR_PHI || in->kind == IR_STORE) continue;
+            for (int a = 0; a < in->arg_count; a++) add_use(&l, in->args[a], b);
+        }
+        for (int k = 0; k < l.ends[b].count; k++) add_use(&l, l.ends[b].items[k], b);
+    }
+
+    stackify(&l);
+    int slots = allocate_slots(&l);
+    if (slots <= max_slot - first_slot) {
+        IndexList fixups = { NULL, 0, 0 };
+        int* address = jm_alloc(sizeof(int) * n);
+        for (int i = 0; i < l.layout_count; i++) {
+            address[l.layout[i]] = bc->count;
+            emit_block(&l, l.layout[i], i + 1 < l.layout_count ? l.layout[i + 1] : -1, &fixups);
+        }
+        for (int i = 0; i < fixups.count; i += 2) {
+            bc->instructions[fixups.items[i]].operand = address[fixups.items[i + 1]];
+        }
+        jm_free(address);
+        jm_free(fixups.items);
+        ir_stats.regions++;
+        ir_stats.blocks += l.layout_count;
+        ir_stats.slots += slots;
+    } else {
+        ir_stats.fallbacks++;
+        slots = -1;
+    }
+
+    free_lists(l.ends, n);
+    free_lists(l.targets, n);
+    jm_free(l.layout);
+    jm_free(l.position);
+    jm_free(l.block_start);
+    jm_free(l.block_end);
+    jm_free(l.uses);
+    jm_free(l.use_block);
+    jm_free(l.stacked);
+    jm_free(l.slot);
+    return slots;
+}
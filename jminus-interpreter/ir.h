@@ -0,0 +1,244 @@
+/**
+ * @file ir.h
+ * @brief SSA intermediate representation between the AST and bytecode
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The compiler turns runs of statements with control flow into a control
+ * flow graph of basic blocks in SSA form, so optimizations work on values
+ * and edges rather than on the shape of the tree, then lowers the graph
+ * back to the bytecode of compiler.h. Passes are written once against
+ * this IR and shared by whatever backend lowers it.
+ *
+ * Instructions:
+ * - IR_OP applies a bytecode opcode (BC_ADD, BC_INDEX_GET, BC_PRINT, ...)
+ *   to its inputs, with the opcode's operand, so the IR speaks the same
+ *   vocabulary as the VM; ir_effects() says what each may do besides
+ *   producing its value
+ * - Every instruction is its value; inputs name other instructions
+ *
+ * Variables and Regions:
+ * - A region is the code of one run of statements. Its variables are
+ *   frame slots and globals of the code around it ("homes"), and locals
+ *   declared inside it, which have no home
+ * - The builder reads and writes variables with IR_GET_VAR and
+ *   IR_SET_VAR; ir_build_ssa() replaces them with values: a home's value
+ *   on entry is IR_ENTRY, and IR_STORE writes final values back to the
+ *   homes assigned inside, once, at the exit
+ *
+ * SSA Construction (Cytron et al.):
+ * 1. Unreachable blocks are dropped and predecessors recorded
+ * 2. Dominators by the iterative algorithm of Cooper, Harvey and Kennedy
+ *    over reverse postorder, then dominance frontiers
+ * 3. Phis for each variable live across blocks, at the iterated
+ *    dominance frontier of the blocks assigning it
+ * 4. Renaming along the dominator tree; phis with one distinct input and
+ *    instructions nothing needs are removed
+ *
+ * Lowering:
+ * - Blocks are laid out in the order the builder started them, so code
+ *   reads like the tree walk's; jumps to the next block are omitted
+ * - A value used once, by the next instructions of its own block in stack
+ *   order, stays on the operand stack; others get a frame slot, and
+ *   values whose lifetimes do not overlap share one. Constants are pushed
+ *   where used
+ * - Phi inputs are pushed together at the end of each predecessor and
+ *   popped into the phis' slots, a parallel copy; critical edges into
+ *   blocks with phis get a block of their own
+ */
+
+#ifndef IR_H
+#define IR_H
+
+#include "compiler.h"
+
+/**
+ * @brief Kinds of IR instructions
+ */
+typedef enum {
+    IR_CONST,    ///< The constant value
+    IR_UNDEF,    ///< A variable no path has assigned (a dead phi's input)
+    IR_ENTRY,    ///< Variable var's home on entry to the region
+    IR_PHI,      ///< One input per predecessor, in predecessor order
+    IR_OP,       ///< opcode with operand applied to the inputs
+    IR_GET_VAR,  ///< Read variable var (before SSA construction)
+    IR_SET_VAR,  ///< Assign the input to variable var (before SSA construction)
+    IR_STORE     ///< Write the input back to var's home (exit block only)
+} IrKind;
+
+/**
+ * @brief How a block ends
+ */
+typedef enum {
+    IR_JUMP,     ///< Continue at succ[0]
+    IR_BRANCH,   ///< succ[0] if cond is true, else succ[1]
+    IR_EXIT      ///< Leave the region (the exit block)
+} IrTerm;
+
+/**
+ * @brief Where a region variable lives outside the region
+ */
+typedef enum {
+    IR_VAR_LOCAL,   ///< Frame slot
+    IR_VAR_GLOBAL,  ///< Global variable
+    IR_VAR_TEMP     ///< Nowhere: declared inside the region
+} IrVarKind;
+
+/// ir_effects() flags
+#define IR_TRAPS  0x1   ///< May stop the program with a runtime error
+#define IR_READS  0x2   ///< Reads array or map contents
+#define IR_WRITES 0x4   ///< Changes array or map contents, or calls host code
+#define IR_ALLOCS 0x8   ///< Yields a new object each time
+#define IR_OUTPUT 0x10  ///< Prints
+
+typedef struct {
+    IrKind kind;
+    OpCode opcode;    ///< IR_OP: the operation
+    int operand;      ///< IR_OP: the bytecode operand
+    Value value;      ///< IR_CONST: the constant
+    int var;          ///< IR_ENTRY, IR_GET_VAR, IR_SET_VAR, IR_STORE: the variable
+    int block;        ///< Block holding it, -1 once removed
+    int* args;        ///< Inputs (owned)
+    int arg_count;    ///< Number of inputs
+} IrInstr;
+
+typedef struct {
+    int* instrs;      ///< Instructions in order, phis first (owned)
+    int count;
+    int capacity;
+    IrTerm term;      ///< How the block ends
+    int cond;         ///< IR_BRANCH: the condition
+    int succ[2];      ///< Successors (see term)
+    int succ_count;
+    int* preds;       ///< Predecessors, set by ir_build_ssa() (owned)
+    int pred_count;
+    int idom;         ///< Immediate dominator, -1 for the entry and removed blocks
+    int order;        ///< Layout position: when the builder started it, -1 if never
+    int rpo;          ///< Position in reverse postorder, -1 if unreachable
+} IrBlock;
+
+typedef struct {
+    IrVarKind kind;
+    const char* name; ///< Variable name (points into token lexemes)
+    int slot;         ///< IR_VAR_LOCAL: frame slot
+    int defined;      ///< IR_VAR_GLOBAL: declared by a let inside the region
+    int assigned;     ///< Nonzero once an IR_SET_VAR writes it
+    int dead;         ///< IR_VAR_LOCAL: nothing reads the slot after the region (no store)
+} IrVar;
+
+/**
+ * @brief A region's control flow graph
+ */
+typedef struct {
+    IrInstr* instrs;  ///< Every instruction ever made, by index
+    int instr_count;
+    int instr_capacity;
+    IrBlock* blocks;  ///< Every block ever made, by index; 0 is the entry
+    int block_count;
+    int block_capacity;
+    IrVar* vars;
+    int var_count;
+    int var_capacity;
+    int exit;         ///< The exit block
+    int* rpo;         ///< Reachable blocks in reverse postorder (owned)
+    int rpo_count;
+    int next_order;   ///< Next layout position
+} IrFunction;
+
+/**
+ * @brief Counters over the regions of the program compiled last (reset by compile())
+ */
+typedef struct {
+    long regions;     ///< Regions lowered to bytecode
+    long fallbacks;   ///< Regions left to the tree walk (too many slots)
+    long blocks;      ///< Blocks lowered
+    long phis;        ///< Phis left after SSA construction
+    long slots;       ///< Frame slots the regions needed, in total
+    long constants;   ///< Values found constant (passes.h)
+    long branches;    ///< Branches decided at compile time
+    long redundant;   ///< Operations replaced by an earlier twin
+    long hoisted;     ///< Operations moved out of loops
+    long closed;      ///< Loops given a closed form
+} IrStats;
+
+extern IrStats ir_stats;
+
+// ----------------------------
+// Building
+// ----------------------------
+
+IrFunction* ir_new(void);
+void ir_free(IrFunction* fn);
+
+/// A new empty block (its order is set when ir_start() first selects it)
+int ir_block(IrFunction* fn);
+
+/// Gives block its layout position if it has none yet
+void ir_start(IrFunction* fn, int block);
+
+int ir_var(IrFunction* fn, IrVarKind kind, const char* name, int slot);
+
+int ir_const(IrFunction* fn, int block, Value value);
+int ir_op(IrFunction* fn, int block, OpCode opcode, int operand, const int* args, int arg_count);
+
+/// A phi with one input per predecessor of block, in predecessor order (for passes)
+int ir_phi(IrFunction* fn, int block, const int* args, int arg_count);
+int ir_get_var(IrFunction* fn, int block, int var);
+void ir_set_var(IrFunction* fn, int block, int var, int value);
+
+void ir_jump(IrFunction* fn, int block, int target);
+void ir_branch(IrFunction* fn, int block, int cond, int if_true, int if_false);
+
+/// Ends the region at block, which gets the stores of assigned homes
+void ir_exit(IrFunction* fn, int block);
+
+// ----------------------------
+// Analysis
+// ----------------------------
+
+/**
+ * @brief Puts the function in SSA form (see the file comment)
+ *
+ * Afterwards every block's preds, idom and rpo are set and no
+ * IR_GET_VAR or IR_SET_VAR is left.
+ */
+void ir_build_ssa(IrFunction* fn);
+
+/// Recomputes predecessors, reverse postorder and dominators after edges change
+void ir_analyze(IrFunction* fn);
+
+/// Nonzero if block a dominates block b
+int ir_dominates(IrFunction* fn, int a, int b);
+
+/// What an instruction may do besides yielding its value (IR_* flags)
+int ir_effects(IrFunction* fn, int instr);
+
+/// Nonzero if the instruction yields a value
+int ir_has_value(IrFunction* fn, int instr);
+
+/// Appends instr to block, before its stores if it is the exit block
+void ir_append(IrFunction* fn, int block, int instr);
+
+/// Replaces every use of value old with value replacement
+void ir_replace_uses(IrFunction* fn, int old, int replacement);
+
+/// Takes instr out of its block (its uses must be gone)
+void ir_remove(IrFunction* fn, int instr);
+
+/// Removes phis with one distinct input and instructions nothing needs
+void ir_remove_dead(IrFunction* fn);
+
+// ----------------------------
+// Lowering
+// ----------------------------
+
+/**
+ * @brief Appends the region's bytecode to bc
+ * @param first_slot First frame slot the region may use for its values
+ * @param max_slot One past the last slot it may use
+ * @return Slots used above first_slot, or -1 (emitting nothing) if more
+ *         than max_slot - first_slot would be needed
+ */
+int ir_lower(IrFunction* fn, Bytecode* bc, int first_slot, int max_slot);
+
+#endif // IR_H
@@ -3,11 +3,12 @@
 #include <string.h>
 #include <ctype.h>
 #include "lexer.h"
+#include "allocator.h"
 
 // Uncomment this to enable debug logging
 // #define DEBUG
 
-#define MAX_TOKENS 1024
+#define INITIAL_TOKENS 1024
 
 typedef struct {
     char ch;
@@ -34,6 +35,8 @@ Keyword keywords[] = {
     { "if", TOKEN_IF },
     { "else", TOKEN_ELSE },      
     { "while", TOKEN_WHILE },
+    { "true", TOKEN_TRUE },
+    { "false", TOKEN_FALSE },
     { NULL, TOKEN_UNKNOWN }
   };
 
@@ -49,15 +52,71 @@ TokenType check_keyword(const char* str) {
 Token make_token(TokenType type, const char* start, int length, int line) {
   Token token;
   token.type = type;
-  token.lexeme = (char*)malloc(length + 1);
+  token.lexeme = (char*)jm_alloc(length + 1);
   strncpy(token.lexeme, start, length);
   token.lexeme[length] = '\0';
   token.line = line;
   return token;
 }
 
+// Grows the token array so at least two more tokens fit (one plus EOF)
+static Token* reserve_tokens(Token* tokens, int count, int* capacity) {
+  if (count + 2 <= *capacity) return tokens;
+  *capacity *= 2;
+  tokens = jm_realloc(tokens, sizeof(Token) * *capacity);
+  if (!tokens) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(1);
+  }
+  return tokens;
+}
+
+// Scans a string literal starting at the opening quote, decoding escapes
+// into the lexeme. The decoded text is never longer than the source.
+static Token lex_string(const char** cursor, int* line) {
+  const char* current = *cursor + 1;
+  int start_line = *line;
+
+  const char* end = current;
+  while (*end != '"') {
+    if (*end == '\0') {
+      fprintf(stderr, "Lexing error: unterminated string starting at line %d\n", start_line);
+      exit(1);
+    }
+    end += (*end == '\\' && end[1] != '\0') ? 2 : 1;
+  }
+
+  Token token;
+  token.type = TOKEN_STRING;
+  token.line = start_line;
+  token.lexeme = jm_alloc(end - current + 1);
+  int length = 0;
+
+  while (current < end) {
+    char ch = *current++;
+    if (ch == '\n') (*line)++;
+    if (ch == '\\') {
+      switch (*current) {
+        case 'n': ch = '\n'; break;
+        case 't': ch = '\t'; break;
+        case '"': ch = '"'; break;
+        case '\\': ch = '\\'; break;
+        default:
+          fprintf(stderr, "Lexing error: unknown escape '\\%c' in string at line %d\n", *current, *line);
+          exit(1);
+      }
+      current++;
+    }
+    token.lexeme[length++] = ch;
+  }
+  token.lexeme[length] = '\0';
+  *cursor = current + 1;
+  return token;
+}
+
 Token* tokenize(const char* src, int* token_count) {
-  Token* tokens = malloc(sizeof(Token) * MAX_TOKENS);
+  int capacity = INITIAL_TOKENS;
+  Token* tokens = jm_alloc(sizeof(Token) * capacity);
   int count = 0;
   int line = 1;
 
@@ -74,6 +133,7 @@ while (*current != '\0' && *current != EOF) {
 #endif
 
     start = current;
+    tokens = reserve_tokens(tokens, count, &capacity);
 
     if (isspace(*current)) {
       if (*current == '\n') line++;
@@ -85,20 +145,39 @@ while (*current != '\0' && *current != EOF) {
       while (isalnum(*current) || *current == '_') current++;
 
       int length = current - start;
-      char* temp = malloc(length + 1);
+      char* temp = jm_alloc(length + 1);
       strncpy(temp, start, length);
       temp[length] = '\0';
 
       TokenType type = check_keyword(temp);
-      free(temp);
+      jm_free(temp);
       
       tokens[count++] = make_token(type, start, current - start, line);
       continue;
     }
 
     if (isdigit(*current)) {
+      TokenType type = TOKEN_INT;
       while (isdigit(*current)) current++;
-      tokens[count++] = make_token(TOKEN_INT, start, current - start, line);
+
+      // A fraction and/or exponent makes it a float: 1.5, 2e3, 1.5e-3
+      if (*current == '.' && isdigit(*(current + 1))) {
+        type = TOKEN_FLOAT;
+        current++;
+        while (isdigit(*current)) current++;
+      }
+      if ((*current == 'e' || *current == 'E') &&
+          (isdigit(*(current + 1)) ||
+           ((*(current + 1) == '+' || *(current + 1) == '-') && isdigit(*(current + 2))))) {
+        type = TOKEN_FLOAT;
+        current += 2;
+        while (isdigit(*current)) current++;
+      }
+      tokens[count++] = make_token(type, start, current - start, line);
+      continue;
+    }
+    if (*current == '"') {
+      tokens[count++] = lex_string(&current, &line);
       continue;
     }
     // Handle line comments (//...)
@@ -111,6 +190,26 @@ while (*current != '\0' && *current != EOF) {
       case '-': tokens[count++] = make_token(TOKEN_MINUS, current++, 1, line); break;
       case '*': tokens[count++] = make_token(TOKEN_STAR, current++, 1, line); break;
       case '/': tokens[count++] = make_token(TOKEN_SLASH, current++, 1, line); break;
+      case '%': tokens[count++] = make_token(TOKEN_PERCENT, current++, 1, line); break;
+      case '&':
+        if (*(current + 1) == '&') {
+          tokens[count++] = make_token(TOKEN_AMP_AMP, current, 2, line);
+          current += 2;
+        } else {
+          tokens[count++] = make_token(TOKEN_AMP, current++, 1, line);
+        }
+        break;
+
+      case '|':
+        if (*(current + 1) == '|') {
+          tokens[count++] = make_token(TOKEN_PIPE_PIPE, current, 2, line);
+          current += 2;
+        } else {
+          tokens[count++] = make_token(TOKEN_PIPE, current++, 1, line);
+        }
+        break;
+
+      case '^': tokens[count++] = make_token(TOKEN_CARET, current++, 1, line); break;
 
       case '=':
         if (*(current + 1) == '=') {
@@ -131,7 +230,10 @@ while (*current != '\0' && *current != EOF) {
         break;
 
       case '<':
-        if (*(current + 1) == '=') {
+        if (*(current + 1) == '<') {
+          tokens[count++] = make_token(TOKEN_LESS_LESS, current, 2, line);
+          current += 2;
+        } else if (*(current + 1) == '=') {
           tokens[count++] = make_token(TOKEN_LESS_EQUAL, current, 2, line);
           current += 2;
         } else {
@@ -140,7 +242,10 @@ while (*current != '\0' && *current != EOF) {
         break;
 
       case '>':
-        if (*(current + 1) == '=') {
+        if (*(current + 1) == '>') {
+          tokens[count++] = make_token(TOKEN_GREATER_GREATER, current, 2, line);
+          current += 2;
+        } else if (*(current + 1) == '=') {
           tokens[count++] = make_token(TOKEN_GREATER_EQUAL, current, 2, line);
           current += 2;
         } else {
@@ -150,10 +255,14 @@ while (*current != '\0' && *current != EOF) {
 
       case ';': tokens[count++] = make_token(TOKEN_SEMICOLON, current++, 1, line); break;
       case ',': tokens[count++] = make_token(TOKEN_COMMA, current++, 1, line); break;
+      case '.': tokens[count++] = make_token(TOKEN_DOT, current++, 1, line); break;
+      case ':': tokens[count++] = make_token(TOKEN_COLON, current++, 1, line); break;
       case '(': tokens[count++] = make_token(TOKEN_LPAREN, current++, 1, line); break;
       case ')': tokens[count++] = make_token(TOKEN_RPAREN, current++, 1, line); break;
       case '{': tokens[count++] = make_token(TOKEN_LBRACE, current++, 1, line); break;
       case '}': tokens[count++] = make_token(TOKEN_RBRACE, current++, 1, line); break;
+      case '[': tokens[count++] = make_token(TOKEN_LBRACKET, current++, 1, line); break;
+      case ']': tokens[count++] = make_token(TOKEN_RBRACKET, current++, 1, line); break;
 
       default:
       if (unexpected_count < MAX_UNEXPECTED) {
@@ -186,9 +295,9 @@ while (*current != '\0' && *current != EOF) {
 
 void free_tokens(Token* tokens, int count) {
   for (int i = 0; i < count; i++) {
-    free(tokens[i].lexeme);
+    jm_free(tokens[i].lexeme);
   }
-  free(tokens);
+  jm_free(tokens);
 }
 
 const char* token_type_to_string(TokenType type) {
@@ -200,14 +309,25 @@ const char* token_type_to_string(TokenType type) {
     case TOKEN_IF: return "IF";
     case TOKEN_WHILE: return "WHILE";
     case TOKEN_ELSE: return "ELSE";
+    case TOKEN_TRUE: return "TRUE";
+    case TOKEN_FALSE: return "FALSE";
     case TOKEN_IDENTIFIER: return "IDENTIFIER";
     case TOKEN_INT: return "INT";
     case TOKEN_FLOAT: return "FLOAT";
+    case TOKEN_STRING: return "STRING";
     case TOKEN_ASSIGN: return "ASSIGN";
     case TOKEN_PLUS: return "PLUS";
     case TOKEN_MINUS: return "MINUS";
     case TOKEN_STAR: return "STAR";
     case TOKEN_SLASH: return "SLASH";
+    case TOKEN_PERCENT: return "PERCENT";
+    case TOKEN_AMP: return "AMP";
+    case TOKEN_PIPE: return "PIPE";
+    case TOKEN_AMP_AMP: return "AMP_AMP";
+    case TOKEN_PIPE_PIPE: return "PIPE_PIPE";
+    case TOKEN_CARET: return "CARET";
+    case TOKEN_LESS_LESS: return "LESS_LESS";
+    case TOKEN_GREATER_GREATER: return "GREATER_GREATER";
     case TOKEN_EQUAL: return "EQUAL";
     case TOKEN_BANG: return "BANG";
     case TOKEN_BANG_EQUAL: return "BANG_EQUAL";
@@ -219,7 +339,11 @@ const char* token_type_to_string(TokenType type) {
     case TOKEN_RPAREN: return "RPAREN";
     case TOKEN_LBRACE: return "LBRACE";
     case TOKEN_RBRACE: return "RBRACE";
+    case TOKEN_LBRACKET: return "LBRACKET";
+    case TOKEN_RBRACKET: return "RBRACKET";
     case TOKEN_COMMA: return "COMMA";
+    case TOKEN_DOT: return "DOT";
+    case TOKEN_COLON: return "COLON";
     case TOKEN_SEMICOLON: return "SEMICOLON";
     case TOKEN_EOF: return "EOF";
     case TOKEN_UNKNOWN: return "UNKNOWN";
@@ -8,9 +8,9 @@
  * Each token represents a meaningful unit of the language:
  * - Keywords (let, if, while, etc.)
  * - Identifiers (variable names)
- * - Literals (numbers)
+ * - Literals (integers, floats, strings, true/false)
  * - Operators (+, -, *, /, etc.)
- * - Delimiters (parentheses, braces, semicolons)
+ * - Delimiters (parentheses, braces, brackets, semicolons)
  * 
  * Token Structure:
  * - type: The kind of token (keyword, identifier, etc.)
@@ -52,11 +52,14 @@ typedef enum {
     TOKEN_IF,
     TOKEN_WHILE,
     TOKEN_ELSE,
+    TOKEN_TRUE,
+    TOKEN_FALSE,
 
     // Identifiers and literals
     TOKEN_IDENTIFIER,
     TOKEN_INT,
     TOKEN_FLOAT,
+    TOKEN_STRING,      // "text"; the lexeme is the unescaped text
 
     // Operators
     TOKEN_ASSIGN,      // =
@@ -64,6 +67,14 @@ typedef enum {
     TOKEN_MINUS,       // -
     TOKEN_STAR,        // *
     TOKEN_SLASH,       // /
+    TOKEN_PERCENT,     // %
+    TOKEN_AMP,         // &
+    TOKEN_PIPE,        // |
+    TOKEN_AMP_AMP,     // && (short-circuit)
+    TOKEN_PIPE_PIPE,   // || (short-circuit)
+    TOKEN_CARET,       // ^
+    TOKEN_LESS_LESS,   // <<
+    TOKEN_GREATER_GREATER, // >>
     TOKEN_EQUAL,       // ==
     TOKEN_BANG,        // !
     TOKEN_BANG_EQUAL,  // !=
@@ -78,8 +89,12 @@ typedef enum {
     TOKEN_RPAREN,      // )
     TOKEN_LBRACE,      // {
     TOKEN_RBRACE,      // }
+    TOKEN_LBRACKET,    // [
+    TOKEN_RBRACKET,    // ]
     TOKEN_SEMICOLON,   // ;
     TOKEN_COMMA,       // ,
+    TOKEN_DOT,         // .
+    TOKEN_COLON,       // :
 
     // Special
     TOKEN_EOF,
@@ -120,7 +135,10 @@ typedef struct {
  * Tokenization Rules:
  * - Keywords are recognized by exact string matches
  * - Identifiers start with a letter and contain letters/digits
- * - Numbers are sequences of digits (integers only)
+ * - Numbers are sequences of digits; a fraction (1.5) or an exponent
+ *   (2e3, 1.5e-3) makes them TOKEN_FLOAT, otherwise they are TOKEN_INT
+ * - Strings are enclosed in double quotes and may span lines; the escapes
+ *   \n, \t, \" and \\ are decoded into the lexeme
  * - Operators are single or double characters
  * - Whitespace separates tokens but is not tokenized
  * - Line numbers are tracked for error reporting
@@ -132,6 +150,8 @@ typedef struct {
  * 
  * Error Handling:
  * - Invalid characters produce TOKEN_ERROR tokens
+ * - Unterminated strings and unknown escapes are reported with their
+ *   line and end tokenizing
  * - Line numbers are preserved for error reporting
  * - Tokenization continues despite individual errors
  */
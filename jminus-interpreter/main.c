@@ -33,6 +33,9 @@
 #include "parser.h"     // Include our custom parser header for creating abstract syntax tree
 #include "compiler.h"   // Include our custom compiler header for bytecode generation
 #include "vm.h"         // Include our custom virtual machine header for code execution
+#include "object.h"     // Include heap object management for freeing runtime objects
+#include "simd.h"       // Include array kernel dispatch for reporting the selected level
+#include "gc.h"         // Include the garbage collector for reporting its counters
 
 /**
  * @brief Reads an entire file into memory as a null-terminated string
@@ -213,6 +216,19 @@ int main(int argc, char* argv[]) {
     // Execute the bytecode in our virtual machine
     // This runs the compiled instructions and produces the program's output
     run(bytecode);
+
+    // If debug mode is enabled, report how the arithmetic sites specialized
+    if (debug) {
+        printf("\n--- VM ---\n");
+        printf("Quickened sites: %ld, deoptimizations: %ld\n",
+               vm_stats.quickenings, vm_stats.deoptimizations);
+        printf("Array kernels: %s\n", simd_kernels()->name);
+        printf("GC: %ld minor, %ld major, %zu bytes allocated, %zu promoted, %ld objects freed\n",
+               gc_stats.minor_collections, gc_stats.major_collections,
+               gc_stats.nursery_bytes, gc_stats.promoted_bytes, gc_stats.freed_objects);
+        printf("GC pauses: %ld, p99 under %.0f us, longest %.0f us\n",
+               gc_stats.pauses, gc_pause_percentile(0.99), gc_stats.max_pause_micros);
+    }
     
     // Clean up memory - free the AST
     free_ast(stmts, stmt_count);
@@ -223,6 +239,9 @@ int main(int argc, char* argv[]) {
     // Clean up memory - free the bytecode
     free_bytecode(bytecode);
     
+    // Clean up memory - free every heap object still alive, and the VM globals
+    free_objects();
+
     // Clean up memory - free the source code string
     free(source);
     
@@ -0,0 +1,202 @@
+/**
+ * @file map.c
+ * @brief Hash maps for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Groups are aligned: group g covers slots [16g, 16g + 16), so a probe
+ * never wraps around inside a group and the control bytes need no cloned
+ * tail. There is no removal, so a slot is either empty or in use and the
+ * top bit of a control byte alone marks the empty ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+#include "str.h"
+#include "gc.h"
+#include "allocator.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAP_MIN_CAPACITY 16
+
+// ----------------------------
+// Hashing
+// ----------------------------
+// splitmix64 finalizer: spreads every input bit over the whole word
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t hash_value(Value value) {
+    if (IS_STRING_OBJ(value)) return mix(string_hash(AS_STRING_OBJ(value)));
+    if (is_double(value) || is_bigint(value)) {
+        // Numbers that compare equal must hash alike: integral doubles in
+        // the tagged range hash as the int, everything else by its double
+        double number = to_double(value);
+        if (number >= (double)INT_VALUE_MIN && number < (double)INT_VALUE_MAX &&
+            (double)(int64_t)number == number) {
+            return mix(INT_VAL((int64_t)number));
+        }
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return mix(bits);
+    }
+    // Ints and booleans by value, other objects by identity
+    return mix(value);
+}
+
+// The same bits are the same key, except a double, which may be NaN and
+// so unequal even to itself
+static inline int keys_equal(Value a, Value b) {
+    if (a == b && !is_double(a)) return 1;
+    return values_equal(a, b);
+}
+
+// ----------------------------
+// Group probing
+// ----------------------------
+// Bit i of the result is set when control byte i of the group is byte
+static inline uint32_t match_byte(const uint8_t* group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i control = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)byte)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < MAP_GROUP_WIDTH; i++) mask |= (uint32_t)(group[i] == byte) << i;
+    return mask;
+#endif
+}
+
+// Bit i of the result is set when slot i of the group is empty
+static inline uint32_t match_empty(const uint8_t* group) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    return match_byte(group, MAP_EMPTY);
+#endif
+}
+
+// Returns the slot holding key, or -1
+static int find_slot(ObjMap* map, Value key, uint64_t hash) {
+    if (map->capacity == 0) return -1;
+    uint8_t h2 = hash & 0x7F;
+    size_t group_mask = map->capacity / MAP_GROUP_WIDTH - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t step = 1; ; step++) {
+        const uint8_t* control = map->control + group * MAP_GROUP_WIDTH;
+        for (uint32_t matches = match_byte(control, h2); matches; matches &= matches - 1) {
+            int slot = (int)(group * MAP_GROUP_WIDTH) + __builtin_ctz(matches);
+            if (keys_equal(map->keys[slot], key)) return slot;
+        }
+        // The key would have gone in the first empty slot of its sequence
+        if (match_empty(control)) return -1;
+        group = (group + step) & group_mask;
+    }
+}
+
+// Puts a key known to be absent in the first empty slot of its sequence
+static void insert_new(ObjMap* map, Value key, Value value, uint64_t hash) {
+    size_t group_mask = map->capacity / MAP_GROUP_WIDTH - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t step = 1; ; step++) {
+        uint32_t empty = match_empty(map->control + group * MAP_GROUP_WIDTH);
+        if (empty) {
+            int slot = (int)(group * MAP_GROUP_WIDTH) + __builtin_ctz(empty);
+            map->control[slot] = hash & 0x7F;
+            map->keys[slot] = key;
+            map->values[slot] = value;
+            map->count++;
+            return;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+static void* allocate_slots(size_t size) {
+    void* buffer = jm_alloc(size);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return buffer;
+}
+
+static void resize(ObjMap* map, int capacity) {
+    uint8_t* control = map->control;
+    Value* keys = map->keys;
+    Value* values = map->values;
+    int old_capacity = map->capacity;
+
+    map->capacity = capacity;
+    map->count = 0;
+    map->control = allocate_slots(capacity);
+    map->keys = allocate_slots(sizeof(Value) * capacity);
+    map->values = allocate_slots(sizeof(Value) * capacity);
+    memset(map->control, MAP_EMPTY, capacity);
+
+    for (int i = 0; i < old_capacity; i++) {
+        if (control[i] != MAP_EMPTY) insert_new(map, keys[i], values[i], hash_value(keys[i]));
+    }
+    jm_free(control);
+    jm_free(keys);
+    jm_free(values);
+}
+
+// ----------------------------
+// Operations
+// ----------------------------
+int is_map(Value value) {
+    return IS_MAP_OBJ(value);
+}
+
+int map_find(ObjMap* map, Value key, Value* value) {
+    int slot = find_slot(map, key, hash_value(key));
+    if (slot < 0) return 0;
+    *value = map->values[slot];
+    return 1;
+}
+
+Value map_get(ObjMap* map, Value key) {
+    Value value;
+    if (!map_find(map, key, &value)) {
+        char text[64];
+        format_value(key, text, sizeof(text));
+        fprintf(stderr, "Runtime error: key %s not found in map\n", text);
+        exit(1);
+    }
+    return value;
+}
+
+void map_set(ObjMap* map, Value key, Value value) {
+    gc_write_barrier(&map->obj, key);
+    gc_write_barrier(&map->obj, value);
+    uint64_t hash = hash_value(key);
+    int slot = find_slot(map, key, hash);
+    if (slot >= 0) {
+        map->values[slot] = value;
+        return;
+    }
+    // Keep at least 1/8 of the slots empty so every probe ends
+    if ((map->count + 1) * 8 > map->capacity * 7) {
+        resize(map, map->capacity ? map->capacity * 2 : MAP_MIN_CAPACITY);
+    }
+    insert_new(map, key, value, hash);
+}
+
+int map_contains(ObjMap* map, Value key) {
+    return find_slot(map, key, hash_value(key)) >= 0;
+}
+
+void map_rehash(ObjMap* map) {
+    if (map->capacity > 0) resize(map, map->capacity);
+}
@@ -0,0 +1,81 @@
+/**
+ * @file map.h
+ * @brief Hash maps for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Maps are heap objects (OBJ_MAP, see object.h) from any value to any
+ * value. Like arrays they are references, and == compares identity.
+ * Keys match when values_equal() holds, so 1 and 1.0 are the same key and
+ * strings match by text. A NaN key matches nothing, not even itself, so
+ * each insert of one adds an entry that no lookup finds.
+ *
+ * Layout (SwissTable):
+ * - Slots are split into groups of MAP_GROUP_WIDTH. Each slot has a
+ *   control byte: MAP_EMPTY, or the low 7 bits of its key's hash (h2)
+ * - Keys and values live in two flat arrays parallel to the control bytes
+ * - A lookup hashes the key once, then probes whole groups: the 16
+ *   control bytes of a group are compared against h2 in one SSE2
+ *   instruction, and only slots whose byte matches have their key
+ *   compared. A group with an empty slot ends the probe
+ * - The remaining hash bits (h1) pick the first group; further groups
+ *   follow a triangular sequence, which visits every group
+ * - Maps grow by doubling once more than 7/8 of the slots are in use
+ *
+ * Without SSE2 the same probes run a byte at a time.
+ *
+ * Error Handling:
+ * - Reading a missing key reports a runtime error and exits
+ */
+
+#ifndef MAP_H
+#define MAP_H
+
+#include "value.h"
+#include "object.h"
+
+/// Slots per probe group (one SSE2 register of control bytes)
+#define MAP_GROUP_WIDTH 16
+
+/// Control byte of a free slot; used slots hold a value below 0x80
+#define MAP_EMPTY 0x80
+
+/**
+ * @brief Checks whether a value is a map
+ */
+int is_map(Value value);
+
+/**
+ * @brief Hashes a value consistently with values_equal()
+ */
+uint64_t hash_value(Value value);
+
+/**
+ * @brief Looks up a key
+ * @return Nonzero if found, with its value stored in *value
+ */
+int map_find(ObjMap* map, Value key, Value* value);
+
+/**
+ * @brief Reads map[key], reporting a runtime error if the key is missing
+ */
+Value map_get(ObjMap* map, Value key);
+
+/**
+ * @brief Stores value under key, adding the key if it is new
+ */
+void map_set(ObjMap* map, Value key, Value value);
+
+/**
+ * @brief Checks whether a key is present
+ */
+int map_contains(ObjMap* map, Value key);
+
+/**
+ * @brief Re-inserts every entry, for keys whose hash has changed
+ *
+ * Called by the collector after it moves keys that are hashed by address.
+ */
+void map_rehash(ObjMap* map);
+
+#endif // MAP_H
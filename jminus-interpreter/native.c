@@ -0,0 +1,59 @@
+/**
+ * @file native.c
+ * @brief Host C functions callable from jminus scripts
+ * @author Joey Zhang
+ * @version 1.0.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "native.h"
+#include "allocator.h"
+
+Native* natives = NULL;
+int native_count = 0;
+static int native_capacity = 0;
+
+int jm_register_native(const char* name, NativeFn function, int arity, int flags) {
+    if (!name || !*name || !function || arity < 0 || arity > NATIVE_MAX_ARITY) {
+        fprintf(stderr, "Invalid native function '%s'\n", name ? name : "");
+        exit(1);
+    }
+
+    int index = find_native(name);
+    if (index >= 0) {
+        natives[index].arity = arity;
+        natives[index].function = function;
+        natives[index].flags = flags;
+        return index;
+    }
+
+    if (native_count >= native_capacity) {
+        int capacity = native_capacity ? native_capacity * 2 : 8;
+        Native* grown = jm_realloc(natives, sizeof(Native) * capacity);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        natives = grown;
+        native_capacity = capacity;
+    }
+    natives[native_count] = (Native){ jm_strdup(name), arity, function, flags };
+    return native_count++;
+}
+
+int find_native(const char* name) {
+    for (int i = 0; i < native_count; i++) {
+        if (strcmp(natives[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+void free_natives(void) {
+    for (int i = 0; i < native_count; i++) jm_free(natives[i].name);
+    jm_free(natives);
+    natives = NULL;
+    native_count = 0;
+    native_capacity = 0;
+}
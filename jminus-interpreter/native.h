@@ -0,0 +1,90 @@
+/**
+ * @file native.h
+ * @brief Host C functions callable from jminus scripts
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * A program embedding jminus registers its own functions (looking up a
+ * price, hashing a key) before compiling scripts that call them:
+ *
+ *     static Value price_of(Value* args) { ... }
+ *     jm_register_native("price", price_of, 1, JM_NATIVE_PURE);
+ *
+ * Calls:
+ * - The compiler resolves a call by name to an index into the native
+ *   table and emits BC_CALL_NATIVE, so no lookup happens at runtime
+ * - Like builtins, a native receives a pointer to its arguments where
+ *   they sit on the operand stack: nothing is copied, and ints arrive as
+ *   the tagged words the VM computes with (see value.h)
+ * - Name resolution: variables, then script functions, then natives,
+ *   then builtins, so a native may replace a builtin of the same name
+ *
+ * Pure Natives:
+ * - A native registered with JM_NATIVE_PURE promises that its result
+ *   depends only on its arguments, that it has no side effects and that
+ *   it never fails
+ * - A call to a pure native whose arguments are all constants runs once,
+ *   at compile time, and its result becomes a constant; results that are
+ *   mutable objects (arrays, maps, records) are still computed per call
+ *
+ * Memory:
+ * - Collections only run at VM safepoints, never inside a native, so a
+ *   native may hold object pointers and allocate freely; one that stores
+ *   a value into an object must call gc_write_barrier() (see gc.h)
+ * - Bytecode refers to natives by index, so entries are never removed;
+ *   registering a name again replaces its function, arity and flags
+ */
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include "value.h"
+
+/// The native is a function of its arguments alone (may run at compile time)
+#define JM_NATIVE_PURE 0x1
+
+/// Largest arity a native may be registered with
+#define NATIVE_MAX_ARITY 8
+
+/**
+ * @brief Signature of a native: receives its arguments in order
+ */
+typedef Value (*NativeFn)(Value* args);
+
+/**
+ * @brief An entry of the native table
+ */
+typedef struct {
+    char* name;         ///< Name used in calls (owned copy)
+    int arity;          ///< Number of arguments
+    NativeFn function;  ///< Implementation
+    int flags;          ///< JM_NATIVE_* flags
+} Native;
+
+extern Native* natives;
+extern int native_count;
+
+/**
+ * @brief Makes a C function callable from scripts compiled afterwards
+ * @param name Name scripts call it by (copied)
+ * @param function Implementation
+ * @param arity Number of arguments, at most NATIVE_MAX_ARITY
+ * @param flags JM_NATIVE_* flags, or 0
+ * @return Index of the native in the table
+ */
+int jm_register_native(const char* name, NativeFn function, int arity, int flags);
+
+/**
+ * @brief Looks up a native by name
+ * @return Index into natives, or -1 if there is none
+ */
+int find_native(const char* name);
+
+/**
+ * @brief Frees the native table
+ *
+ * Only call this once no bytecode that calls natives will run again.
+ */
+void free_natives(void);
+
+#endif // NATIVE_H
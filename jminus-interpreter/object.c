@@ -0,0 +1,74 @@
+/**
+ * @file object.c
+ * @brief Heap-allocated runtime objects for the jminus language
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Objects are allocated by the collector (see gc.c), which keeps them
+ * 8-byte aligned, leaving the low three bits of every object pointer free
+ * for the value tag.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "object.h"
+#include "allocator.h"
+
+ObjFloat* new_float(double value) {
+    ObjFloat* number = (ObjFloat*)allocate_object(sizeof(ObjFloat), OBJ_FLOAT);
+    number->value = value;
+    return number;
+}
+
+ObjBigInt* new_bigint(int length) {
+    ObjBigInt* number = (ObjBigInt*)allocate_object(sizeof(ObjBigInt) + sizeof(uint32_t) * length, OBJ_BIGINT);
+    number->length = length;
+    return number;
+}
+
+ObjArray* new_array(int capacity) {
+    ObjArray* array = (ObjArray*)allocate_object(sizeof(ObjArray), OBJ_ARRAY);
+    array->count = 0;
+    array->capacity = capacity;
+    array->items = NULL;
+    array->cards = NULL;
+    if (capacity > 0) {
+        array->items = jm_alloc(sizeof(Value) * capacity);
+        if (!array->items) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    return array;
+}
+
+ObjMap* new_map(void) {
+    ObjMap* map = (ObjMap*)allocate_object(sizeof(ObjMap), OBJ_MAP);
+    map->count = 0;
+    map->capacity = 0;
+    map->control = NULL;
+    map->keys = NULL;
+    map->values = NULL;
+    return map;
+}
+
+ObjRecord* new_record(ObjShape* shape) {
+    ObjRecord* record = (ObjRecord*)allocate_object(sizeof(ObjRecord) + sizeof(Value) * shape->field_count, OBJ_RECORD);
+    record->shape = shape;
+    return record;
+}
+
+ObjUpvalue* new_upvalue(Value value) {
+    ObjUpvalue* upvalue = (ObjUpvalue*)allocate_object(sizeof(ObjUpvalue), OBJ_UPVALUE);
+    upvalue->value = value;
+    return upvalue;
+}
+
+ObjClosure* new_closure(int program, int function, struct ObjString* name, int upvalue_count) {
+    ObjClosure* closure = (ObjClosure*)allocate_object(sizeof(ObjClosure) + sizeof(Value) * upvalue_count, OBJ_CLOSURE);
+    closure->program = program;
+    closure->function = function;
+    closure->upvalue_count = upvalue_count;
+    closure->name = name;
+    return closure;
+}
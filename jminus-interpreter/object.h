@@ -0,0 +1,246 @@
+/**
+ * @file object.h
+ * @brief Heap-allocated runtime objects for the jminus language
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Values that do not fit in a tagged word live on the heap and are
+ * referenced by pointer (see value.h). Every object starts with an Obj
+ * header recording its type.
+ *
+ * Object Types:
+ * - OBJ_FLOAT: A double outside the immediate range (huge, tiny, inf, NaN)
+ * - OBJ_BIGINT: An integer outside the 63-bit range (see bigint.h)
+ * - OBJ_ARRAY: A growable array of values (see array.h)
+ * - OBJ_STRING: An immutable string, flat or a rope (see str.h)
+ * - OBJ_MAP: A hash map from values to values (see map.h)
+ * - OBJ_SHAPE: The field layout shared by records (see record.h)
+ * - OBJ_RECORD: A record whose fields are stored inline (see record.h)
+ * - OBJ_UPVALUE: A cell holding a variable that escaping closures share
+ * - OBJ_CLOSURE: A function used as a value, with the variables it captured
+ *
+ * Memory Management:
+ * - Objects are managed by the generational collector in gc.h: new ones
+ *   are bump-allocated in the nursery, and those that survive a minor
+ *   collection are copied into the old space, a list of malloc'd objects
+ * - Since objects move, a pointer to one is only good until the next
+ *   safepoint (see gc.h); between safepoints it stays put
+ * - free_objects() releases every object at once
+ */
+
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stddef.h>
+#include "value.h"
+
+/**
+ * @brief Kinds of heap objects
+ */
+typedef enum {
+    OBJ_FLOAT,  ///< Boxed double
+    OBJ_BIGINT, ///< Arbitrary-precision integer
+    OBJ_ARRAY,  ///< Dynamic array
+    OBJ_STRING, ///< Immutable string
+    OBJ_MAP,    ///< Hash map
+    OBJ_SHAPE,  ///< Record field layout
+    OBJ_RECORD, ///< Record with inline fields
+    OBJ_UPVALUE, ///< Boxed captured variable
+    OBJ_CLOSURE ///< Function value
+} ObjType;
+
+/**
+ * @brief Header shared by all heap objects
+ */
+struct Obj {
+    ObjType type;        ///< Kind of object
+    uint8_t marked;      ///< Reached by the current major collection
+    uint8_t remembered;  ///< In the remembered set (see gc.h)
+    uint8_t forwarded;   ///< Copied out of the nursery; next is the copy
+    struct Obj* next;    ///< Next object in the old space list, or the forwarding address
+};
+
+/**
+ * @brief A double that could not be stored as an immediate value
+ */
+typedef struct {
+    Obj obj;       ///< Object header
+    double value;  ///< The boxed double
+} ObjFloat;
+
+/**
+ * @brief An integer that does not fit in a tagged value
+ */
+typedef struct {
+    Obj obj;           ///< Object header
+    int sign;          ///< 1 or -1 (a bigint is never zero)
+    int length;        ///< Number of limbs, the last one nonzero
+    uint32_t limbs[];  ///< Magnitude, least significant limb first
+} ObjBigInt;
+
+/**
+ * @brief A growable array; the elements are one contiguous buffer
+ */
+typedef struct {
+    Obj obj;       ///< Object header
+    int count;     ///< Number of elements
+    int capacity;  ///< Allocated element slots
+    Value* items;  ///< Element buffer (NULL while capacity is 0)
+    uint8_t* cards; ///< Dirty flag per GC_CARD_SIZE elements, NULL until first needed (see gc.h)
+} ObjArray;
+
+/**
+ * @brief A hash map in the SwissTable layout (see map.h)
+ *
+ * Slot i is in use when control[i] holds 7 bits of its key's hash, and
+ * free when control[i] is MAP_EMPTY; keys[i] and values[i] hold its entry.
+ */
+typedef struct {
+    Obj obj;           ///< Object header
+    int count;         ///< Number of entries
+    int capacity;      ///< Number of slots: 0 or a power of two, at least 16
+    uint8_t* control;  ///< One control byte per slot
+    Value* keys;       ///< Key of each slot
+    Value* values;     ///< Value of each slot
+} ObjMap;
+
+/**
+ * @brief The field layout of a record: field names in offset order
+ *
+ * Shapes form a tree rooted at the empty shape. Each shape keeps the
+ * shapes reached by adding one more field, so records built from the same
+ * names in the same order always end up with the same shape object.
+ */
+typedef struct ObjShape {
+    Obj obj;                        ///< Object header
+    int field_count;                ///< Number of fields
+    struct ObjString** fields;      ///< Interned field names, by offset
+    struct ObjShape** transitions;  ///< Shapes with one field appended
+    int transition_count;           ///< Number of transitions
+    int transition_capacity;        ///< Allocated transition slots
+} ObjShape;
+
+/**
+ * @brief A record: a shape and one inline value per field of the shape
+ */
+typedef struct {
+    Obj obj;          ///< Object header
+    ObjShape* shape;  ///< Field layout, fixed when the record is created
+    Value fields[];   ///< Field values, by offset
+} ObjRecord;
+
+/**
+ * @brief A variable moved to the heap because an escaping closure captures
+ *        it and it is assigned after being captured
+ *
+ * The function declaring the variable and every closure capturing it hold
+ * the same cell, so an assignment through any of them is seen by all.
+ * Cells only ever sit in frame slots and closures, never in user values.
+ */
+typedef struct {
+    Obj obj;      ///< Object header
+    Value value;  ///< Current value of the variable
+} ObjUpvalue;
+
+/**
+ * @brief A function used as a value (see compiler.h for how calls work)
+ *
+ * Captures are flat: the closure holds every outer variable its body
+ * uses, including those only needed by the functions it calls, so a call
+ * copies them into the new frame and never walks a chain of scopes. Each
+ * is the variable's value if it is never assigned after capture, or the
+ * variable's ObjUpvalue cell otherwise.
+ */
+typedef struct {
+    Obj obj;                 ///< Object header
+    int program;             ///< Id of the Bytecode whose functions table function indexes
+    int function;            ///< Index in the functions table
+    int upvalue_count;       ///< Number of captures
+    struct ObjString* name;  ///< Function name, for printing
+    Value upvalues[];        ///< Captured values and cells, in the function's capture order
+} ObjClosure;
+
+#define OBJ_TYPE(v)    (AS_OBJ(v)->type)
+#define IS_FLOAT_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_FLOAT)
+#define AS_FLOAT_OBJ(v) ((ObjFloat*)AS_OBJ(v))
+#define IS_BIGINT_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_BIGINT)
+#define AS_BIGINT_OBJ(v) ((ObjBigInt*)AS_OBJ(v))
+#define IS_ARRAY_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_ARRAY)
+#define AS_ARRAY_OBJ(v) ((ObjArray*)AS_OBJ(v))
+#define IS_MAP_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_MAP)
+#define AS_MAP_OBJ(v) ((ObjMap*)AS_OBJ(v))
+#define IS_RECORD_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_RECORD)
+#define AS_RECORD_OBJ(v) ((ObjRecord*)AS_OBJ(v))
+#define IS_UPVALUE_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_UPVALUE)
+#define AS_UPVALUE_OBJ(v) ((ObjUpvalue*)AS_OBJ(v))
+#define IS_CLOSURE_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_CLOSURE)
+#define AS_CLOSURE_OBJ(v) ((ObjClosure*)AS_OBJ(v))
+
+/**
+ * @brief Allocates a heap object, in the nursery when it fits
+ * @param size Size of the whole object in bytes
+ * @param type Kind of object
+ * @return The new object (exits on allocation failure)
+ */
+Obj* allocate_object(size_t size, ObjType type);
+
+/**
+ * @brief Allocates a heap object directly in the old space
+ *
+ * For long-lived objects that should never be copied, such as interned
+ * strings and shapes. Unlike other objects allocated old, these are not
+ * remembered at birth, so they must not be filled with nursery pointers.
+ */
+Obj* allocate_tenured_object(size_t size, ObjType type);
+
+/**
+ * @brief Boxes a double in a new ObjFloat
+ */
+ObjFloat* new_float(double value);
+
+/**
+ * @brief Allocates a bigint with room for the given number of limbs
+ *
+ * The sign and limbs are left for the caller to fill in.
+ */
+ObjBigInt* new_bigint(int length);
+
+/**
+ * @brief Allocates an empty array with room for the given number of elements
+ */
+ObjArray* new_array(int capacity);
+
+/**
+ * @brief Allocates an empty map (slots are allocated on the first insert)
+ */
+ObjMap* new_map(void);
+
+/**
+ * @brief Allocates a record of the given shape
+ *
+ * The field values are left for the caller to fill in.
+ */
+ObjRecord* new_record(ObjShape* shape);
+
+/**
+ * @brief Allocates a cell holding a captured variable's value
+ */
+ObjUpvalue* new_upvalue(Value value);
+
+/**
+ * @brief Allocates a closure of a function with room for its captures
+ *
+ * The captures are left for the caller to fill in.
+ */
+ObjClosure* new_closure(int program, int function, struct ObjString* name, int upvalue_count);
+
+/**
+ * @brief Frees every object allocated so far
+ *
+ * Values referring to objects must not be used afterwards. This includes
+ * interned strings, so names compiled before the call are stale too. The
+ * VM and interpreter globals are dropped along with the objects.
+ */
+void free_objects(void);
+
+#endif // OBJECT_H
@@ -0,0 +1,813 @@
+/**
+ * @file optimizer.c
+ * @brief AST-level optimizations run by the compiler before code generation
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * This file implements function inlining and constant folding over the AST.
+ *
+ * Inlining Strategy:
+ * - Build a table of the functions calls may refer to; bodies are parsed,
+ *   and recursion (reaching oneself through the call graph) is checked,
+ *   only for callees small enough in tokens to be candidates
+ * - Process each candidate body before it is inlined anywhere, so a
+ *   function's size is measured after its own callees were substituted
+ * - Replace eligible calls with EXPR_INLINE nodes; the compiler maps the
+ *   callee's parameters and locals to fresh slots of the current frame
+ *
+ * Folding Strategy:
+ * - Fold arguments before inlining so constant arguments can be substituted
+ * - Simplify each inlined body right away (constant ifs, literal returns)
+ * - Finish with a folding pass over the whole program
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "optimizer.h"
+#include "value.h"
+#include "bigint.h"
+#include "allocator.h"
+
+/**
+ * Per-function bookkeeping for the inliner.
+ */
+typedef struct {
+    FnStmt* fn;     // Declaration (owned by the AST)
+    int recursive;  // Nonzero if fn can reach itself through calls, -1 if unknown
+    int state;      // 0 = not processed, 1 = in progress, 2 = done
+} FnInfo;
+
+static FnInfo* functions;
+static int function_count;
+static FnStmt* owner;  // Function whose body is being prepared, NULL for the code passed in
+
+static FnInfo* find_fn(const char* name) {
+    for (int i = 0; i < function_count; i++) {
+        if (strcmp(functions[i].fn->name.lexeme, name) == 0) return &functions[i];
+    }
+    return NULL;
+}
+
+// Parses a lazily parsed body the first time the optimizer looks into it
+static Stmt* body_of(FnStmt* fn) {
+    if (fn->body) return fn->body;
+    if (!parse_function_body(fn)) {
+        fprintf(stderr, "Syntax error in function '%s'\n", fn->name.lexeme);
+        exit(1);
+    }
+    return fn->body;
+}
+
+static FnInfo* callee_info(Expr* expr) {
+    if (expr->type != EXPR_CALL || expr->call.callee->type != EXPR_VARIABLE) return NULL;
+    return find_fn(expr->call.callee->variable.name.lexeme);
+}
+
+// ----------------------------
+// Literals
+// ----------------------------
+static int literal_constant(Expr* expr, Value* value) {
+    if (!expr || expr->type != EXPR_LITERAL) return 0;
+    *value = literal_value(expr->literal.value);
+    return 1;
+}
+
+/*
+ * Builds a literal node for a constant. Doubles are written in their
+ * shortest round-trip form, so the literal reads back to the same value.
+ */
+static Expr* make_literal(Value value, int line) {
+    char buffer[64];
+    char* text = buffer;
+    int length;
+    if (is_bigint(value)) {
+        // Bigints may not fit the buffer
+        text = bigint_to_string(value);
+        length = (int)strlen(text);
+    } else {
+        length = format_value(value, buffer, sizeof(buffer));
+    }
+
+    Expr* expr = allocate(sizeof(Expr));
+    expr->type = EXPR_LITERAL;
+    if (is_integer(value)) expr->literal.value.type = TOKEN_INT;
+    else if (IS_BOOL(value)) expr->literal.value.type = AS_BOOL(value) ? TOKEN_TRUE : TOKEN_FALSE;
+    else expr->literal.value.type = TOKEN_FLOAT;
+    expr->literal.value.lexeme = allocate(length + 1);
+    memcpy(expr->literal.value.lexeme, text, length + 1);
+    if (text != buffer) jm_free(text);
+    expr->literal.value.line = line;
+    expr->literal.owns_lexeme = 1;
+    return expr;
+}
+
+// ----------------------------
+// Tree queries
+// ----------------------------
+static int count_stmt(Stmt* stmt);
+
+static int count_expr(Expr* expr) {
+    if (!expr) return 0;
+    switch (expr->type) {
+        case EXPR_BINARY:
+            return 1 + count_expr(expr->binary.left) + count_expr(expr->binary.right);
+        case EXPR_CALL: {
+            int count = 1;
+            for (int i = 0; i < expr->call.arg_count; i++) count += count_expr(expr->call.args[i]);
+            return count;
+        }
+        case EXPR_INLINE: {
+            int count = 1 + count_stmt(expr->inlined.body);
+            for (int i = 0; i < expr->inlined.arg_count; i++) count += count_expr(expr->inlined.args[i]);
+            return count;
+        }
+        case EXPR_ARRAY: {
+            int count = 1;
+            for (int i = 0; i < expr->array.count; i++) count += count_expr(expr->array.elements[i]);
+            return count;
+        }
+        case EXPR_INDEX:
+            return 1 + count_expr(expr->index.object) + count_expr(expr->index.index);
+        case EXPR_RECORD: {
+            int count = 1;
+            for (int i = 0; i < expr->record.count; i++) count += count_expr(expr->record.values[i]);
+            return count;
+        }
+        case EXPR_FIELD:
+            return 1 + count_expr(expr->field.object);
+        case EXPR_UNARY:
+            return 1 + count_expr(expr->unary.operand);
+        default:
+            return 1;
+    }
+}
+
+static int count_stmt(Stmt* stmt) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case STMT_EXPR: return 1 + count_expr(stmt->expr.expression);
+        case STMT_LET: return 1 + count_expr(stmt->let.initializer);
+        case STMT_YAP: return 1 + count_expr(stmt->yap.expression);
+        case STMT_RETURN: return 1 + count_expr(stmt->return_stmt.value);
+        case STMT_IF:
+            return 1 + count_expr(stmt->if_stmt.condition)
+                     + count_stmt(stmt->if_stmt.then_branch)
+                     + count_stmt(stmt->if_stmt.else_branch);
+        case STMT_WHILE:
+            return 1 + count_expr(stmt->while_stmt.condition) + count_stmt(stmt->while_stmt.body);
+        case STMT_BLOCK: {
+            int count = 1;
+            for (int i = 0; i < stmt->block.count; i++) count += count_stmt(stmt->block.statements[i]);
+            return count;
+        }
+        case STMT_FN:
+            return 1 + count_stmt(stmt->fn.body);
+    }
+    return 1;
+}
+
+/*
+ * Returns nonzero if the tree calls target, directly or through the
+ * functions it calls. visited has one flag per entry of functions.
+ */
+static int stmt_reaches(Stmt* stmt, FnStmt* target, char* visited);
+
+static int expr_reaches(Expr* expr, FnStmt* target, char* visited) {
+    if (!expr) return 0;
+    switch (expr->type) {
+        case EXPR_BINARY:
+            return expr_reaches(expr->binary.left, target, visited) ||
+                   expr_reaches(expr->binary.right, target, visited);
+        case EXPR_CALL: {
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                if (expr_reaches(expr->call.args[i], target, visited)) return 1;
+            }
+            FnInfo* info = callee_info(expr);
+            if (!info) return 0;
+            if (info->fn == target) return 1;
+            if (visited[info - functions]) return 0;
+            visited[info - functions] = 1;
+            return stmt_reaches(body_of(info->fn), target, visited);
+        }
+        case EXPR_INLINE:
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                if (expr_reaches(expr->inlined.args[i], target, visited)) return 1;
+            }
+            return stmt_reaches(expr->inlined.body, target, visited);
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                if (expr_reaches(expr->array.elements[i], target, visited)) return 1;
+            }
+            return 0;
+        case EXPR_INDEX:
+            return expr_reaches(expr->index.object, target, visited) ||
+                   expr_reaches(expr->index.index, target, visited);
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                if (expr_reaches(expr->record.values[i], target, visited)) return 1;
+            }
+            return 0;
+        case EXPR_FIELD:
+            return expr_reaches(expr->field.object, target, visited);
+        case EXPR_UNARY:
+            return expr_reaches(expr->unary.operand, target, visited);
+        default:
+            return 0;
+    }
+}
+
+static int stmt_reaches(Stmt* stmt, FnStmt* target, char* visited) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case STMT_EXPR: return expr_reaches(stmt->expr.expression, target, visited);
+        case STMT_LET: return expr_reaches(stmt->let.initializer, target, visited);
+        case STMT_YAP: return expr_reaches(stmt->yap.expression, target, visited);
+        case STMT_RETURN: return expr_reaches(stmt->return_stmt.value, target, visited);
+        case STMT_IF:
+            return expr_reaches(stmt->if_stmt.condition, target, visited) ||
+                   stmt_reaches(stmt->if_stmt.then_branch, target, visited) ||
+                   stmt_reaches(stmt->if_stmt.else_branch, target, visited);
+        case STMT_WHILE:
+            return expr_reaches(stmt->while_stmt.condition, target, visited) ||
+                   stmt_reaches(stmt->while_stmt.body, target, visited);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (stmt_reaches(stmt->block.statements[i], target, visited)) return 1;
+            }
+            return 0;
+        case STMT_FN:
+            return stmt_reaches(stmt->fn.body, target, visited);
+    }
+    return 0;
+}
+
+/*
+ * Returns nonzero if the tree assigns or redeclares name in the scope it
+ * belongs to. Bodies of nested inlines are a different scope and skipped.
+ */
+static int stmt_assigns(Stmt* stmt, const char* name);
+
+static int expr_assigns(Expr* expr, const char* name) {
+    if (!expr) return 0;
+    switch (expr->type) {
+        case EXPR_BINARY:
+            if (strcmp(expr->binary.op.lexeme, "=") == 0 && expr->binary.left->type == EXPR_VARIABLE &&
+                strcmp(expr->binary.left->variable.name.lexeme, name) == 0) {
+                return 1;
+            }
+            return expr_assigns(expr->binary.left, name) || expr_assigns(expr->binary.right, name);
+        case EXPR_CALL:
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                if (expr_assigns(expr->call.args[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_INLINE:
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                if (expr_assigns(expr->inlined.args[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                if (expr_assigns(expr->array.elements[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_INDEX:
+            return expr_assigns(expr->index.object, name) || expr_assigns(expr->index.index, name);
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                if (expr_assigns(expr->record.values[i], name)) return 1;
+            }
+            return 0;
+        case EXPR_FIELD:
+            return expr_assigns(expr->field.object, name);
+        case EXPR_UNARY:
+            return expr_assigns(expr->unary.operand, name);
+        default:
+            return 0;
+    }
+}
+
+static int stmt_assigns(Stmt* stmt, const char* name) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case STMT_EXPR: return expr_assigns(stmt->expr.expression, name);
+        case STMT_LET:
+            return strcmp(stmt->let.name.lexeme, name) == 0 || expr_assigns(stmt->let.initializer, name);
+        case STMT_YAP: return expr_assigns(stmt->yap.expression, name);
+        case STMT_RETURN: return expr_assigns(stmt->return_stmt.value, name);
+        case STMT_IF:
+            return expr_assigns(stmt->if_stmt.condition, name) ||
+                   stmt_assigns(stmt->if_stmt.then_branch, name) ||
+                   stmt_assigns(stmt->if_stmt.else_branch, name);
+        case STMT_WHILE:
+            return expr_assigns(stmt->while_stmt.condition, name) ||
+                   stmt_assigns(stmt->while_stmt.body, name);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (stmt_assigns(stmt->block.statements[i], name)) return 1;
+            }
+            return 0;
+        case STMT_FN:
+            return 0;
+    }
+    return 0;
+}
+
+/*
+ * Returns nonzero if the body declares a function; those are never
+ * inlined, since their nested functions capture the body's variables.
+ */
+static int declares_function(Stmt* stmt) {
+    if (!stmt) return 0;
+    switch (stmt->type) {
+        case STMT_FN: return 1;
+        case STMT_IF:
+            return declares_function(stmt->if_stmt.then_branch) || declares_function(stmt->if_stmt.else_branch);
+        case STMT_WHILE: return declares_function(stmt->while_stmt.body);
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                if (declares_function(stmt->block.statements[i])) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Returns nonzero if name is a parameter or local of the body being
+ * prepared, where a call to name calls a value, not the function. The
+ * compiler leaves shadowed functions out of the table for the code it
+ * passes in.
+ */
+static int shadowed(const char* name) {
+    if (!owner) return 0;
+    for (int i = 0; i < owner->param_count; i++) {
+        if (strcmp(owner->params[i].lexeme, name) == 0) return 1;
+    }
+    return stmt_assigns(owner->body, name);
+}
+
+// ----------------------------
+// Constant substitution
+// ----------------------------
+static void substitute_stmt(Stmt* stmt, const char* name, Expr* literal);
+
+static void substitute_expr(Expr** slot, const char* name, Expr* literal) {
+    Expr* expr = *slot;
+    if (!expr) return;
+    switch (expr->type) {
+        case EXPR_VARIABLE:
+            if (strcmp(expr->variable.name.lexeme, name) == 0) {
+                *slot = clone_expr(literal);
+                free_expr(expr);
+            }
+            break;
+        case EXPR_BINARY:
+            substitute_expr(&expr->binary.right, name, literal);
+            // The left side of an assignment is a target, not a use, but
+            // the array and index of an element target (and the record of
+            // a field target) are evaluated
+            if (strcmp(expr->binary.op.lexeme, "=") != 0 || expr->binary.left->type == EXPR_INDEX ||
+                expr->binary.left->type == EXPR_FIELD) {
+                substitute_expr(&expr->binary.left, name, literal);
+            }
+            break;
+        case EXPR_CALL:
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                substitute_expr(&expr->call.args[i], name, literal);
+            }
+            break;
+        case EXPR_INLINE:
+            // Only the arguments are evaluated in our scope
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                substitute_expr(&expr->inlined.args[i], name, literal);
+            }
+            break;
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                substitute_expr(&expr->array.elements[i], name, literal);
+            }
+            break;
+        case EXPR_INDEX:
+            substitute_expr(&expr->index.object, name, literal);
+            substitute_expr(&expr->index.index, name, literal);
+            break;
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                substitute_expr(&expr->record.values[i], name, literal);
+            }
+            break;
+        case EXPR_FIELD:
+            substitute_expr(&expr->field.object, name, literal);
+            break;
+        case EXPR_UNARY:
+            substitute_expr(&expr->unary.operand, name, literal);
+            break;
+        default:
+            break;
+    }
+}
+
+static void substitute_stmt(Stmt* stmt, const char* name, Expr* literal) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_EXPR: substitute_expr(&stmt->expr.expression, name, literal); break;
+        case STMT_LET: substitute_expr(&stmt->let.initializer, name, literal); break;
+        case STMT_YAP: substitute_expr(&stmt->yap.expression, name, literal); break;
+        case STMT_RETURN: substitute_expr(&stmt->return_stmt.value, name, literal); break;
+        case STMT_IF:
+            substitute_expr(&stmt->if_stmt.condition, name, literal);
+            substitute_stmt(stmt->if_stmt.then_branch, name, literal);
+            substitute_stmt(stmt->if_stmt.else_branch, name, literal);
+            break;
+        case STMT_WHILE:
+            substitute_expr(&stmt->while_stmt.condition, name, literal);
+            substitute_stmt(stmt->while_stmt.body, name, literal);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                substitute_stmt(stmt->block.statements[i], name, literal);
+            }
+            break;
+        case STMT_FN:
+            break;
+    }
+}
+
+// ----------------------------
+// Constant folding
+// ----------------------------
+Expr* fold_expr(Expr* expr) {
+    if (!expr) return NULL;
+
+    switch (expr->type) {
+        case EXPR_BINARY: {
+            const char* op = expr->binary.op.lexeme;
+            expr->binary.right = fold_expr(expr->binary.right);
+            if (strcmp(op, "=") == 0) {
+                if (expr->binary.left->type == EXPR_INDEX || expr->binary.left->type == EXPR_FIELD) {
+                    expr->binary.left = fold_expr(expr->binary.left);
+                }
+                return expr;
+            }
+            expr->binary.left = fold_expr(expr->binary.left);
+
+            Value a, b, result;
+            if (strcmp(op, "&&") == 0 || strcmp(op, "||") == 0) {
+                // A constant left side either decides or leaves it to the right side
+                if (!literal_constant(expr->binary.left, &a)) return expr;
+                if (is_truthy(a) == (op[0] == '|')) result = INT_VAL(is_truthy(a));
+                else if (literal_constant(expr->binary.right, &b)) result = INT_VAL(is_truthy(b));
+                else return expr;
+                Expr* folded = make_literal(result, expr->binary.op.line);
+                free_expr(expr);
+                return folded;
+            }
+            if (!literal_constant(expr->binary.left, &a) || !literal_constant(expr->binary.right, &b)) return expr;
+
+            // Equality is defined for all values, the rest only for numbers
+            int numbers = is_number(a) && is_number(b);
+            if (strcmp(op, "==") == 0) result = INT_VAL(values_equal(a, b));
+            else if (strcmp(op, "!=") == 0) result = INT_VAL(!values_equal(a, b));
+            else if (!numbers) return expr;  // Report the type error at runtime
+            else if (strcmp(op, "+") == 0) result = add_values(a, b);
+            else if (strcmp(op, "-") == 0) result = subtract_values(a, b);
+            else if (strcmp(op, "*") == 0) result = multiply_values(a, b);
+            else if (strcmp(op, "/") == 0) {
+                if (IS_INT(b) && AS_INT(b) == 0) return expr;  // Report division by zero at runtime
+                result = divide_values(a, b);
+            }
+            else if (strcmp(op, "<") == 0) result = INT_VAL(compare_values(a, b) == -1);
+            else if (strcmp(op, "<=") == 0) result = INT_VAL(compare_values(a, b) <= 0);
+            else if (strcmp(op, ">") == 0) result = INT_VAL(compare_values(a, b) == 1);
+            else if (strcmp(op, ">=") == 0) {
+                int order = compare_values(a, b);
+                result = INT_VAL(order == 0 || order == 1);
+            }
+            else if (strcmp(op, "%") == 0) {
+                if (IS_INT(b) && AS_INT(b) == 0) return expr;  // Report division by zero at runtime
+                result = modulo_values(a, b);
+            }
+            else if (!IS_INT(a) || !IS_INT(b)) return expr;  // Bitwise operators and shifts take ints
+            else if (strcmp(op, "&") == 0) result = and_values(a, b);
+            else if (strcmp(op, "|") == 0) result = or_values(a, b);
+            else if (strcmp(op, "^") == 0) result = xor_values(a, b);
+            else if (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0) {
+                if (AS_INT(b) < 0 || AS_INT(b) > 63) return expr;  // Report the count at runtime
+                result = op[0] == '<' ? shift_left_values(a, b) : shift_right_values(a, b);
+            }
+            else return expr;
+
+            // Infinities and NaN have no literal syntax; leave them to runtime
+            if (is_double(result) && !isfinite(as_double(result))) return expr;
+
+            Expr* folded = make_literal(result, expr->binary.op.line);
+            free_expr(expr);
+            return folded;
+        }
+        case EXPR_CALL:
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                expr->call.args[i] = fold_expr(expr->call.args[i]);
+            }
+            return expr;
+        case EXPR_INLINE:
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                expr->inlined.args[i] = fold_expr(expr->inlined.args[i]);
+            }
+            return expr;
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                expr->array.elements[i] = fold_expr(expr->array.elements[i]);
+            }
+            return expr;
+        case EXPR_INDEX:
+            expr->index.object = fold_expr(expr->index.object);
+            expr->index.index = fold_expr(expr->index.index);
+            return expr;
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                expr->record.values[i] = fold_expr(expr->record.values[i]);
+            }
+            return expr;
+        case EXPR_FIELD:
+            expr->field.object = fold_expr(expr->field.object);
+            return expr;
+        case EXPR_UNARY: {
+            expr->unary.operand = fold_expr(expr->unary.operand);
+            Value value;
+            if (!literal_constant(expr->unary.operand, &value)) return expr;
+            Expr* folded = make_literal(INT_VAL(!is_truthy(value)), expr->unary.op.line);
+            free_expr(expr);
+            return folded;
+        }
+        default:
+            return expr;
+    }
+}
+
+static void fold_stmt(Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_EXPR: stmt->expr.expression = fold_expr(stmt->expr.expression); break;
+        case STMT_LET: stmt->let.initializer = fold_expr(stmt->let.initializer); break;
+        case STMT_YAP: stmt->yap.expression = fold_expr(stmt->yap.expression); break;
+        case STMT_RETURN: stmt->return_stmt.value = fold_expr(stmt->return_stmt.value); break;
+        case STMT_IF:
+            stmt->if_stmt.condition = fold_expr(stmt->if_stmt.condition);
+            fold_stmt(stmt->if_stmt.then_branch);
+            fold_stmt(stmt->if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            stmt->while_stmt.condition = fold_expr(stmt->while_stmt.condition);
+            fold_stmt(stmt->while_stmt.body);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) fold_stmt(stmt->block.statements[i]);
+            break;
+        case STMT_FN:
+            break;  // Bodies are optimized when they are compiled
+    }
+}
+
+/*
+ * Folds an inlined body and reduces ifs whose condition became constant,
+ * which is where constant arguments usually end up. Returns the statement
+ * that replaces stmt.
+ */
+static Stmt* simplify_inlined(Stmt* stmt) {
+    if (!stmt) return NULL;
+    switch (stmt->type) {
+        case STMT_IF: {
+            Value condition;
+            stmt->if_stmt.condition = fold_expr(stmt->if_stmt.condition);
+            if (!literal_constant(stmt->if_stmt.condition, &condition)) {
+                stmt->if_stmt.then_branch = simplify_inlined(stmt->if_stmt.then_branch);
+                stmt->if_stmt.else_branch = simplify_inlined(stmt->if_stmt.else_branch);
+                return stmt;
+            }
+
+            // Keep the branch that runs and free the rest of the if
+            int cond = is_truthy(condition);
+            Stmt* taken = cond ? stmt->if_stmt.then_branch : stmt->if_stmt.else_branch;
+            if (cond) stmt->if_stmt.then_branch = NULL;
+            else stmt->if_stmt.else_branch = NULL;
+            free_stmt(stmt);
+
+            if (!taken) {
+                taken = allocate(sizeof(Stmt));
+                taken->type = STMT_BLOCK;
+                taken->block.statements = allocate(sizeof(Stmt*));
+                taken->block.count = 0;
+            }
+            return simplify_inlined(taken);
+        }
+        case STMT_WHILE:
+            stmt->while_stmt.condition = fold_expr(stmt->while_stmt.condition);
+            stmt->while_stmt.body = simplify_inlined(stmt->while_stmt.body);
+            return stmt;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                stmt->block.statements[i] = simplify_inlined(stmt->block.statements[i]);
+            }
+            return stmt;
+        default:
+            fold_stmt(stmt);
+            return stmt;
+    }
+}
+
+/*
+ * Looks for a return that is certain to be the first thing the body does.
+ * Sets *found when the answer is known; returns the returned literal, or
+ * NULL if the body starts with anything else.
+ */
+static Expr* leading_return(Stmt* stmt, int* found) {
+    switch (stmt->type) {
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) {
+                Expr* value = leading_return(stmt->block.statements[i], found);
+                if (*found) return value;
+            }
+            return NULL;  // Empty blocks are skipped over
+        case STMT_RETURN:
+            *found = 1;
+            if (!stmt->return_stmt.value) return make_literal(INT_VAL(0), stmt->return_stmt.keyword.line);
+            if (stmt->return_stmt.value->type != EXPR_LITERAL) return NULL;
+            return clone_expr(stmt->return_stmt.value);
+        default:
+            *found = 1;
+            return NULL;
+    }
+}
+
+// ----------------------------
+// Inlining
+// ----------------------------
+static void inline_stmt(Stmt* stmt);
+static void prepare_function(FnInfo* info);
+
+static int can_inline(FnInfo* info, int arg_count) {
+    FnStmt* fn = info->fn;
+    if (fn->param_count != arg_count) return 0;
+
+    // Rule out large bodies from their token count, without parsing them
+    if (fn->body_end - fn->body_start > INLINE_TOKEN_BUDGET) return 0;
+    if (declares_function(body_of(fn))) return 0;
+
+    if (info->recursive < 0) {
+        char* visited = allocate(function_count > 0 ? function_count : 1);
+        info->recursive = stmt_reaches(body_of(fn), fn, visited);
+        jm_free(visited);
+    }
+    if (info->recursive) return 0;
+
+    prepare_function(info);
+    return count_stmt(fn->body) <= INLINE_BUDGET;
+}
+
+static Expr* inline_call(Expr* call, FnInfo* info) {
+    FnStmt* fn = info->fn;
+
+    Expr* expr = allocate(sizeof(Expr));
+    expr->type = EXPR_INLINE;
+    expr->inlined.callee = fn;
+    expr->inlined.arg_count = fn->param_count;
+    expr->inlined.args = allocate(sizeof(Expr*) * (fn->param_count > 0 ? fn->param_count : 1));
+    expr->inlined.body = clone_stmt(fn->body);
+
+    // Substitute constant arguments the body never reassigns; bind the rest
+    for (int i = 0; i < fn->param_count; i++) {
+        Expr* arg = fold_expr(call->call.args[i]);
+        call->call.args[i] = NULL;
+        if (arg->type == EXPR_LITERAL && !stmt_assigns(expr->inlined.body, fn->params[i].lexeme)) {
+            substitute_stmt(expr->inlined.body, fn->params[i].lexeme, arg);
+            free_expr(arg);
+        } else {
+            expr->inlined.args[i] = arg;
+        }
+    }
+    free_expr(call);  // Arguments were moved out above
+
+    expr->inlined.body = simplify_inlined(expr->inlined.body);
+
+    // A body that just returns a literal collapses to the literal, unless
+    // some bound argument still has to be evaluated
+    for (int i = 0; i < fn->param_count; i++) {
+        if (expr->inlined.args[i]) return expr;
+    }
+    int found = 0;
+    Expr* value = leading_return(expr->inlined.body, &found);
+    if (!value) return expr;
+    free_expr(expr);
+    return value;
+}
+
+static void inline_expr(Expr** slot) {
+    Expr* expr = *slot;
+    if (!expr) return;
+    switch (expr->type) {
+        case EXPR_BINARY:
+            inline_expr(&expr->binary.left);
+            inline_expr(&expr->binary.right);
+            break;
+        case EXPR_CALL: {
+            for (int i = 0; i < expr->call.arg_count; i++) {
+                inline_expr(&expr->call.args[i]);
+            }
+            FnInfo* info = callee_info(expr);
+            if (info && !shadowed(info->fn->name.lexeme) && can_inline(info, expr->call.arg_count)) {
+                *slot = inline_call(expr, info);
+            }
+            break;
+        }
+        case EXPR_INLINE:
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                inline_expr(&expr->inlined.args[i]);
+            }
+            break;
+        case EXPR_ARRAY:
+            for (int i = 0; i < expr->array.count; i++) {
+                inline_expr(&expr->array.elements[i]);
+            }
+            break;
+        case EXPR_INDEX:
+            inline_expr(&expr->index.object);
+            inline_expr(&expr->index.index);
+            break;
+        case EXPR_RECORD:
+            for (int i = 0; i < expr->record.count; i++) {
+                inline_expr(&expr->record.values[i]);
+            }
+            break;
+        case EXPR_FIELD:
+            inline_expr(&expr->field.object);
+            break;
+        case EXPR_UNARY:
+            inline_expr(&expr->unary.operand);
+            break;
+        default:
+            break;
+    }
+}
+
+static void inline_stmt(Stmt* stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+        case STMT_EXPR: inline_expr(&stmt->expr.expression); break;
+        case STMT_LET: inline_expr(&stmt->let.initializer); break;
+        case STMT_YAP: inline_expr(&stmt->yap.expression); break;
+        case STMT_RETURN: inline_expr(&stmt->return_stmt.value); break;
+        case STMT_IF:
+            inline_expr(&stmt->if_stmt.condition);
+            inline_stmt(stmt->if_stmt.then_branch);
+            inline_stmt(stmt->if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            inline_expr(&stmt->while_stmt.condition);
+            inline_stmt(stmt->while_stmt.body);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < stmt->block.count; i++) inline_stmt(stmt->block.statements[i]);
+            break;
+        case STMT_FN:
+            break;  // Bodies are optimized when they are compiled
+    }
+}
+
+/*
+ * Inlines into a function body before the function itself is considered
+ * for inlining. Only non-recursive functions are inlined, so a function
+ * in progress is never requested again while it is being prepared.
+ * A body prepared during an earlier optimize_ast() call is prepared
+ * again; that finds nothing new to inline, since the same calls qualify.
+ */
+static void prepare_function(FnInfo* info) {
+    if (info->state != 0) return;
+    info->state = 1;
+    FnStmt* enclosing = owner;
+    owner = info->fn;
+    inline_stmt(info->fn->body);
+    owner = enclosing;
+    info->state = 2;
+}
+
+void optimize_ast(Stmt** stmts, int stmt_count, FnStmt** fns, int fn_count) {
+    // Collect the functions calls may refer to; nothing is parsed yet
+    functions = jm_alloc(sizeof(FnInfo) * (fn_count > 0 ? fn_count : 1));
+    function_count = fn_count;
+    for (int i = 0; i < fn_count; i++) {
+        functions[i].fn = fns[i];
+        functions[i].recursive = -1;
+        functions[i].state = 0;
+    }
+
+    for (int i = 0; i < stmt_count; i++) inline_stmt(stmts[i]);
+    for (int i = 0; i < stmt_count; i++) fold_stmt(stmts[i]);
+
+    jm_free(functions);
+    functions = NULL;
+    function_count = 0;
+}
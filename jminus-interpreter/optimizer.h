@@ -0,0 +1,72 @@
+/**
+ * @file optimizer.h
+ * @brief AST-level optimizations run by the compiler before code generation
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The optimizer rewrites the AST in place between parsing and bytecode
+ * generation. It currently performs two passes, in this order:
+ *
+ * Inlining:
+ * - Calls to small, non-recursive functions are replaced by an
+ *   EXPR_INLINE node holding a private copy of the callee's body
+ * - Function bodies are parsed lazily; only callees whose body is within
+ *   INLINE_TOKEN_BUDGET tokens (and the functions they reach) get parsed
+ * - Constant arguments are substituted for parameters the body never
+ *   assigns; other arguments are bound to fresh frame slots by the compiler
+ * - Function size is measured in AST nodes after inlining into the function
+ *   itself, and must not exceed INLINE_BUDGET
+ * - Recursive functions (direct or mutual) are never inlined
+ *
+ * Constant Folding:
+ * - Binary operations on two literals are evaluated at compile time with
+ *   the runtime's own value functions, so ints and doubles fold exactly as
+ *   they would compute
+ * - Division by zero, type errors, shift counts out of range and infinite
+ *   or NaN results are left to runtime
+ * - Inside inlined bodies, if statements with a constant condition are
+ *   reduced to the branch that runs, and an inlined body that immediately
+ *   returns a literal is replaced by that literal
+ *
+ * Memory Management:
+ * - Replaced nodes are freed; new nodes are owned by the AST as usual
+ * - Function declarations are left in place for calls that were not inlined
+ * - Bodies of declarations are not optimized here; the compiler optimizes
+ *   each body on its own when the function is first compiled
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "parser.h"
+
+/**
+ * @brief Maximum size (in AST nodes) of a function body that may be inlined
+ */
+#define INLINE_BUDGET 40
+
+/**
+ * @brief Maximum size (in tokens) of an unparsed body worth parsing for inlining
+ */
+#define INLINE_TOKEN_BUDGET (INLINE_BUDGET * 4)
+
+/**
+ * @brief Runs all AST optimizations over a list of statements
+ * @param stmts Statements to optimize (modified in place): top-level code,
+ *              or a single function body
+ * @param stmt_count Number of statements
+ * @param fns Declarations of the functions calls may refer to
+ * @param fn_count Number of declarations
+ */
+void optimize_ast(Stmt** stmts, int stmt_count, FnStmt** fns, int fn_count);
+
+/**
+ * @brief Folds constant subexpressions of an expression tree
+ * @param expr Expression to fold (may be NULL)
+ * @return The folded expression (the original node or its replacement)
+ *
+ * Nodes that are replaced are freed.
+ */
+Expr* fold_expr(Expr* expr);
+
+#endif // OPTIMIZER_H
@@ -2,6 +2,7 @@
 #include <stdlib.h>    // Include standard library for memory management (malloc, free)
 #include <string.h>    // Include string library for string operations like memset
 #include "parser.h"    // Include our custom parser header with necessary data structures
+#include "allocator.h" // Include the allocator that all parser memory goes through
 
 // ----------------------------
 // Internal State
@@ -50,7 +51,7 @@ static int match(TokenType type) {
 
 void* allocate(size_t size) {
     // Allocate memory of given size and initialize it to zeros
-    void* node = malloc(size);
+    void* node = jm_alloc(size);
     // Check if allocation was successful
     if (!node) {
         fprintf(stderr, "Memory allocation failed\n");
@@ -61,10 +62,22 @@ void* allocate(size_t size) {
     return node;
 }
 
+static Stmt** reserve_statements(Stmt** statements, int count, int* capacity) {
+    // Double the statement array when it is full
+    if (count < *capacity) return statements;
+    *capacity *= 2;
+    statements = jm_realloc(statements, sizeof(Stmt*) * *capacity);
+    if (!statements) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return statements;
+}
+
 // ----------------------------
 // Memory cleanup
 // ----------------------------
-static void free_expr(Expr* expr) {
+void free_expr(Expr* expr) {
     // Recursively free memory for expression nodes
     if (!expr) return;  // Return if null pointer
     
@@ -82,18 +95,57 @@ static void free_expr(Expr* expr) {
                 free_expr(expr->call.args[i]);
             }
             // Free the array of argument pointers
-            free(expr->call.args);
+            jm_free(expr->call.args);
+            break;
+        case EXPR_INLINE:
+            // Free bound arguments and the private copy of the body
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                free_expr(expr->inlined.args[i]);
+            }
+            jm_free(expr->inlined.args);
+            free_stmt(expr->inlined.body);
+            break;
+        case EXPR_ARRAY:
+            // Free every element and the array of element pointers
+            for (int i = 0; i < expr->array.count; i++) {
+                free_expr(expr->array.elements[i]);
+            }
+            jm_free(expr->array.elements);
+            break;
+        case EXPR_INDEX:
+            // Free the indexed expression and the index
+            free_expr(expr->index.object);
+            free_expr(expr->index.index);
+            break;
+        case EXPR_RECORD:
+            // Free every field value and both field arrays
+            for (int i = 0; i < expr->record.count; i++) {
+                free_expr(expr->record.values[i]);
+            }
+            jm_free(expr->record.names);
+            jm_free(expr->record.values);
+            break;
+        case EXPR_FIELD:
+            // Free the accessed expression
+            free_expr(expr->field.object);
+            break;
+        case EXPR_UNARY:
+            // Free the operand
+            free_expr(expr->unary.operand);
             break;
         case EXPR_LITERAL:
+            // Folded literals own their lexeme
+            if (expr->literal.owns_lexeme) jm_free(expr->literal.value.lexeme);
+            break;
         case EXPR_VARIABLE:
             // These don't have any sub-expressions to free
             break;
     }
     // Free the expression node itself
-    free(expr);
+    jm_free(expr);
 }
 
-static void free_stmt(Stmt* stmt) {
+void free_stmt(Stmt* stmt) {
     // Recursively free memory for statement nodes
     if (!stmt) return;  // Return if null pointer
     
@@ -128,11 +180,145 @@ static void free_stmt(Stmt* stmt) {
                 free_stmt(stmt->block.statements[i]);
             }
             // Free the array of statement pointers
-            free(stmt->block.statements);
+            jm_free(stmt->block.statements);
+            break;
+        case STMT_FN:
+            // Free the parameter list and the function body
+            jm_free(stmt->fn.params);
+            free_stmt(stmt->fn.body);
+            break;
+        case STMT_RETURN:
+            // Free the returned expression (may be NULL)
+            free_expr(stmt->return_stmt.value);
             break;
     }
     // Free the statement node itself
-    free(stmt);
+    jm_free(stmt);
+}
+
+// ----------------------------
+// Copying
+// ----------------------------
+Expr* clone_expr(Expr* expr) {
+    // Recursively copy an expression tree
+    if (!expr) return NULL;
+
+    Expr* copy = allocate(sizeof(Expr));
+    *copy = *expr;  // Copies tokens and scalar fields
+
+    switch (expr->type) {
+        case EXPR_LITERAL:
+            if (expr->literal.owns_lexeme) {
+                size_t length = strlen(expr->literal.value.lexeme) + 1;
+                copy->literal.value.lexeme = allocate(length);
+                memcpy(copy->literal.value.lexeme, expr->literal.value.lexeme, length);
+            }
+            break;
+        case EXPR_VARIABLE:
+            break;
+        case EXPR_BINARY:
+            copy->binary.left = clone_expr(expr->binary.left);
+            copy->binary.right = clone_expr(expr->binary.right);
+            break;
+        case EXPR_CALL:
+            copy->call.callee = clone_expr(expr->call.callee);
+            copy->call.args = NULL;
+            if (expr->call.arg_count > 0) {
+                copy->call.args = allocate(sizeof(Expr*) * expr->call.arg_count);
+                for (int i = 0; i < expr->call.arg_count; i++) {
+                    copy->call.args[i] = clone_expr(expr->call.args[i]);
+                }
+            }
+            break;
+        case EXPR_INLINE: {
+            int count = expr->inlined.arg_count;
+            copy->inlined.args = allocate(sizeof(Expr*) * (count > 0 ? count : 1));
+            for (int i = 0; i < count; i++) {
+                copy->inlined.args[i] = clone_expr(expr->inlined.args[i]);
+            }
+            copy->inlined.body = clone_stmt(expr->inlined.body);
+            break;
+        }
+        case EXPR_ARRAY:
+            copy->array.elements = NULL;
+            if (expr->array.count > 0) {
+                copy->array.elements = allocate(sizeof(Expr*) * expr->array.count);
+                for (int i = 0; i < expr->array.count; i++) {
+                    copy->array.elements[i] = clone_expr(expr->array.elements[i]);
+                }
+            }
+            break;
+        case EXPR_INDEX:
+            copy->index.object = clone_expr(expr->index.object);
+            copy->index.index = clone_expr(expr->index.index);
+            break;
+        case EXPR_RECORD:
+            copy->record.names = NULL;
+            copy->record.values = NULL;
+            if (expr->record.count > 0) {
+                copy->record.names = allocate(sizeof(Token) * expr->record.count);
+                memcpy(copy->record.names, expr->record.names, sizeof(Token) * expr->record.count);
+                copy->record.values = allocate(sizeof(Expr*) * expr->record.count);
+                for (int i = 0; i < expr->record.count; i++) {
+                    copy->record.values[i] = clone_expr(expr->record.values[i]);
+                }
+            }
+            break;
+        case EXPR_FIELD:
+            copy->field.object = clone_expr(expr->field.object);
+            break;
+        case EXPR_UNARY:
+            copy->unary.operand = clone_expr(expr->unary.operand);
+            break;
+    }
+    return copy;
+}
+
+Stmt* clone_stmt(Stmt* stmt) {
+    // Recursively copy a statement tree
+    if (!stmt) return NULL;
+
+    Stmt* copy = allocate(sizeof(Stmt));
+    *copy = *stmt;  // Copies tokens and scalar fields
+
+    switch (stmt->type) {
+        case STMT_EXPR:
+            copy->expr.expression = clone_expr(stmt->expr.expression);
+            break;
+        case STMT_LET:
+            copy->let.initializer = clone_expr(stmt->let.initializer);
+            break;
+        case STMT_YAP:
+            copy->yap.expression = clone_expr(stmt->yap.expression);
+            break;
+        case STMT_IF:
+            copy->if_stmt.condition = clone_expr(stmt->if_stmt.condition);
+            copy->if_stmt.then_branch = clone_stmt(stmt->if_stmt.then_branch);
+            copy->if_stmt.else_branch = clone_stmt(stmt->if_stmt.else_branch);
+            break;
+        case STMT_WHILE:
+            copy->while_stmt.condition = clone_expr(stmt->while_stmt.condition);
+            copy->while_stmt.body = clone_stmt(stmt->while_stmt.body);
+            break;
+        case STMT_BLOCK:
+            copy->block.statements = allocate(sizeof(Stmt*) * (stmt->block.count > 0 ? stmt->block.count : 1));
+            for (int i = 0; i < stmt->block.count; i++) {
+                copy->block.statements[i] = clone_stmt(stmt->block.statements[i]);
+            }
+            break;
+        case STMT_FN:
+            copy->fn.params = NULL;
+            if (stmt->fn.param_count > 0) {
+                copy->fn.params = allocate(sizeof(Token) * stmt->fn.param_count);
+                memcpy(copy->fn.params, stmt->fn.params, sizeof(Token) * stmt->fn.param_count);
+            }
+            copy->fn.body = clone_stmt(stmt->fn.body);
+            break;
+        case STMT_RETURN:
+            copy->return_stmt.value = clone_expr(stmt->return_stmt.value);
+            break;
+    }
+    return copy;
 }
 
 void free_ast(Stmt** stmts, int stmt_count) {
@@ -142,7 +328,7 @@ void free_ast(Stmt** stmts, int stmt_count) {
         free_stmt(stmts[i]);
     }
     // Free the array of statement pointers
-    free(stmts);
+    jm_free(stmts);
 }
 
 // ----------------------------
@@ -152,8 +338,13 @@ void free_ast(Stmt** stmts, int stmt_count) {
 Expr* parse_expression();
 Expr* parse_equality();
 Expr* parse_comparison();
+Expr* parse_bit_or();
+Expr* parse_bit_xor();
+Expr* parse_bit_and();
+Expr* parse_shift();
 Expr* parse_term();
 Expr* parse_factor();
+Expr* parse_call();
 Expr* parse_primary();
 Stmt* parse_statement();
 Stmt* parse_block_statement();
@@ -161,6 +352,11 @@ Stmt* parse_if_statement();
 Stmt* parse_while_statement();
 Stmt* parse_let_statement();
 Stmt* parse_yap_statement();
+Stmt* parse_fn_statement();
+Stmt* parse_return_statement();
+
+// Upper bound on parameters per function, arguments per call and array literal elements
+#define MAX_ARGS 255
 
 // ----------------------------
 // Expression Parsing
@@ -168,9 +364,9 @@ Stmt* parse_yap_statement();
 Expr* parse_primary() {
     // Parse literals, variables, and parenthesized expressions
     
-    if (match(TOKEN_INT)) {
-        // Create a literal expression node for integer tokens
-        LiteralExpr lit = { previous() };
+    if (match(TOKEN_INT) || match(TOKEN_FLOAT) || match(TOKEN_STRING) || match(TOKEN_TRUE) || match(TOKEN_FALSE)) {
+        // Create a literal expression node for number, string and boolean tokens
+        LiteralExpr lit = { previous(), 0 };
         Expr* expr = allocate(sizeof(Expr));
         expr->type = EXPR_LITERAL;
         expr->literal = lit;
@@ -186,6 +382,89 @@ Expr* parse_primary() {
         return expr;
     }
 
+    if (match(TOKEN_LBRACKET)) {
+        // Parse an array literal: comma-separated elements up to ']'
+        Token bracket = previous();
+        Expr* elements[MAX_ARGS];
+        int count = 0;
+        if (!check(TOKEN_RBRACKET)) {
+            do {
+                if (count >= MAX_ARGS) {
+                    fprintf(stderr, "Too many elements in array literal\n");
+                    return NULL;
+                }
+                Expr* element = parse_expression();
+                if (!element) return NULL;
+                elements[count++] = element;
+            } while (match(TOKEN_COMMA));
+        }
+        if (!match(TOKEN_RBRACKET)) {
+            fprintf(stderr, "Expected ']' after array elements\n");
+            return NULL;
+        }
+
+        ArrayExpr array = { bracket, NULL, count };
+        if (count > 0) {
+            array.elements = allocate(sizeof(Expr*) * count);
+            memcpy(array.elements, elements, sizeof(Expr*) * count);
+        }
+        Expr* expr = allocate(sizeof(Expr));
+        expr->type = EXPR_ARRAY;
+        expr->array = array;
+        return expr;
+    }
+
+    if (match(TOKEN_LBRACE)) {
+        // Parse a record literal: comma-separated name: value fields up to '}'
+        Token brace = previous();
+        Token names[MAX_ARGS];
+        Expr* values[MAX_ARGS];
+        int count = 0;
+        if (!check(TOKEN_RBRACE)) {
+            do {
+                if (count >= MAX_ARGS) {
+                    fprintf(stderr, "Too many fields in record literal\n");
+                    return NULL;
+                }
+                if (!match(TOKEN_IDENTIFIER)) {
+                    fprintf(stderr, "Expected field name in record literal\n");
+                    return NULL;
+                }
+                Token name = previous();
+                for (int i = 0; i < count; i++) {
+                    if (strcmp(names[i].lexeme, name.lexeme) == 0) {
+                        fprintf(stderr, "Duplicate field '%s' in record literal\n", name.lexeme);
+                        return NULL;
+                    }
+                }
+                if (!match(TOKEN_COLON)) {
+                    fprintf(stderr, "Expected ':' after field name\n");
+                    return NULL;
+                }
+                Expr* value = parse_expression();
+                if (!value) return NULL;
+                names[count] = name;
+                values[count++] = value;
+            } while (match(TOKEN_COMMA));
+        }
+        if (!match(TOKEN_RBRACE)) {
+            fprintf(stderr, "Expected '}' after record fields\n");
+            return NULL;
+        }
+
+        RecordExpr record = { brace, NULL, NULL, count };
+        if (count > 0) {
+            record.names = allocate(sizeof(Token) * count);
+            memcpy(record.names, names, sizeof(Token) * count);
+            record.values = allocate(sizeof(Expr*) * count);
+            memcpy(record.values, values, sizeof(Expr*) * count);
+        }
+        Expr* expr = allocate(sizeof(Expr));
+        expr->type = EXPR_RECORD;
+        expr->record = record;
+        return expr;
+    }
+
     if (match(TOKEN_LPAREN)) {
         // Parse parenthesized expression and check for closing parenthesis
         Expr* expr = parse_expression();
@@ -201,6 +480,77 @@ Expr* parse_primary() {
     return NULL;
 }
 
+Expr* parse_call() {
+    // Parse a primary expression followed by any number of call, index and field suffixes
+    Expr* expr = parse_primary();
+    if (!expr) return NULL;
+
+    while (check(TOKEN_LPAREN) || check(TOKEN_LBRACKET) || check(TOKEN_DOT)) {
+        if (match(TOKEN_DOT)) {
+            // Field suffix: expr.name
+            if (!match(TOKEN_IDENTIFIER)) {
+                fprintf(stderr, "Expected field name after '.'\n");
+                return NULL;
+            }
+            FieldExpr access = { expr, previous() };
+            Expr* field_expr = allocate(sizeof(Expr));
+            field_expr->type = EXPR_FIELD;
+            field_expr->field = access;
+            expr = field_expr;
+            continue;
+        }
+        if (match(TOKEN_LBRACKET)) {
+            // Index suffix: expr[index]
+            Token bracket = previous();
+            Expr* index = parse_expression();
+            if (!index) return NULL;
+            if (!match(TOKEN_RBRACKET)) {
+                fprintf(stderr, "Expected ']' after index\n");
+                return NULL;
+            }
+            IndexExpr access = { expr, bracket, index };
+            Expr* index_expr = allocate(sizeof(Expr));
+            index_expr->type = EXPR_INDEX;
+            index_expr->index = access;
+            expr = index_expr;
+            continue;
+        }
+        advance();  // '('
+
+        // Collect comma-separated arguments until the closing parenthesis
+        Expr* args[MAX_ARGS];
+        int arg_count = 0;
+        if (!check(TOKEN_RPAREN)) {
+            do {
+                if (arg_count >= MAX_ARGS) {
+                    fprintf(stderr, "Too many arguments in call\n");
+                    return NULL;
+                }
+                Expr* arg = parse_expression();
+                if (!arg) return NULL;
+                args[arg_count++] = arg;
+            } while (match(TOKEN_COMMA));
+        }
+        if (!match(TOKEN_RPAREN)) {
+            fprintf(stderr, "Expected ')' after arguments\n");
+            return NULL;
+        }
+
+        // Create call expression node owning a copy of the argument list
+        CallExpr call = { expr, NULL, arg_count };
+        if (arg_count > 0) {
+            call.args = allocate(sizeof(Expr*) * arg_count);
+            memcpy(call.args, args, sizeof(Expr*) * arg_count);
+        }
+        Expr* call_expr = allocate(sizeof(Expr));
+        call_expr->type = EXPR_CALL;
+        call_expr->call = call;
+        expr = call_expr;
+    }
+
+    return expr;
+}
+
 Expr* parse_binary(Expr* (*next_fn)(), TokenType ops[], int op_count) {
     // Generic binary expression parser used for different precedence levels
     
@@ -242,10 +592,25 @@ Expr* parse_binary(Expr* (*next_fn)(), TokenType ops[], int op_count) {
     return left;
 }
 
+Expr* parse_unary() {
+    // Parse prefix logical not, which binds tighter than any binary operator
+    if (match(TOKEN_BANG)) {
+        Token op = previous();
+        Expr* operand = parse_unary();
+        if (!operand) return NULL;
+        UnaryExpr unary = { op, operand };
+        Expr* expr = allocate(sizeof(Expr));
+        expr->type = EXPR_UNARY;
+        expr->unary = unary;
+        return expr;
+    }
+    return parse_call();
+}
+
 Expr* parse_factor() {
-    // Parse multiplication and division (highest precedence binary ops)
-    TokenType ops[] = { TOKEN_STAR, TOKEN_SLASH };
-    return parse_binary(parse_primary, ops, 2);
+    // Parse multiplication, division and remainder (highest precedence binary ops)
+    TokenType ops[] = { TOKEN_STAR, TOKEN_SLASH, TOKEN_PERCENT };
+    return parse_binary(parse_unary, ops, 3);
 }
 
 Expr* parse_term() {
@@ -254,10 +619,32 @@ Expr* parse_term() {
     return parse_binary(parse_factor, ops, 2);
 }
 
+Expr* parse_shift() {
+    // Parse shifts (<<, >>)
+    TokenType ops[] = { TOKEN_LESS_LESS, TOKEN_GREATER_GREATER };
+    return parse_binary(parse_term, ops, 2);
+}
+
+// Bitwise operators bind tighter than comparisons, so x & 1 == 0 tests the low bit
+Expr* parse_bit_and() {
+    TokenType ops[] = { TOKEN_AMP };
+    return parse_binary(parse_shift, ops, 1);
+}
+
+Expr* parse_bit_xor() {
+    TokenType ops[] = { TOKEN_CARET };
+    return parse_binary(parse_bit_and, ops, 1);
+}
+
+Expr* parse_bit_or() {
+    TokenType ops[] = { TOKEN_PIPE };
+    return parse_binary(parse_bit_xor, ops, 1);
+}
+
 Expr* parse_comparison() {
     // Parse comparison operators (<, <=, >, >=)
     TokenType ops[] = { TOKEN_LESS, TOKEN_LESS_EQUAL, TOKEN_GREATER, TOKEN_GREATER_EQUAL };
-    return parse_binary(parse_term, ops, 4);
+    return parse_binary(parse_bit_or, ops, 4);
 }
 
 Expr* parse_equality() {
@@ -266,11 +653,22 @@ Expr* parse_equality() {
     return parse_binary(parse_comparison, ops, 2);
 }
 
+// Logical operators bind loosest, so a < b && b < c needs no parentheses
+Expr* parse_and() {
+    TokenType ops[] = { TOKEN_AMP_AMP };
+    return parse_binary(parse_equality, ops, 1);
+}
+
+Expr* parse_or() {
+    TokenType ops[] = { TOKEN_PIPE_PIPE };
+    return parse_binary(parse_and, ops, 1);
+}
+
 Expr* parse_expression() {
     // Top-level expression parser that handles assignments
     
     // Parse left-hand side (could be variable or other expression)
-    Expr* expr = parse_equality();
+    Expr* expr = parse_or();
     if (!expr) return NULL;
 
     // Check if this is an assignment expression
@@ -281,8 +679,8 @@ Expr* parse_expression() {
         Expr* value = parse_expression();
         if (!value) return NULL;
 
-        // Ensure left side is a valid assignment target (variable)
-        if (expr->type != EXPR_VARIABLE) {
+        // Ensure left side is a valid assignment target (variable, element or field)
+        if (expr->type != EXPR_VARIABLE && expr->type != EXPR_INDEX && expr->type != EXPR_FIELD) {
             fprintf(stderr, "Invalid assignment target.\n");
             return NULL;
         }
@@ -438,17 +836,141 @@ Stmt* parse_while_statement() {
     return stmt;
 }
 
+Stmt* parse_fn_statement() {
+    // Parse function declarations: fn name(params) { body }
+
+    // Expect function name after 'fn' keyword
+    if (!match(TOKEN_IDENTIFIER)) {
+        fprintf(stderr, "Expected function name after 'fn'\n");
+        return NULL;
+    }
+    Token name = previous();
+
+    // Expect parameter list in parentheses
+    if (!match(TOKEN_LPAREN)) {
+        fprintf(stderr, "Expected '(' after function name\n");
+        return NULL;
+    }
+    Token params[MAX_ARGS];
+    int param_count = 0;
+    if (!check(TOKEN_RPAREN)) {
+        do {
+            if (param_count >= MAX_ARGS) {
+                fprintf(stderr, "Too many parameters in function '%s'\n", name.lexeme);
+                return NULL;
+            }
+            if (!match(TOKEN_IDENTIFIER)) {
+                fprintf(stderr, "Expected parameter name\n");
+                return NULL;
+            }
+            params[param_count++] = previous();
+        } while (match(TOKEN_COMMA));
+    }
+    if (!match(TOKEN_RPAREN)) {
+        fprintf(stderr, "Expected ')' after parameters\n");
+        return NULL;
+    }
+
+    // The body must be a block
+    if (!match(TOKEN_LBRACE)) {
+        fprintf(stderr, "Expected '{' before function body\n");
+        return NULL;
+    }
+
+    // Pre-scan the body by matching braces only; it is parsed on first use
+    int body_start = current;
+    int depth = 1;
+    while (!is_at_end()) {
+        if (peek().type == TOKEN_LBRACE) depth++;
+        if (peek().type == TOKEN_RBRACE && --depth == 0) break;
+        advance();
+    }
+    if (!match(TOKEN_RBRACE)) {
+        fprintf(stderr, "Expected '}' after body of function '%s'\n", name.lexeme);
+        return NULL;
+    }
+
+    // Create function declaration node (body stays NULL until parsed)
+    FnStmt fn = { name, NULL, param_count, NULL, tokens, body_start, current - 1 };
+    if (param_count > 0) {
+        fn.params = allocate(sizeof(Token) * param_count);
+        memcpy(fn.params, params, sizeof(Token) * param_count);
+    }
+    Stmt* stmt = allocate(sizeof(Stmt));
+    stmt->type = STMT_FN;
+    stmt->fn = fn;
+    return stmt;
+}
+
+Stmt* parse_function_body(FnStmt* fn) {
+    // Parse a pre-scanned function body on demand
+    if (fn->body) return fn->body;
+
+    // Save the parser state, which may belong to another parse in progress
+    Token* saved_tokens = tokens;
+    int saved_current = current;
+    int saved_total = total;
+
+    // Point the parser at the body tokens, just after the opening brace
+    tokens = fn->tokens;
+    current = fn->body_start;
+    total = fn->body_end + 1;
+
+    // The body must end exactly at the brace found by the pre-scan
+    Stmt* body = parse_block_statement();
+    if (body && current != fn->body_end + 1) {
+        fprintf(stderr, "Unexpected '}' in body of function '%s'\n", fn->name.lexeme);
+        free_stmt(body);
+        body = NULL;
+    }
+
+    // Restore the parser state
+    tokens = saved_tokens;
+    current = saved_current;
+    total = saved_total;
+
+    fn->body = body;
+    return body;
+}
+
+Stmt* parse_return_statement() {
+    // Parse return statements with an optional value
+    Token keyword = previous();
+
+    // A bare 'return;' returns 0
+    Expr* value = NULL;
+    if (!check(TOKEN_SEMICOLON)) {
+        value = parse_expression();
+        if (!value) return NULL;
+    }
+
+    // Expect semicolon after return value
+    if (!match(TOKEN_SEMICOLON)) {
+        fprintf(stderr, "Expected ';' after return value\n");
+        return NULL;
+    }
+
+    // Create return statement node
+    ReturnStmt return_stmt = { keyword, value };
+    Stmt* stmt = allocate(sizeof(Stmt));
+    stmt->type = STMT_RETURN;
+    stmt->return_stmt = return_stmt;
+    return stmt;
+}
+
 Stmt* parse_block_statement() {
     // Parse block of statements enclosed in braces
     
-    // Allocate array for statements (max 128 statements per block)
-    Stmt** statements = allocate(sizeof(Stmt*) * 128);
+    // Allocate array for statements (grown as needed)
+    int capacity = 16;
+    Stmt** statements = allocate(sizeof(Stmt*) * capacity);
     int count = 0;
 
     // Parse statements until closing brace or end of file
     while (!check(TOKEN_RBRACE) && !is_at_end()) {
         Stmt* stmt = parse_statement();
         if (!stmt) return NULL;
+        statements = reserve_statements(statements, count, &capacity);
         statements[count++] = stmt;
     }
 
@@ -470,6 +992,8 @@ Stmt* parse_statement() {
     // Parse any kind of statement, dispatching to specific parsers
     
     // Check for specific statement keywords and dispatch accordingly
+    if (match(TOKEN_FN)) return parse_fn_statement();
+    if (match(TOKEN_RETURN)) return parse_return_statement();
     if (match(TOKEN_LET)) return parse_let_statement();
     if (match(TOKEN_YAP)) return parse_yap_statement();
     if (match(TOKEN_IF)) return parse_if_statement();
@@ -505,8 +1029,9 @@ Stmt** parse(Token* token_array, int token_count, int* stmt_count) {
     current = 0;
     total = token_count;
 
-    // Allocate array for top-level statements (max 128)
-    Stmt** stmts = allocate(sizeof(Stmt*) * 128);
+    // Allocate array for top-level statements (grown as needed)
+    int capacity = 128;
+    Stmt** stmts = allocate(sizeof(Stmt*) * capacity);
     int count = 0;
 
     // Parse statements until end of file
@@ -517,6 +1042,7 @@ Stmt** parse(Token* token_array, int token_count, int* stmt_count) {
             free_ast(stmts, count);
             return NULL;
         }
+        stmts = reserve_statements(stmts, count, &capacity);
         stmts[count++] = stmt;
     }
 
@@ -541,7 +1067,8 @@ void print_expr(Expr* expr, int indent) {
         case EXPR_LITERAL:
             // Print literal value
             print_indent(indent);
-            printf("Literal: %s\n", expr->literal.value.lexeme);
+            if (expr->literal.value.type == TOKEN_STRING) printf("Literal: \"%s\"\n", expr->literal.value.lexeme);
+            else printf("Literal: %s\n", expr->literal.value.lexeme);
             break;
         case EXPR_VARIABLE:
             // Print variable name
@@ -564,6 +1091,55 @@ void print_expr(Expr* expr, int indent) {
                 print_expr(expr->call.args[i], indent + 1);  // Each argument
             }
             break;
+        case EXPR_INLINE:
+            // Print inlined call with bound arguments and the substituted body
+            print_indent(indent);
+            printf("Inline: %s\n", expr->inlined.callee->name.lexeme);
+            for (int i = 0; i < expr->inlined.arg_count; i++) {
+                if (!expr->inlined.args[i]) continue;  // Substituted constant
+                print_indent(indent + 1);
+                printf("Bind: %s\n", expr->inlined.callee->params[i].lexeme);
+                print_expr(expr->inlined.args[i], indent + 2);
+            }
+            print_stmt(expr->inlined.body, indent + 1);
+            break;
+        case EXPR_ARRAY:
+            // Print array literal and its elements (recursively)
+            print_indent(indent);
+            printf("Array: %d elements\n", expr->array.count);
+            for (int i = 0; i < expr->array.count; i++) {
+                print_expr(expr->array.elements[i], indent + 1);
+            }
+            break;
+        case EXPR_INDEX:
+            // Print indexed expression and the index
+            print_indent(indent);
+            printf("Index:\n");
+            print_expr(expr->index.object, indent + 1);
+            print_expr(expr->index.index, indent + 1);
+            break;
+        case EXPR_RECORD:
+            // Print each field name and its value (recursively)
+            print_indent(indent);
+            printf("Record: %d fields\n", expr->record.count);
+            for (int i = 0; i < expr->record.count; i++) {
+                print_indent(indent + 1);
+                printf("%s:\n", expr->record.names[i].lexeme);
+                print_expr(expr->record.values[i], indent + 2);
+            }
+            break;
+        case EXPR_FIELD:
+            // Print the field name and the accessed expression
+            print_indent(indent);
+            printf("Field: %s\n", expr->field.name.lexeme);
+            print_expr(expr->field.object, indent + 1);
+            break;
+        case EXPR_UNARY:
+            // Print the operator and its operand
+            print_indent(indent);
+            printf("Unary: %s\n", expr->unary.op.lexeme);
+            print_expr(expr->unary.operand, indent + 1);
+            break;
     }
 }
 
@@ -625,5 +1201,27 @@ void print_stmt(Stmt* stmt, int indent) {
                 print_stmt(stmt->block.statements[i], indent + 1);
             }
             break;
+        case STMT_FN:
+            // Print function declaration with parameters and body
+            print_indent(indent);
+            printf("FnStmt: %s(", stmt->fn.name.lexeme);
+            for (int i = 0; i < stmt->fn.param_count; i++) {
+                printf(i > 0 ? ", %s" : "%s", stmt->fn.params[i].lexeme);
+            }
+            printf(")\n");
+            if (stmt->fn.body) {
+                print_stmt(stmt->fn.body, indent + 1);
+            } else {
+                // Bodies are only parsed once the function is used
+                print_indent(indent + 1);
+                printf("(body not parsed: %d tokens)\n", stmt->fn.body_end - stmt->fn.body_start);
+            }
+            break;
+        case STMT_RETURN:
+            // Print return statement and its value
+            print_indent(indent);
+            printf("ReturnStmt:\n");
+            print_expr(stmt->return_stmt.value, indent + 1);
+            break;
     }
 }
@@ -21,9 +21,14 @@
  * 
  * Parsing Strategy:
  * 1. Program → Statement* (zero or more statements)
- * 2. Statement → Let | Yap | If | While | Block | Expression
- * 3. Expression → Binary | Unary | Primary
- * 4. Primary → Literal | Variable | Grouped
+ * 2. Statement → Fn | Return | Let | Yap | If | While | Block | Expression
+ *    (Fn bodies are only brace-matched here and parsed on first use)
+ * 3. Expression → Binary | Unary | Call
+ *    (binary operators, loosest first: =; ||; &&; == !=; < <= > >=; |; ^;
+ *    &; << >>; + -; * / %; then prefix !)
+ * 4. Call → Primary ( "(" Arguments? ")" | "[" Expression "]" )*
+ * 5. Primary → Literal | Variable | Grouped | Array
+ *    (Literal → Int | Float | String | true | false; Array → "[" Elements? "]")
  * 
  * Error Handling:
  * - Syntax errors are reported with line numbers
@@ -35,6 +40,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stddef.h>
 #include "lexer.h"
 
 typedef struct Expr Expr;
@@ -43,11 +49,14 @@ typedef struct Stmt Stmt;
 /**
  * @brief Represents a literal value in the AST
  * 
- * Literals are constant values that appear directly in the source code.
- * Currently supports only integer literals.
+ * Literals are constant values that appear directly in the source code:
+ * integers, floats, strings, true and false (the token type tells which; see
+ * literal_value() in value.h). Literals produced by constant
+ * folding own their lexeme, which is freed together with the node.
  */
 typedef struct {
-    Token value; ///< The token containing the literal value
+    Token value;     ///< The token containing the literal value
+    int owns_lexeme; ///< Nonzero if value.lexeme was allocated for this node
 } LiteralExpr;
 
 /**
@@ -64,7 +73,9 @@ typedef struct {
  * @brief Represents a binary operation in the AST
  * 
  * Binary expressions combine two sub-expressions with an operator.
- * Examples: a + b, x * y, condition == true
+ * For && and || the right side runs only when the left side does not
+ * already decide the result, which is 1 or 0.
+ * Examples: a + b, x * y, condition == true, i < n && a[i] != 0
  */
 typedef struct {
     Expr* left;   ///< Left-hand side expression
@@ -72,11 +83,22 @@ typedef struct {
     Expr* right;  ///< Right-hand side expression
 } BinaryExpr;
 
+/**
+ * @brief Represents a prefix operation in the AST
+ * 
+ * Logical not yields 1 when its operand is falsy and 0 otherwise.
+ * Example: !done
+ */
+typedef struct {
+    Token op;          ///< The operator token
+    Expr* operand;     ///< The operand expression
+} UnaryExpr;
+
 /**
  * @brief Represents a function call in the AST
  * 
- * Function calls invoke functions with arguments.
- * Currently only supports the built-in 'yap' function.
+ * Function calls invoke user-defined functions with arguments.
+ * Example: fib(n - 1)
  */
 typedef struct {
     Expr* callee;      ///< The function being called
@@ -84,6 +106,76 @@ typedef struct {
     int arg_count;     ///< Number of arguments
 } CallExpr;
 
+/**
+ * @brief Represents an array literal in the AST
+ * 
+ * Each evaluation creates a new array holding the element values.
+ * Example: [1, 2, x + 1]
+ */
+typedef struct {
+    Token bracket;     ///< The '[' token (for error reporting)
+    Expr** elements;   ///< Array of element expressions
+    int count;         ///< Number of elements
+} ArrayExpr;
+
+/**
+ * @brief Represents an indexing operation in the AST
+ * 
+ * Reads an array element, or names the element to store into when it
+ * is the target of an assignment.
+ * Examples: a[i], a[i] = 0
+ */
+typedef struct {
+    Expr* object;      ///< The array being indexed
+    Token bracket;     ///< The '[' token (for error reporting)
+    Expr* index;       ///< The index expression
+} IndexExpr;
+
+/**
+ * @brief Represents a record literal in the AST
+ * 
+ * Each evaluation creates a new record. Records built from the same
+ * field names in the same order share one shape.
+ * Example: {x: 1, y: 2}
+ */
+typedef struct {
+    Token brace;       ///< The '{' token (for error reporting)
+    Token* names;      ///< Field names, in order
+    Expr** values;     ///< Value expression per field
+    int count;         ///< Number of fields
+} RecordExpr;
+
+/**
+ * @brief Represents a field access in the AST
+ * 
+ * Reads a record field, or names the field to store into when it is
+ * the target of an assignment.
+ * Examples: p.x, p.x = 0
+ */
+typedef struct {
+    Expr* object;      ///< The record being accessed
+    Token name;        ///< The field name
+} FieldExpr;
+
+typedef struct FnStmt FnStmt;
+
+/**
+ * @brief Represents a function body substituted at a call site
+ * 
+ * Produced by the inliner (never by the parser). The arguments are
+ * evaluated in order into fresh frame slots named after the callee's
+ * parameters, then the body runs with only those slots visible, and a
+ * return leaves its value as the value of the whole expression.
+ * Arguments that were constants are substituted into the body instead,
+ * in which case their entry in args is NULL.
+ */
+typedef struct {
+    FnStmt* callee;    ///< The inlined function (not owned)
+    Expr** args;       ///< Argument per parameter, NULL if substituted
+    int arg_count;     ///< Number of entries in args (the callee's arity)
+    Stmt* body;        ///< Private copy of the callee's body
+} InlineExpr;
+
 /**
  * @brief Union of all possible expression types
  * 
@@ -94,15 +186,27 @@ typedef struct Expr {
     enum {
         EXPR_LITERAL,  ///< Constant value (number)
         EXPR_VARIABLE, ///< Variable reference
-        EXPR_BINARY,   ///< Binary operation
-        EXPR_CALL      ///< Function call
+        EXPR_BINARY,   ///< Binary operation (&& and || short-circuit)
+        EXPR_UNARY,    ///< Prefix operation
+        EXPR_CALL,     ///< Function call
+        EXPR_INLINE,   ///< Inlined function body (optimizer only)
+        EXPR_ARRAY,    ///< Array literal
+        EXPR_INDEX,    ///< Array element access
+        EXPR_RECORD,   ///< Record literal
+        EXPR_FIELD     ///< Record field access
     } type;            ///< Tag indicating the expression type
     
     union {
         LiteralExpr literal;   ///< Literal expression data
         VariableExpr variable; ///< Variable expression data
         BinaryExpr binary;     ///< Binary expression data
+        UnaryExpr unary;       ///< Prefix expression data
         CallExpr call;         ///< Function call data
+        InlineExpr inlined;    ///< Inlined call data
+        ArrayExpr array;       ///< Array literal data
+        IndexExpr index;       ///< Indexing data
+        RecordExpr record;     ///< Record literal data
+        FieldExpr field;       ///< Field access data
     };
 } Expr;
 
@@ -110,7 +214,7 @@ typedef struct Expr {
  * @brief Represents an expression statement in the AST
  * 
  * Expression statements evaluate an expression for its side effects.
- * Examples: x = 5; (assignment), yap(x); (function call)
+ * Examples: x = 5; (assignment), a[0] = 5; (element assignment), f(x); (call)
  */
 typedef struct {
     Expr* expression; ///< The expression to evaluate
@@ -172,6 +276,37 @@ typedef struct {
     int count;         ///< Number of statements
 } BlockStmt;
 
+/**
+ * @brief Represents a function declaration in the AST
+ * 
+ * Function declarations bind a name to a parameter list and a body.
+ * Example: fn add(a, b) { return a + b; }
+ * 
+ * Bodies are parsed lazily: the parser only matches braces to find the
+ * end of the body and records its token range. parse_function_body()
+ * builds the body on first use, so the token array must outlive the AST.
+ */
+typedef struct FnStmt {
+    Token name;       ///< Function name token
+    Token* params;    ///< Array of parameter name tokens
+    int param_count;  ///< Number of parameters
+    Stmt* body;       ///< Function body (always a block), NULL until parsed
+    Token* tokens;    ///< Token array containing the body (not owned)
+    int body_start;   ///< Index of the first token after '{'
+    int body_end;     ///< Index of the closing '}'
+} FnStmt;
+
+/**
+ * @brief Represents a return statement in the AST
+ * 
+ * Return statements leave the current function with a value.
+ * Example: return n * 2;
+ */
+typedef struct {
+    Token keyword; ///< The 'return' token (for error reporting)
+    Expr* value;   ///< Returned expression (NULL returns 0)
+} ReturnStmt;
+
 /**
  * @brief Union of all possible statement types
  * 
@@ -185,7 +320,9 @@ typedef struct Stmt {
         STMT_YAP,    ///< Print statement
         STMT_IF,     ///< Conditional statement
         STMT_WHILE,  ///< Loop statement
-        STMT_BLOCK   ///< Block of statements
+        STMT_BLOCK,  ///< Block of statements
+        STMT_FN,     ///< Function declaration
+        STMT_RETURN  ///< Return statement
     } type;          ///< Tag indicating the statement type
     
     union {
@@ -195,6 +332,8 @@ typedef struct Stmt {
         IfStmt if_stmt;   ///< If statement data
         WhileStmt while_stmt; ///< While statement data
         BlockStmt block;  ///< Block statement data
+        FnStmt fn;        ///< Function declaration data
+        ReturnStmt return_stmt; ///< Return statement data
     };
 } Stmt;
 
@@ -229,6 +368,17 @@ typedef struct Stmt {
  */
 Stmt** parse(Token* token_array, int token_count, int* stmt_count);
 
+/**
+ * @brief Parses the body of a function declaration on first use
+ * @param fn Function declaration whose body was pre-scanned by parse()
+ * @return The parsed body block, or NULL on a syntax error
+ * 
+ * The body is cached in fn->body, so later calls return it directly.
+ * Syntax errors inside a body are therefore only reported once the
+ * function is first compiled or inlined.
+ */
+Stmt* parse_function_body(FnStmt* fn);
+
 /**
  * @brief Frees all memory allocated for the AST
  * @param stmts Array of statement nodes to free
@@ -245,6 +395,42 @@ Stmt** parse(Token* token_array, int token_count, int* stmt_count);
  */
 void free_ast(Stmt** stmts, int stmt_count);
 
+/**
+ * @brief Allocates zero-initialized memory for AST nodes
+ * @param size Number of bytes to allocate
+ * @return Pointer to the zeroed memory (exits on allocation failure)
+ */
+void* allocate(size_t size);
+
+/**
+ * @brief Frees a single expression node and everything it owns
+ * @param expr Expression to free (NULL is ignored)
+ */
+void free_expr(Expr* expr);
+
+/**
+ * @brief Frees a single statement node and everything it owns
+ * @param stmt Statement to free (NULL is ignored)
+ */
+void free_stmt(Stmt* stmt);
+
+/**
+ * @brief Deep-copies an expression tree
+ * @param expr Expression to copy (NULL yields NULL)
+ * @return New expression tree (free with free_expr())
+ * 
+ * Tokens are copied by value, so lexemes are shared with the original
+ * unless the literal owns its lexeme, in which case it is duplicated.
+ */
+Expr* clone_expr(Expr* expr);
+
+/**
+ * @brief Deep-copies a statement tree
+ * @param stmt Statement to copy (NULL yields NULL)
+ * @return New statement tree (free with free_stmt())
+ */
+Stmt* clone_stmt(Stmt* stmt);
+
 /**
  * @brief Prints a human-readable representation of the AST
  * @param stmt The statement node to print
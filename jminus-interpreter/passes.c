@@ -0,0 +1,1134 @@
+/**
+ * @file passes.c
+ * @brief Optimization passes over the SSA IR
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * See passes.h for what each pass does and the order they run in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "passes.h"
+#include "builtins.h"
+#include "allocator.h"
+
+// ----------------------------
+// Loops
+// ----------------------------
+
+typedef struct {
+    int header;
+    int preheader;    // -1 if the header has no single outside predecessor
+    char* blocks;     // Per block: nonzero if in the loop (owned)
+} Loop;
+
+static int in_loop(Loop* loop, int block) {
+    return block >= 0 && loop->blocks[block];
+}
+
+/*
+ * Finds the natural loops, innermost first: a loop's header comes later
+ * in reverse postorder than the headers of the loops around it.
+ */
+static Loop* find_loops(IrFunction* fn, int* count) {
+    int n = fn->block_count;
+    Loop* loops = NULL;
+    *count = 0;
+    int* work = jm_alloc(sizeof(int) * (n > 0 ? n : 1));
+    for (int i = fn->rpo_count - 1; i >= 0; i--) {
+        int header = fn->rpo[i];
+        IrBlock* block = &fn->blocks[header];
+        char* body = NULL;
+        int top = 0;
+        for (int j = 0; j < block->pred_count; j++) {
+            int latch = block->preds[j];
+            if (!ir_dominates(fn, header, latch)) continue;
+            if (!body) {
+                body = jm_calloc(n, 1);
+                body[header] = 1;
+            }
+            if (!body[latch]) {
+                body[latch] = 1;
+                work[top++] = latch;
+            }
+        }
+        if (!body) continue;
+        // Everything that reaches a back edge without passing the header
+        while (top > 0) {
+            IrBlock* member = &fn->blocks[work[--top]];
+            for (int j = 0; j < member->pred_count; j++) {
+                int pred = member->preds[j];
+                if (body[pred]) continue;
+                body[pred] = 1;
+                work[top++] = pred;
+            }
+        }
+
+        int preheader = -1;
+        int outside = 0;
+        for (int j = 0; j < block->pred_count; j++) {
+            if (body[block->preds[j]]) continue;
+            outside++;
+            preheader = block->preds[j];
+        }
+        if (outside != 1 || fn->blocks[preheader].succ_count != 1) preheader = -1;
+
+        loops = jm_realloc(loops, sizeof(Loop) * (*count + 1));
+        loops[*count] = (Loop){ header, preheader, body };
+        (*count)++;
+    }
+    jm_free(work);
+    return loops;
+}
+
+static void free_loops(Loop* loops, int count) {
+    for (int i = 0; i < count; i++) jm_free(loops[i].blocks);
+    jm_free(loops);
+}
+
+// ----------------------------
+// Types
+// ----------------------------
+
+/*
+ * Marks the values that are always numbers: constants, comparisons, and
+ * results of operations that fail on anything else. Every value starts out
+ * as a number and only ever loses that, once an input is not, so the loop
+ * settles on the largest consistent marking.
+ */
+static char* number_values(IrFunction* fn) {
+    int count = fn->instr_count > 0 ? fn->instr_count : 1;
+    char* number = jm_alloc(count);
+    memset(number, 1, count);
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < fn->instr_count; i++) {
+            IrInstr* in = &fn->instrs[i];
+            if (in->block < 0) continue;
+            int result = 0;
+            switch (in->kind) {
+                case IR_CONST:
+                    result = is_number(in->value);
+                    break;
+                case IR_UNDEF:
+                    result = 1;  // Lowered as 0
+                    break;
+                case IR_PHI:
+                    result = 1;
+                    for (int k = 0; k < in->arg_count; k++) result &= in->args[k] >= 0 && number[in->args[k]];
+                    break;
+                case IR_OP:
+                    switch (in->opcode) {
+                        case BC_ADD:
+                            // Strings concatenate
+                            result = number[in->args[0]] && number[in->args[1]];
+                            break;
+                        case BC_SUB: case BC_MUL: case BC_DIV: case BC_MOD:
+                        case BC_BIT_AND: case BC_BIT_OR: case BC_BIT_XOR:
+                        case BC_SHIFT_LEFT: case BC_SHIFT_RIGHT:
+                        case BC_MIN: case BC_MAX: case BC_ABS:
+                        case BC_EQUAL: case BC_NOT_EQUAL: case BC_LESS: case BC_LESS_EQUAL:
+                        case BC_GREATER: case BC_GREATER_EQUAL: case BC_NOT: case BC_MAP_HAS:
+                        case BC_IS_INTEGER:
+                            result = 1;
+                            break;
+                        case BC_CALL_BUILTIN:
+                            result = strcmp(builtins[in->operand].name, "len") == 0;
+                            break;
+                        default:
+                            break;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            if (number[i] && !result) {
+                number[i] = 0;
+                changed = 1;
+            }
+        }
+    }
+    return number;
+}
+
+// Nonzero if the operation cannot stop the program, given what its inputs are
+static int cannot_fail(IrFunction* fn, const char* number, int instr) {
+    IrInstr* in = &fn->instrs[instr];
+    if (!(ir_effects(fn, instr) & IR_TRAPS)) return 1;
+    if (in->kind != IR_OP) return 0;
+    switch (in->opcode) {
+        case BC_ADD: case BC_SUB: case BC_MUL:
+        case BC_LESS: case BC_LESS_EQUAL: case BC_GREATER: case BC_GREATER_EQUAL:
+        case BC_MIN: case BC_MAX:
+            return number[in->args[0]] && number[in->args[1]];
+        case BC_ABS:
+            return number[in->args[0]];
+        case BC_DIV:
+        case BC_MOD: {
+            IrInstr* divisor = &fn->instrs[in->args[1]];
+            return number[in->args[0]] && divisor->kind == IR_CONST && is_number(divisor->value) &&
+                   !values_equal(divisor->value, INT_VAL(0));
+        }
+        default:
+            return 0;
+    }
+}
+
+// ----------------------------
+// Sparse conditional constant propagation
+// ----------------------------
+
+enum { UNKNOWN, KNOWN, VARYING };
+
+typedef struct {
+    IrFunction* fn;
+    char* state;      // Per instruction: UNKNOWN, KNOWN or VARYING
+    Value* value;     // Per instruction: the constant, if KNOWN
+    char* reached;    // Per block: some executable edge leads here
+    char* taken;      // Per block and successor: the edge is executable
+    int* users;       // Per instruction, from first_user: instructions using it
+    int* first_user;
+    int* branches;    // Per instruction, from first_branch: blocks branching on it
+    int* first_branch;
+    int* instr_work;
+    char* instr_queued;
+    int instr_count;
+    int* block_work;
+    int block_count;
+} Propagation;
+
+/*
+ * Evaluates an operation on constants the way the VM would. Fails (0)
+ * where the VM would stop with an error, and for results that are not
+ * ints, which would need a heap object kept alive until the constants
+ * table holds it.
+ */
+static int evaluate(IrInstr* in, const Value* args, Value* result) {
+    Value a = args[0];
+    Value b = in->arg_count > 1 ? args[1] : a;
+    int numbers = is_number(a) && is_number(b);
+    int ints = IS_INT(a) && IS_INT(b);
+    switch (in->opcode) {
+        case BC_EQUAL: *result = INT_VAL(values_equal(a, b)); break;
+        case BC_NOT_EQUAL: *result = INT_VAL(!values_equal(a, b)); break;
+        case BC_NOT: *result = INT_VAL(!is_truthy(a)); break;
+        case BC_IS_INTEGER: *result = INT_VAL(is_integer(a)); break;
+        case BC_LESS: if (!numbers) return 0; *result = INT_VAL(compare_values(a, b) == -1); break;
+        case BC_LESS_EQUAL: if (!numbers) return 0; *result = INT_VAL(compare_values(a, b) <= 0); break;
+        case BC_GREATER: if (!numbers) return 0; *result = INT_VAL(compare_values(a, b) == 1); break;
+        case BC_GREATER_EQUAL: {
+            if (!numbers) return 0;
+            int order = compare_values(a, b);
+            *result = INT_VAL(order == 0 || order == 1);
+            break;
+        }
+        case BC_ADD: if (!numbers) return 0; *result = add_values(a, b); break;
+        case BC_SUB: if (!numbers) return 0; *result = subtract_values(a, b); break;
+        case BC_MUL: if (!numbers) return 0; *result = multiply_values(a, b); break;
+        case BC_DIV:
+        case BC_MOD:
+            if (!numbers || values_equal(b, INT_VAL(0))) return 0;
+            *result = in->opcode == BC_DIV ? divide_values(a, b) : modulo_values(a, b);
+            break;
+        case BC_BIT_AND: if (!ints) return 0; *result = and_values(a, b); break;
+        case BC_BIT_OR: if (!ints) return 0; *result = or_values(a, b); break;
+        case BC_BIT_XOR: if (!ints) return 0; *result = xor_values(a, b); break;
+        case BC_SHIFT_LEFT:
+        case BC_SHIFT_RIGHT:
+            if (!ints || AS_INT(b) < 0 || AS_INT(b) > 63) return 0;
+            *result = in->opcode == BC_SHIFT_LEFT ? shift_left_values(a, b) : shift_right_values(a, b);
+            break;
+        case BC_MIN: if (!numbers) return 0; *result = min_values(a, b); break;
+        case BC_MAX: if (!numbers) return 0; *result = max_values(a, b); break;
+        case BC_ABS: if (!is_number(a)) return 0; *result = abs_value(a); break;
+        default:
+            return 0;
+    }
+    return IS_INT(*result);
+}
+
+static void push_instr(Propagation* p, int instr) {
+    if (p->instr_queued[instr]) return;
+    p->instr_queued[instr] = 1;
+    p->instr_work[p->instr_count++] = instr;
+}
+
+static void set_state(Propagation* p, int instr, int state, Value value) {
+    if (p->state[instr] == state && (state != KNOWN || p->value[instr] == value)) return;
+    p->state[instr] = (char)state;
+    p->value[instr] = value;
+    for (int i = p->first_user[instr]; i < p->first_user[instr + 1]; i++) push_instr(p, p->users[i]);
+    for (int i = p->first_branch[instr]; i < p->first_branch[instr + 1]; i++) {
+        // A negative entry revisits just the block's branch
+        p->block_work[p->block_count++] = -1 - p->branches[i];
+    }
+}
+
+static int edge_taken(Propagation* p, int from, int to) {
+    IrBlock* block = &p->fn->blocks[from];
+    for (int k = 0; k < block->succ_count; k++) {
+        if (block->succ[k] == to && p->taken[from * 2 + k]) return 1;
+    }
+    return 0;
+}
+
+static void take_edge(Propagation* p, int from, int k) {
+    if (p->taken[from * 2 + k]) return;
+    p->taken[from * 2 + k] = 1;
+    int to = p->fn->blocks[from].succ[k];
+    if (!p->reached[to]) {
+        p->reached[to] = 1;
+        p->block_work[p->block_count++] = to;
+        return;
+    }
+    // Only the phis see the new edge
+    IrBlock* block = &p->fn->blocks[to];
+    for (int i = 0; i < block->count && p->fn->instrs[block->instrs[i]].kind == IR_PHI; i++) {
+        push_instr(p, block->instrs[i]);
+    }
+}
+
+static void visit_instr(Propagation* p, int id) {
+    IrFunction* fn = p->fn;
+    IrInstr* in = &fn->instrs[id];
+    switch (in->kind) {
+        case IR_CONST:
+            set_state(p, id, KNOWN, in->value);
+            return;
+        case IR_UNDEF:
+            // No path reads it
+            return;
+        case IR_PHI: {
+            IrBlock* block = &fn->blocks[in->block];
+            int state = UNKNOWN;
+            Value value = 0;
+            for (int j = 0; j < in->arg_count && state != VARYING; j++) {
+                if (!edge_taken(p, block->preds[j], in->block)) continue;
+                int arg = in->args[j];
+                if (arg < 0 || p->state[arg] == VARYING) state = VARYING;
+                else if (p->state[arg] == UNKNOWN) continue;
+                else if (state == UNKNOWN) {
+                    state = KNOWN;
+                    value = p->value[arg];
+                } else if (p->value[arg] != value) {
+                    state = VARYING;
+                }
+            }
+            set_state(p, id, state, value);
+            return;
+        }
+        case IR_OP: {
+            if (!ir_has_value(fn, id)) return;
+            Value args[2];
+            int state = in->arg_count >= 1 && in->arg_count <= 2 ? KNOWN : VARYING;
+            for (int k = 0; k < in->arg_count && state != VARYING; k++) {
+                if (p->state[in->args[k]] == VARYING) state = VARYING;
+                else if (p->state[in->args[k]] == UNKNOWN) state = UNKNOWN;
+                else if (k < 2) args[k] = p->value[in->args[k]];
+            }
+            Value value = 0;
+            if (state == KNOWN && !evaluate(in, args, &value)) state = VARYING;
+            if (state != UNKNOWN) set_state(p, id, state, value);
+            return;
+        }
+        default:
+            // IR_ENTRY: whatever the home held
+            set_state(p, id, VARYING, 0);
+            return;
+    }
+}
+
+static void visit_terminator(Propagation* p, int b) {
+    IrBlock* block = &p->fn->blocks[b];
+    if (block->term == IR_JUMP) {
+        take_edge(p, b, 0);
+    } else if (block->term == IR_BRANCH) {
+        int state = p->state[block->cond];
+        if (state == VARYING) {
+            take_edge(p, b, 0);
+            take_edge(p, b, 1);
+        } else if (state == KNOWN) {
+            take_edge(p, b, is_truthy(p->value[block->cond]) ? 0 : 1);
+        }
+    }
+}
+
+// Use lists as one array per kind, sliced per instruction (counting sort)
+static void index_uses(Propagation* p) {
+    IrFunction* fn = p->fn;
+    int count = fn->instr_count;
+    p->first_user = jm_calloc(count + 1, sizeof(int));
+    p->first_branch = jm_calloc(count + 1, sizeof(int));
+    for (int i = 0; i < count; i++) {
+        if (fn->instrs[i].block < 0) continue;
+        for (int k = 0; k < fn->instrs[i].arg_count; k++) {
+            if (fn->instrs[i].args[k] >= 0) p->first_user[fn->instrs[i].args[k] + 1]++;
+        }
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].rpo >= 0 && fn->blocks[b].term == IR_BRANCH) p->first_branch[fn->blocks[b].cond + 1]++;
+    }
+    for (int i = 0; i < count; i++) {
+        p->first_user[i + 1] += p->first_user[i];
+        p->first_branch[i + 1] += p->first_branch[i];
+    }
+    p->users = jm_alloc(sizeof(int) * (p->first_user[count] > 0 ? p->first_user[count] : 1));
+    p->branches = jm_alloc(sizeof(int) * (p->first_branch[count] > 0 ? p->first_branch[count] : 1));
+    int* next = jm_alloc(sizeof(int) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) next[i] = p->first_user[i];
+    for (int i = 0; i < count; i++) {
+        if (fn->instrs[i].block < 0) continue;
+        for (int k = 0; k < fn->instrs[i].arg_count; k++) {
+            if (fn->instrs[i].args[k] >= 0) p->users[next[fn->instrs[i].args[k]]++] = i;
+        }
+    }
+    for (int i = 0; i < count; i++) next[i] = p->first_branch[i];
+    for (int b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].rpo >= 0 && fn->blocks[b].term == IR_BRANCH) p->branches[next[fn->blocks[b].cond]++] = b;
+    }
+    jm_free(next);
+}
+
+void ir_propagate_constants(IrFunction* fn) {
+    int count = fn->instr_count > 0 ? fn->instr_count : 1;
+    int n = fn->block_count;
+    Propagation p;
+    p.fn = fn;
+    p.state = jm_calloc(count, 1);
+    p.value = jm_calloc(count, sizeof(Value));
+    p.reached = jm_calloc(n, 1);
+    p.taken = jm_calloc(n * 2, 1);
+    p.instr_work = jm_alloc(sizeof(int) * count);
+    p.instr_queued = jm_calloc(count, 1);
+    p.instr_count = 0;
+    index_uses(&p);
+    // A block is queued once when reached, and once per change of its condition
+    p.block_work = jm_alloc(sizeof(int) * (n + p.first_branch[fn->instr_count] * 3 + 1));
+    p.block_count = 0;
+
+    p.reached[0] = 1;
+    p.block_work[p.block_count++] = 0;
+    while (p.block_count > 0 || p.instr_count > 0) {
+        if (p.block_count > 0) {
+            int b = p.block_work[--p.block_count];
+            if (b < 0) {
+                if (p.reached[-1 - b]) visit_terminator(&p, -1 - b);
+                continue;
+            }
+            IrBlock* block = &fn->blocks[b];
+            for (int i = 0; i < block->count; i++) visit_instr(&p, block->instrs[i]);
+            visit_terminator(&p, b);
+            continue;
+        }
+        int id = p.instr_work[--p.instr_count];
+        p.instr_queued[id] = 0;
+        if (fn->instrs[id].block >= 0 && p.reached[fn->instrs[id].block]) visit_instr(&p, id);
+    }
+
+    // Decided branches become jumps, before new constants outgrow the lattice
+    for (int b = 0; b < n; b++) {
+        IrBlock* block = &fn->blocks[b];
+        if (!p.reached[b] || block->term != IR_BRANCH || p.state[block->cond] != KNOWN) continue;
+        ir_jump(fn, b, block->succ[is_truthy(p.value[block->cond]) ? 0 : 1]);
+        block->cond = -1;
+        ir_stats.branches++;
+    }
+
+    // Constants replace what was found constant
+    int analyzed = fn->instr_count;
+    for (int i = 0; i < analyzed; i++) {
+        IrInstr* in = &fn->instrs[i];
+        if (in->block < 0 || !p.reached[in->block] || p.state[i] != KNOWN) continue;
+        if (in->kind == IR_OP) {
+            jm_free(in->args);
+            in->args = NULL;
+            in->arg_count = 0;
+            in->kind = IR_CONST;
+            in->value = p.value[i];
+            ir_stats.constants++;
+        } else if (in->kind == IR_PHI) {
+            // Phis stay together at the top of their block; the entry dominates every use
+            ir_replace_uses(fn, i, ir_const(fn, 0, p.value[i]));
+            ir_remove(fn, i);
+            ir_stats.constants++;
+        }
+    }
+    ir_analyze(fn);
+    ir_remove_dead(fn);
+
+    jm_free(p.state);
+    jm_free(p.value);
+    jm_free(p.reached);
+    jm_free(p.taken);
+    jm_free(p.users);
+    jm_free(p.first_user);
+    jm_free(p.branches);
+    jm_free(p.first_branch);
+    jm_free(p.instr_work);
+    jm_free(p.instr_queued);
+    jm_free(p.block_work);
+}
+
+// ----------------------------
+// Global value numbering
+// ----------------------------
+
+typedef struct {
+    IrFunction* fn;
+    int* leader;      // Per instruction: the earlier one with its value, or itself
+    int* head;        // Hash bucket: last instruction entered, or -1
+    int* next;        // Per instruction: the one entered before it in its bucket
+    int mask;         // Buckets - 1 (a power of two)
+} Numbering;
+
+// What stands for an input: constants by their value, the rest by their leader
+static int number_of(Numbering* v, int arg) {
+    return arg < 0 ? -1 : v->leader[arg];
+}
+
+// Operands the VM may take in either order with the same result
+static int commutes(IrInstr* in) {
+    if (in->kind != IR_OP || in->arg_count != 2) return 0;
+    switch (in->opcode) {
+        case BC_EQUAL: case BC_NOT_EQUAL: case BC_MUL:
+        case BC_BIT_AND: case BC_BIT_OR: case BC_BIT_XOR:
+            return 1;
+        default:
+            // Strings concatenate in order; min and max of equal numbers keep the first
+            return 0;
+    }
+}
+
+static int input_number(Numbering* v, IrInstr* in, int k) {
+    if (commutes(in)) {
+        int a = number_of(v, in->args[0]), b = number_of(v, in->args[1]);
+        return (k == 0) == (a < b) ? a : b;
+    }
+    return number_of(v, in->args[k]);
+}
+
+static unsigned hash_instr(Numbering* v, int id) {
+    IrInstr* in = &v->fn->instrs[id];
+    unsigned hash;
+    if (in->kind == IR_CONST) {
+        hash = (unsigned)(in->value ^ (in->value >> 32));
+    } else {
+        hash = (unsigned)in->kind * 31u + (unsigned)in->opcode * 131u + (unsigned)in->operand;
+        if (in->kind == IR_PHI) hash = hash * 31u + (unsigned)in->block;
+        for (int k = 0; k < in->arg_count; k++) hash = hash * 31u + (unsigned)input_number(v, in, k);
+    }
+    return (hash ^ (hash >> 16)) & (unsigned)v->mask;
+}
+
+static int same_value(Numbering* v, int a, int b) {
+    IrInstr* x = &v->fn->instrs[a];
+    IrInstr* y = &v->fn->instrs[b];
+    if (x->kind != y->kind) return 0;
+    if (x->kind == IR_CONST) return x->value == y->value;
+    if (x->opcode != y->opcode || x->operand != y->operand || x->arg_count != y->arg_count) return 0;
+    // Phis are the same value only in the same block
+    if (x->kind == IR_PHI && x->block != y->block) return 0;
+    for (int k = 0; k < x->arg_count; k++) {
+        if (input_number(v, x, k) != input_number(v, y, k)) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Nonzero if the instruction's value depends on its inputs alone.
+ * Reads count only where nothing writes, and a dominating twin that
+ * could fail has failed already.
+ */
+static int numberable(IrFunction* fn, int id, int writes) {
+    IrInstr* in = &fn->instrs[id];
+    if (in->kind == IR_CONST) return 1;
+    if (in->kind == IR_PHI) {
+        for (int k = 0; k < in->arg_count; k++) {
+            if (in->args[k] < 0) return 0;
+        }
+        return 1;
+    }
+    if (in->kind != IR_OP || !ir_has_value(fn, id)) return 0;
+    int effects = ir_effects(fn, id);
+    if (effects & (IR_WRITES | IR_OUTPUT | IR_ALLOCS)) return 0;
+    return !(effects & IR_READS) || !writes;
+}
+
+void ir_number_values(IrFunction* fn) {
+    int count = fn->instr_count > 0 ? fn->instr_count : 1;
+    int buckets = 16;
+    while (buckets < count * 2) buckets *= 2;
+    Numbering v;
+    v.fn = fn;
+    v.leader = jm_alloc(sizeof(int) * count);
+    v.next = jm_alloc(sizeof(int) * count);
+    v.head = jm_alloc(sizeof(int) * buckets);
+    v.mask = buckets - 1;
+    for (int i = 0; i < fn->instr_count; i++) v.leader[i] = i;
+    for (int i = 0; i < buckets; i++) v.head[i] = -1;
+
+    int writes = 0;
+    for (int i = 0; i < fn->instr_count; i++) {
+        if (fn->instrs[i].block >= 0 && fn->instrs[i].kind != IR_STORE) writes |= ir_effects(fn, i) & IR_WRITES;
+    }
+
+    // A block's dominators come before it in reverse postorder
+    for (int r = 0; r < fn->rpo_count; r++) {
+        int b = fn->rpo[r];
+        int i = 0;
+        while (i < fn->blocks[b].count) {
+            int id = fn->blocks[b].instrs[i];
+            if (!numberable(fn, id, writes)) {
+                i++;
+                continue;
+            }
+            unsigned bucket = hash_instr(&v, id);
+            int twin = v.head[bucket];
+            while (twin >= 0 && !(same_value(&v, twin, id) && ir_dominates(fn, fn->instrs[twin].block, b))) {
+                twin = v.next[twin];
+            }
+            if (twin < 0) {
+                v.next[id] = v.head[bucket];
+                v.head[bucket] = id;
+                i++;
+                continue;
+            }
+            v.leader[id] = twin;
+            // Constants are pushed where they are used, so they stay
+            if (fn->instrs[id].kind == IR_CONST) {
+                i++;
+                continue;
+            }
+            ir_replace_uses(fn, id, twin);
+            ir_remove(fn, id);
+            ir_stats.redundant++;
+        }
+    }
+    ir_remove_dead(fn);
+
+    jm_free(v.leader);
+    jm_free(v.next);
+    jm_free(v.head);
+}
+
+// ----------------------------
+// Loop-invariant code motion
+// ----------------------------
+
+static int is_invariant(IrFunction* fn, Loop* loop, int instr) {
+    IrInstr* in = &fn->instrs[instr];
+    for (int k = 0; k < in->arg_count; k++) {
+        IrInstr* arg = &fn->instrs[in->args[k]];
+        if (arg->kind != IR_CONST && in_loop(loop, arg->block)) return 0;
+    }
+    return 1;
+}
+
+static void hoist(IrFunction* fn, Loop* loop, int instr) {
+    // Constants go along, so definitions still dominate their uses
+    IrInstr* in = &fn->instrs[instr];
+    for (int k = 0; k < in->arg_count; k++) {
+        int arg = in->args[k];
+        if (fn->instrs[arg].kind != IR_CONST || !in_loop(loop, fn->instrs[arg].block)) continue;
+        ir_remove(fn, arg);
+        ir_append(fn, loop->preheader, arg);
+    }
+    ir_remove(fn, instr);
+    ir_append(fn, loop->preheader, instr);
+    ir_stats.hoisted++;
+}
+
+static void hoist_loop(IrFunction* fn, Loop* loop, const char* number) {
+    int writes = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        if (!in_loop(loop, b)) continue;
+        for (int i = 0; i < fn->blocks[b].count; i++) writes |= ir_effects(fn, fn->blocks[b].instrs[i]) & IR_WRITES;
+    }
+
+    // Definitions before uses: blocks in reverse postorder
+    for (int r = 0; r < fn->rpo_count; r++) {
+        int b = fn->rpo[r];
+        if (!in_loop(loop, b)) continue;
+        // In the header, until something could fail or write first
+        int first = b == loop->header;
+        int i = 0;
+        while (i < fn->blocks[b].count) {
+            int id = fn->blocks[b].instrs[i];
+            IrInstr* in = &fn->instrs[id];
+            int effects = ir_effects(fn, id);
+            int safe = cannot_fail(fn, number, id);
+            int movable = in->kind == IR_OP && ir_has_value(fn, id) && is_invariant(fn, loop, id) &&
+                          !(effects & (IR_WRITES | IR_OUTPUT | IR_ALLOCS)) &&
+                          (!(effects & IR_READS) || (first && !writes)) && (safe || first);
+            if (movable) {
+                // Its constants may have left from before it: rescan
+                hoist(fn, loop, id);
+                first = b == loop->header;
+                i = 0;
+                continue;
+            }
+            if ((effects & (IR_WRITES | IR_OUTPUT)) || !safe) first = 0;
+            i++;
+        }
+    }
+}
+
+void ir_hoist_invariants(IrFunction* fn) {
+    int count;
+    Loop* loops = find_loops(fn, &count);
+    char* number = number_values(fn);
+    for (int i = 0; i < count; i++) {
+        if (loops[i].preheader >= 0) hoist_loop(fn, &loops[i], number);
+    }
+    jm_free(number);
+    free_loops(loops, count);
+}
+
+// ----------------------------
+// Closed forms
+// ----------------------------
+
+#define MAX_TERMS 4   // Evolutions up to cubic in the iteration count
+#define SCEV_BUDGET 1000
+
+/*
+ * How a value evolves over a loop: in iteration k it is the sum of
+ * terms[j] * C(k, j), a chain of recurrences in the binomial basis (so the
+ * coefficients of integer recurrences stay integers), plus self times the
+ * phi being solved.
+ */
+typedef struct {
+    int terms[MAX_TERMS];  // Values computed outside the loop, -1 for 0
+    int count;             // Terms in use
+    int self;
+} Evolution;
+
+typedef struct {
+    IrFunction* fn;
+    int header;
+    int body;
+    int preheader;
+    int block;           // Where the closed forms are computed
+    Evolution* solved;   // Per instruction: a header phi's evolution
+    char* state;         // Per instruction: 1 while solving its phi, 2 once solved
+    int* leaves;         // Values from before the loop the evolutions use
+    int leaf_count;
+    int budget;          // Instructions left to visit
+} Scev;
+
+static int scev_int(Scev* s, int64_t value) {
+    return ir_const(s->fn, s->block, INT_VAL(value));
+}
+
+static int scev_op(Scev* s, OpCode opcode, int a, int b) {
+    // Constants fold, so a step like i - 1 is still a constant
+    IrInstr* x = &s->fn->instrs[a];
+    IrInstr* y = &s->fn->instrs[b];
+    if (x->kind == IR_CONST && y->kind == IR_CONST) {
+        IrInstr op = { .kind = IR_OP, .opcode = opcode, .arg_count = 2 };
+        Value values[2] = { x->value, y->value };
+        Value result;
+        if (evaluate(&op, values, &result)) return ir_const(s->fn, s->block, result);
+    }
+    int args[2] = { a, b };
+    return ir_op(s->fn, s->block, opcode, 0, args, 2);
+}
+
+// Sums and products of terms, where -1 is 0
+// Terms of -1 are 0, and a constant 0 becomes one, so zeros drop out of sums and products
+static int term(Scev* s, int t) {
+    if (t >= 0 && s->fn->instrs[t].kind == IR_CONST && s->fn->instrs[t].value == INT_VAL(0)) return -1;
+    return t;
+}
+
+static int term_add(Scev* s, int a, int b) {
+    a = term(s, a);
+    b = term(s, b);
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return scev_op(s, BC_ADD, a, b);
+}
+
+static int term_sub(Scev* s, int a, int b) {
+    a = term(s, a);
+    b = term(s, b);
+    if (b < 0) return a;
+    return scev_op(s, BC_SUB, a < 0 ? scev_int(s, 0) : a, b);
+}
+
+static int term_mul(Scev* s, int a, int b) {
+    a = term(s, a);
+    b = term(s, b);
+    if (a < 0 || b < 0) return -1;
+    if (s->fn->instrs[a].kind == IR_CONST && s->fn->instrs[a].value == INT_VAL(1)) return b;
+    if (s->fn->instrs[b].kind == IR_CONST && s->fn->instrs[b].value == INT_VAL(1)) return a;
+    return scev_op(s, BC_MUL, a, b);
+}
+
+static int in_scev_loop(Scev* s, int block) {
+    return block == s->header || block == s->body;
+}
+
+// Inputs from outside the loop are guarded to be integers; constants must be
+static int add_leaf(Scev* s, int value) {
+    IrInstr* in = &s->fn->instrs[value];
+    if (in->kind == IR_CONST) return is_integer(in->value);
+    for (int i = 0; i < s->leaf_count; i++) {
+        if (s->leaves[i] == value) return 1;
+    }
+    s->leaves[s->leaf_count++] = value;
+    return 1;
+}
+
+static void clear_evolution(Evolution* e) {
+    for (int j = 0; j < MAX_TERMS; j++) e->terms[j] = -1;
+    e->count = 0;
+    e->self = 0;
+}
+
+// C(k, a) * C(k, b) is the sum over j of (a + b - j)! / (j! (a - j)! (b - j)!) * C(k, a + b - j)
+static int multiply(Scev* s, Evolution* x, Evolution* y, Evolution* out) {
+    static const int64_t factorial[] = { 1, 1, 2, 6, 24, 120, 720 };
+    if (x->count == 0 || y->count == 0) return 1;
+    if (x->count + y->count - 1 > MAX_TERMS) return 0;
+    out->count = x->count + y->count - 1;
+    for (int a = 0; a < x->count; a++) {
+        for (int b = 0; b < y->count; b++) {
+            int product = term_mul(s, x->terms[a], y->terms[b]);
+            if (product < 0) continue;
+            for (int j = 0; j <= a && j <= b; j++) {
+                int64_t factor = factorial[a + b - j] / (factorial[j] * factorial[a - j] * factorial[b - j]);
+                int term = factor == 1 ? product : scev_op(s, BC_MUL, product, scev_int(s, factor));
+                out->terms[a + b - j] = term_add(s, out->terms[a + b - j], term);
+            }
+        }
+    }
+    return 1;
+}
+
+static int solve_phi(Scev* s, int phi);
+
+// Fails (0) for anything but sums and products of recurrences and invariants
+static int evolve(Scev* s, int value, int self, Evolution* out) {
+    IrFunction* fn = s->fn;
+    clear_evolution(out);
+    if (value < 0 || --s->budget < 0) return 0;
+    if (value == self) {
+        out->self = 1;
+        return 1;
+    }
+    IrInstr* in = &fn->instrs[value];
+    if (in->kind == IR_CONST || !in_scev_loop(s, in->block)) {
+        if (!add_leaf(s, value)) return 0;
+        // A constant of the loop is made again where the closed form is
+        out->terms[0] = in_scev_loop(s, in->block) ? ir_const(fn, s->block, in->value) : value;
+        out->count = 1;
+        return 1;
+    }
+    if (in->kind == IR_PHI) {
+        if (!solve_phi(s, value)) return 0;
+        *out = s->solved[value];
+        return 1;
+    }
+    if (in->kind != IR_OP || in->arg_count != 2) return 0;
+    OpCode opcode = in->opcode;
+    int left = in->args[0], right = in->args[1];
+    Evolution a, b;
+    if (!evolve(s, left, self, &a) || !evolve(s, right, self, &b)) return 0;
+    switch (opcode) {
+        case BC_ADD:
+        case BC_SUB:
+            out->count = a.count > b.count ? a.count : b.count;
+            for (int j = 0; j < out->count; j++) {
+                out->terms[j] = opcode == BC_ADD ? term_add(s, a.terms[j], b.terms[j]) : term_sub(s, a.terms[j], b.terms[j]);
+            }
+            out->self = opcode == BC_ADD ? a.self + b.self : a.self - b.self;
+            return 1;
+        case BC_MUL:
+            // A phi times something is not a sum any more
+            return !a.self && !b.self && multiply(s, &a, &b, out);
+        default:
+            return 0;
+    }
+}
+
+// A header phi starts at its input from the preheader and adds a step each iteration
+static int solve_phi(Scev* s, int phi) {
+    if (s->state[phi] == 2) return 1;
+    if (s->state[phi] == 1) return 0;  // Depends on itself through another phi
+    IrFunction* fn = s->fn;
+    if (fn->instrs[phi].block != s->header || fn->instrs[phi].arg_count != 2) return 0;
+    s->state[phi] = 1;
+    int outside = fn->blocks[s->header].preds[0] == s->preheader ? 0 : 1;
+    int start = fn->instrs[phi].args[outside];
+    int next = fn->instrs[phi].args[1 - outside];
+    Evolution first, step;
+    if (!evolve(s, start, -1, &first) || !evolve(s, next, phi, &step)) return 0;
+    if (step.self != 1 || step.count >= MAX_TERMS) return 0;
+    Evolution* out = &s->solved[phi];
+    clear_evolution(out);
+    out->terms[0] = first.terms[0];
+    for (int j = 0; j < step.count; j++) out->terms[j + 1] = step.terms[j];
+    out->count = step.count + 1;
+    s->state[phi] = 2;
+    return 1;
+}
+
+/*
+ * Iterations of a loop on counter i from start by step while i op limit
+ * holds, or -1 if the loop need not end: max(limit - start, 0), rounded
+ * up to a multiple of the step, over the step.
+ */
+static int trip_count(Scev* s, OpCode op, int start, int64_t step, int limit) {
+    int distance;
+    if (step > 0 && (op == BC_LESS || op == BC_LESS_EQUAL)) distance = term_sub(s, limit, start);
+    else if (step < 0 && (op == BC_GREATER || op == BC_GREATER_EQUAL)) distance = term_sub(s, start, limit);
+    else return -1;
+    if (op == BC_LESS_EQUAL || op == BC_GREATER_EQUAL) distance = term_add(s, distance, scev_int(s, 1));
+    if (distance < 0) return scev_int(s, 0);
+    int trips = scev_op(s, BC_MAX, distance, scev_int(s, 0));
+    int64_t stride = step > 0 ? step : -step;
+    if (stride > 1) trips = scev_op(s, BC_DIV, scev_op(s, BC_ADD, trips, scev_int(s, stride - 1)), scev_int(s, stride));
+    return trips;
+}
+
+static OpCode flipped(OpCode op) {
+    switch (op) {
+        case BC_LESS: return BC_GREATER;
+        case BC_LESS_EQUAL: return BC_GREATER_EQUAL;
+        case BC_GREATER: return BC_LESS;
+        case BC_GREATER_EQUAL: return BC_LESS_EQUAL;
+        default: return BC_HALT;
+    }
+}
+
+// Takes the closed form's instructions out of the function
+static void discard_block(IrFunction* fn, int block) {
+    IrBlock* b = &fn->blocks[block];
+    for (int i = 0; i < b->count; i++) fn->instrs[b->instrs[i]].block = -1;
+    b->count = 0;
+    // Loops found before map only the blocks there were; this one was the last made
+    if (block == fn->block_count - 1) {
+        jm_free(b->instrs);
+        jm_free(b->preds);
+        fn->block_count--;
+    }
+}
+
+static int has_uses(IrFunction* fn, int value) {
+    for (int i = 0; i < fn->instr_count; i++) {
+        IrInstr* in = &fn->instrs[i];
+        if (in->block < 0) continue;
+        for (int k = 0; k < in->arg_count; k++) {
+            if (in->args[k] == value) return 1;
+        }
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].rpo >= 0 && fn->blocks[b].term == IR_BRANCH && fn->blocks[b].cond == value) return 1;
+    }
+    return 0;
+}
+
+// The header's values the code after the loop uses (phis only, or -1 if anything else is used)
+static int used_after(IrFunction* fn, Scev* s, int* phis) {
+    int count = 0;
+    for (int i = 0; i < fn->instr_count; i++) {
+        IrInstr* in = &fn->instrs[i];
+        if (in->block < 0 || in_scev_loop(s, in->block)) continue;
+        for (int k = 0; k < in->arg_count; k++) {
+            int arg = in->args[k];
+            if (arg < 0 || !in_scev_loop(s, fn->instrs[arg].block)) continue;
+            if (fn->instrs[arg].kind != IR_PHI) return -1;
+            int seen = 0;
+            for (int j = 0; j < count; j++) seen |= phis[j] == arg;
+            if (!seen) phis[count++] = arg;
+        }
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        IrBlock* block = &fn->blocks[b];
+        if (block->rpo >= 0 && !in_scev_loop(s, b) && block->term == IR_BRANCH && in_scev_loop(s, fn->instrs[block->cond].block)) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+/*
+ * Gives a loop of one body block counting towards an invariant limit its
+ * closed form (see passes.h); nonzero if it did. The preheader branches to
+ * the closed form if every input is an integer, else to the loop.
+ */
+static int close_loop(IrFunction* fn, Loop* loop) {
+    int header = loop->header;
+    IrBlock* h = &fn->blocks[header];
+    if (loop->preheader < 0 || h->term != IR_BRANCH || h->pred_count != 2) return 0;
+    int body = h->succ[0], exit = h->succ[1];
+    if (body == header || !in_loop(loop, body) || in_loop(loop, exit)) return 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        if (in_loop(loop, b) && b != header && b != body) return 0;
+    }
+    IrBlock* bb = &fn->blocks[body];
+    if (bb->term != IR_JUMP || bb->succ[0] != header || bb->pred_count != 1 || fn->blocks[exit].pred_count != 1) return 0;
+    IrInstr* cond = &fn->instrs[h->cond];
+    if (cond->kind != IR_OP || cond->block != header || cond->arg_count != 2) return 0;
+    for (int i = 0; i < h->count; i++) {
+        IrKind kind = fn->instrs[h->instrs[i]].kind;
+        if (kind != IR_PHI && kind != IR_CONST && h->instrs[i] != h->cond) return 0;
+    }
+
+    Scev s;
+    s.fn = fn;
+    s.header = header;
+    s.body = body;
+    s.preheader = loop->preheader;
+    s.budget = SCEV_BUDGET;
+    s.leaf_count = 0;
+    int* after = jm_alloc(sizeof(int) * fn->instr_count);
+    int after_count = used_after(fn, &s, after);
+    if (after_count < 0) {
+        jm_free(after);
+        return 0;
+    }
+    int count = fn->instr_count;
+    s.solved = jm_alloc(sizeof(Evolution) * count);
+    s.state = jm_calloc(count, 1);
+    s.leaves = jm_alloc(sizeof(int) * count);
+    s.block = ir_block(fn);
+
+    // Every value of the loop must evolve, so none can fail, print or write
+    int ok = 1;
+    for (int i = 0; i < fn->blocks[header].count && ok; i++) {
+        int id = fn->blocks[header].instrs[i];
+        if (fn->instrs[id].kind == IR_PHI) ok = solve_phi(&s, id);
+    }
+    for (int i = 0; i < fn->blocks[body].count && ok; i++) {
+        int id = fn->blocks[body].instrs[i];
+        Evolution e;
+        if (fn->instrs[id].kind != IR_CONST) ok = evolve(&s, id, -1, &e);
+    }
+
+    // The condition compares a counter phi, stepping by a constant, with an invariant limit
+    int trips = -1;
+    if (ok) {
+        int counter = fn->instrs[fn->blocks[header].cond].args[0];
+        int limit = fn->instrs[fn->blocks[header].cond].args[1];
+        OpCode op = fn->instrs[fn->blocks[header].cond].opcode;
+        if (fn->instrs[counter].kind != IR_PHI || fn->instrs[counter].block != header) {
+            int swap = counter;
+            counter = limit;
+            limit = swap;
+            op = flipped(op);
+        }
+        Evolution bound;
+        if (fn->instrs[counter].kind == IR_PHI && fn->instrs[counter].block == header &&
+            evolve(&s, limit, -1, &bound) && bound.count <= 1) {
+            Evolution* iv = &s.solved[counter];
+            IrInstr* step = iv->count == 2 && iv->terms[1] >= 0 ? &fn->instrs[iv->terms[1]] : NULL;
+            if (step && step->kind == IR_CONST && IS_INT(step->value) && AS_INT(step->value) != 0) {
+                trips = trip_count(&s, op, iv->terms[0], AS_INT(step->value), bound.terms[0]);
+            }
+        }
+    }
+    if (trips < 0) {
+        discard_block(fn, s.block);
+        jm_free(s.solved);
+        jm_free(s.state);
+        jm_free(s.leaves);
+        jm_free(after);
+        return 0;
+    }
+
+    // Each value after the loop is the sum of its terms times C(trips, j)
+    int choose[MAX_TERMS];
+    choose[1] = trips;
+    for (int j = 2; j < MAX_TERMS; j++) {
+        int falling = scev_op(&s, BC_MUL, choose[j - 1], scev_op(&s, BC_SUB, trips, scev_int(&s, j - 1)));
+        choose[j] = scev_op(&s, BC_DIV, falling, scev_int(&s, j));
+    }
+    int* final = jm_alloc(sizeof(int) * (after_count > 0 ? after_count : 1));
+    for (int i = 0; i < after_count; i++) {
+        Evolution* e = &s.solved[after[i]];
+        int value = e->terms[0];
+        for (int j = 1; j < e->count; j++) value = term_add(&s, value, term_mul(&s, e->terms[j], choose[j]));
+        final[i] = value < 0 ? scev_int(&s, 0) : value;
+    }
+
+    int guard = -1;
+    for (int i = 0; i < s.leaf_count; i++) {
+        int test = ir_op(fn, loop->preheader, BC_IS_INTEGER, 0, &s.leaves[i], 1);
+        if (guard >= 0) {
+            int args[2] = { guard, test };
+            test = ir_op(fn, loop->preheader, BC_BIT_AND, 0, args, 2);
+        }
+        guard = test;
+    }
+    ir_start(fn, s.block);
+    ir_jump(fn, s.block, exit);
+    if (guard >= 0) ir_branch(fn, loop->preheader, guard, s.block, header);
+    else ir_jump(fn, loop->preheader, s.block);
+    ir_analyze(fn);
+
+    // Both ways meet at the exit, unless the loop is gone
+    for (int i = 0; i < after_count; i++) {
+        int merged = final[i];
+        if (fn->blocks[exit].pred_count == 2) {
+            int args[2];
+            for (int j = 0; j < 2; j++) args[j] = fn->blocks[exit].preds[j] == s.block ? final[i] : after[i];
+            merged = ir_phi(fn, exit, args, 2);
+        }
+        for (int k = 0; k < fn->instr_count; k++) {
+            IrInstr* in = &fn->instrs[k];
+            if (in->block < 0 || in_scev_loop(&s, in->block) || k == merged) continue;
+            for (int a = 0; a < in->arg_count; a++) {
+                if (in->args[a] == after[i]) in->args[a] = merged;
+            }
+        }
+    }
+
+    // Terms nothing ended up using
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        IrBlock* block = &fn->blocks[s.block];
+        for (int i = block->count - 1; i >= 0; i--) {
+            if (has_uses(fn, block->instrs[i])) continue;
+            ir_remove(fn, block->instrs[i]);
+            changed = 1;
+        }
+    }
+    ir_stats.closed++;
+
+    jm_free(final);
+    jm_free(s.solved);
+    jm_free(s.state);
+    jm_free(s.leaves);
+    jm_free(after);
+    return 1;
+}
+
+void ir_close_loops(IrFunction* fn) {
+    // Closing a loop changes the graph, so the loops are found again
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        int count;
+        Loop* loops = find_loops(fn, &count);
+        for (int i = 0; i < count && !changed; i++) changed = close_loop(fn, &loops[i]);
+        free_loops(loops, count);
+    }
+    ir_remove_dead(fn);
+}
+
+// ----------------------------
+// Pipeline
+// ----------------------------
+
+void ir_optimize(IrFunction* fn) {
+    ir_propagate_constants(fn);
+    ir_number_values(fn);
+    ir_hoist_invariants(fn);
+    ir_close_loops(fn);
+}
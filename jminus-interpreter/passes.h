@@ -0,0 +1,89 @@
+/**
+ * @file passes.h
+ * @brief Optimization passes over the SSA IR of ir.h
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The compiler runs ir_optimize() on every region between SSA
+ * construction and lowering. Each pass keeps the function in SSA form and
+ * leaves predecessors, reverse postorder and dominators valid.
+ *
+ * Loops:
+ * - A loop is a header with back edges from blocks it dominates; its body
+ *   is what reaches a back edge without passing the header
+ * - Its preheader is the one predecessor outside the loop, which must end
+ *   in a jump to the header (the builder always makes one)
+ *
+ * Sparse Conditional Constant Propagation (Wegman and Zadeck):
+ * - Values are unknown, a known constant, or varying; blocks count only
+ *   once an executable edge reaches them, and a branch on a known value
+ *   makes only one of its edges executable
+ * - Operations are evaluated with the runtime's own value functions, and
+ *   only where they cannot fail, so errors still happen at runtime
+ * - Constants replace what was found constant, decided branches become
+ *   jumps, and what is no longer reached (an if's dead arm, a loop whose
+ *   condition is false on entry) or used is removed. SSA values are
+ *   already copies of their variables, so copies propagate as well
+ *
+ * Global Value Numbering:
+ * - Operations with the same opcode, operand and inputs yield the same
+ *   value, so one dominated by such a twin is replaced by it; equal
+ *   constants count as the same input, equality, multiplication and the
+ *   bitwise operators take theirs in either order, and phis of one block
+ *   with the same inputs are the same value
+ * - Only values that depend on their inputs alone are shared: nothing
+ *   that allocates, prints or writes, and reads of arrays and maps only
+ *   in regions that write none. A twin that could fail has already run
+ *   without failing, so the dominated copy cannot fail either
+ *
+ * Loop-Invariant Code Motion:
+ * - An operation whose inputs are all computed outside the loop moves to
+ *   the end of the preheader, so it runs once per entry to the loop
+ * - Nothing may start to trap, print or allocate where it did not before:
+ *   only operations that cannot fail for the types of their inputs (the
+ *   arithmetic and comparisons of numbers, division by a nonzero constant)
+ *   move out of the body, which may run zero times
+ * - The header runs at least once per entry, so its operations may also
+ *   move if they would fail anyway, as long as nothing before them in the
+ *   header could fail, print or write first; reads of arrays and maps only
+ *   move out of loops that write none
+ * - Inner loops go first, so their invariants can keep moving outwards
+ *
+ * Closed Forms (Scalar Evolution):
+ * - A value that starts at a and adds b each time round, where b itself
+ *   starts somewhere and adds c, and so on, is a chain of recurrences:
+ *   after k trips it is a*C(k,0) + b*C(k,1) + c*C(k,2) + ..., sums of
+ *   sums up to cubics. Products of chains are chains again
+ * - A loop of a header and one body block, counting a variable towards
+ *   a bound fixed outside it by a constant step, runs a number of trips
+ *   known on entry. When every phi and every operation of the body is
+ *   such a chain, the loop is replaced by its values after that many
+ *   trips, and only phis may be used after it
+ * - Ints grow into bigints rather than overflow, so the closed form is
+ *   exact whenever the inputs are integers; the preheader checks that
+ *   they are and otherwise runs the original loop, which still knows how
+ *   to add doubles or fail on strings. Loops that print, read or write
+ *   are left alone
+ */
+
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "ir.h"
+
+/// Replaces constant values by constants and removes dead branches (see the file comment)
+void ir_propagate_constants(IrFunction* fn);
+
+/// Computes each repeated pure operation once (see the file comment)
+void ir_number_values(IrFunction* fn);
+
+/// Hoists loop invariants into preheaders (see the file comment)
+void ir_hoist_invariants(IrFunction* fn);
+
+/// Replaces counted loops by the closed forms of their recurrences (see the file comment)
+void ir_close_loops(IrFunction* fn);
+
+/// Runs every pass, in order
+void ir_optimize(IrFunction* fn);
+
+#endif // PASSES_H
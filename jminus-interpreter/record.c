@@ -0,0 +1,118 @@
+/**
+ * @file record.c
+ * @brief Records and their shapes for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Field names are interned, so fields are found by comparing pointers.
+ * Records have few fields, and lookups only happen on inline cache misses,
+ * so shapes and their transitions are searched linearly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "record.h"
+#include "gc.h"
+#include "allocator.h"
+
+// The empty shape, created on first use
+static ObjShape* root = NULL;
+
+static void* allocate_buffer(size_t size) {
+    void* buffer = jm_alloc(size > 0 ? size : 1);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return buffer;
+}
+
+static ObjShape* new_shape(int field_count) {
+    ObjShape* shape = (ObjShape*)allocate_tenured_object(sizeof(ObjShape), OBJ_SHAPE);
+    shape->field_count = field_count;
+    shape->fields = allocate_buffer(sizeof(ObjString*) * field_count);
+    shape->transitions = NULL;
+    shape->transition_count = 0;
+    shape->transition_capacity = 0;
+    return shape;
+}
+
+// ----------------------------
+// Shapes
+// ----------------------------
+int is_record(Value value) {
+    return IS_RECORD_OBJ(value);
+}
+
+ObjShape* root_shape(void) {
+    if (!root) root = new_shape(0);
+    return root;
+}
+
+ObjShape* shape_add_field(ObjShape* shape, ObjString* name) {
+    // A transition is identified by the field it appends
+    for (int i = 0; i < shape->transition_count; i++) {
+        ObjShape* next = shape->transitions[i];
+        if (next->fields[shape->field_count] == name) return next;
+    }
+
+    ObjShape* next = new_shape(shape->field_count + 1);
+    memcpy(next->fields, shape->fields, sizeof(ObjString*) * shape->field_count);
+    next->fields[shape->field_count] = name;
+
+    if (shape->transition_count >= shape->transition_capacity) {
+        shape->transition_capacity = shape->transition_capacity ? shape->transition_capacity * 2 : 4;
+        shape->transitions = jm_realloc(shape->transitions, sizeof(ObjShape*) * shape->transition_capacity);
+        if (!shape->transitions) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    shape->transitions[shape->transition_count++] = next;
+    return next;
+}
+
+int shape_field_offset(ObjShape* shape, ObjString* name) {
+    for (int i = 0; i < shape->field_count; i++) {
+        if (shape->fields[i] == name) return i;
+    }
+    return -1;
+}
+
+void trace_shapes(void) {
+    if (!root) return;
+    Obj* object = &root->obj;
+    gc_trace_object(&object);
+}
+
+void reset_shapes(void) {
+    root = NULL;
+}
+
+// ----------------------------
+// Field access
+// ----------------------------
+int record_field_offset(Value record, ObjString* name) {
+    if (!IS_RECORD_OBJ(record)) {
+        fprintf(stderr, "Runtime error: only records have fields (accessing '%s')\n", string_chars(name));
+        exit(1);
+    }
+    int offset = shape_field_offset(AS_RECORD_OBJ(record)->shape, name);
+    if (offset < 0) {
+        fprintf(stderr, "Runtime error: record has no field '%s'\n", string_chars(name));
+        exit(1);
+    }
+    return offset;
+}
+
+Value record_get(Value record, ObjString* name) {
+    int offset = record_field_offset(record, name);
+    return AS_RECORD_OBJ(record)->fields[offset];
+}
+
+void record_set(Value record, ObjString* name, Value value) {
+    int offset = record_field_offset(record, name);
+    gc_write_barrier(AS_OBJ(record), value);
+    AS_RECORD_OBJ(record)->fields[offset] = value;
+}
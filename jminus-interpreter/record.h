@@ -0,0 +1,92 @@
+/**
+ * @file record.h
+ * @brief Records and their shapes for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Records are heap objects (OBJ_RECORD, see object.h) with a fixed set of
+ * named fields, created by literals such as {x: 1, y: 2}. Like arrays and
+ * maps they are references, and == compares identity.
+ *
+ * Layout:
+ * - A record points to its shape, which lists the field names in order;
+ *   the field values are stored inline after the header, by offset
+ * - Shapes are shared: every literal with the same field names in the
+ *   same order produces records of one shape (see shape_add_field)
+ * - Fields are fixed when the record is created; assigning a field the
+ *   shape lacks is an error rather than a layout change
+ *
+ * Field Access:
+ * The VM gives every obj.field site an inline cache holding the last
+ * shape seen there and the field's offset in it (see FieldCache in
+ * compiler.h). A record of that shape is read with one shape compare and
+ * one load; any other shape takes the lookup below and refills the cache.
+ *
+ * Error Handling:
+ * - Accessing a field of a non-record, or a field the record does not
+ *   have, reports a runtime error and exits
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "value.h"
+#include "object.h"
+#include "str.h"
+
+/**
+ * @brief Checks whether a value is a record
+ */
+int is_record(Value value);
+
+/**
+ * @brief Returns the shape with no fields, the root of every shape
+ */
+ObjShape* root_shape(void);
+
+/**
+ * @brief Returns the shape with the fields of shape followed by name
+ *
+ * The shape is created on first use and returned again afterwards.
+ * name must be interned and not already a field of shape.
+ */
+ObjShape* shape_add_field(ObjShape* shape, ObjString* name);
+
+/**
+ * @brief Finds the offset of a field
+ * @param name Interned field name
+ * @return The offset, or -1 if the shape has no such field
+ */
+int shape_field_offset(ObjShape* shape, ObjString* name);
+
+/**
+ * @brief Offset of a field in a record, reporting a runtime error if the
+ *        value is not a record or has no such field
+ */
+int record_field_offset(Value record, ObjString* name);
+
+/**
+ * @brief Reads record.name
+ */
+Value record_get(Value record, ObjString* name);
+
+/**
+ * @brief Stores value into record.name
+ */
+void record_set(Value record, ObjString* name, Value value);
+
+/**
+ * @brief Traces the shape tree for the collector (see gc.h)
+ *
+ * Shapes are long-lived and never move, so this only marks them.
+ */
+void trace_shapes(void);
+
+/**
+ * @brief Forgets the shape tree
+ *
+ * Called by free_objects() once the shapes themselves are gone.
+ */
+void reset_shapes(void);
+
+#endif // RECORD_H
@@ -7,6 +7,7 @@
 #include "compiler.h"
 #include "vm.h"
 #include "interpreter.h"
+#include "object.h"
 
 // --- Color macros ---
 #define COLOR_RESET   "\x1b[0m"
@@ -100,6 +101,8 @@ int main(void) {
         free_ast(stmts, stmt_count);
     }
 
+    // Globals may refer to objects from any line, so free them only at exit
+    free_objects();
     puts(COLOR_GREEN "\nGoodbye 👋" COLOR_RESET);
     return 0;
 } 
\ No newline at end of file
@@ -17,13 +17,29 @@ for test_file in "$TEST_DIR"/*_tests.c; do
   gcc -std=c99 -Wall \
       "$SRC_DIR"/lexer.c \
       "$SRC_DIR"/parser.c \
+      "$SRC_DIR"/capture.c \
+      "$SRC_DIR"/optimizer.c \
+      "$SRC_DIR"/ir.c \
+      "$SRC_DIR"/passes.c \
       "$SRC_DIR"/compiler.c \
       "$SRC_DIR"/vm.c \
       "$SRC_DIR"/interpreter.c \
       "$SRC_DIR"/environment.c \
+      "$SRC_DIR"/value.c \
+      "$SRC_DIR"/object.c \
+      "$SRC_DIR"/bigint.c \
+      "$SRC_DIR"/array.c \
+      "$SRC_DIR"/builtins.c \
+      "$SRC_DIR"/native.c \
+      "$SRC_DIR"/simd.c \
+      "$SRC_DIR"/str.c \
+      "$SRC_DIR"/map.c \
+      "$SRC_DIR"/record.c \
+      "$SRC_DIR"/gc.c \
+      "$SRC_DIR"/allocator.c \
       "$SRC_DIR"/winmain.c \
       "$test_file" \
-      -o "$out"
+      -o "$out" -lm
 
   echo "[*] Running $test_name..."
   "$out"
@@ -0,0 +1,406 @@
+/**
+ * @file simd.c
+ * @brief Vector kernels behind the array builtins
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Every kernel checks its elements while it computes and reports failure
+ * at the end of the block, so the common case runs without branches in
+ * the loop. The vector versions finish blocks whose length is not a
+ * multiple of the lane count with the scalar kernels.
+ */
+
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Exclusive bounds on the ints the kernels accept (see simd.h)
+#define SMALL_BOUND ((int64_t)1 << 31)
+#define DOT_BOUND   ((int64_t)1 << 24)
+
+static inline int small_int(Value value, int64_t bound) {
+    return IS_INT(value) && AS_INT(value) > -bound && AS_INT(value) < bound;
+}
+
+// ----------------------------
+// Portable C
+// ----------------------------
+static int sum_scalar(const Value* items, int count, int64_t* result) {
+    int64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (!small_int(items[i], SMALL_BOUND)) return 0;
+        total += AS_INT(items[i]);
+    }
+    *result = total;
+    return 1;
+}
+
+// Tagged ints order like the ints they hold, so the words compare directly
+static int min_scalar(const Value* items, int count, Value* result) {
+    Value best = items[0];
+    for (int i = 0; i < count; i++) {
+        if (!IS_INT(items[i])) return 0;
+        if ((int64_t)items[i] < (int64_t)best) best = items[i];
+    }
+    *result = best;
+    return 1;
+}
+
+static int max_scalar(const Value* items, int count, Value* result) {
+    Value best = items[0];
+    for (int i = 0; i < count; i++) {
+        if (!IS_INT(items[i])) return 0;
+        if ((int64_t)items[i] > (int64_t)best) best = items[i];
+    }
+    *result = best;
+    return 1;
+}
+
+static int dot_scalar(const Value* a, const Value* b, int count, int64_t* result) {
+    int64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (!small_int(a[i], DOT_BOUND) || !small_int(b[i], DOT_BOUND)) return 0;
+        total += AS_INT(a[i]) * AS_INT(b[i]);
+    }
+    *result = total;
+    return 1;
+}
+
+static int scale_scalar(const Value* items, int count, int64_t factor, Value* out) {
+    if (factor <= -SMALL_BOUND || factor >= SMALL_BOUND) return 0;
+    for (int i = 0; i < count; i++) {
+        if (!small_int(items[i], SMALL_BOUND)) return 0;
+        out[i] = INT_VAL(AS_INT(items[i]) * factor);
+    }
+    return 1;
+}
+
+static int add_scalar(const Value* items, int count, int64_t addend, Value* out) {
+    if (addend <= -SMALL_BOUND || addend >= SMALL_BOUND) return 0;
+    for (int i = 0; i < count; i++) {
+        if (!small_int(items[i], SMALL_BOUND)) return 0;
+        out[i] = INT_VAL(AS_INT(items[i]) + addend);
+    }
+    return 1;
+}
+
+static const SimdKernels scalar_kernels = {
+    "scalar", sum_scalar, min_scalar, max_scalar, dot_scalar, scale_scalar, add_scalar
+};
+
+#ifdef SIMD_X86
+// Reduces the lanes of a min/max accumulator and the scalar tail
+static Value pick_lane(const Value* lanes, int lane_count, Value tail, int has_tail, int want_max) {
+    Value best = has_tail ? tail : lanes[0];
+    for (int i = 0; i < lane_count; i++) {
+        int better = want_max ? (int64_t)lanes[i] > (int64_t)best : (int64_t)lanes[i] < (int64_t)best;
+        if (better) best = lanes[i];
+    }
+    return best;
+}
+
+// Lane checks work on the tagged words: n is in (-bound, bound) exactly
+// when 2n + 1 is in (-2 * bound + 1, 2 * bound), and the tag bit moved
+// to the sign position marks a lane holding an int. Checks accumulate as
+// sign bits and are read once per block with movemask.
+
+// ----------------------------
+// SSE4.2 (two lanes)
+// ----------------------------
+__attribute__((target("sse4.2")))
+static inline __m128i lanes_ok_sse42(__m128i t, __m128i low, __m128i high) {
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi64(t, low), _mm_cmpgt_epi64(high, t));
+    return _mm_and_si128(in_range, _mm_slli_epi64(t, 63));
+}
+
+__attribute__((target("sse4.2")))
+static int all_lanes_sse42(__m128i ok) {
+    return _mm_movemask_pd(_mm_castsi128_pd(ok)) == 0x3;
+}
+
+__attribute__((target("sse4.2")))
+static int sum_sse42(const Value* items, int count, int64_t* result) {
+    const __m128i low = _mm_set1_epi64x(-2 * SMALL_BOUND + 1);
+    const __m128i high = _mm_set1_epi64x(2 * SMALL_BOUND);
+    __m128i ok = _mm_set1_epi64x(-1);
+    __m128i total = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*)(items + i));
+        ok = _mm_and_si128(ok, lanes_ok_sse42(t, low, high));
+        total = _mm_add_epi64(total, t);
+    }
+    int64_t tail;
+    if (!all_lanes_sse42(ok) || !sum_scalar(items + i, count - i, &tail)) return 0;
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    // Each tagged word is 2n + 1, so the words of i elements sum to 2 * sum + i
+    *result = (lanes[0] + lanes[1] - i) / 2 + tail;
+    return 1;
+}
+
+__attribute__((target("sse4.2")))
+static int min_sse42(const Value* items, int count, Value* result) {
+    if (count < 2) return min_scalar(items, count, result);
+    __m128i best = _mm_loadu_si128((const __m128i*)items);
+    __m128i tags = best;
+    int i = 2;
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*)(items + i));
+        tags = _mm_and_si128(tags, t);
+        best = _mm_blendv_epi8(best, t, _mm_cmpgt_epi64(best, t));
+    }
+    if (!all_lanes_sse42(_mm_slli_epi64(tags, 63))) return 0;
+    Value lanes[2], tail = 0;
+    _mm_storeu_si128((__m128i*)lanes, best);
+    if (i < count && !min_scalar(items + i, count - i, &tail)) return 0;
+    *result = pick_lane(lanes, 2, tail, i < count, 0);
+    return 1;
+}
+
+__attribute__((target("sse4.2")))
+static int max_sse42(const Value* items, int count, Value* result) {
+    if (count < 2) return max_scalar(items, count, result);
+    __m128i best = _mm_loadu_si128((const __m128i*)items);
+    __m128i tags = best;
+    int i = 2;
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*)(items + i));
+        tags = _mm_and_si128(tags, t);
+        best = _mm_blendv_epi8(best, t, _mm_cmpgt_epi64(t, best));
+    }
+    if (!all_lanes_sse42(_mm_slli_epi64(tags, 63))) return 0;
+    Value lanes[2], tail = 0;
+    _mm_storeu_si128((__m128i*)lanes, best);
+    if (i < count && !max_scalar(items + i, count - i, &tail)) return 0;
+    *result = pick_lane(lanes, 2, tail, i < count, 1);
+    return 1;
+}
+
+__attribute__((target("sse4.2")))
+static int dot_sse42(const Value* a, const Value* b, int count, int64_t* result) {
+    const __m128i low = _mm_set1_epi64x(-2 * DOT_BOUND + 1);
+    const __m128i high = _mm_set1_epi64x(2 * DOT_BOUND);
+    __m128i ok = _mm_set1_epi64x(-1);
+    __m128i total = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        ok = _mm_and_si128(ok, _mm_and_si128(lanes_ok_sse42(x, low, high), lanes_ok_sse42(y, low, high)));
+        // Shifting out the tag leaves n in the low 32 bits, which is all
+        // the signed 32x32->64 multiply reads
+        total = _mm_add_epi64(total, _mm_mul_epi32(_mm_srli_epi64(x, 1), _mm_srli_epi64(y, 1)));
+    }
+    int64_t tail;
+    if (!all_lanes_sse42(ok) || !dot_scalar(a + i, b + i, count - i, &tail)) return 0;
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    *result = lanes[0] + lanes[1] + tail;
+    return 1;
+}
+
+__attribute__((target("sse4.2")))
+static int scale_sse42(const Value* items, int count, int64_t factor, Value* out) {
+    if (factor <= -SMALL_BOUND || factor >= SMALL_BOUND) return 0;
+    const __m128i low = _mm_set1_epi64x(-2 * SMALL_BOUND + 1);
+    const __m128i high = _mm_set1_epi64x(2 * SMALL_BOUND);
+    const __m128i one = _mm_set1_epi64x(1);
+    const __m128i k = _mm_set1_epi64x(factor);
+    __m128i ok = _mm_set1_epi64x(-1);
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*)(items + i));
+        ok = _mm_and_si128(ok, lanes_ok_sse42(t, low, high));
+        __m128i product = _mm_mul_epi32(_mm_srli_epi64(t, 1), k);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_or_si128(_mm_slli_epi64(product, 1), one));
+    }
+    return all_lanes_sse42(ok) && scale_scalar(items + i, count - i, factor, out + i);
+}
+
+__attribute__((target("sse4.2")))
+static int add_sse42(const Value* items, int count, int64_t addend, Value* out) {
+    if (addend <= -SMALL_BOUND || addend >= SMALL_BOUND) return 0;
+    const __m128i low = _mm_set1_epi64x(-2 * SMALL_BOUND + 1);
+    const __m128i high = _mm_set1_epi64x(2 * SMALL_BOUND);
+    const __m128i step = _mm_set1_epi64x(2 * addend);  // Adding 2k to 2n + 1 tags n + k
+    __m128i ok = _mm_set1_epi64x(-1);
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*)(items + i));
+        ok = _mm_and_si128(ok, lanes_ok_sse42(t, low, high));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi64(t, step));
+    }
+    return all_lanes_sse42(ok) && add_scalar(items + i, count - i, addend, out + i);
+}
+
+static const SimdKernels sse42_kernels = {
+    "sse4.2", sum_sse42, min_sse42, max_sse42, dot_sse42, scale_sse42, add_sse42
+};
+
+// ----------------------------
+// AVX2 (four lanes)
+// ----------------------------
+__attribute__((target("avx2")))
+static inline __m256i lanes_ok_avx2(__m256i t, __m256i low, __m256i high) {
+    __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi64(t, low), _mm256_cmpgt_epi64(high, t));
+    return _mm256_and_si256(in_range, _mm256_slli_epi64(t, 63));
+}
+
+__attribute__((target("avx2")))
+static int all_lanes_avx2(__m256i ok) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(ok)) == 0xF;
+}
+
+__attribute__((target("avx2")))
+static int sum_avx2(const Value* items, int count, int64_t* result) {
+    const __m256i low = _mm256_set1_epi64x(-2 * SMALL_BOUND + 1);
+    const __m256i high = _mm256_set1_epi64x(2 * SMALL_BOUND);
+    __m256i ok = _mm256_set1_epi64x(-1);
+    __m256i total = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)(items + i));
+        ok = _mm256_and_si256(ok, lanes_ok_avx2(t, low, high));
+        total = _mm256_add_epi64(total, t);
+    }
+    int64_t tail;
+    if (!all_lanes_avx2(ok) || !sum_scalar(items + i, count - i, &tail)) return 0;
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    *result = (lanes[0] + lanes[1] + lanes[2] + lanes[3] - i) / 2 + tail;
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static int min_avx2(const Value* items, int count, Value* result) {
+    if (count < 4) return min_scalar(items, count, result);
+    __m256i best = _mm256_loadu_si256((const __m256i*)items);
+    __m256i tags = best;
+    int i = 4;
+    for (; i + 4 <= count; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)(items + i));
+        tags = _mm256_and_si256(tags, t);
+        best = _mm256_blendv_epi8(best, t, _mm256_cmpgt_epi64(best, t));
+    }
+    if (!all_lanes_avx2(_mm256_slli_epi64(tags, 63))) return 0;
+    Value lanes[4], tail = 0;
+    _mm256_storeu_si256((__m256i*)lanes, best);
+    if (i < count && !min_scalar(items + i, count - i, &tail)) return 0;
+    *result = pick_lane(lanes, 4, tail, i < count, 0);
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static int max_avx2(const Value* items, int count, Value* result) {
+    if (count < 4) return max_scalar(items, count, result);
+    __m256i best = _mm256_loadu_si256((const __m256i*)items);
+    __m256i tags = best;
+    int i = 4;
+    for (; i + 4 <= count; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)(items + i));
+        tags = _mm256_and_si256(tags, t);
+        best = _mm256_blendv_epi8(best, t, _mm256_cmpgt_epi64(t, best));
+    }
+    if (!all_lanes_avx2(_mm256_slli_epi64(tags, 63))) return 0;
+    Value lanes[4], tail = 0;
+    _mm256_storeu_si256((__m256i*)lanes, best);
+    if (i < count && !max_scalar(items + i, count - i, &tail)) return 0;
+    *result = pick_lane(lanes, 4, tail, i < count, 1);
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static int dot_avx2(const Value* a, const Value* b, int count, int64_t* result) {
+    const __m256i low = _mm256_set1_epi64x(-2 * DOT_BOUND + 1);
+    const __m256i high = _mm256_set1_epi64x(2 * DOT_BOUND);
+    __m256i ok = _mm256_set1_epi64x(-1);
+    __m256i total = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        ok = _mm256_and_si256(ok, _mm256_and_si256(lanes_ok_avx2(x, low, high), lanes_ok_avx2(y, low, high)));
+        total = _mm256_add_epi64(total, _mm256_mul_epi32(_mm256_srli_epi64(x, 1), _mm256_srli_epi64(y, 1)));
+    }
+    int64_t tail;
+    if (!all_lanes_avx2(ok) || !dot_scalar(a + i, b + i, count - i, &tail)) return 0;
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    *result = lanes[0] + lanes[1] + lanes[2] + lanes[3] + tail;
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static int scale_avx2(const Value* items, int count, int64_t factor, Value* out) {
+    if (factor <= -SMALL_BOUND || factor >= SMALL_BOUND) return 0;
+    const __m256i low = _mm256_set1_epi64x(-2 * SMALL_BOUND + 1);
+    const __m256i high = _mm256_set1_epi64x(2 * SMALL_BOUND);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i k = _mm256_set1_epi64x(factor);
+    __m256i ok = _mm256_set1_epi64x(-1);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)(items + i));
+        ok = _mm256_and_si256(ok, lanes_ok_avx2(t, low, high));
+        __m256i product = _mm256_mul_epi32(_mm256_srli_epi64(t, 1), k);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_or_si256(_mm256_slli_epi64(product, 1), one));
+    }
+    return all_lanes_avx2(ok) && scale_scalar(items + i, count - i, factor, out + i);
+}
+
+__attribute__((target("avx2")))
+static int add_avx2(const Value* items, int count, int64_t addend, Value* out) {
+    if (addend <= -SMALL_BOUND || addend >= SMALL_BOUND) return 0;
+    const __m256i low = _mm256_set1_epi64x(-2 * SMALL_BOUND + 1);
+    const __m256i high = _mm256_set1_epi64x(2 * SMALL_BOUND);
+    const __m256i step = _mm256_set1_epi64x(2 * addend);
+    __m256i ok = _mm256_set1_epi64x(-1);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)(items + i));
+        ok = _mm256_and_si256(ok, lanes_ok_avx2(t, low, high));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi64(t, step));
+    }
+    return all_lanes_avx2(ok) && add_scalar(items + i, count - i, addend, out + i);
+}
+
+static const SimdKernels avx2_kernels = {
+    "avx2", sum_avx2, min_avx2, max_avx2, dot_avx2, scale_avx2, add_avx2
+};
+#endif // SIMD_X86
+
+// ----------------------------
+// Dispatch
+// ----------------------------
+static const SimdKernels* selected = NULL;
+
+SimdLevel simd_best_level(void) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SIMD_SSE42;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel simd_select(SimdLevel level) {
+    SimdLevel best = simd_best_level();
+    if (level > best) level = best;
+    switch (level) {
+#ifdef SIMD_X86
+        case SIMD_AVX2: selected = &avx2_kernels; break;
+        case SIMD_SSE42: selected = &sse42_kernels; break;
+#endif
+        default: selected = &scalar_kernels; break;
+    }
+    return level;
+}
+
+const SimdKernels* simd_kernels(void) {
+    if (!selected) simd_select(SIMD_AVX2);
+    return selected;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file simd.h
+ * @brief Vector kernels behind the array builtins
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The kernels process one block of an array's contiguous buffer of tagged
+ * values (see value.h) and only handle the common case: every element is
+ * a tagged int in a small range (below). For anything else they return 0
+ * without a result, and the caller (array.c) redoes that block with the
+ * generic value functions, so results are exact and identical at every
+ * level, including doubles, bigints and type errors.
+ *
+ * Fast-path ranges (n is the int an element holds):
+ * - sum, scale, add: |n| < 2^31 (the constant of scale/add too)
+ * - dot: |n| < 2^24, so a block of products cannot overflow
+ * - min, max: any int, since tagged ints order like the ints they hold
+ *
+ * Dispatch:
+ * - AVX2 (4 lanes), SSE4.2 (2 lanes) or portable C, picked once at
+ *   startup from what the CPU supports; simd_select() narrows the choice
+ *   for tests and benchmarks
+ * - The vector code is compiled with per-function target attributes, so
+ *   the rest of the program needs no special compiler flags
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include "value.h"
+
+/// Maximum elements per kernel call; keeps every lane sum within 64 bits
+#define SIMD_BLOCK 4096
+
+/**
+ * @brief Instruction set levels, from least to most capable
+ */
+typedef enum {
+    SIMD_SCALAR,  ///< Portable C
+    SIMD_SSE42,   ///< SSE4.2 (64-bit compares), two lanes
+    SIMD_AVX2     ///< AVX2, four lanes
+} SimdLevel;
+
+/**
+ * @brief One implementation of every kernel
+ *
+ * Each returns nonzero on success. count is at most SIMD_BLOCK (and at
+ * least 1 for min and max); out may not overlap items.
+ */
+typedef struct {
+    const char* name;
+    int (*sum)(const Value* items, int count, int64_t* result);
+    int (*min)(const Value* items, int count, Value* result);
+    int (*max)(const Value* items, int count, Value* result);
+    int (*dot)(const Value* a, const Value* b, int count, int64_t* result);
+    int (*scale)(const Value* items, int count, int64_t factor, Value* out);
+    int (*add)(const Value* items, int count, int64_t addend, Value* out);
+} SimdKernels;
+
+/**
+ * @brief Returns the kernels for the selected level
+ */
+const SimdKernels* simd_kernels(void);
+
+/**
+ * @brief Returns the most capable level the CPU supports
+ */
+SimdLevel simd_best_level(void);
+
+/**
+ * @brief Selects a level, clamped to what the CPU supports
+ * @return The level actually selected
+ */
+SimdLevel simd_select(SimdLevel level);
+
+#endif // SIMD_H
@@ -0,0 +1,255 @@
+/**
+ * @file str.c
+ * @brief Immutable strings: interning, cached hashes and ropes
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * The intern table is an open-addressing hash set of string pointers
+ * with linear probing, kept at most half full. Ropes can be arbitrarily
+ * deep (a loop of appends builds a left-leaning chain as long as the
+ * loop), so flattening and printing walk them with an explicit stack
+ * rather than recursion.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "str.h"
+#include "gc.h"
+#include "allocator.h"
+
+// ----------------------------
+// Allocation
+// ----------------------------
+static void* allocate_buffer(size_t size) {
+    void* buffer = jm_alloc(size);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return buffer;
+}
+
+static ObjString* new_string(int length, int tenured) {
+    ObjString* string = (ObjString*)(tenured ? allocate_tenured_object(sizeof(ObjString), OBJ_STRING)
+                                             : allocate_object(sizeof(ObjString), OBJ_STRING));
+    string->length = length;
+    string->interned = 0;
+    string->hash = 0;
+    string->chars = NULL;
+    string->left = NULL;
+    string->right = NULL;
+    return string;
+}
+
+static ObjString* new_flat_string(const char* chars, int length, uint32_t hash, int tenured) {
+    ObjString* string = new_string(length, tenured);
+    string->chars = allocate_buffer(length + 1);
+    memcpy(string->chars, chars, length);
+    string->chars[length] = '\0';
+    string->hash = hash;
+    return string;
+}
+
+// FNV-1a; 0 is reserved for "not computed yet"
+static uint32_t hash_bytes(const char* chars, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)chars[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+// ----------------------------
+// Intern table
+// ----------------------------
+static ObjString** table = NULL;
+static int table_capacity = 0;  // Always a power of two (or 0)
+static int table_count = 0;
+
+// Returns the slot holding the given text, or the empty slot where it belongs
+static ObjString** find_slot(ObjString** entries, int capacity, const char* chars, int length, uint32_t hash) {
+    uint32_t index = hash & (capacity - 1);
+    while (1) {
+        ObjString* entry = entries[index];
+        if (!entry || (entry->hash == hash && entry->length == length &&
+                       memcmp(entry->chars, chars, length) == 0)) {
+            return &entries[index];
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void grow_table(void) {
+    int capacity = table_capacity ? table_capacity * 2 : 256;
+    ObjString** entries = jm_calloc(capacity, sizeof(ObjString*));
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < table_capacity; i++) {
+        ObjString* entry = table[i];
+        if (entry) *find_slot(entries, capacity, entry->chars, entry->length, entry->hash) = entry;
+    }
+    jm_free(table);
+    table = entries;
+    table_capacity = capacity;
+}
+
+static ObjString* intern(const char* chars, int length) {
+    if ((table_count + 1) * 2 > table_capacity) grow_table();
+    uint32_t hash = hash_bytes(chars, length);
+    ObjString** slot = find_slot(table, table_capacity, chars, length, hash);
+    if (*slot) {
+        // A string the sweep has yet to free may be handed out again
+        if (gc_phase == GC_SWEEPING) (*slot)->obj.marked = 1;
+    } else {
+        // Interned strings tend to live as long as the program
+        *slot = new_flat_string(chars, length, hash, 1);
+        (*slot)->interned = 1;
+        table_count++;
+    }
+    return *slot;
+}
+
+void remove_interned_string(ObjString* string) {
+    uint32_t mask = table_capacity - 1;
+    uint32_t hole = string->hash & mask;
+    while (table[hole] != string) hole = (hole + 1) & mask;
+
+    // Shift back the entries that probed past the hole, so lookups still
+    // reach them without tombstones
+    for (uint32_t next = (hole + 1) & mask; table[next]; next = (next + 1) & mask) {
+        uint32_t home = table[next]->hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole] = NULL;
+    table_count--;
+}
+
+void reset_interned_strings(void) {
+    jm_free(table);
+    table = NULL;
+    table_capacity = 0;
+    table_count = 0;
+}
+
+// ----------------------------
+// Construction
+// ----------------------------
+ObjString* copy_string(const char* chars, int length) {
+    if (length <= STRING_INTERN_MAX) return intern(chars, length);
+    return new_flat_string(chars, length, 0, 0);
+}
+
+ObjString* intern_name(const char* name) {
+    return intern(name, (int)strlen(name));
+}
+
+ObjString* concat_strings(ObjString* a, ObjString* b) {
+    if (a->length == 0) return b;
+    if (b->length == 0) return a;
+    if (a->length > INT_MAX - b->length) {
+        fprintf(stderr, "Runtime error: string too long\n");
+        exit(1);
+    }
+
+    // Both halves of a short result are short themselves, hence flat
+    int length = a->length + b->length;
+    if (length <= STRING_INTERN_MAX) {
+        char buffer[STRING_INTERN_MAX];
+        memcpy(buffer, a->chars, a->length);
+        memcpy(buffer + a->length, b->chars, b->length);
+        return intern(buffer, length);
+    }
+
+    ObjString* rope = new_string(length, 0);
+    rope->left = a;
+    rope->right = b;
+    return rope;
+}
+
+// ----------------------------
+// Reading
+// ----------------------------
+/*
+ * Calls visit on each flat piece of a string, in order. Pieces are the
+ * leaves of the rope, or any inner node that has already been flattened.
+ */
+static void each_piece(ObjString* string, void (*visit)(const char*, int, void*), void* context) {
+    ObjString* inline_stack[64];
+    ObjString** stack = inline_stack;
+    int capacity = 64;
+    int count = 0;
+
+    stack[count++] = string;
+    while (count > 0) {
+        ObjString* node = stack[--count];
+        if (node->chars) {
+            visit(node->chars, node->length, context);
+            continue;
+        }
+        if (count + 2 > capacity) {
+            capacity *= 2;
+            if (stack == inline_stack) {
+                stack = allocate_buffer(sizeof(ObjString*) * capacity);
+                memcpy(stack, inline_stack, sizeof(inline_stack));
+            } else {
+                stack = jm_realloc(stack, sizeof(ObjString*) * capacity);
+                if (!stack) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+        }
+        stack[count++] = node->right;
+        stack[count++] = node->left;
+    }
+    if (stack != inline_stack) jm_free(stack);
+}
+
+static void append_piece(const char* chars, int length, void* context) {
+    char** cursor = context;
+    memcpy(*cursor, chars, length);
+    *cursor += length;
+}
+
+static void write_piece(const char* chars, int length, void* context) {
+    fwrite(chars, 1, length, (FILE*)context);
+}
+
+const char* string_chars(ObjString* string) {
+    if (string->chars) return string->chars;
+
+    char* chars = allocate_buffer(string->length + 1);
+    char* cursor = chars;
+    each_piece(string, append_piece, &cursor);
+    chars[string->length] = '\0';
+
+    // The halves stay valid strings of their own; this node no longer needs them
+    string->chars = chars;
+    string->left = NULL;
+    string->right = NULL;
+    return chars;
+}
+
+uint32_t string_hash(ObjString* string) {
+    if (!string->hash) string->hash = hash_bytes(string_chars(string), string->length);
+    return string->hash;
+}
+
+int strings_equal(ObjString* a, ObjString* b) {
+    if (a == b) return 1;
+    if (a->length != b->length) return 0;
+    if (a->interned && b->interned) return 0;
+    if (string_hash(a) != string_hash(b)) return 0;
+    return memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+void print_string(ObjString* string, FILE* out) {
+    each_piece(string, write_piece, out);
+}
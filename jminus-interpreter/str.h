@@ -0,0 +1,112 @@
+/**
+ * @file str.h
+ * @brief Immutable strings: interning, cached hashes and ropes
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Strings are heap objects (OBJ_STRING, see object.h) that never change
+ * once created, so they can be shared freely and their hash computed
+ * once.
+ *
+ * Interning:
+ * - Every string of at most STRING_INTERN_MAX bytes is interned: there
+ *   is exactly one object per distinct short text, and two interned
+ *   strings are equal exactly when they are the same object
+ * - Identifiers use the same table, so variable names are interned
+ *   strings and globals are looked up by pointer (see environment.h)
+ *
+ * Ropes:
+ * - Concatenation whose result is longer than STRING_INTERN_MAX builds a
+ *   rope node pointing at its two halves instead of copying them, so
+ *   s = s + x in a loop costs O(1) per iteration
+ * - A rope is flattened into one buffer the first time its text is read
+ *   (equality, hashing, formatting), and stays flat afterwards
+ * - print_string() streams the pieces of a rope without flattening it
+ *
+ * Hashes are FNV-1a over the bytes, computed on first use and cached in
+ * the object.
+ */
+
+#ifndef STR_H
+#define STR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "object.h"
+
+/// Strings up to this many bytes are interned and always flat
+#define STRING_INTERN_MAX 40
+
+/**
+ * @brief An immutable string, flat or a rope of two strings
+ */
+typedef struct ObjString {
+    Obj obj;                  ///< Object header
+    int length;               ///< Length in bytes
+    int interned;             ///< Nonzero if this is the table's copy of its text
+    uint32_t hash;            ///< FNV-1a hash, 0 until computed
+    char* chars;              ///< Null-terminated text; NULL while an unflattened rope
+    struct ObjString* left;   ///< First half of a rope (NULL once flat)
+    struct ObjString* right;  ///< Second half of a rope (NULL once flat)
+} ObjString;
+
+#define IS_STRING_OBJ(v) (IS_OBJ(v) && OBJ_TYPE(v) == OBJ_STRING)
+#define AS_STRING_OBJ(v) ((ObjString*)AS_OBJ(v))
+
+/**
+ * @brief Returns the string holding a copy of the given bytes
+ *
+ * Short texts return the interned string, creating it on first use.
+ */
+ObjString* copy_string(const char* chars, int length);
+
+/**
+ * @brief Returns the interned string for a null-terminated name
+ *
+ * Names are interned whatever their length.
+ */
+ObjString* intern_name(const char* name);
+
+/**
+ * @brief Concatenates two strings
+ *
+ * Short results are flat and interned; longer ones are rope nodes.
+ */
+ObjString* concat_strings(ObjString* a, ObjString* b);
+
+/**
+ * @brief Returns the text of a string, flattening a rope first
+ */
+const char* string_chars(ObjString* string);
+
+/**
+ * @brief Returns the cached hash of a string, computing it on first use
+ */
+uint32_t string_hash(ObjString* string);
+
+/**
+ * @brief Compares the text of two strings
+ */
+int strings_equal(ObjString* a, ObjString* b);
+
+/**
+ * @brief Writes the text of a string to a stream without flattening it
+ */
+void print_string(ObjString* string, FILE* out);
+
+/**
+ * @brief Removes an interned string from the table
+ *
+ * Called by the collector when it frees the string, so the table never
+ * holds freed strings and does not keep strings alive by itself.
+ */
+void remove_interned_string(ObjString* string);
+
+/**
+ * @brief Empties the intern table
+ *
+ * Called by free_objects() once the strings themselves are gone.
+ */
+void reset_interned_strings(void);
+
+#endif // STR_H
@@ -0,0 +1,163 @@
+// tests/allocator_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../gc.h"
+#include "../allocator.h"
+
+static Value result;
+
+static void capture_output(Value value) {
+    result = value;
+}
+
+static Value run_source(const char* src) {
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    run(bc);
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+    return result;
+}
+
+// Counts calls, then forwards to the system allocator
+static long counted_allocs = 0;
+
+static void* counting_alloc(void* context, size_t size) {
+    (void)context;
+    counted_allocs++;
+    return malloc(size);
+}
+
+static void* counting_realloc(void* context, void* pointer, size_t size) {
+    (void)context;
+    if (!pointer) counted_allocs++;
+    return realloc(pointer, size);
+}
+
+static void counting_free(void* context, void* pointer) {
+    (void)context;
+    free(pointer);
+}
+
+int main(void) {
+    vm_output = capture_output;
+
+    // Test 1: slab blocks are reused from their size class once freed
+    jm_slab slab;
+    jm_slab_init(&slab, 0);
+    jm_allocator slabs = jm_slab_allocator(&slab);
+    char* small = slabs.alloc(slabs.context, 40);
+    char* other = slabs.alloc(slabs.context, 40);
+    assert(small && other && small != other);
+    assert(((size_t)small & 7) == 0 && ((size_t)other & 7) == 0);
+    slabs.free(slabs.context, small);
+    char* reused = slabs.alloc(slabs.context, 33);
+    char* fresh = slabs.alloc(slabs.context, 40);
+    assert(reused == small && fresh != small);
+    void* big = slabs.alloc(slabs.context, 100000);
+    assert(big && slab.large != NULL);
+    slabs.free(slabs.context, big);
+    assert(slab.large == NULL);
+
+    // Growing keeps the contents; shrinking stays in place
+    memcpy(other, "slab data", 10);
+    char* grown = slabs.realloc(slabs.context, other, 3000);
+    assert(strcmp(grown, "slab data") == 0);
+    assert(slabs.realloc(slabs.context, grown, 10) == grown);
+    grown = slabs.realloc(slabs.context, grown, 50000);
+    assert(strcmp(grown, "slab data") == 0);
+    slabs.free(slabs.context, grown);
+    slabs.free(slabs.context, reused);
+    slabs.free(slabs.context, fresh);
+    assert(slab.in_use == 0);
+    jm_slab_release(&slab);
+    assert(slab.chunks == NULL);
+
+    // Release frees the chunks and large blocks of whatever is still live
+    // (under LeakSanitizer, a large block it missed shows up as a leak)
+    char* live = slabs.alloc(slabs.context, 50000);
+    assert(live && slabs.alloc(slabs.context, 40) && slabs.alloc(slabs.context, 60000));
+    assert(slab.large != NULL && slab.chunks != NULL);
+    jm_slab_release(&slab);
+
+    // Test 2: past its limit a slab allocator fails like malloc
+    jm_slab_init(&slab, 1024);
+    void* blocks[64];
+    int count = 0;
+    while (count < 64 && (blocks[count] = slabs.alloc(slabs.context, 100)) != NULL) count++;
+    assert(count == 1024 / 112);
+    assert(slabs.alloc(slabs.context, 5000) == NULL);
+    slabs.free(slabs.context, blocks[0]);
+    assert(slabs.alloc(slabs.context, 100) == blocks[0]);
+    jm_slab_release(&slab);
+
+    // Test 3: an arena bumps, grows its newest block in place, and gives
+    // everything back at once
+    jm_arena arena;
+    jm_arena_init(&arena, 0);
+    jm_allocator arenas = jm_arena_allocator(&arena);
+    char* first = arenas.alloc(arenas.context, 24);
+    char* second = arenas.alloc(arenas.context, 24);
+    assert(second == first + 32);
+    memcpy(second, "arena", 6);
+    assert(arenas.realloc(arenas.context, second, 400) == second);
+    char* moved = arenas.realloc(arenas.context, first, 400);
+    assert(moved != first && moved > second);
+    void* huge = arenas.alloc(arenas.context, JM_ARENA_BLOCK * 2);
+    assert(huge && arena.used > JM_ARENA_BLOCK * 2);
+    jm_arena_release(&arena);
+    assert(arena.used == 0 && arena.blocks == NULL);
+
+    jm_arena_init(&arena, 256);
+    assert(arenas.alloc(arenas.context, 200) != NULL);
+    assert(arenas.alloc(arenas.context, 200) == NULL);
+    jm_arena_release(&arena);
+
+    // Test 4: a whole run, heap included, can live in an arena
+    jm_arena_init(&arena, 0);
+    jm_set_allocator(&arenas);
+    Value value = run_source(
+        "let words = []; let i = 0;"
+        "while (i < 2000) { push(words, {n: i, s: \"w\" + i}); i = i + 1; }"
+        "let m = map(); m[\"k\"] = words[1999].n; yap(m[\"k\"]);");
+    assert(value == INT_VAL(1999));
+    assert(arena.used > 2000 * 16);
+    free_objects();
+    jm_set_allocator(NULL);
+    jm_arena_release(&arena);
+
+    // Test 5: a custom allocator sees every allocation, and NULL puts the
+    // default back
+    jm_allocator counting = { counting_alloc, counting_realloc, counting_free, NULL };
+    jm_set_allocator(&counting);
+    assert(jm_get_allocator()->alloc == counting_alloc);
+    value = run_source("let a = [1, 2, 3]; yap(sum(a));");
+    assert(value == INT_VAL(6));
+    assert(counted_allocs > 10);
+    free_objects();
+    jm_set_allocator(NULL);
+    assert(jm_get_allocator()->alloc != counting_alloc);
+
+    // The jm_* helpers follow malloc
+    char* copy = jm_strdup("copied");
+    assert(strcmp(copy, "copied") == 0);
+    int* zeros = jm_calloc(100, sizeof(int));
+    for (int i = 0; i < 100; i++) assert(zeros[i] == 0);
+    assert(jm_calloc((size_t)-1, 16) == NULL);
+    jm_free(copy);
+    jm_free(zeros);
+    jm_free(NULL);
+
+    printf("✅ allocator_tests passed\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+// tests/bigint_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../value.h"
+#include "../object.h"
+#include "../bigint.h"
+#include "../allocator.h"
+
+static void assert_text(Value value, const char* expected) {
+    char* text = bigint_to_string(value);
+    if (strcmp(text, expected) != 0) {
+        fprintf(stderr, "❌ bigint: got %s, expected %s\n", text, expected);
+        assert(0);
+    }
+    jm_free(text);
+}
+
+// "1" followed by the given number of zeros
+static Value power_of_ten(int zeros) {
+    char* digits = malloc(zeros + 2);
+    digits[0] = '1';
+    memset(digits + 1, '0', zeros);
+    digits[zeros + 1] = '\0';
+    Value value = bigint_parse(digits);
+    free(digits);
+    return value;
+}
+
+int main(void) {
+    // Overflowing the 63-bit range promotes instead of wrapping
+    Value max = INT_VAL(INT_VALUE_MAX);
+    Value big = add_values(max, INT_VAL(1));
+    assert(is_bigint(big));
+    assert_text(big, "4611686018427387904");
+    assert(IS_INT(subtract_values(big, INT_VAL(1))) && "results that fit are demoted");
+    assert(subtract_values(big, INT_VAL(1)) == max);
+    assert(IS_INT(subtract_values(INT_VAL(INT_VALUE_MIN), INT_VAL(0))));
+    assert(is_bigint(subtract_values(INT_VAL(INT_VALUE_MIN), INT_VAL(1))));
+    assert_text(multiply_values(INT_VAL(INT_VALUE_MIN), INT_VAL(INT_VALUE_MIN)), "21267647932558653966460912964485513216");
+    assert_text(divide_values(INT_VAL(INT_VALUE_MIN), INT_VAL(-1)), "4611686018427387904");
+
+    // Parsing and formatting, including chunks with leading zeros
+    assert_text(bigint_parse("1000000000000000000000000000001"), "1000000000000000000000000000001");
+    assert_text(bigint_parse("-98765432109876543210987654321"), "-98765432109876543210987654321");
+    assert(bigint_parse("42") == INT_VAL(42));
+
+    // 100! exercises repeated multiplication and formatting
+    Value factorial = INT_VAL(1);
+    for (int i = 2; i <= 100; i++) factorial = multiply_values(factorial, INT_VAL(i));
+    assert_text(factorial,
+        "93326215443944152681699238856266700490715968264381621468592963895217599993229915608941463976156518286253697920827223758251185210916864000000000000000000000000");
+
+    // Division truncates toward zero and undoes multiplication
+    Value quotient = divide_values(factorial, power_of_ten(24));
+    assert_text(quotient,
+        "93326215443944152681699238856266700490715968264381621468592963895217599993229915608941463976156518286253697920827223758251185210916864");
+    Value two_200 = bigint_parse("1606938044258990275541962092341162602522202993782792835301376");
+    assert(bigint_compare(divide_values(multiply_values(factorial, two_200), two_200), factorial) == 0);
+    assert_text(divide_values(bigint_parse("-1606938044258990275541962092341162602522202993782792835301376"), INT_VAL(7)),
+        "-229562577751284325077423156048737514646028999111827547900196");
+    assert(divide_values(INT_VAL(5), factorial) == INT_VAL(0));
+
+    // Comparison and mixing with doubles
+    assert(compare_values(factorial, INT_VAL(INT_VALUE_MAX)) == 1);
+    assert(compare_values(subtract_values(INT_VAL(0), factorial), INT_VAL(INT_VALUE_MIN)) == -1);
+    assert(values_equal(big, double_value(4611686018427387904.0)));
+    assert(as_double(add_values(big, double_value(0.5))) == 4611686018427387904.5);
+    assert(is_truthy(big));
+
+    // Karatsuba: (10^600 - 1)^2 = 99..9800..01, operands well above the threshold
+    Value nines = subtract_values(power_of_ten(600), INT_VAL(1));
+    char expected[1201];
+    memset(expected, '9', 599);
+    expected[599] = '8';
+    memset(expected + 600, '0', 599);
+    expected[1199] = '1';
+    expected[1200] = '\0';
+    assert_text(multiply_values(nines, nines), expected);
+
+    // Unbalanced and deeper Karatsuba, checked against add/subtract:
+    // (10^3000 - 1)(10^400 - 1) = 10^3400 - 10^3000 - 10^400 + 1
+    Value a = subtract_values(power_of_ten(3000), INT_VAL(1));
+    Value b = subtract_values(power_of_ten(400), INT_VAL(1));
+    Value expect = add_values(subtract_values(subtract_values(power_of_ten(3400), power_of_ten(3000)), power_of_ten(400)), INT_VAL(1));
+    assert(bigint_compare(multiply_values(a, b), expect) == 0);
+    Value product = multiply_values(a, multiply_values(a, factorial));
+    assert(bigint_compare(divide_values(product, a), multiply_values(a, factorial)) == 0);
+    assert(bigint_compare(divide_values(divide_values(product, factorial), a), a) == 0);
+
+    // Formatting past BIGINT_DECIMAL_THRESHOLD and BIGINT_RECIPROCAL_THRESHOLD
+    // splits at powers of ten: runs of nines and zeros straddle every split
+    int long_digits = 40000;
+    char* long_text = malloc(long_digits + 3);
+    char* digits = long_text + 1;
+    memset(digits, '9', long_digits);
+    digits[long_digits] = '\0';
+    assert_text(subtract_values(power_of_ten(long_digits), INT_VAL(1)), digits);
+    digits[0] = '1';
+    memset(digits + 1, '0', long_digits);
+    digits[long_digits + 1] = '\0';
+    assert_text(power_of_ten(long_digits), digits);
+    memset(digits, '9', long_digits / 2);
+    memset(digits + long_digits / 2, '0', long_digits / 2);
+    memcpy(digits + long_digits - 5, "12345", 6);
+    Value halves = add_values(multiply_values(subtract_values(power_of_ten(long_digits / 2), INT_VAL(1)),
+                                              power_of_ten(long_digits / 2)), INT_VAL(12345));
+    assert_text(halves, digits);
+    long_text[0] = '-';
+    assert_text(subtract_values(INT_VAL(0), halves), long_text);
+    free(long_text);
+
+    // Bitwise operators and shifts past 63 bits: 1 << 62 is the first bigint
+    Value two_62 = shift_left_values(INT_VAL(1), INT_VAL(62));
+    assert_text(two_62, "4611686018427387904");
+    assert_text(shift_left_values(INT_VAL(1), INT_VAL(63)), "9223372036854775808");
+    assert(shift_right_values(two_62, INT_VAL(1)) == INT_VAL((int64_t)1 << 61));
+    assert(and_values(two_62, INT_VAL(1)) == INT_VAL(0));
+    assert_text(and_values(two_62, INT_VAL(-1)), "4611686018427387904");
+    assert_text(or_values(two_62, INT_VAL(1)), "4611686018427387905");
+    assert(xor_values(two_62, two_62) == INT_VAL(0));
+    assert_text(shift_left_values(two_62, INT_VAL(63)), "42535295865117307932921825928971026432");
+
+    // Negative bigints act as two's complement, and >> rounds down as on ints
+    Value minus = subtract_values(INT_VAL(0), shift_left_values(INT_VAL(3), INT_VAL(62)));
+    assert_text(minus, "-13835058055282163712");
+    assert(and_values(minus, INT_VAL(255)) == INT_VAL(0));
+    assert_text(or_values(minus, INT_VAL(1)), "-13835058055282163711");
+    assert_text(xor_values(minus, INT_VAL(-1)), "13835058055282163711");
+    assert(shift_right_values(minus, INT_VAL(62)) == INT_VAL(-3));
+    assert(shift_right_values(add_values(minus, INT_VAL(1)), INT_VAL(62)) == INT_VAL(-3));
+    assert(shift_right_values(subtract_values(minus, INT_VAL(1)), INT_VAL(62)) == INT_VAL(-4));
+    Value two_63 = shift_left_values(INT_VAL(1), INT_VAL(63));
+    Value rounded = divide_values(add_values(factorial, subtract_values(two_63, INT_VAL(1))), two_63);
+    assert(bigint_compare(shift_right_values(subtract_values(INT_VAL(0), factorial), INT_VAL(63)),
+                          subtract_values(INT_VAL(0), rounded)) == 0);
+    assert(bigint_compare(shift_right_values(shift_left_values(minus, INT_VAL(40)), INT_VAL(40)), minus) == 0);
+
+    free_objects();
+    printf("✅ bigint_tests passed\n");
+    return 0;
+}
@@ -0,0 +1,162 @@
+// tests/closure_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../gc.h"
+#include "../value.h"
+
+#define MAX_OUTPUT 16
+
+static Value output[MAX_OUTPUT];
+static int output_count = 0;
+
+static void capture_output(Value value) {
+    assert(output_count < MAX_OUTPUT);
+    output[output_count++] = value;
+}
+
+static void run_source(const char* src) {
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    output_count = 0;
+    run(bc);
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+}
+
+// Nursery bytes allocated by running src
+static size_t allocated_by(const char* src) {
+    size_t before = gc_stats.nursery_bytes;
+    run_source(src);
+    return gc_stats.nursery_bytes - before;
+}
+
+int main(void) {
+    vm_output = capture_output;
+
+    // Test 1: an escaping closure keeps its assigned variable in a cell,
+    // and each call of the outer function makes a new one
+    run_source(
+        "fn make_counter() {"
+        "  let count = 0;"
+        "  fn next() { count = count + 1; return count; }"
+        "  return next;"
+        "}"
+        "let c = make_counter(); let d = make_counter();"
+        "yap(c()); yap(c()); yap(d()); yap(c());");
+    assert(output_count == 4);
+    assert(output[0] == INT_VAL(1) && output[1] == INT_VAL(2));
+    assert(output[2] == INT_VAL(1) && output[3] == INT_VAL(3));
+    assert(vm_stats.closures == 2 && vm_stats.upvalues == 2);
+
+    // Test 2: a variable that is never assigned is copied into the closure
+    run_source(
+        "fn make_adder(n) { fn add(x) { return x + n; } return add; }"
+        "let add5 = make_adder(5); let add7 = make_adder(7);"
+        "yap(add5(10)); yap(add7(10)); yap(add5);");
+    assert(output[0] == INT_VAL(15) && output[1] == INT_VAL(17));
+    char buffer[32];
+    format_value(output[2], buffer, sizeof(buffer));
+    assert(strcmp(buffer, "<fn add>") == 0);
+    assert(vm_stats.closures == 2 && vm_stats.upvalues == 0);
+
+    // Test 3: closures over the same variable share its cell
+    run_source(
+        "fn cell() {"
+        "  let v = 1;"
+        "  fn get() { return v; }"
+        "  fn set(x) { v = x; }"
+        "  set(42);"
+        "  return [get, set];"
+        "}"
+        "let p = cell(); yap(p[0]()); p[1](7); yap(p[0]());");
+    assert(output[0] == INT_VAL(42) && output[1] == INT_VAL(7));
+
+    // Test 4: nested functions that never escape allocate nothing, even
+    // when they assign the outer variable, however often they are called
+    const char* small =
+        "fn total(n) {"
+        "  let sum = 0;"
+        "  fn add(v) { sum = sum + v; }"
+        "  fn twice(v) { add(v); add(v); }"
+        "  let i = 0;"
+        "  while (i < n) { twice(i); i = i + 1; }"
+        "  return sum;"
+        "}"
+        "yap(total(10));";
+    const char* large =
+        "fn total(n) {"
+        "  let sum = 0;"
+        "  fn add(v) { sum = sum + v; }"
+        "  fn twice(v) { add(v); add(v); }"
+        "  let i = 0;"
+        "  while (i < n) { twice(i); i = i + 1; }"
+        "  return sum;"
+        "}"
+        "yap(total(10000));";
+    size_t small_bytes = allocated_by(small);
+    assert(output[0] == INT_VAL(90));
+    size_t large_bytes = allocated_by(large);
+    assert(output[0] == INT_VAL(9999 * 10000));
+    assert(large_bytes == small_bytes);
+    assert(vm_stats.closures == 0 && vm_stats.upvalues == 0);
+
+    // Test 5: functions passed as values, recursion and tail calls
+    run_source(
+        "fn apply(f, x) { return f(x); }"
+        "fn double(x) { return x * 2; }"
+        "fn fact(n) {"
+        "  fn go(i, acc) { if (i > n) { return acc; } return go(i + 1, acc * i); }"
+        "  return go(1, 1);"
+        "}"
+        "fn compose(f, g) { fn h(x) { return f(g(x)); } return h; }"
+        "yap(apply(double, 21)); yap(fact(20)); yap(compose(double, double)(5));"
+        "fn outer() { fn mid() { fn inner() { return depth; } return inner(); } let depth = 3; return mid(); }"
+        "yap(outer());");
+    assert(output[0] == INT_VAL(42));
+    assert(output[1] == INT_VAL(2432902008176640000LL));
+    assert(output[2] == INT_VAL(20));
+    assert(output[3] == INT_VAL(3));
+
+    // Test 6: parameters shadow top-level functions; variables belong to
+    // the whole function, so closures made in a loop share them
+    run_source(
+        "fn f(x) { return x + 1; }"
+        "fn call_with(f) { return f(10); }"
+        "fn neg(x) { return 0 - x; }"
+        "yap(call_with(neg)); yap(f(1));"
+        "fn makers() {"
+        "  let out = []; let i = 0;"
+        "  while (i < 3) { let j = i; fn get() { return j * 10; } push(out, get); j = j + 1; i = i + 1; }"
+        "  return out;"
+        "}"
+        "let ms = makers(); yap(ms[0]()); yap(ms[2]());");
+    assert(output[0] == INT_VAL(-10) && output[1] == INT_VAL(2));
+    assert(output[2] == INT_VAL(30) && output[3] == INT_VAL(30));
+
+    // Test 7: closures and cells survive collections
+    free_objects();
+    gc_set_nursery_size(4096);
+    run_source(
+        "fn make_counter() { let n = 0; fn next() { n = n + 1; return n; } return next; }"
+        "let counters = []; let i = 0;"
+        "while (i < 500) { push(counters, make_counter()); let junk = [i, i, i]; i = i + 1; }"
+        "i = 0; let total = 0;"
+        "while (i < 500) { counters[i](); total = total + counters[i](); i = i + 1; }"
+        "yap(total);");
+    assert(output[0] == INT_VAL(1000));
+    assert(gc_stats.minor_collections > 0);
+    free_objects();
+
+    printf("✅ closure_tests passed\n");
+    return 0;
+}
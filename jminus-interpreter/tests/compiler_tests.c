@@ -6,6 +6,8 @@
 #include "../lexer.h"
 #include "../parser.h"
 #include "../compiler.h"
+#include "../str.h"
+#include "../optimizer.h"
 
 static void assert_bool(int cond, const char* msg) {
     if (!cond) {
@@ -18,6 +20,34 @@ static void print_pass(const char* msg) {
     printf("✅ %s\n", msg);
 }
 
+static int count_opcode(Bytecode* bc, OpCode opcode) {
+    int count = 0;
+    for (int i = 0; i < bc->count; i++) {
+        if (bc->instructions[i].opcode == opcode) count++;
+    }
+    return count;
+}
+
+// Instructions one iteration of the last loop executes, when its body
+// does not branch: from the target of its back jump through the jump
+static int loop_length(Bytecode* bc, int* start) {
+    for (int i = bc->count - 1; i >= 0; i--) {
+        if (bc->instructions[i].opcode == BC_JUMP && bc->instructions[i].operand <= i) {
+            *start = bc->instructions[i].operand;
+            return i - *start + 1;
+        }
+    }
+    return 0;
+}
+
+static int count_in(Bytecode* bc, OpCode opcode, int from, int to) {
+    int count = 0;
+    for (int i = from; i < to; i++) {
+        if (bc->instructions[i].opcode == opcode) count++;
+    }
+    return count;
+}
+
 int main(void) {
     // --------
     // Test 1: let-statement
@@ -31,12 +61,14 @@ int main(void) {
         Stmt** stmts = parse(tokens, tcount, &scount);
         Bytecode* bc = compile(stmts, scount);
 
-        assert_bool(bc->const_count == 1,          "let: const_count should be 1");
-        assert_bool(bc->constants[0] == 42,        "let: constant[0] should be 42");
+        assert_bool(bc->const_count == 2,          "let: const_count should be 2 (value and name)");
+        assert_bool(bc->constants[0] == INT_VAL(42),        "let: constant[0] should be 42");
+        assert_bool(bc->constants[1] == OBJ_VAL(intern_name("x")), "let: constant[1] should be the name x");
         assert_bool(bc->count >= 3,                "let: should have at least 3 instructions");
         assert_bool(bc->instructions[0].opcode == BC_CONST,      "let: instr0 must be BC_CONST");
         assert_bool(bc->instructions[0].operand ==  0,           "let: instr0 operand must be 0");
         assert_bool(bc->instructions[1].opcode == BC_DEFINE_VAR, "let: instr1 must be BC_DEFINE_VAR");
+        assert_bool(bc->instructions[1].operand == 1,            "let: instr1 operand must be the name constant");
         assert_bool(bc->instructions[2].opcode == BC_HALT,       "let: instr2 must be BC_HALT");
         print_pass("let-statement compiles to BC_DEFINE_VAR");
         free_bytecode(bc);
@@ -77,14 +109,12 @@ int main(void) {
         int scount;
         Stmt** stmts = parse(tokens, tcount, &scount);
         Bytecode* bc = compile(stmts, scount);
-        assert_bool(bc->const_count == 2,          "yap: const_count should be 2");
-        assert_bool(bc->constants[0] == 1,         "yap: constant[0] should be 1");
-        assert_bool(bc->constants[1] == 2,         "yap: constant[1] should be 2");
+        // 1+2 is folded at compile time
+        assert_bool(bc->const_count == 1,          "yap: const_count should be 1");
+        assert_bool(bc->constants[0] == INT_VAL(3),         "yap: constant[0] should be folded to 3");
         assert_bool(bc->instructions[0].opcode == BC_CONST,  "yap: instr0 must be BC_CONST");
-        assert_bool(bc->instructions[1].opcode == BC_CONST,  "yap: instr1 must be BC_CONST");
-        assert_bool(bc->instructions[2].opcode == BC_ADD,    "yap: instr2 must be BC_ADD");
-        assert_bool(bc->instructions[3].opcode == BC_PRINT,  "yap: instr3 must be BC_PRINT");
-        assert_bool(bc->instructions[4].opcode == BC_HALT,   "yap: instr4 must be BC_HALT");
+        assert_bool(bc->instructions[1].opcode == BC_PRINT,  "yap: instr1 must be BC_PRINT");
+        assert_bool(bc->instructions[2].opcode == BC_HALT,   "yap: instr2 must be BC_HALT");
         print_pass("yap-expression compiles to BC_PRINT");
         free_bytecode(bc);
         free_tokens(tokens, tcount);
@@ -92,10 +122,11 @@ int main(void) {
 
     // --------
     // Test 4: if-statement
-    //   if (1 == 1) { yap(123); } else { yap(456); }
+    //   let c = [1][0]; if (c == 1) { yap(123); } else { yap(456); }
+    //   (c is not a constant, so both arms stay; see Test 20)
     // --------
     {
-        const char* src = "if (1 == 1) { yap(123); } else { yap(456); }";
+        const char* src = "let c = [1][0]; if (c == 1) { yap(123); } else { yap(456); }";
         int tcount;
         Token* tokens = tokenize(src, &tcount);
         int scount;
@@ -115,10 +146,11 @@ int main(void) {
 
     // --------
     // Test 5: while-statement
-    //   let x = 0; while (x < 2) { x = x + 1; }
+    //   let x = 0; while (x < 20) { x = x * 2 + 1; }
+    //   (x doubles, so the loop has no closed form; see Test 22)
     // --------
     {
-        const char* src = "let x = 0; while (x < 2) { x = x + 1; }";
+        const char* src = "let x = 0; while (x < 20) { x = x * 2 + 1; }";
         int tcount;
         Token* tokens = tokenize(src, &tcount);
         int scount;
@@ -136,6 +168,562 @@ int main(void) {
         free_tokens(tokens, tcount);
     }
 
+    // --------
+    // Test 6: function declaration and call
+    //   add is recursive, so the call is not inlined
+    // --------
+    {
+        const char* src = "fn add(a, b) { if (a == 0) { return b; } return add(a - 1, b) + 1; } yap(add(1, 2));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(bc->function_count == 1,                "fn: function_count should be 1");
+        assert_bool(bc->functions[0].arity == 2,            "fn: add takes 2 arguments");
+        assert_bool(bc->functions[0].entry == -1,           "fn: body is not compiled before the first call");
+        int top_level = bc->count;
+        compile_function(bc, 0);
+        int entry = bc->functions[0].entry;
+        assert_bool(entry == top_level,                     "fn: body is appended after top-level code");
+        assert_bool(bc->functions[0].local_count == 2,      "fn: add needs 2 slots");
+        assert_bool(bc->instructions[entry].opcode == BC_LOAD_LOCAL && bc->instructions[entry].operand == 0,
+                    "fn: a is slot 0");
+        int found_call = 0, found_return = 0, found_b = 0;
+        for (int i = 0; i < bc->count; i++) {
+            if (bc->instructions[i].opcode == BC_CALL && bc->instructions[i].operand == 0) found_call++;
+            if (bc->instructions[i].opcode == BC_RETURN) found_return = 1;
+            if (bc->instructions[i].opcode == BC_LOAD_LOCAL && bc->instructions[i].operand == 1) found_b = 1;
+        }
+        assert_bool(found_b, "fn: b is slot 1");
+        assert_bool(found_call == 2, "fn: calls should emit BC_CALL 0");
+        assert_bool(found_return, "fn: body should emit BC_RETURN");
+        print_pass("function call compiles to BC_CALL/BC_RETURN");
+        free_bytecode(bc);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 7: tail calls
+    //   return f(...) is a tail call, return f(...) + 1 is not
+    // --------
+    {
+        const char* src = "fn loop(n) { if (n == 0) { return 0; } return loop(n - 1); }"
+                          "fn depth(n) { if (n == 0) { return 0; } return depth(n - 1) + 1; }";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        compile_function(bc, 0);
+        compile_function(bc, 1);
+        int tail_to_loop = 0, tail_to_depth = 0, call_to_depth = 0;
+        for (int i = 0; i < bc->count; i++) {
+            if (bc->instructions[i].opcode == BC_TAIL_CALL && bc->instructions[i].operand == 0) tail_to_loop = 1;
+            if (bc->instructions[i].opcode == BC_TAIL_CALL && bc->instructions[i].operand == 1) tail_to_depth = 1;
+            if (bc->instructions[i].opcode == BC_CALL && bc->instructions[i].operand == 1) call_to_depth = 1;
+        }
+        assert_bool(tail_to_loop, "tail: return loop(n - 1) should emit BC_TAIL_CALL");
+        assert_bool(!tail_to_depth, "tail: return depth(n - 1) + 1 is not a tail call");
+        assert_bool(call_to_depth, "tail: depth(n - 1) + 1 should emit BC_CALL");
+        print_pass("return f(...) compiles to BC_TAIL_CALL");
+        free_bytecode(bc);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 8: inlining small functions
+    //   abs(i) in a loop is inlined, abs(0 - 7) folds to a constant,
+    //   recursive fact(n) stays a call
+    // --------
+    {
+        const char* src = "fn abs(x) { if (x < 0) { return 0 - x; } return x; }"
+                          "fn fact(n) { if (n < 2) { return 1; } return n * fact(n - 1); }"
+                          "let i = 0; while (i < 3) { yap(abs(i)); i = i + 1; }"
+                          "yap(abs(0 - 7)); yap(fact(4));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        compile_function(bc, 1);
+        int calls_to_abs = 0, calls_to_fact = 0, has_seven = 0;
+        for (int i = 0; i < bc->count; i++) {
+            if (bc->instructions[i].opcode == BC_CALL && bc->instructions[i].operand == 0) calls_to_abs++;
+            if (bc->instructions[i].opcode == BC_CALL && bc->instructions[i].operand == 1) calls_to_fact++;
+            if (bc->instructions[i].opcode == BC_CONST && bc->constants[bc->instructions[i].operand] == INT_VAL(7) &&
+                bc->instructions[i + 1].opcode == BC_PRINT) has_seven = 1;
+        }
+        assert_bool(calls_to_abs == 0, "inline: abs should never be called");
+        assert_bool(calls_to_fact == 2, "inline: fact is recursive and must stay a call");
+        assert_bool(has_seven, "inline: abs(0 - 7) should fold to the constant 7");
+        assert_bool(bc->local_count == 1, "inline: top-level frame needs one slot for x");
+        print_pass("small functions are inlined and folded");
+        free_bytecode(bc);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 9: inlining respects the size budget
+    // --------
+    {
+        const char* src = "fn big(x) { let a = x + 1; let b = a + 2; let c = b + 3; let d = c + 4;"
+                          " let e = d + 5; let f = e + 6; let g = f + 7; let h = g + 8;"
+                          " let i = h + 1; let j = i + 2; let k = j + 3; let l = k + 4; return l; }"
+                          "yap(big(1));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        int found_call = 0;
+        for (int i = 0; i < bc->count; i++) {
+            if (bc->instructions[i].opcode == BC_CALL) found_call = 1;
+        }
+        assert_bool(found_call, "budget: large function should stay a call");
+        print_pass("functions over the inline budget are called");
+        free_bytecode(bc);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 10: lazy parsing
+    //   bodies are brace-matched only, so an unused body with a syntax
+    //   error compiles, and nothing is generated for it
+    // --------
+    {
+        const char* src = "fn broken(x) { let = { ; } } fn used(x) { return x; } yap(1);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        assert_bool(stmts != NULL && scount == 3, "lazy: syntax errors in bodies are not reported by parse()");
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(stmts[0]->fn.body == NULL, "lazy: unused body is never parsed");
+        assert_bool(bc->functions[0].entry == -1 && bc->functions[1].entry == -1,
+                    "lazy: no function is compiled before its first call");
+        assert_bool(bc->count == 3, "lazy: only top-level code is generated");
+        print_pass("function bodies are parsed and compiled on demand");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 11: bounds check elimination
+    //   a[i] inside `i = 0; while (i < len(a)) { ...; i = i + 1; }` is
+    //   unchecked; any other loop shape, or a body that touches a or i,
+    //   keeps the checked opcodes
+    // --------
+    {
+        const char* sources[] = {
+            "let a = [1, 2, 3]; let s = 0; let i = 0;"
+            "while (i < len(a)) { s = s + a[i]; a[i] = 0; i = i + 1; }",
+            "let a = [1, 2, 3]; let n = 3; let s = 0; let i = 0;"
+            "while (i < n) { s = s + a[i]; i = i + 1; }",
+            "let a = [1, 2, 3]; let s = 0; let i = 0;"
+            "while (i < len(a)) { s = s + a[i]; a = [1]; i = i + 1; }",
+            "let a = [1, 2, 3]; let s = 0; let i = 0;"
+            "while (i < len(a)) { i = i + 1; s = s + a[i]; }",
+        };
+        for (int n = 0; n < 4; n++) {
+            int tcount;
+            Token* tokens = tokenize(sources[n], &tcount);
+            int scount;
+            Stmt** stmts = parse(tokens, tcount, &scount);
+            Bytecode* bc = compile(stmts, scount);
+            if (n == 0) {
+                assert_bool(count_opcode(bc, BC_INDEX_GET_UNCHECKED) == 1, "bounds: proven read should be unchecked");
+                assert_bool(count_opcode(bc, BC_INDEX_SET_UNCHECKED) == 1, "bounds: proven write should be unchecked");
+                assert_bool(count_opcode(bc, BC_INDEX_GET) == 0 && count_opcode(bc, BC_INDEX_SET) == 0,
+                            "bounds: proven loop should have no checked access");
+            } else {
+                assert_bool(count_opcode(bc, BC_INDEX_GET) == 1, "bounds: unproven read should be checked");
+                assert_bool(count_opcode(bc, BC_INDEX_GET_UNCHECKED) == 0, "bounds: unproven read must not be unchecked");
+            }
+            free_bytecode(bc);
+            free_ast(stmts, scount);
+            free_tokens(tokens, tcount);
+        }
+        print_pass("accesses in counted loops over len(a) skip bounds checks");
+    }
+
+    // --------
+    // Test 12: global names
+    //   The operand of a variable opcode is the constant holding the
+    //   interned name; every use of a name shares one constant, and names
+    //   with a common first letter get different ones
+    // --------
+    {
+        const char* src = "let abc = 1; let abd = 2; abc = abc + abd;";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        int abc = -1, abd = -1;
+        for (int i = 0; i < bc->count; i++) {
+            Instruction instr = bc->instructions[i];
+            if (instr.opcode != BC_DEFINE_VAR && instr.opcode != BC_LOAD_VAR && instr.opcode != BC_SET_VAR) continue;
+            ObjString* name = AS_STRING_OBJ(bc->constants[instr.operand]);
+            int* seen = strcmp(name->chars, "abc") == 0 ? &abc : &abd;
+            assert_bool(*seen < 0 || *seen == instr.operand, "names: one constant per name");
+            *seen = instr.operand;
+        }
+        assert_bool(abc >= 0 && abd >= 0 && abc != abd, "names: distinct names get distinct constants");
+        assert_bool(bc->constants[abc] == OBJ_VAL(intern_name("abc")), "names: constants are interned");
+        print_pass("global names are interned constants");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 13: map membership
+    //   has(m, k) compiles to BC_MAP_HAS rather than a builtin call
+    // --------
+    {
+        const char* src = "let m = map(); m[1] = 2; yap(has(m, 1));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(count_opcode(bc, BC_MAP_HAS) == 1, "has: should compile to BC_MAP_HAS");
+        assert_bool(count_opcode(bc, BC_CALL_BUILTIN) == 1, "has: only map() is a builtin call");
+        assert_bool(count_opcode(bc, BC_INDEX_SET) == 1, "has: m[1] = 2 stays generic until run");
+        print_pass("has() compiles to BC_MAP_HAS");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 14: records
+    //   Literals with the same fields in the same order share a shape
+    //   constant, and every field access site gets its own inline cache
+    // --------
+    {
+        const char* src = "let p = {x: 1, y: 2}; let q = {x: 3, y: 4}; let r = {y: 5, x: 6};"
+                          "p.x = q.y; yap(p.x + r.x);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        int shapes[3];
+        int records = 0;
+        for (int i = 0; i < bc->count; i++) {
+            if (bc->instructions[i].opcode == BC_RECORD) shapes[records++] = bc->instructions[i].operand;
+        }
+        assert_bool(records == 3, "records: one BC_RECORD per literal");
+        assert_bool(shapes[0] == shapes[1], "records: same fields, same shape constant");
+        assert_bool(shapes[0] != shapes[2], "records: field order makes a different shape");
+        assert_bool(count_opcode(bc, BC_GET_FIELD) == 3, "records: three field reads");
+        assert_bool(count_opcode(bc, BC_SET_FIELD) == 1, "records: one field write");
+        assert_bool(bc->field_cache_count == 4, "records: one inline cache per site");
+        for (int i = 0; i < bc->field_cache_count; i++) {
+            assert_bool(bc->field_caches[i].shape == NULL, "records: caches start empty");
+        }
+        print_pass("record literals and field access sites");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 15: nested functions
+    //   A helper that is only called gets an assigned variable as a stack
+    //   reference and no closure is made; a function used as a value
+    //   boxes the variables it captures that are assigned
+    // --------
+    {
+        const char* src = "fn outer(n) { let sum = 0; fn add(v) { sum = sum + v; } add(n);"
+                          "  let k = 2; fn scaled(x) { return x * k; } fn inc() { sum = sum + 1; } yap(scaled);"
+                          "  return inc; }"
+                          "yap(outer(1));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        compile_function(bc, 0);
+        assert_bool(bc->function_count == 4, "nested: every nested function gets an entry");
+        Function* add = &bc->functions[1];
+        Function* scaled = &bc->functions[2];
+        Function* inc = &bc->functions[3];
+        assert_bool(add->parent == 0 && strcmp(add->name, "add") == 0, "nested: add belongs to outer");
+        assert_bool(add->capture_count == 1 && add->captures[0].mode == CAPTURE_UPVALUE,
+                    "nested: sum is boxed, since the escaping inc assigns it");
+        assert_bool(scaled->capture_count == 1 && scaled->captures[0].mode == CAPTURE_VALUE,
+                    "nested: k is never assigned, so it is copied");
+        assert_bool(inc->capture_count == 1, "nested: inc captures sum");
+        assert_bool(count_opcode(bc, BC_NEW_UPVALUE) == 1, "nested: one cell, for sum");
+        assert_bool(count_opcode(bc, BC_CLOSURE) == 2, "nested: scaled and inc are used as values");
+        assert_bool(count_opcode(bc, BC_SET_UPVALUE) == 1, "nested: outer's let sum stores into the cell");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        src = "fn total(n) { let sum = 0; fn add(v) { sum = sum + v; } add(n); add(n); return sum; } yap(total(1));";
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        compile_function(bc, 0);
+        compile_function(bc, 1);
+        assert_bool(bc->functions[1].captures[0].mode == CAPTURE_REF, "nested: sum stays in total's frame");
+        assert_bool(count_opcode(bc, BC_REF_LOCAL) == 2, "nested: each call passes the slot's stack index");
+        assert_bool(count_opcode(bc, BC_SET_REF) == 1 && count_opcode(bc, BC_LOAD_REF) == 1,
+                    "nested: add reads and writes sum through the reference");
+        assert_bool(count_opcode(bc, BC_CLOSURE) == 0 && count_opcode(bc, BC_NEW_UPVALUE) == 0,
+                    "nested: nothing is allocated");
+        print_pass("nested functions capture by value, reference or cell");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 16: block scoping
+    //   Top-level lets stay globals; lets in blocks get frame slots that
+    //   sibling blocks reuse, so the frame is as deep as the nesting. The
+    //   script is one region (see ir.h): its block lets are SSA values,
+    //   and only the loop's x needs a slot
+    // --------
+    {
+        const char* src = "let x = 1;"
+                          "{ let x = 2; let y = 3; yap(x + y); }"
+                          "while (x < 3) { let a = x; if (a > 1) { let b = a; yap(b); } x = x + 1; }"
+                          "fn g(n) { { let a = n; let b = a; n = b; } { let c = n; n = c; } return n; }";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        compile_function(bc, 0);
+        assert_bool(count_opcode(bc, BC_DEFINE_VAR) == 1, "blocks: only the top-level x is a global");
+        assert_bool(bc->local_count == 1, "blocks: the lets of the region need no slots");
+        assert_bool(bc->functions[0].local_count == 3, "blocks: g needs n plus its deepest block");
+        print_pass("block locals reuse frame slots");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 17: remainder, bitwise operators and intrinsics
+    //   Each compiles to one opcode; constant operands fold, except where
+    //   the runtime must report an error; min of an array stays a builtin
+    // --------
+    {
+        const char* src = "yap(7 % 4 + (6 & 3) + (6 | 1) + (6 ^ 5) + (1 << 4) + (0 - 64 >> 3));"
+                          "yap(min(3, 0 - 2) + max(1.5, 1) + abs(0 - 9));"
+                          "yap(1 % 0); yap(1 << 64);"
+                          "let x = 5; yap(x % 2); yap(x & x | x ^ x); yap(x << 1 >> 1);"
+                          "yap(min(x, 1)); yap(max(x, 1)); yap(abs(x)); yap(min([x]));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(bc->instructions[0].opcode == BC_CONST &&
+                    bc->constants[bc->instructions[0].operand] == INT_VAL(3 + 2 + 7 + 3 + 16 - 8),
+                    "intrinsics: constant operators fold");
+        assert_bool(count_opcode(bc, BC_MOD) == 2 && count_opcode(bc, BC_SHIFT_LEFT) == 2,
+                    "intrinsics: 1 % 0 and 1 << 64 are left to runtime");
+        assert_bool(count_opcode(bc, BC_BIT_AND) == 1 && count_opcode(bc, BC_BIT_OR) == 1 &&
+                    count_opcode(bc, BC_BIT_XOR) == 1 && count_opcode(bc, BC_SHIFT_RIGHT) == 1,
+                    "intrinsics: one opcode per operator");
+        assert_bool(count_opcode(bc, BC_MIN) == 1 && count_opcode(bc, BC_MAX) == 1 &&
+                    count_opcode(bc, BC_ABS) == 1,
+                    "intrinsics: only the calls with a variable argument are left as opcodes");
+        assert_bool(count_opcode(bc, BC_CALL_BUILTIN) == 1, "intrinsics: min of an array calls the builtin");
+        print_pass("remainder, bitwise operators and intrinsics");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 18: &&, || and ! in conditions compile to jumps
+    //   Only the comparisons and plain values push a truth value; each
+    //   is consumed by its own jump, and ! just flips the jump's sense.
+    //   In a value context && materializes 1 or 0 once, at the end; a
+    //   condition folded to a constant needs no jump at all
+    // --------
+    {
+        const char* src = "let v = [1, 2, 3]; let a = v[0]; let b = v[1]; let c = v[2];"
+                          "if (a < b && (b < c || !c)) { yap(1); }"
+                          "while (!(a > c)) { a = a + 1; }"
+                          "if (true || a) { yap(2); }"
+                          "yap(a == 3 && b); yap(!b);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(count_opcode(bc, BC_JUMP_IF_FALSE) == 1 + 2 && count_opcode(bc, BC_JUMP_IF_TRUE) == 2 + 1,
+                    "logical: one conditional jump per leaf");
+        assert_bool(count_opcode(bc, BC_NOT) == 1, "logical: only the ! in a value context is an opcode");
+        assert_bool(count_opcode(bc, BC_JUMP) == 1 + 1, "logical: the loop and the value && jump");
+        print_pass("logical operators compile to jumps");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 19: loop-invariant code motion
+    //   limit * 100 / base is computed once before the loop, and so is
+    //   k * 3 from the body: k is a length, so it cannot fail. An
+    //   iteration is the compare and its jump, two additions and the
+    //   phi copies. 100 / z stays in its loop: z might be 0, and the
+    //   body might never run (it does not here)
+    // --------
+    {
+        const char* src = "let a = [3, 0, 0]; let limit = a[0]; let base = 7; let k = len(a);"
+                          "let i = 0; let s = 0;"
+                          "while (i < limit * 100 / base) { s = s + k * 3; i = i + 1; }"
+                          "yap(s);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        int start;
+        int length = loop_length(bc, &start);
+        assert_bool(length == 13, "licm: 13 instructions per iteration");
+        assert_bool(count_in(bc, BC_MUL, start, start + length) == 0 && count_in(bc, BC_DIV, start, start + length) == 0,
+                    "licm: no multiplication or division left in the loop");
+        assert_bool(count_in(bc, BC_MUL, 0, start) == 2 && count_in(bc, BC_DIV, 0, start) == 1,
+                    "licm: each computed once, before the loop");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        src = "let z = [0][0]; let n = z; let i = 0; let s = 0; while (i < n) { s = s + 100 / z; i = i + 1; } yap(s);";
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        length = loop_length(bc, &start);
+        assert_bool(count_in(bc, BC_DIV, start, start + length) == 1, "licm: a division that may fail stays in the body");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        // b's phis feed each other around both loops; finding which values
+        // are numbers must still settle (this used to flip forever)
+        src = "let b = 0; let i = 0; while (i < 2) { let j = 1;"
+              "  while (j < 10) { b = 4; if (1) { } else { b = 2; } j = j + 1; }"
+              "  if (i) { b = b - 1; } i = i + 1; }";
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        assert_bool(bc != NULL && count_opcode(bc, BC_HALT) == 1, "licm: phi cycles settle");
+        print_pass("loop invariants are computed once, before the loop");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 20: constant propagation across statements
+    //   debug is 0 wherever it is read, so the compare and the arm that
+    //   prints are gone, and so is the loop over k, whose condition is
+    //   false on entry. After the loop only s and k are read (the call
+    //   stays with the tree walk), so debug (slot 0), n (1) and i (3) are
+    //   never stored
+    // --------
+    {
+        const char* src = "fn show(x) { yap(x); }"
+                          "{ let debug = 0; let n = [5][0]; let s = 0; let i = 0;"
+                          "  while (i < n) { if (debug == 1) { yap(i); } s = s + i; i = i + 1; }"
+                          "  let k = 0; while (k > 5) { k = k + 1; }"
+                          "  show(s); yap(k); }";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(count_opcode(bc, BC_EQUAL) == 0, "sccp: debug == 1 is decided at compile time");
+        assert_bool(count_opcode(bc, BC_PRINT) == 2, "sccp: the debug arm is deleted");
+        int loops = 0, stores = 0;
+        for (int i = 0; i < bc->count; i++) {
+            Instruction instr = bc->instructions[i];
+            if (instr.opcode == BC_JUMP && instr.operand <= i) loops++;
+            if (instr.opcode == BC_SET_LOCAL && (instr.operand == 0 || instr.operand == 1 || instr.operand == 3)) stores++;
+        }
+        assert_bool(loops == 1, "sccp: the loop that never runs is removed");
+        assert_bool(stores == 0, "sccp: variables never read again are not stored");
+        print_pass("constants propagate across statements and decide branches");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // --------
+    // Test 21: value numbering
+    //   a * b and b * a are one product, kept in a slot for both
+    //   comparisons, even without control flow around them. In the loop,
+    //   v[0] * i is computed once for the test and the sum: the condition
+    //   block dominates the arm, and nothing writes v
+    // --------
+    {
+        const char* src = "{ let a = [6][0]; let b = [7][0]; yap(a * b > 10); yap(b * a < 100); }";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(count_opcode(bc, BC_MUL) == 1, "gvn: one multiplication for both comparisons");
+        assert_bool(count_opcode(bc, BC_LOAD_LOCAL) == 2, "gvn: only the product is reloaded");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        src = "let v = [2, 3]; let i = 0; let s = 0;"
+              "while (i < 4) { if (v[0] * i > 3) { s = s + v[0] * i; } i = i + 1; } yap(s);";
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        assert_bool(count_opcode(bc, BC_MUL) == 1 && count_opcode(bc, BC_INDEX_GET) == 1,
+                    "gvn: the arm reuses the condition's product");
+        print_pass("repeated pure expressions are computed once");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 22: closed forms
+    //   With constant bounds the sum of squares is a constant, and the
+    //   loop is gone. With a bound read from an array, one IS_INTEGER
+    //   guard chooses between the closed form and the original loop
+    // --------
+    {
+        const char* src = "{ let i = 0; let s = 0; while (i < 100) { s = s + i * i; i = i + 1; } yap(s); }";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        assert_bool(bc->count == 3 && bc->instructions[0].opcode == BC_CONST, "scev: the loop folds to one constant");
+        assert_bool(bc->constants[bc->instructions[0].operand] == INT_VAL(328350), "scev: the sum of squares to 99");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        src = "{ let n = [100][0]; let i = 0; let s = 0; while (i < n) { s = s + i * i; i = i + 1; } yap(s); }";
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        assert_bool(count_opcode(bc, BC_IS_INTEGER) == 1, "scev: the bound is checked once");
+        assert_bool(count_opcode(bc, BC_JUMP_IF_FALSE) == 1, "scev: the original loop remains for other types");
+        print_pass("counted loops are replaced by closed forms");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
     printf("\n🎉 All compiler tests passed!\n");
     return 0;
 }
@@ -0,0 +1,162 @@
+// tests/gc_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../gc.h"
+#include "../str.h"
+
+#define MAX_OUTPUT 16
+
+static Value output[MAX_OUTPUT];
+static int output_count = 0;
+
+static void capture_output(Value value) {
+    assert(output_count < MAX_OUTPUT);
+    output[output_count++] = value;
+}
+
+static void run_source(const char* src) {
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    output_count = 0;
+    run(bc);
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+}
+
+int main(void) {
+    vm_output = capture_output;
+
+    // Test 1: small objects are bump-allocated, large ones start out old
+    gc_set_nursery_size(4096);
+    ObjArray* young = new_array(0);
+    assert(gc_is_young(&young->obj));
+    ObjBigInt* large = new_bigint(2000);
+    assert(!gc_is_young(&large->obj));
+    assert(!gc_is_young(&intern_name("tenured")->obj));
+    free_objects();
+
+    // Test 2: survivors of many minor collections keep their contents,
+    // including nursery objects stored into promoted arrays (cards)
+    gc_set_nursery_size(4096);
+    run_source(
+        "let keep = []; let i = 0;"
+        "while (i < 3000) {"
+        "  let junk = [i, i, i];"
+        "  push(keep, [i, \"item \" + i]);"
+        "  i = i + 1;"
+        "}"
+        "let total = 0; i = 0;"
+        "while (i < len(keep)) { total = total + keep[i][0]; i = i + 1; }"
+        "yap(total); yap(keep[2999][1] == \"item 2999\");");
+    assert(output_count == 2);
+    assert(output[0] == INT_VAL(2999 * 3000 / 2));
+    assert(output[1] == INT_VAL(1));
+    assert(gc_stats.minor_collections > 10);
+    assert(gc_stats.promoted_bytes > 0);
+
+    // Test 3: nursery objects stored into old records and maps survive,
+    // and maps keyed by moved objects are rehashed
+    run_source(
+        "let holder = {value: 0};"
+        "let m = map(); let ks = []; let i = 0;"
+        "while (i < 2000) {"
+        "  holder.value = [i];"
+        "  let k = [i];"
+        "  m[k] = i * 2;"
+        "  push(ks, k);"
+        "  i = i + 1;"
+        "}"
+        "let total = 0; i = 0;"
+        "while (i < len(ks)) { total = total + m[ks[i]]; i = i + 1; }"
+        "yap(total); yap(holder.value[0]);");
+    assert(output[0] == INT_VAL(1999 * 2000));
+    assert(output[1] == INT_VAL(1999));
+
+    // Test 4: a major collection frees unreachable old objects and keeps
+    // everything the globals reach
+    long freed = gc_stats.freed_objects;
+    long majors = gc_stats.major_collections;
+    run_source("keep = 0; ks = 0;");
+    gc_collect(GC_MAJOR);
+    assert(gc_stats.major_collections == majors + 1);
+    assert(gc_stats.freed_objects > freed + 2000);
+    run_source("yap(has(m, [0])); yap(holder.value[0]); yap(\"item \" + 7 == \"item 7\");");
+    assert(output[0] == INT_VAL(0));
+    assert(output[1] == INT_VAL(1999));
+    assert(output[2] == INT_VAL(1));
+
+    // Test 5: strings interned only by the dropped objects are removed
+    // from the table, and interning their text again works
+    ObjString* kept = intern_name("item 12");
+    assert(kept->length == 7 && copy_string("item 12", 7) == kept);
+    free_objects();
+
+    // Test 6: heap growth alone requests major collections
+    gc_set_nursery_size(4096);
+    run_source(
+        "let i = 0; let keep = 0;"
+        "while (i < 100000) { keep = [i, i + 1, \"some text that is long enough to stay un-interned\" + i]; i = i + 1; }"
+        "yap(keep[1]);");
+    assert(output[0] == INT_VAL(100000));
+    assert(gc_stats.major_collections > 0);
+    free_objects();
+
+    // Test 7: without a nursery every object is old and nothing moves
+    gc_set_nursery_size(0);
+    run_source("let a = []; let i = 0; while (i < 100) { push(a, [i]); i = i + 1; } yap(a[99][0]);");
+    assert(output[0] == INT_VAL(99));
+    assert(gc_stats.minor_collections == 0 && gc_stats.nursery_bytes == 0);
+    gc_set_nursery_size(GC_NURSERY_SIZE);
+    free_objects();
+
+    // Test 8: major collections run a small step at a time while the
+    // program keeps moving references between marked and unmarked arrays
+    gc_set_nursery_size(4096);
+    gc_set_step_budget(16);
+    run_source(
+        "let n = 2000; let a = []; let i = 0;"
+        "while (i < n) { push(a, [i]); i = i + 1; }"
+        "let window = []; i = 0;"
+        "while (i < 100) { push(window, 0); i = i + 1; }"
+        "i = 0;"
+        "while (i < 300000) {"
+        "  let j = i * 7919 - i * 7919 / n * n;"
+        "  let k = i - i / n * n;"
+        "  let t = a[k]; a[k] = a[j]; a[j] = t;"
+        "  window[i - i / 100 * 100] = [i, \"w\" + i];"
+        "  i = i + 1;"
+        "}"
+        "let total = 0; i = 0;"
+        "while (i < n) { total = total + a[i][0]; i = i + 1; }"
+        "yap(total);");
+    assert(output[0] == INT_VAL(1999 * 2000 / 2));
+    assert(gc_stats.major_collections >= 2);
+    assert(gc_stats.incremental_steps > gc_stats.major_collections * 100);
+
+    // Every pause is in the histogram, and percentiles bound it from above
+    long pauses = 0;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) pauses += gc_stats.pause_histogram[i];
+    assert(pauses == gc_stats.pauses && pauses > gc_stats.incremental_steps);
+    assert(gc_pause_percentile(0.5) <= gc_pause_percentile(0.99));
+    assert(gc_pause_percentile(1.0) >= gc_stats.max_pause_micros ||
+           gc_stats.pause_histogram[GC_PAUSE_BUCKETS - 1] > 0);
+    // The clock is finer than the smallest bucket, so not every pause
+    // reads as under a microsecond
+    assert(gc_stats.pause_histogram[0] < pauses);
+    assert(gc_stats.total_pause_micros >= gc_stats.max_pause_micros && gc_stats.max_pause_micros > 0);
+    gc_set_step_budget(GC_STEP_BUDGET);
+    gc_set_nursery_size(GC_NURSERY_SIZE);
+    free_objects();
+
+    printf("✅ gc_tests passed\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+// tests/ir_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../ir.h"
+#include "../vm.h"
+#include "../value.h"
+
+#define MAX_OUTPUT 16
+
+static Value output[MAX_OUTPUT];
+static int output_count = 0;
+static int local_count = 0;
+
+static void capture_output(Value value) {
+    assert(output_count < MAX_OUTPUT);
+    output[output_count++] = value;
+}
+
+static void run_source(const char* src) {
+    int tcount, scount;
+    Token* tokens = tokenize(src, &tcount);
+    Stmt** stmts = parse(tokens, tcount, &scount);
+    Bytecode* bc = compile(stmts, scount);
+    output_count = 0;
+    run(bc);
+    local_count = bc->local_count;
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+}
+
+// Phis of the variable in block, and the input each takes from pred
+static int phi_of(IrFunction* fn, int block, int var) {
+    for (int i = 0; i < fn->blocks[block].count; i++) {
+        IrInstr* instr = &fn->instrs[fn->blocks[block].instrs[i]];
+        if (instr->kind == IR_PHI && instr->var == var) return fn->blocks[block].instrs[i];
+    }
+    return -1;
+}
+
+static int phi_input(IrFunction* fn, int phi, int pred) {
+    IrBlock* block = &fn->blocks[fn->instrs[phi].block];
+    for (int j = 0; j < block->pred_count; j++) {
+        if (block->preds[j] == pred) return fn->instrs[phi].args[j];
+    }
+    return -1;
+}
+
+int main(void) {
+    vm_output = capture_output;
+
+    // Test 1: dominators and phis of a hand-built graph
+    //   x = 1; if (...) x = 2;  while (x < 10) x = x + 1;  yap(x);
+    {
+        memset(&ir_stats, 0, sizeof(ir_stats));
+        IrFunction* fn = ir_new();
+        int x = ir_var(fn, IR_VAR_TEMP, "x", -1);
+        int then_block = ir_block(fn), else_block = ir_block(fn), join = ir_block(fn);
+        int header = ir_block(fn), body = ir_block(fn), end = ir_block(fn);
+        int one = ir_const(fn, 0, INT_VAL(1));
+        ir_set_var(fn, 0, x, one);
+        ir_branch(fn, 0, ir_const(fn, 0, TRUE_VAL), then_block, else_block);
+        int two = ir_const(fn, then_block, INT_VAL(2));
+        ir_set_var(fn, then_block, x, two);
+        ir_jump(fn, then_block, join);
+        ir_jump(fn, else_block, join);
+        ir_jump(fn, join, header);
+        int args[2] = { ir_get_var(fn, header, x), ir_const(fn, header, INT_VAL(10)) };
+        ir_branch(fn, header, ir_op(fn, header, BC_LESS, 0, args, 2), body, end);
+        args[0] = ir_get_var(fn, body, x);
+        args[1] = ir_const(fn, body, INT_VAL(1));
+        int sum = ir_op(fn, body, BC_ADD, 0, args, 2);
+        ir_set_var(fn, body, x, sum);
+        ir_jump(fn, body, header);
+        int value = ir_get_var(fn, end, x);
+        ir_op(fn, end, BC_PRINT, 0, &value, 1);
+        ir_exit(fn, end);
+        ir_build_ssa(fn);
+
+        assert(fn->blocks[then_block].idom == 0 && fn->blocks[else_block].idom == 0);
+        assert(fn->blocks[join].idom == 0 && fn->blocks[header].idom == join);
+        assert(fn->blocks[body].idom == header && fn->blocks[end].idom == header);
+        assert(ir_dominates(fn, join, body) && !ir_dominates(fn, then_block, join));
+
+        int merge = phi_of(fn, join, x);
+        int loop = phi_of(fn, header, x);
+        assert(merge >= 0 && loop >= 0 && ir_stats.phis == 2);
+        assert(phi_input(fn, merge, then_block) == two && phi_input(fn, merge, else_block) == one);
+        assert(phi_input(fn, loop, join) == merge && phi_input(fn, loop, body) == sum);
+        assert(fn->instrs[sum].args[0] == loop);
+        for (int i = 0; i < fn->instr_count; i++) {
+            if (fn->instrs[i].block < 0) continue;
+            assert(fn->instrs[i].kind != IR_GET_VAR && fn->instrs[i].kind != IR_SET_VAR);
+        }
+        ir_free(fn);
+    }
+
+    // Test 2: a loop over globals runs in SSA form, with the loop's
+    // variables in phis written back once at the end
+    run_source("let i = 0; let s = 0; while (i < 10) { s = s + i; i = i + 1; } yap(s); yap(i);");
+    assert(output_count == 2 && output[0] == INT_VAL(45) && output[1] == INT_VAL(10));
+    assert(ir_stats.regions == 1 && ir_stats.fallbacks == 0 && ir_stats.phis == 2);
+
+    // Test 3: phis read their inputs together, so swapping works
+    run_source("let u = 1; let v = 2; while (u < 3) { let w = u; u = v; v = w + 10; } yap(u); yap(v);");
+    assert(output[0] == INT_VAL(11) && output[1] == INT_VAL(12));
+
+    // Test 4: the edge that skips the then-branch gets a block of its own
+    // for the phi's input; both ways through give the right value
+    run_source("let c = 1; let x = 0; if (c > 0) { x = 5; } yap(x);"
+               "let d = 0; let y = 0; if (d > 0) { y = 5; } yap(y);");
+    assert(output_count == 2 && output[0] == INT_VAL(5) && output[1] == INT_VAL(0));
+
+    // Test 5: && and || as values, and conditions with side effects
+    run_source("let a = 2; let b = 0; let n = 0;"
+               "while (n < 4) { let v = a > n && b == 0 || n == 3; yap(v); n = n + 1; }"
+               "if (!(a < 1) && [a][0] == 2) { yap(a); }");
+    assert(output_count == 5);
+    assert(output[0] == INT_VAL(1) && output[1] == INT_VAL(1));
+    assert(output[2] == INT_VAL(0) && output[3] == INT_VAL(1) && output[4] == INT_VAL(2));
+
+    // Test 6: lets in blocks are SSA values; loops whose values are dead
+    // by the time the next starts share a slot
+    run_source("{ let i = 0; while (i < 3) { i = i * 2 + 1; } yap(i);"
+               "  let j = 0; while (j < 4) { j = j * 2 + 1; } yap(j); }");
+    assert(output[0] == INT_VAL(3) && output[1] == INT_VAL(7));
+    assert(ir_stats.regions == 1 && ir_stats.slots == 1 && local_count == 1);
+
+    // Test 7: function bodies get regions when first called (f recurses,
+    // so it is not inlined); locals are written back before the return
+    run_source("fn f(n) { if (n < 0) { return f(0 - n); }"
+               "  let c = 0; let j = 0; while (j < n) { if (j % 2 == 0) { c = c + j; } j = j + 1; } return c + j; }"
+               "yap(f(10)); yap(f(0 - 3));");
+    assert(output[0] == INT_VAL(30) && output[1] == INT_VAL(5));
+    assert(ir_stats.regions == 1);
+
+    // Test 8: calls of script functions are left to the tree walk, as are
+    // globals not yet defined by a top-level let
+    run_source("fn g(x) { return x; } let a = 0; while (a < 3) { a = g(a) + 1; } yap(a);");
+    assert(output[0] == INT_VAL(3) && ir_stats.regions == 0);
+
+    // Test 9: values crossing several blocks and arrays written in loops
+    run_source("let a = [0, 0, 0, 0]; let i = 0; let last = 0;"
+               "while (i < len(a)) { a[i] = i * i; if (i > 1) { last = a[i] + last; } else { last = 0 - 1; } i = i + 1; }"
+               "yap(a[3]); yap(last); yap(i);");
+    assert(output[0] == INT_VAL(9) && output[1] == INT_VAL(12) && output[2] == INT_VAL(4));
+
+    // Test 10: invariants of an inner loop move to its preheader, then out
+    // of the outer loop as well: n * 2 and d != 0 make two moves each,
+    // while 10 / d, which may fail, stays behind its test
+    run_source("let a = [2, 0]; let n = len(a); let d = a[1]; let t = 0; let i = 0;"
+               "while (i < 3) { let j = 0; while (j < 4) { t = t + n * 2; if (d != 0) { t = t + 10 / d; } j = j + 1; } i = i + 1; }"
+               "yap(t);");
+    assert(output_count == 1 && output[0] == INT_VAL(48));
+    assert(ir_stats.regions == 1 && ir_stats.hoisted == 4);
+
+    // Test 11: constant propagation is optimistic across the back edge:
+    // x stays 5 only if the arm that changes it never runs, and that arm
+    // runs only if x changes. x != 5, x's phi and x * 2 become constants,
+    // the branch is decided, and the division by zero is never compiled
+    run_source("let x = 5; let z = 0; let n = [4][0]; let i = 0;"
+               "while (i < n) { if (x != 5) { x = 0; yap(10 / z); } i = i + 1; } yap(x * 2);");
+    assert(output_count == 1 && output[0] == INT_VAL(10));
+    assert(ir_stats.constants == 4 && ir_stats.branches == 1 && ir_stats.phis == 3);
+    // Branches on a constant phi are decided before the phi is replaced
+    run_source("let x = 1; let i = 0; while (i < 3) { if (i) { x = 1; } else { x = 1; }"
+               "  if (x) { i = i + 1; } else { i = i + 2; } } yap(i);");
+    assert(output_count == 1 && output[0] == INT_VAL(3));
+    run_source("let x = 1; let i = 0; while (i < 3) { if (x) { yap(i); } x = 1; i = i + 1; }");
+    assert(output_count == 3 && output[0] == INT_VAL(0) && output[2] == INT_VAL(2));
+
+    // Test 12: value numbering shares a * b between the condition and both
+    // arms (b * a is the same product), but not reads of an array across
+    // a write to it
+    run_source("let v = [3, 4]; let a = v[0]; let b = v[1]; let i = 0; let s = 0;"
+               "while (i < 3) { if (a * b + i > 13) { s = s + b * a; } else { s = s - a * b; } i = i + 1; } yap(s);"
+               "let w = [1]; let x = w[0] + 1; w[0] = 5; let y = w[0] + 1; yap(x); yap(y);");
+    assert(output_count == 3 && output[0] == INT_VAL(-12));
+    assert(output[1] == INT_VAL(2) && output[2] == INT_VAL(6));
+    assert(ir_stats.regions == 1 && ir_stats.redundant == 2);
+
+    // Test 13: counted loops become the closed forms of their sums, checked
+    // for integer inputs on entry; a float bound runs the loop instead,
+    // bigints come out exact, and a loop that prints is left alone
+    run_source("let n = [100][0]; let i = 0; let s = 0; let q = 0; while (i < n) { s = s + i; q = q + i * i; i = i + 1; }"
+               "yap(s); yap(q); yap(i);");
+    assert(output_count == 3 && output[0] == INT_VAL(4950));
+    assert(output[1] == INT_VAL(328350) && output[2] == INT_VAL(100));
+    assert(ir_stats.regions == 1 && ir_stats.closed == 1);
+    run_source("let n = [10][0]; let i = n; let s = 0; while (i >= 0) { s = s + i * 3 - 1; i = i - 3; } yap(s); yap(i);"
+               "let m = [2.5][0]; let j = 0; let t = 0; while (j < m) { t = t + j; j = j + 1; } yap(t); yap(j);");
+    assert(output_count == 4 && output[0] == INT_VAL(62) && output[1] == INT_VAL(-2));
+    assert(output[2] == INT_VAL(3) && output[3] == INT_VAL(3));
+    assert(ir_stats.closed == 2);
+    run_source("let n = [4000000000][0]; let i = 0; let s = 0; while (i < n) { s = s + i; i = i + 1; }"
+               "yap(s - 7999999998000000000); yap(i);");
+    assert(output_count == 2 && output[0] == INT_VAL(0) && output[1] == INT_VAL(4000000000));
+    assert(ir_stats.closed == 1);
+    run_source("let i = 0; let s = 0; while (i < 3) { s = s + i; yap(s); i = i + 1; }");
+    assert(output_count == 3 && output[2] == INT_VAL(3) && ir_stats.closed == 0);
+
+    printf("✅ All IR tests passed!\n");
+    return 0;
+}
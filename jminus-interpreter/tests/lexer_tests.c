@@ -51,6 +51,85 @@ int main(void) {
     }
 
     free_tokens(tokens, count);
+
+    // Numbers with a fraction or exponent are floats
+    const char* numbers = "1.5 2e3 4.25E-2 7 true false";
+    tokens = tokenize(numbers, &count);
+    TokenType number_types[] = {
+        TOKEN_FLOAT, TOKEN_FLOAT, TOKEN_FLOAT, TOKEN_INT, TOKEN_TRUE, TOKEN_FALSE, TOKEN_EOF
+    };
+    assert(count == 7 && "number token count mismatch");
+    for (int i = 0; i < count; i++) {
+        assert(tokens[i].type == number_types[i] && "number token type mismatch");
+    }
+    assert(strcmp(tokens[2].lexeme, "4.25E-2") == 0 && "float lexeme mismatch");
+    free_tokens(tokens, count);
+
+    // Brackets for array literals and indexing
+    tokens = tokenize("a[0] = [1];", &count);
+    TokenType bracket_types[] = {
+        TOKEN_IDENTIFIER, TOKEN_LBRACKET, TOKEN_INT, TOKEN_RBRACKET, TOKEN_ASSIGN,
+        TOKEN_LBRACKET, TOKEN_INT, TOKEN_RBRACKET, TOKEN_SEMICOLON, TOKEN_EOF
+    };
+    assert(count == 10 && "bracket token count mismatch");
+    for (int i = 0; i < count; i++) {
+        assert(tokens[i].type == bracket_types[i] && "bracket token type mismatch");
+    }
+    free_tokens(tokens, count);
+
+    // Strings: the lexeme is the unescaped text, and lines inside count
+    tokens = tokenize("yap(\"a \\\"b\\\"\\n\\\\\" + \"x\ny\");\nz", &count);
+    TokenType string_types[] = {
+        TOKEN_YAP, TOKEN_LPAREN, TOKEN_STRING, TOKEN_PLUS, TOKEN_STRING,
+        TOKEN_RPAREN, TOKEN_SEMICOLON, TOKEN_IDENTIFIER, TOKEN_EOF
+    };
+    assert(count == 9 && "string token count mismatch");
+    for (int i = 0; i < count; i++) {
+        assert(tokens[i].type == string_types[i] && "string token type mismatch");
+    }
+    assert(strcmp(tokens[2].lexeme, "a \"b\"\n\\") == 0 && "string escapes mismatch");
+    assert(strcmp(tokens[4].lexeme, "x\ny") == 0 && "multi-line string mismatch");
+    assert(tokens[7].line == 3 && "line count after string mismatch");
+    free_tokens(tokens, count);
+
+    // Dots and colons for record literals and field access
+    tokens = tokenize("p.x = {x: 1.5};", &count);
+    TokenType record_types[] = {
+        TOKEN_IDENTIFIER, TOKEN_DOT, TOKEN_IDENTIFIER, TOKEN_ASSIGN, TOKEN_LBRACE,
+        TOKEN_IDENTIFIER, TOKEN_COLON, TOKEN_FLOAT, TOKEN_RBRACE, TOKEN_SEMICOLON, TOKEN_EOF
+    };
+    assert(count == 11 && "record token count mismatch");
+    for (int i = 0; i < count; i++) {
+        assert(tokens[i].type == record_types[i] && "record token type mismatch");
+    }
+    free_tokens(tokens, count);
+
+    // Remainder, bitwise and shift operators; << and >> are single tokens
+    tokens = tokenize("a % b & c | d ^ e << 2 >> 1 <= 3", &count);
+    TokenType bitwise_types[] = {
+        TOKEN_IDENTIFIER, TOKEN_PERCENT, TOKEN_IDENTIFIER, TOKEN_AMP, TOKEN_IDENTIFIER,
+        TOKEN_PIPE, TOKEN_IDENTIFIER, TOKEN_CARET, TOKEN_IDENTIFIER, TOKEN_LESS_LESS,
+        TOKEN_INT, TOKEN_GREATER_GREATER, TOKEN_INT, TOKEN_LESS_EQUAL, TOKEN_INT, TOKEN_EOF
+    };
+    assert(count == 16 && "bitwise token count mismatch");
+    for (int i = 0; i < count; i++) {
+        assert(tokens[i].type == bitwise_types[i] && "bitwise token type mismatch");
+    }
+    free_tokens(tokens, count);
+
+    // Doubled & and | are the logical operators; ! stands alone before (
+    tokens = tokenize("!(a && b) || c & d | e != f", &count);
+    TokenType logical_types[] = {
+        TOKEN_BANG, TOKEN_LPAREN, TOKEN_IDENTIFIER, TOKEN_AMP_AMP, TOKEN_IDENTIFIER,
+        TOKEN_RPAREN, TOKEN_PIPE_PIPE, TOKEN_IDENTIFIER, TOKEN_AMP, TOKEN_IDENTIFIER,
+        TOKEN_PIPE, TOKEN_IDENTIFIER, TOKEN_BANG_EQUAL, TOKEN_IDENTIFIER, TOKEN_EOF
+    };
+    assert(count == 15 && "logical token count mismatch");
+    for (int i = 0; i < count; i++) {
+        assert(tokens[i].type == logical_types[i] && "logical token type mismatch");
+    }
+    free_tokens(tokens, count);
+
     printf("✅ lexer_tests passed\n");
     return 0;
 }
@@ -0,0 +1,104 @@
+// tests/map_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../value.h"
+#include "../object.h"
+#include "../map.h"
+#include "../str.h"
+
+#define KEYS 100000
+
+static Value string_key(const char* prefix, int n) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%s%d", prefix, n);
+    return OBJ_VAL(copy_string(text, length));
+}
+
+static void check_layout(ObjMap* map) {
+    int used = 0;
+    for (int i = 0; i < map->capacity; i++) {
+        if (map->control[i] == MAP_EMPTY) continue;
+        assert(map->control[i] == (hash_value(map->keys[i]) & 0x7F));
+        used++;
+    }
+    assert(used == map->count);
+    assert(map->count * 8 <= map->capacity * 7);
+}
+
+int main(void) {
+    // Equal keys hash alike, whatever their representation
+    assert(hash_value(INT_VAL(3)) == hash_value(double_value(3.0)));
+    assert(hash_value(double_value(0.0)) == hash_value(double_value(-0.0)));
+    Value big = add_values(INT_VAL(INT_VALUE_MAX), INT_VAL(INT_VALUE_MAX));
+    assert(hash_value(big) == hash_value(double_value(to_double(big))));
+    ObjString* flat = copy_string("a long key that is well past the intern limit", 45);
+    ObjString* rope = concat_strings(copy_string("a long key that is well past", 28),
+                                     copy_string(" the intern limit", 17));
+    assert(hash_value(OBJ_VAL(flat)) == hash_value(OBJ_VAL(rope)));
+
+    // An empty map finds nothing
+    ObjMap* map = new_map();
+    Value found;
+    assert(!map_find(map, INT_VAL(1), &found) && !map_contains(map, INT_VAL(1)));
+
+    // Ints, strings, doubles and booleans as keys; setting twice overwrites
+    map_set(map, INT_VAL(1), INT_VAL(10));
+    map_set(map, OBJ_VAL(copy_string("US", 2)), INT_VAL(7));
+    map_set(map, double_value(2.5), TRUE_VAL);
+    map_set(map, TRUE_VAL, INT_VAL(-1));
+    map_set(map, OBJ_VAL(flat), INT_VAL(99));
+    map_set(map, double_value(1.0), INT_VAL(11));
+    assert(map->count == 5);
+    assert(map_get(map, INT_VAL(1)) == INT_VAL(11));
+    assert(map_get(map, OBJ_VAL(concat_strings(copy_string("U", 1), copy_string("S", 1)))) == INT_VAL(7));
+    assert(map_get(map, double_value(2.5)) == TRUE_VAL);
+    assert(map_get(map, TRUE_VAL) == INT_VAL(-1));
+    assert(map_get(map, OBJ_VAL(rope)) == INT_VAL(99));
+    assert(!map_contains(map, INT_VAL(2)) && !map_contains(map, FALSE_VAL));
+
+    // NaN is not == to itself, so a NaN key never matches, not even the
+    // same value: every insert adds an entry and lookups find none
+    Value nan = double_value(0.0 / 0.0);
+    map_set(map, nan, INT_VAL(1));
+    map_set(map, nan, INT_VAL(2));
+    assert(map->count == 7 && !map_contains(map, nan));
+
+    // Arrays are keys by identity
+    ObjArray* a = new_array(0);
+    map_set(map, OBJ_VAL(a), INT_VAL(5));
+    assert(map_contains(map, OBJ_VAL(a)) && !map_contains(map, OBJ_VAL(new_array(0))));
+    check_layout(map);
+
+    // Growth keeps every entry, through many resizes
+    ObjMap* large = new_map();
+    for (int i = 0; i < KEYS; i++) map_set(large, string_key("k", i), INT_VAL(i));
+    for (int i = 0; i < KEYS; i += 2) map_set(large, INT_VAL(i), INT_VAL(-i));
+    assert(large->count == KEYS + KEYS / 2);
+    check_layout(large);
+    for (int i = 0; i < KEYS; i++) {
+        assert(map_get(large, string_key("k", i)) == INT_VAL(i));
+        assert(map_contains(large, INT_VAL(i)) == (i % 2 == 0));
+        assert(!map_contains(large, string_key("x", i)));
+    }
+
+    // Keys that share a group and h2 are told apart by comparing keys
+    ObjMap* crowded = new_map();
+    Value keys[12];
+    int placed = 0;
+    for (int i = 0; placed < 12; i++) {
+        Value key = INT_VAL(i);
+        if ((hash_value(key) & 0x7F) != (hash_value(INT_VAL(0)) & 0x7F)) continue;
+        keys[placed] = key;
+        map_set(crowded, key, INT_VAL(placed++));
+    }
+    assert(crowded->capacity == 16 && crowded->count == 12);
+    check_layout(crowded);
+    for (int i = 0; i < 12; i++) assert(map_get(crowded, keys[i]) == INT_VAL(i));
+
+    free_objects();
+    printf("✅ map_tests passed\n");
+    return 0;
+}
@@ -0,0 +1,158 @@
+// tests/native_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include "../native.h"
+#include "../array.h"
+#include "../str.h"
+#include "../value.h"
+
+#define MAX_OUTPUT 16
+
+static Value output[MAX_OUTPUT];
+static int output_count = 0;
+
+static void capture_output(Value value) {
+    assert(output_count < MAX_OUTPUT);
+    output[output_count++] = value;
+}
+
+static int count_opcode(Bytecode* bc, OpCode opcode) {
+    int count = 0;
+    for (int i = 0; i < bc->count; i++) {
+        if (bc->instructions[i].opcode == opcode) count++;
+    }
+    return count;
+}
+
+// ----------------------------
+// Natives
+// ----------------------------
+static int calls = 0;
+
+static Value native_price(Value* args) {
+    calls++;
+    return INT_VAL(AS_INT(args[0]) * 100 + 99);
+}
+
+static Value native_hash(Value* args) {
+    calls++;
+    uint64_t h = (uint64_t)AS_INT(args[0]) * 0x9E3779B97F4A7C15ULL;
+    return INT_VAL((int64_t)(h >> 40));
+}
+
+static Value native_sub(Value* args) {
+    return INT_VAL(AS_INT(args[0]) - AS_INT(args[1]));
+}
+
+static Value native_greet(Value* args) {
+    calls++;
+    (void)args;
+    return OBJ_VAL(copy_string("hello", 5));
+}
+
+static Value native_pair(Value* args) {
+    calls++;
+    ObjArray* array = new_array(2);
+    array_push(array, args[0]);
+    array_push(array, args[1]);
+    return OBJ_VAL(array);
+}
+
+static Value native_len(Value* args) {
+    (void)args;
+    return INT_VAL(-1);
+}
+
+// Compiles src, then runs it; the bytecode is returned for inspection
+static Bytecode* run_source(const char* src, Token** tokens, int* tcount, Stmt*** stmts, int* scount) {
+    *tokens = tokenize(src, tcount);
+    *stmts = parse(*tokens, *tcount, scount);
+    Bytecode* bc = compile(*stmts, *scount);
+    output_count = 0;
+    run(bc);
+    return bc;
+}
+
+static void release(Bytecode* bc, Token* tokens, int tcount, Stmt** stmts, int scount) {
+    free_bytecode(bc);
+    free_ast(stmts, scount);
+    free_tokens(tokens, tcount);
+}
+
+int main(void) {
+    vm_output = capture_output;
+    Token* tokens;
+    Stmt** stmts;
+    int tcount, scount;
+
+    int price = jm_register_native("price", native_price, 1, JM_NATIVE_PURE);
+    int hash = jm_register_native("hash", native_hash, 1, 0);
+    jm_register_native("sub", native_sub, 2, JM_NATIVE_PURE);
+    jm_register_native("greet", native_greet, 0, JM_NATIVE_PURE);
+    jm_register_native("pair", native_pair, 2, JM_NATIVE_PURE);
+    assert(price == 0 && hash == 1 && native_count == 5);
+    assert(find_native("hash") == hash && find_native("nope") == -1);
+
+    // Test 1: calls resolve to BC_CALL_NATIVE and see their arguments in order
+    calls = 0;
+    Bytecode* bc = run_source(
+        "let t = 0; let i = 0;"
+        "while (i < 100) { t = t + hash(i) - hash(i); i = i + 1; }"
+        "yap(t); yap(sub(i, 1));"
+        "fn total(n) { return price(n) + sub(n, 10); }"
+        "yap(total(i));",
+        &tokens, &tcount, &stmts, &scount);
+    assert(output[0] == INT_VAL(0));
+    assert(output[1] == INT_VAL(99));
+    assert(output[2] == INT_VAL(10099 + 90));
+    assert(calls == 200 + 1);
+    assert(count_opcode(bc, BC_CALL_NATIVE) == 5);  // total() is inlined
+    release(bc, tokens, tcount, stmts, scount);
+
+    // Test 2: pure natives with constant arguments run once, at compile
+    // time, unless their result is a mutable object
+    calls = 0;
+    bc = run_source(
+        "let i = 0; while (i < 10) { yap(price(3) + sub(10, 4)); i = i + 1; }"
+        "yap(greet()); let p = pair(1, 2); push(p, 3); yap(len(pair(1, 2)));",
+        &tokens, &tcount, &stmts, &scount);
+    assert(output[0] == INT_VAL(405) && output[9] == INT_VAL(405));
+    char buffer[32];
+    format_value(output[10], buffer, sizeof(buffer));
+    assert(strcmp(buffer, "hello") == 0);
+    assert(output[11] == INT_VAL(2));
+    assert(count_opcode(bc, BC_CALL_NATIVE) == 2);  // Both pair() calls
+    // price and greet run at compile time; pair does too, but its arrays
+    // are discarded and each call makes its own
+    assert(calls == 1 + 1 + 2 + 2);
+    release(bc, tokens, tcount, stmts, scount);
+
+    // Test 3: script functions shadow natives, and natives shadow builtins
+    jm_register_native("len", native_len, 1, 0);
+    bc = run_source(
+        "fn price(n) { return n; }"
+        "yap(price(5)); yap(len([1, 2, 3]));",
+        &tokens, &tcount, &stmts, &scount);
+    assert(output[0] == INT_VAL(5) && output[1] == INT_VAL(-1));
+    assert(count_opcode(bc, BC_CALL_BUILTIN) == 0);
+    release(bc, tokens, tcount, stmts, scount);
+
+    // Test 4: registering a name again replaces the native in place
+    assert(jm_register_native("hash", native_price, 1, 0) == hash);
+    bc = run_source("yap(hash(2));", &tokens, &tcount, &stmts, &scount);
+    assert(output[0] == INT_VAL(299));
+    release(bc, tokens, tcount, stmts, scount);
+
+    free_natives();
+    assert(native_count == 0 && find_native("price") == -1);
+
+    printf("✅ native_tests passed\n");
+    return 0;
+}
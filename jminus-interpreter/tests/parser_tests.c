@@ -64,9 +64,189 @@ static void test_yap_statement() {
     free_ast(stmts, stmt_count);
 }
 
+static void test_fn_statement() {
+    const char* src = "fn add(a, b) { if (a) { return a + b; } return b; } add(1, 2);";
+    int token_count;
+    Token* tokens = tokenize(src, &token_count);
+
+    int stmt_count;
+    Stmt** stmts = parse(tokens, token_count, &stmt_count);
+    assert(stmt_count == 2);
+
+    Stmt* s = stmts[0];
+    assert(s->type == STMT_FN);
+    assert(strcmp(s->fn.name.lexeme, "add") == 0);
+    assert(s->fn.param_count == 2);
+    assert(strcmp(s->fn.params[1].lexeme, "b") == 0);
+
+    // The body is only brace-matched until it is first needed
+    assert(s->fn.body == NULL);
+    assert(s->fn.tokens[s->fn.body_start].type == TOKEN_IF);
+    assert(s->fn.tokens[s->fn.body_end].type == TOKEN_RBRACE);
+    assert(s->fn.tokens[s->fn.body_end + 1].type == TOKEN_IDENTIFIER);
+
+    Stmt* body = parse_function_body(&s->fn);
+    assert(body == s->fn.body);
+    assert(body->type == STMT_BLOCK);
+    assert(body->block.count == 2);
+    assert(body->block.statements[0]->type == STMT_IF);
+    assert(body->block.statements[1]->type == STMT_RETURN);
+    assert(parse_function_body(&s->fn) == body);
+
+    // add(1, 2) is an expression statement wrapping a call
+    Expr* call = stmts[1]->expr.expression;
+    assert(call->type == EXPR_CALL);
+    assert(strcmp(call->call.callee->variable.name.lexeme, "add") == 0);
+    assert(call->call.arg_count == 2);
+    assert(atoi(call->call.args[1]->literal.value.lexeme) == 2);
+
+    free_tokens(tokens, token_count);
+    free_ast(stmts, stmt_count);
+}
+
+static void test_array_expressions(void) {
+    const char* src = "let a = [1, [2], 3]; a[1][0] = a[2];";
+    int token_count = 0;
+    Token* tokens = tokenize(src, &token_count);
+    int stmt_count = 0;
+    Stmt** stmts = parse(tokens, token_count, &stmt_count);
+    assert(stmt_count == 2);
+
+    Expr* array = stmts[0]->let.initializer;
+    assert(array->type == EXPR_ARRAY);
+    assert(array->array.count == 3);
+    assert(array->array.elements[1]->type == EXPR_ARRAY);
+    assert(array->array.elements[1]->array.count == 1);
+
+    // Index suffixes chain left to right: (a[1])[0]
+    Expr* assign = stmts[1]->expr.expression;
+    assert(assign->type == EXPR_BINARY);
+    assert(strcmp(assign->binary.op.lexeme, "=") == 0);
+    Expr* target = assign->binary.left;
+    assert(target->type == EXPR_INDEX);
+    assert(target->index.object->type == EXPR_INDEX);
+    assert(target->index.object->index.object->type == EXPR_VARIABLE);
+    assert(assign->binary.right->type == EXPR_INDEX);
+
+    free_tokens(tokens, token_count);
+    free_ast(stmts, stmt_count);
+}
+
+static void test_string_literal(void) {
+    const char* src = "let s = \"ab\" + x;";
+    int token_count = 0;
+    Token* tokens = tokenize(src, &token_count);
+    int stmt_count = 0;
+    Stmt** stmts = parse(tokens, token_count, &stmt_count);
+    assert(stmt_count == 1);
+
+    Expr* sum = stmts[0]->let.initializer;
+    assert(sum->type == EXPR_BINARY);
+    Expr* literal = sum->binary.left;
+    assert(literal->type == EXPR_LITERAL);
+    assert(literal->literal.value.type == TOKEN_STRING);
+    assert(strcmp(literal->literal.value.lexeme, "ab") == 0);
+
+    free_tokens(tokens, token_count);
+    free_ast(stmts, stmt_count);
+}
+
+static void test_records(void) {
+    const char* src = "let p = {x: 1, y: a[0]}; p.y.z = p.x;";
+    int token_count = 0;
+    Token* tokens = tokenize(src, &token_count);
+    int stmt_count = 0;
+    Stmt** stmts = parse(tokens, token_count, &stmt_count);
+    assert(stmt_count == 2);
+
+    Expr* record = stmts[0]->let.initializer;
+    assert(record->type == EXPR_RECORD);
+    assert(record->record.count == 2);
+    assert(strcmp(record->record.names[1].lexeme, "y") == 0);
+    assert(record->record.values[1]->type == EXPR_INDEX);
+
+    // Field suffixes chain left to right, and a field is an assignment target
+    Expr* assign = stmts[1]->expr.expression;
+    assert(assign->type == EXPR_BINARY);
+    Expr* target = assign->binary.left;
+    assert(target->type == EXPR_FIELD && strcmp(target->field.name.lexeme, "z") == 0);
+    assert(target->field.object->type == EXPR_FIELD);
+    assert(strcmp(target->field.object->field.name.lexeme, "y") == 0);
+    assert(assign->binary.right->type == EXPR_FIELD);
+
+    free_tokens(tokens, token_count);
+    free_ast(stmts, stmt_count);
+}
+
+static void test_bitwise_precedence(void) {
+    // (a | (b ^ (c & (d << (1 + 2 % 3))))) == 0: unlike C, bitwise
+    // operators bind tighter than comparisons
+    const char* src = "a | b ^ c & d << 1 + 2 % 3 == 0;";
+    int token_count = 0;
+    Token* tokens = tokenize(src, &token_count);
+    int stmt_count = 0;
+    Stmt** stmts = parse(tokens, token_count, &stmt_count);
+    assert(stmt_count == 1);
+
+    Expr* equality = stmts[0]->expr.expression;
+    assert(equality->type == EXPR_BINARY && strcmp(equality->binary.op.lexeme, "==") == 0);
+    Expr* or = equality->binary.left;
+    assert(strcmp(or->binary.op.lexeme, "|") == 0);
+    Expr* xor = or->binary.right;
+    assert(strcmp(xor->binary.op.lexeme, "^") == 0);
+    Expr* and = xor->binary.right;
+    assert(strcmp(and->binary.op.lexeme, "&") == 0);
+    Expr* shift = and->binary.right;
+    assert(strcmp(shift->binary.op.lexeme, "<<") == 0);
+    Expr* sum = shift->binary.right;
+    assert(strcmp(sum->binary.op.lexeme, "+") == 0);
+    assert(strcmp(sum->binary.right->binary.op.lexeme, "%") == 0);
+
+    free_tokens(tokens, token_count);
+    free_ast(stmts, stmt_count);
+}
+
+static void test_logical_precedence(void) {
+    // (a || ((b < 1) && (!c == d))) = ...: || binds loosest, ! tightest
+    const char* src = "x = a || b < 1 && !c == d;";
+    int token_count = 0;
+    Token* tokens = tokenize(src, &token_count);
+    int stmt_count = 0;
+    Stmt** stmts = parse(tokens, token_count, &stmt_count);
+    assert(stmt_count == 1);
+
+    Expr* assign = stmts[0]->expr.expression;
+    assert(strcmp(assign->binary.op.lexeme, "=") == 0);
+    Expr* or = assign->binary.right;
+    assert(or->type == EXPR_BINARY && strcmp(or->binary.op.lexeme, "||") == 0);
+    assert(or->binary.left->type == EXPR_VARIABLE);
+    Expr* and = or->binary.right;
+    assert(strcmp(and->binary.op.lexeme, "&&") == 0);
+    assert(strcmp(and->binary.left->binary.op.lexeme, "<") == 0);
+    Expr* equality = and->binary.right;
+    assert(strcmp(equality->binary.op.lexeme, "==") == 0);
+    Expr* not = equality->binary.left;
+    assert(not->type == EXPR_UNARY && not->unary.op.type == TOKEN_BANG);
+    assert(not->unary.operand->type == EXPR_VARIABLE);
+
+    // Clones are deep, so both trees free independently
+    Expr* copy = clone_expr(or);
+    assert(copy->binary.right->binary.right->binary.left->type == EXPR_UNARY);
+    free_expr(copy);
+
+    free_tokens(tokens, token_count);
+    free_ast(stmts, stmt_count);
+}
+
 int main(void) {
     test_let_statement();
     test_yap_statement();
+    test_fn_statement();
+    test_array_expressions();
+    test_string_literal();
+    test_records();
+    test_bitwise_precedence();
+    test_logical_precedence();
     printf("✅  parser_tests passed\n");
     return 0;
 }
@@ -0,0 +1,57 @@
+// tests/record_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "../value.h"
+#include "../object.h"
+#include "../record.h"
+#include "../str.h"
+
+int main(void) {
+    ObjString* x = intern_name("x");
+    ObjString* y = intern_name("y");
+
+    // Adding the same fields in the same order reaches the same shape
+    ObjShape* root = root_shape();
+    assert(root->field_count == 0 && root_shape() == root);
+    ObjShape* xy = shape_add_field(shape_add_field(root, x), y);
+    assert(xy->field_count == 2);
+    assert(shape_add_field(shape_add_field(root_shape(), intern_name("x")), intern_name("y")) == xy);
+    ObjShape* yx = shape_add_field(shape_add_field(root, y), x);
+    assert(yx != xy);
+    assert(root->transition_count == 2);
+
+    // Offsets follow the order the fields were added in
+    assert(shape_field_offset(xy, x) == 0 && shape_field_offset(xy, y) == 1);
+    assert(shape_field_offset(yx, x) == 1 && shape_field_offset(yx, y) == 0);
+    assert(shape_field_offset(xy, intern_name("z")) == -1);
+
+    // Fields are stored inline at their offsets
+    ObjRecord* record = new_record(yx);
+    record->fields[0] = INT_VAL(2);
+    record->fields[1] = INT_VAL(1);
+    Value value = OBJ_VAL(record);
+    assert(is_record(value) && !is_record(INT_VAL(1)));
+    assert(record_get(value, x) == INT_VAL(1));
+    record_set(value, y, double_value(0.5));
+    assert(record->fields[0] == double_value(0.5));
+
+    // Many shapes branch off one parent
+    for (int i = 0; i < 100; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%d", i);
+        ObjShape* shape = shape_add_field(xy, intern_name(name));
+        assert(shape->field_count == 3 && shape->fields[2] == intern_name(name));
+        assert(shape_field_offset(shape, y) == 1);
+    }
+    assert(xy->transition_count == 100);
+
+    free_objects();
+
+    // The shape tree starts over once the objects are freed
+    assert(root_shape()->transition_count == 0);
+    free_objects();
+    printf("✅ record_tests passed\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+// tests/simd_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../value.h"
+#include "../object.h"
+#include "../array.h"
+#include "../simd.h"
+
+static uint64_t seed = 12345;
+
+static int64_t random_int(int64_t low, int64_t high) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return low + (int64_t)((seed >> 11) % (uint64_t)(high - low + 1));
+}
+
+static ObjArray* random_array(int count, int64_t low, int64_t high) {
+    ObjArray* array = new_array(count);
+    for (int i = 0; i < count; i++) array->items[i] = INT_VAL(random_int(low, high));
+    array->count = count;
+    return array;
+}
+
+// The equivalent jminus loops, one element at a time
+static Value reference_sum(ObjArray* array) {
+    Value total = INT_VAL(0);
+    for (int i = 0; i < array->count; i++) total = add_values(total, array->items[i]);
+    return total;
+}
+
+static Value reference_extreme(ObjArray* array, int want_max) {
+    Value best = array->items[0];
+    for (int i = 1; i < array->count; i++) {
+        if (compare_values(array->items[i], best) == (want_max ? 1 : -1)) best = array->items[i];
+    }
+    return best;
+}
+
+static Value reference_dot(ObjArray* a, ObjArray* b) {
+    Value total = INT_VAL(0);
+    for (int i = 0; i < a->count; i++) total = add_values(total, multiply_values(a->items[i], b->items[i]));
+    return total;
+}
+
+static void assert_same(Value actual, Value expected, const char* what) {
+    if (!values_equal(actual, expected)) {
+        char got[64], want[64];
+        format_value(actual, got, sizeof(got));
+        format_value(expected, want, sizeof(want));
+        fprintf(stderr, "❌ simd (%s): %s gave %s, expected %s\n", simd_kernels()->name, what, got, want);
+        assert(0);
+    }
+}
+
+static void check_map(ObjArray* result, ObjArray* source, Value constant, Value (*op)(Value, Value), const char* what) {
+    assert(result->count == source->count);
+    for (int i = 0; i < source->count; i++) {
+        assert_same(result->items[i], op(source->items[i], constant), what);
+    }
+}
+
+static void check_all(ObjArray* a, ObjArray* b) {
+    assert_same(array_sum(a), reference_sum(a), "sum");
+    if (a->count > 0) {
+        assert_same(array_min(a), reference_extreme(a, 0), "min");
+        assert_same(array_max(a), reference_extreme(a, 1), "max");
+    }
+    assert_same(array_dot(a, b), reference_dot(a, b), "dot");
+    Value constants[] = { INT_VAL(-3), INT_VAL(0x7FFFFFFF), INT_VAL(1LL << 31), double_value(0.5) };
+    for (int i = 0; i < 4; i++) {
+        check_map(array_scale(a, constants[i]), a, constants[i], multiply_values, "scale");
+        check_map(array_add(a, constants[i]), a, constants[i], add_values, "add");
+    }
+}
+
+int main(void) {
+    SimdLevel best = simd_best_level();
+    for (int level = SIMD_SCALAR; level <= (int)best; level++) {
+        assert(simd_select((SimdLevel)level) == (SimdLevel)level);
+
+        // Lengths around the lane counts and the block size
+        int lengths[] = { 0, 1, 2, 3, 5, 8, 4095, 4096, 4097, 10001 };
+        for (int i = 0; i < 10; i++) {
+            ObjArray* a = random_array(lengths[i], -1000000, 1000000);
+            ObjArray* b = random_array(lengths[i], -1000000, 1000000);
+            check_all(a, b);
+
+            // Blocks of small ints stay on the fast path
+            const SimdKernels* kernels = simd_kernels();
+            int block = lengths[i] < SIMD_BLOCK ? lengths[i] : SIMD_BLOCK;
+            int64_t partial;
+            Value extreme, out[SIMD_BLOCK];
+            assert(kernels->sum(a->items, block, &partial));
+            assert(kernels->dot(a->items, b->items, block, &partial));
+            assert(kernels->scale(a->items, block, -7, out));
+            assert(kernels->add(a->items, block, 7, out));
+            assert(block == 0 || kernels->min(a->items, block, &extreme));
+            assert(block == 0 || kernels->max(a->items, block, &extreme));
+        }
+
+        // The edges of the fast-path ranges, and just past them
+        int64_t edges[] = {
+            (1LL << 31) - 1, -(1LL << 31) + 1, 1LL << 31, -(1LL << 31),
+            (1LL << 24) - 1, -(1LL << 24) + 1, 1LL << 24, -(1LL << 24),
+            INT_VALUE_MAX, INT_VALUE_MIN, 0, -1
+        };
+        for (int i = 0; i < 12; i++) {
+            ObjArray* a = random_array(4100, -5, 5);
+            ObjArray* b = random_array(4100, -5, 5);
+            a->items[4099 - i * 300] = INT_VAL(edges[i]);
+            b->items[i * 300] = INT_VAL(edges[i]);
+            check_all(a, b);
+            check_all(b, a);
+        }
+
+        // Whole blocks of big ints overflow 64 bits and continue as bigints
+        ObjArray* big = random_array(9000, INT_VALUE_MAX - 10, INT_VALUE_MAX);
+        check_all(big, big);
+        assert(is_bigint(array_sum(big)));
+
+        // Doubles and bigints take the generic path for their block only
+        ObjArray* mixed = random_array(9000, 0, 100);
+        mixed->items[5000] = double_value(0.25);
+        mixed->items[8999] = add_values(INT_VAL(INT_VALUE_MAX), INT_VAL(1));
+        check_all(mixed, random_array(9000, 0, 100));
+    }
+
+    simd_select(best);
+    ObjArray* ones = random_array(100000, 1, 1);
+    assert(array_sum(ones) == INT_VAL(100000));
+
+    free_objects();
+    printf("✅ simd_tests passed (levels up to %s)\n", simd_kernels()->name);
+    return 0;
+}
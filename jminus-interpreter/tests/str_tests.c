@@ -0,0 +1,95 @@
+// tests/str_tests.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../value.h"
+#include "../object.h"
+#include "../str.h"
+
+#define APPENDS 100000
+
+// Reads back everything written to a temporary file
+static char* read_back(FILE* file, long* length) {
+    *length = ftell(file);
+    rewind(file);
+    char* text = malloc(*length + 1);
+    assert(fread(text, 1, *length, file) == (size_t)*length);
+    text[*length] = '\0';
+    return text;
+}
+
+int main(void) {
+    // Short strings are interned: one object per text
+    ObjString* a = copy_string("hello", 5);
+    assert(a == copy_string("hello", 5));
+    assert(a == intern_name("hello"));
+    assert(a->interned && a != copy_string("hellO", 5));
+    assert(concat_strings(copy_string("hel", 3), copy_string("lo", 2)) == a);
+
+    // Identifiers are interned whatever their length; long texts are not
+    char name[STRING_INTERN_MAX * 2];
+    memset(name, 'n', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    assert(intern_name(name) == intern_name(name));
+    ObjString* long_copy = copy_string(name, (int)strlen(name));
+    assert(!long_copy->interned && long_copy != copy_string(name, (int)strlen(name)));
+    assert(strings_equal(long_copy, intern_name(name)));
+
+    // Hashes are computed once and cached
+    ObjString* text = copy_string(name, (int)strlen(name) - 1);
+    assert(text->hash == 0);
+    uint32_t hash = string_hash(text);
+    assert(hash != 0 && text->hash == hash && string_hash(text) == hash);
+
+    // Appending in a loop builds ropes without copying
+    ObjString* piece = copy_string("ab", 2);
+    ObjString* rope = copy_string("", 0);
+    for (int i = 0; i < APPENDS; i++) rope = concat_strings(rope, piece);
+    assert(rope->length == 2 * APPENDS && rope->chars == NULL);
+
+    // Printing streams the pieces and leaves the rope as it was
+    FILE* out = tmpfile();
+    assert(out);
+    print_string(rope, out);
+    assert(rope->chars == NULL);
+    long length;
+    char* printed = read_back(out, &length);
+    fclose(out);
+    assert(length == 2 * APPENDS);
+    for (long i = 0; i < length; i++) assert(printed[i] == "ab"[i % 2]);
+
+    // The first read flattens it once
+    const char* flat = string_chars(rope);
+    assert(rope->chars == flat && rope->left == NULL && rope->right == NULL);
+    assert(memcmp(flat, printed, length) == 0 && flat[length] == '\0');
+    assert(string_chars(rope) == flat);
+    free(printed);
+
+    // Ropes of the same text compare equal however they were built
+    ObjString* other = copy_string("", 0);
+    for (int i = 0; i < APPENDS; i++) other = concat_strings(concat_strings(other, copy_string("a", 1)), copy_string("b", 1));
+    assert(other != rope && values_equal(OBJ_VAL(other), OBJ_VAL(rope)));
+    assert(!values_equal(OBJ_VAL(concat_strings(other, piece)), OBJ_VAL(rope)));
+
+    // Ropes can hold ropes on either side
+    ObjString* left = concat_strings(copy_string(name, 30), copy_string(name, 30));
+    ObjString* nested = concat_strings(copy_string("<", 1), concat_strings(left, copy_string(">", 1)));
+    assert(nested->length == 62 && nested->chars == NULL);
+    assert(string_chars(nested)[0] == '<' && string_chars(nested)[61] == '>');
+
+    // Concatenation through add_values converts the other operand
+    Value sum = add_values(OBJ_VAL(copy_string("n=", 2)), INT_VAL(42));
+    assert(IS_STRING_OBJ(sum) && AS_STRING_OBJ(sum) == copy_string("n=42", 4));
+    assert(AS_STRING_OBJ(add_values(double_value(0.5), OBJ_VAL(piece))) == copy_string("0.5ab", 5));
+
+    // Freeing every object empties the table too
+    free_objects();
+    ObjString* again = copy_string("hello", 5);
+    assert(again->interned && again == intern_name("hello"));
+    free_objects();
+
+    printf("✅ str_tests passed\n");
+    return 0;
+}
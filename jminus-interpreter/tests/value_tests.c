@@ -0,0 +1,72 @@
+// tests/value_tests.c
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "../value.h"
+#include "../object.h"
+
+static void assert_format(Value value, const char* expected) {
+    char text[64];
+    format_value(value, text, sizeof(text));
+    if (strcmp(text, expected) != 0) {
+        fprintf(stderr, "❌ format: got %s, expected %s\n", text, expected);
+        assert(0);
+    }
+}
+
+int main(void) {
+    // Integers use the full 63 bits
+    assert(IS_INT(INT_VAL(0)) && AS_INT(INT_VAL(0)) == 0);
+    assert(AS_INT(INT_VAL(-42)) == -42);
+    assert(AS_INT(INT_VAL(INT_VALUE_MAX)) == INT_VALUE_MAX);
+    assert(AS_INT(INT_VAL(INT_VALUE_MIN)) == INT_VALUE_MIN);
+    assert(!IS_INT(TRUE_VAL) && !IS_INT(FALSE_VAL));
+
+    // Doubles in the immediate range round-trip without allocating
+    double immediates[] = { 0.0, -0.0, 1.0, -1.5, 0.1, 3.14159, 1e-30, -2.5e30, 1e38 };
+    for (size_t i = 0; i < sizeof(immediates) / sizeof(immediates[0]); i++) {
+        Value value = double_value(immediates[i]);
+        assert(IS_IMMEDIATE_FLOAT(value) && "double should be immediate");
+        assert(!IS_INT(value) && !IS_OBJ(value) && !IS_BOOL(value));
+        assert(memcmp(&(double){ as_double(value) }, &immediates[i], sizeof(double)) == 0);
+    }
+
+    // Everything else is boxed but reads back the same
+    double boxed[] = { 1e300, -1e-300, 5e-324, INFINITY, -INFINITY };
+    for (size_t i = 0; i < sizeof(boxed) / sizeof(boxed[0]); i++) {
+        Value value = double_value(boxed[i]);
+        assert(IS_FLOAT_OBJ(value) && "double should be boxed");
+        assert(is_double(value) && as_double(value) == boxed[i]);
+    }
+    assert(isnan(as_double(double_value(NAN))));
+
+    // Int arithmetic overflowing 63 bits continues exactly (see bigint_tests)
+    Value big = add_values(INT_VAL(INT_VALUE_MAX), INT_VAL(1));
+    assert(is_integer(big) && !IS_INT(big) && to_double(big) == 4611686018427387904.0);
+    assert(IS_INT(multiply_values(INT_VAL(3037000499), INT_VAL(-3))));
+    assert(AS_INT(divide_values(INT_VAL(7), INT_VAL(2))) == 3);
+    assert(as_double(divide_values(INT_VAL(7), double_value(2.0))) == 3.5);
+
+    // Comparison and truthiness across representations
+    assert(values_equal(INT_VAL(2), double_value(2.0)));
+    assert(!values_equal(INT_VAL(1), TRUE_VAL));
+    assert(!values_equal(double_value(NAN), double_value(NAN)));
+    assert(compare_values(INT_VAL(-3), double_value(-2.5)) == -1);
+    assert(compare_values(double_value(NAN), INT_VAL(0)) == 2);
+    assert(!is_truthy(INT_VAL(0)) && !is_truthy(double_value(-0.0)) && !is_truthy(FALSE_VAL));
+    assert(is_truthy(double_value(0.5)) && is_truthy(TRUE_VAL) && is_truthy(INT_VAL(-1)));
+
+    // Shortest round-trip formatting
+    assert_format(INT_VAL(-7), "-7");
+    assert_format(double_value(0.1), "0.1");
+    assert_format(double_value(2.0), "2.0");
+    assert_format(add_values(double_value(0.1), double_value(0.2)), "0.30000000000000004");
+    assert_format(double_value(1e300), "1e+300");
+    assert_format(TRUE_VAL, "true");
+
+    free_objects();
+    printf("✅ value_tests passed\n");
+    return 0;
+}
@@ -2,19 +2,41 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include "../lexer.h"
+#include "../parser.h"
 #include "../compiler.h"
 #include "../vm.h"
+#include "../str.h"
+#include "../allocator.h"
 
-static int test_output[32];
+static Value test_output[32];
 static int test_output_count = 0;
 
-void test_vm_output(int value) {
+void test_vm_output(Value value) {
     test_output[test_output_count++] = value;
 }
 
-static void assert_int(int actual, int expected, const char* msg) {
+static void assert_int(long long actual, long long expected, const char* msg) {
     if (actual != expected) {
-        fprintf(stderr, "❌ Assertion failed: %s (got %d, expected %d)\n", msg, actual, expected);
+        fprintf(stderr, "❌ Assertion failed: %s (got %lld, expected %lld)\n", msg, actual, expected);
+        exit(1);
+    }
+}
+
+static void assert_value(Value actual, const char* expected, const char* msg) {
+    char text[64];
+    format_value(actual, text, sizeof(text));
+    if (strcmp(text, expected) != 0) {
+        fprintf(stderr, "❌ Assertion failed: %s (got %s, expected %s)\n", msg, text, expected);
+        exit(1);
+    }
+}
+
+static void assert_int_value(Value actual, long long expected, const char* msg) {
+    if (!IS_INT(actual) || AS_INT(actual) != expected) {
+        char text[64];
+        format_value(actual, text, sizeof(text));
+        fprintf(stderr, "❌ Assertion failed: %s (got %s, expected %lld)\n", msg, text, expected);
         exit(1);
     }
 }
@@ -30,15 +52,15 @@ int main(void) {
     // Test 1: Arithmetic and print
     {
         test_output_count = 0;
-        Bytecode* bc = malloc(sizeof(Bytecode));
-        bc->instructions = malloc(sizeof(Instruction) * 5);
-        bc->constants = malloc(sizeof(int) * 2);
+        Bytecode* bc = jm_calloc(1, sizeof(Bytecode));
+        bc->instructions = jm_alloc(sizeof(Instruction) * 5);
+        bc->constants = jm_alloc(sizeof(Value) * 2);
         bc->capacity = 5;
         bc->const_capacity = 2;
         bc->count = 0;
         bc->const_count = 0;
-        bc->constants[0] = 7;
-        bc->constants[1] = 3;
+        bc->constants[0] = INT_VAL(7);
+        bc->constants[1] = INT_VAL(3);
         bc->instructions[0] = (Instruction){BC_CONST, 0}; // push 7
         bc->instructions[1] = (Instruction){BC_CONST, 1}; // push 3
         bc->instructions[2] = (Instruction){BC_ADD, 0};   // add
@@ -48,7 +70,7 @@ int main(void) {
         bc->const_count = 2;
         run(bc);
         assert_int(test_output_count, 1, "arithmetic: should print once");
-        assert_int(test_output[0], 10, "arithmetic: 7+3 should print 10");
+        assert_int_value(test_output[0], 10, "arithmetic: 7+3 should print 10");
         print_pass("arithmetic and print");
         free_bytecode(bc);
     }
@@ -56,27 +78,28 @@ int main(void) {
     // Test 2: Variable definition and assignment
     {
         test_output_count = 0;
-        Bytecode* bc = malloc(sizeof(Bytecode));
-        bc->instructions = malloc(sizeof(Instruction) * 8);
-        bc->constants = malloc(sizeof(int) * 2);
+        Bytecode* bc = jm_calloc(1, sizeof(Bytecode));
+        bc->instructions = jm_alloc(sizeof(Instruction) * 8);
+        bc->constants = jm_alloc(sizeof(Value) * 3);
         bc->capacity = 8;
-        bc->const_capacity = 2;
+        bc->const_capacity = 3;
         bc->count = 0;
         bc->const_count = 0;
-        bc->constants[0] = 5;
-        bc->constants[1] = 9;
+        bc->constants[0] = INT_VAL(5);
+        bc->constants[1] = INT_VAL(9);
+        bc->constants[2] = OBJ_VAL(intern_name("x"));
         bc->instructions[0] = (Instruction){BC_CONST, 0}; // push 5
-        bc->instructions[1] = (Instruction){BC_DEFINE_VAR, 'x'}; // let x = 5
+        bc->instructions[1] = (Instruction){BC_DEFINE_VAR, 2}; // let x = 5
         bc->instructions[2] = (Instruction){BC_CONST, 1}; // push 9
-        bc->instructions[3] = (Instruction){BC_SET_VAR, 'x'}; // x = 9
-        bc->instructions[4] = (Instruction){BC_LOAD_VAR, 'x'}; // load x
+        bc->instructions[3] = (Instruction){BC_SET_VAR, 2}; // x = 9
+        bc->instructions[4] = (Instruction){BC_LOAD_VAR, 2}; // load x
         bc->instructions[5] = (Instruction){BC_PRINT, 0}; // print x
         bc->instructions[6] = (Instruction){BC_HALT, 0};
         bc->count = 7;
-        bc->const_count = 2;
+        bc->const_count = 3;
         run(bc);
         assert_int(test_output_count, 1, "var: should print once");
-        assert_int(test_output[0], 9, "var: x should be 9 after assignment");
+        assert_int_value(test_output[0], 9, "var: x should be 9 after assignment");
         print_pass("variable define/assign");
         free_bytecode(bc);
     }
@@ -84,15 +107,15 @@ int main(void) {
     // Test 3: If-statement (simulated)
     {
         test_output_count = 0;
-        Bytecode* bc = malloc(sizeof(Bytecode));
-        bc->instructions = malloc(sizeof(Instruction) * 8);
-        bc->constants = malloc(sizeof(int) * 2);
+        Bytecode* bc = jm_calloc(1, sizeof(Bytecode));
+        bc->instructions = jm_alloc(sizeof(Instruction) * 8);
+        bc->constants = jm_alloc(sizeof(Value) * 2);
         bc->capacity = 8;
         bc->const_capacity = 2;
         bc->count = 0;
         bc->const_count = 0;
-        bc->constants[0] = 1;
-        bc->constants[1] = 42;
+        bc->constants[0] = INT_VAL(1);
+        bc->constants[1] = INT_VAL(42);
         bc->instructions[0] = (Instruction){BC_CONST, 0}; // push 1 (true)
         bc->instructions[1] = (Instruction){BC_JUMP_IF_FALSE, 5}; // if false, jump to 5
         bc->instructions[2] = (Instruction){BC_CONST, 1}; // push 42
@@ -104,11 +127,556 @@ int main(void) {
         bc->const_count = 2;
         run(bc);
         assert_int(test_output_count, 1, "if: should print once");
-        assert_int(test_output[0], 42, "if: should print 42");
+        assert_int_value(test_output[0], 42, "if: should print 42");
         print_pass("if-statement (true branch)");
         free_bytecode(bc);
     }
 
+    // Test 4: Recursive function calls on the frame stack
+    {
+        test_output_count = 0;
+        const char* src =
+            "fn fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }"
+            "yap(fib(30));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 1, "fib: should print once");
+        assert_int_value(test_output[0], 832040, "fib: fib(30) should be 832040");
+        print_pass("recursive fib(30)");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 5: Locals, multiple arguments and implicit return
+    {
+        test_output_count = 0;
+        const char* src =
+            "let g = 100;"
+            "fn mix(a, b) { let t = a * 10; t = t + b; return t + g; }"
+            "fn nothing() { let z = 1; }"
+            "yap(mix(3, 4)); yap(nothing()); mix(1, 1); yap(g);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 3, "locals: should print three times");
+        assert_int_value(test_output[0], 134, "locals: mix(3, 4) should be 134");
+        assert_int_value(test_output[1], 0, "locals: missing return should yield 0");
+        assert_int_value(test_output[2], 100, "locals: global must be untouched");
+        print_pass("function locals and arguments");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 6: Tail calls run in constant stack space
+    {
+        test_output_count = 0;
+        const char* src =
+            "fn count(n, acc) { if (n == 0) { return acc; } return count(n - 1, acc + 1); }"
+            "fn even(n) { if (n == 0) { return 1; } return odd(n - 1); }"
+            "fn odd(n) { if (n == 0) { return 0; } return even(n - 1); }"
+            "yap(count(1000000, 0)); yap(even(100001));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 2, "tail: should print twice");
+        assert_int_value(test_output[0], 1000000, "tail: count should recurse 1000000 times");
+        assert_int_value(test_output[1], 0, "tail: 100001 is odd");
+        print_pass("tail calls in constant stack");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 7: Inlined helpers behave like calls
+    {
+        test_output_count = 0;
+        const char* src =
+            "fn min(a, b) { if (a < b) { return a; } return b; }"
+            "fn max(a, b) { if (a > b) { return a; } return b; }"
+            "fn clamp(v, lo, hi) { return max(lo, min(v, hi)); }"
+            "fn sq(x) { let y = x * x; return y; }"
+            "fn main(x) { let y = 1; return clamp(x, y, 10) + y; }"
+            "let i = 0 - 5; let s = 0;"
+            "while (i < 15) { s = s + clamp(i, 0 - 2, 3); i = i + 1; }"
+            "yap(s); yap(sq(sq(3))); yap(main(42)); yap(clamp(7, 0, 3));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 4, "inline: should print four times");
+        assert_int_value(test_output[0], 30, "inline: clamped sum should be 30");
+        assert_int_value(test_output[1], 81, "inline: sq(sq(3)) should be 81");
+        assert_int_value(test_output[2], 11, "inline: caller locals must not leak into inlined body");
+        assert_int_value(test_output[3], 3, "inline: clamp(7, 0, 3) should be 3");
+        print_pass("inlined functions");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 8: Large library, few functions used
+    {
+        test_output_count = 0;
+        // 300 recursive rules of ~20 tokens each (over 6000 tokens in total)
+        char* src = malloc(64 * 1024);
+        int length = 0;
+        for (int i = 0; i < 300; i++) {
+            length += sprintf(src + length,
+                "fn rule%d(n) { if (n < 1) { return %d; } return rule%d(n - 1) + 1; }", i, i, i);
+        }
+        sprintf(src + length, "yap(rule7(3)); yap(rule299(0)); yap(rule7(1));");
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 3, "lazy: should print three times");
+        assert_int_value(test_output[0], 10, "lazy: rule7(3) should be 10");
+        assert_int_value(test_output[1], 299, "lazy: rule299(0) should be 299");
+        assert_int_value(test_output[2], 8, "lazy: cached rule7 should give 8");
+        int compiled = 0, parsed = 0;
+        for (int i = 0; i < bc->function_count; i++) {
+            if (bc->functions[i].entry >= 0) compiled++;
+            if (bc->functions[i].decl->body) parsed++;
+        }
+        assert_int(compiled, 2, "lazy: only called functions are compiled");
+        assert_int(parsed, 2, "lazy: only called functions are parsed");
+        print_pass("function bodies compiled on first call");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+        free(src);
+    }
+
+    // Test 9: Floats, booleans and 63-bit ints
+    {
+        test_output_count = 0;
+        const char* src =
+            "fn price(qty, unit) { return qty * unit * 1.08; }"
+            "let r = 0; let i = 0; while (i < 10) { r = r + 0.1; i = i + 1; }"
+            "yap(price(3, 2.5)); yap(r); yap(7 / 2); yap(7 / 2.0);"
+            "yap(2.0 == 2); yap(1.5 < 2); yap(true);"
+            "let big = 1000000000 * 1000000000; yap(big); yap(big * 10);"
+            "if (0.0) { yap(1); } else { yap(0); }"
+            "yap(0 - 6476648798459257004);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 11, "values: should print eleven times");
+        assert_value(test_output[0], "8.100000000000001", "values: price(3, 2.5)");
+        assert_value(test_output[1], "0.9999999999999999", "values: ten additions of 0.1");
+        assert_value(test_output[2], "3", "values: int division truncates");
+        assert_value(test_output[3], "3.5", "values: mixed division is a double");
+        assert_value(test_output[4], "1", "values: 2.0 == 2");
+        assert_value(test_output[5], "1", "values: 1.5 < 2");
+        assert_value(test_output[6], "true", "values: boolean literal");
+        assert_value(test_output[7], "1000000000000000000", "values: 63-bit int product");
+        assert_value(test_output[8], "10000000000000000000", "values: overflow continues as a bigint");
+        assert_value(test_output[9], "0", "values: 0.0 is false");
+        assert_value(test_output[10], "-6476648798459257004", "values: a folded negative literal below 63 bits");
+        print_pass("floats, booleans and 63-bit ints");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 10: Quickening rewrites monomorphic sites and gives up on polymorphic ones
+    //   (i % 7 has no closed form, so the loop is kept)
+    {
+        test_output_count = 0;
+        const char* src =
+            "let i = 0; let s = 0;"
+            "while (i < 1000) { s = s + i % 7; i = i + 1; }"
+            "yap(s);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int_value(test_output[0], 2997, "quicken: int loop result");
+        int int_ops = 0, generic_ops = 0;
+        for (int i = 0; i < bc->count; i++) {
+            OpCode op = bc->instructions[i].opcode;
+            if (op == BC_ADD_INT || op == BC_LESS_INT) int_ops++;
+            if (op == BC_ADD || op == BC_LESS) generic_ops++;
+        }
+        assert_int(int_ops, 3, "quicken: loop sites become int variants");
+        assert_int(generic_ops, 0, "quicken: no generic sites left in the loop");
+        assert_int(vm_stats.deoptimizations, 0, "quicken: int loop never deoptimizes");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        // x alternates between an int and a double, so x + 1 misses its guard
+        test_output_count = 0;
+        src =
+            "let k = 0; let x = 1; let f = 1;"
+            "while (k < 10) {"
+            "  yap(x + 1);"
+            "  if (f) { x = 0.5; f = 0; } else { x = 1; f = 1; }"
+            "  k = k + 1;"
+            "}";
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 10, "quicken: should print ten times");
+        for (int i = 0; i < 10; i++) {
+            assert_value(test_output[i], i % 2 ? "1.5" : "2", "quicken: polymorphic site stays correct");
+        }
+        assert_int(vm_stats.deoptimizations, 4, "quicken: misses stop at the deopt limit");
+        int generic_site = 0;
+        for (int i = 0; i < bc->count; i++) {
+            if (bc->instructions[i].opcode == BC_ADD && bc->instructions[i].operand == 4) generic_site = 1;
+        }
+        assert_int(generic_site, 1, "quicken: polymorphic site is left generic");
+        print_pass("quickening and deoptimization");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 11: Arrays are shared references with checked and proven accesses
+    {
+        test_output_count = 0;
+        const char* src =
+            "let c = [1, 2, 3]; yap(c); yap(c[2]);"
+            "let a = [1, 2, 3]; a[0] = [4, [5, 6]]; yap(a[0]);"
+            "let b = a; b[1] = 9; yap(a[1]);"
+            "yap(push(a, 7)); yap(len(a));"
+            "let s = 0; let i = 0;"
+            "while (i < len(a)) { if (i > 0) { s = s + a[i]; } i = i + 1; }"
+            "yap(s);"
+            "fn sum(v) { let t = 0; let j = 0; while (j < len(v)) { t = t + v[j]; j = j + 1; } return t; }"
+            "yap(sum([10, 20, 30])); yap([]); yap(a == b); yap([1] == [1]); yap(a);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 12, "arrays: should print twelve times");
+        assert_value(test_output[0], "[1, 2, 3]", "arrays: literal");
+        assert_value(test_output[1], "3", "arrays: index");
+        assert_value(test_output[2], "[4, [5, 6]]", "arrays: nested element assignment");
+        assert_value(test_output[3], "9", "arrays: assignment through an alias");
+        assert_value(test_output[4], "4", "arrays: push returns the new length");
+        assert_value(test_output[5], "4", "arrays: len");
+        assert_value(test_output[6], "19", "arrays: proven loop over len(a)");
+        assert_value(test_output[7], "60", "arrays: proven loop over a parameter");
+        assert_value(test_output[8], "[]", "arrays: empty literal");
+        assert_value(test_output[9], "1", "arrays: same array is equal");
+        assert_value(test_output[10], "0", "arrays: equality is identity");
+        assert_value(test_output[11], "[[4, [5, 6]], 9, 3, 7]", "arrays: final contents");
+        print_pass("array literals, indexing and builtins");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 12: Vectorized array builtins
+    {
+        test_output_count = 0;
+        const char* src =
+            "let v = []; let k = 0; while (k < 10000) { push(v, k - 5000); k = k + 1; }"
+            "yap(sum(v)); yap(min(v)); yap(max(v)); yap(dot(v, v));"
+            "let w = add(scale(v, 2), 1); yap(w[0]); yap(w[9999]); yap(len(w));"
+            "yap(sum(scale([1, 2], 0.5))); yap(sum([4611686018427387903, 1]));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 9, "builtins: should print nine times");
+        assert_value(test_output[0], "-5000", "builtins: sum");
+        assert_value(test_output[1], "-5000", "builtins: min");
+        assert_value(test_output[2], "4999", "builtins: max");
+        assert_value(test_output[3], "83333335000", "builtins: dot");
+        assert_value(test_output[4], "-9999", "builtins: scale then add, first");
+        assert_value(test_output[5], "9999", "builtins: scale then add, last");
+        assert_value(test_output[6], "10000", "builtins: map keeps the length");
+        assert_value(test_output[7], "1.5", "builtins: scale by a double");
+        assert_value(test_output[8], "4611686018427387904", "builtins: sum promotes to a bigint");
+        print_pass("sum, min, max, dot, scale and add");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 13: Strings, and globals told apart by their whole name
+    {
+        test_output_count = 0;
+        const char* src =
+            "let abc = \"ab\"; let abd = abc + \"c\" + 1; yap(abd); yap(abc);"
+            "let s = \"\"; let i = 0; while (i < 1000) { s = s + \"xy\"; i = i + 1; }"
+            "let t = \"\"; i = 0; while (i < 1000) { t = t + \"x\" + \"y\"; i = i + 1; }"
+            "yap(s == t); yap(s == t + \"!\"); yap(abc == \"a\" + \"b\");"
+            "if (\"\") { yap(0); } else { yap(1); }"
+            "yap([\"q\", 2.0 + \"\"]);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 7, "strings: should print seven times");
+        assert_value(test_output[0], "abc1", "strings: concatenation converts numbers");
+        assert_value(test_output[1], "ab", "strings: abc and abd are different globals");
+        assert_int_value(test_output[2], 1, "strings: ropes built differently are equal");
+        assert_int_value(test_output[3], 0, "strings: different lengths differ");
+        assert_int_value(test_output[4], 1, "strings: computed short strings equal literals");
+        assert_int_value(test_output[5], 1, "strings: the empty string is false");
+        assert_value(test_output[6], "[\"q\", \"2.0\"]", "strings: quoted inside arrays");
+        print_pass("strings and interned global names");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 14: Maps, with indexing quickened to the map opcodes
+    {
+        test_output_count = 0;
+        const char* src =
+            "let rates = map(); rates[\"US\"] = 7; rates[\"DE\"] = 19;"
+            "fn rate(m, code) { if (has(m, code)) { return m[code]; } return 0; }"
+            "yap(rate(rates, \"D\" + \"E\")); yap(rate(rates, \"FR\"));"
+            "let squares = map(); let i = 0;"
+            "while (i < 1000) { squares[i] = i * i; i = i + 1; }"
+            "let t = 0; i = 0; while (i < 1000) { t = t + squares[i * 1.0]; i = i + 1; }"
+            "yap(t); yap(rates);"
+            "let both = [[5], squares]; let n = 0; let s = 0;"
+            "while (n < 2) { s = s + both[n][2 * n]; n = n + 1; }"
+            "yap(s);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 5, "maps: should print five times");
+        assert_int_value(test_output[0], 19, "maps: present key");
+        assert_int_value(test_output[1], 0, "maps: missing key");
+        assert_int_value(test_output[2], 332833500, "maps: int keys found by equal doubles");
+        assert_value(test_output[3], "{\"US\": 7, \"DE\": 19}", "maps: printing");
+        assert_int_value(test_output[4], 9, "maps: a site indexing an array and a map");
+        int map_ops = 0;
+        for (int i = 0; i < bc->count; i++) {
+            OpCode op = bc->instructions[i].opcode;
+            map_ops += op == BC_MAP_GET || op == BC_MAP_SET;
+        }
+        assert_int(map_ops >= 3, 1, "maps: indexing sites quickened to map opcodes");
+        print_pass("maps and map opcodes");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 15: Records, with field sites served by their inline caches
+    {
+        test_output_count = 0;
+        const char* src =
+            "let ps = []; let i = 0;"
+            "while (i < 1000) { push(ps, {x: i, y: 2 * i}); i = i + 1; }"
+            "let t = 0; i = 0;"
+            "while (i < 1000) { let p = ps[i]; p.y = p.y + p.x; t = t + p.y; i = i + 1; }"
+            "yap(t);"
+            "let mixed = [{x: 1}, {y: 0, x: 2}, {x: 3}, {y: 0, x: 4}];"
+            "let s = 0; i = 0; while (i < 4) { s = s + mixed[i].x; i = i + 1; }"
+            "yap(s); yap(mixed[1]); yap({name: \"n\", inner: {v: [1]}});";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 4, "records: should print four times");
+        assert_int_value(test_output[0], 1498500, "records: field reads and writes");
+        assert_int_value(test_output[1], 10, "records: a site seeing two shapes");
+        assert_value(test_output[2], "{y: 0, x: 2}", "records: printing in field order");
+        assert_value(test_output[3], "{name: \"n\", inner: {v: [1]}}", "records: nested printing");
+        // Four monomorphic sites miss once each; the mixed site misses on
+        // every change of shape
+        assert_int(vm_stats.field_cache_misses, 4 + 4, "records: inline cache misses");
+        print_pass("records and field inline caches");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 16: Block scoping: inner lets shadow outer variables until the
+    // block ends, and each loop iteration starts its locals afresh
+    {
+        test_output_count = 0;
+        const char* src =
+            "let x = 1; { let x = 2; yap(x); } yap(x);"
+            "let i = 0; let t = 0;"
+            "while (i < 3) { let sq = i * i; { let sq = 100; t = t + sq; } t = t + sq; i = i + 1; }"
+            "yap(t);"
+            "fn f(n) { let r = n; if (n > 0) { let r = 0 - n; } { let a = [n]; r = r + a[0]; } return r; }"
+            "yap(f(5));";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 4, "blocks: should print four times");
+        assert_int_value(test_output[0], 2, "blocks: the inner x shadows the outer");
+        assert_int_value(test_output[1], 1, "blocks: the outer x is back after the block");
+        assert_int_value(test_output[2], 305, "blocks: nested shadowing in a loop body");
+        assert_int_value(test_output[3], 10, "blocks: a shadowed parameter-initialized local");
+        print_pass("block-scoped locals");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 17: Remainder, bitwise operators, shifts and the min, max and
+    // abs intrinsics, on ints, doubles and past the 63-bit range
+    {
+        test_output_count = 0;
+        const char* src =
+            "let a = 0 - 17; let b = 5; let big = 4611686018427387903;"
+            "yap(a % b); yap(17 % b); yap(7.5 % 2);"
+            "yap((a & 12) | (b ^ 3)); yap(a >> 2); yap(b << 61); yap(a << 3);"
+            "yap(min(a, b)); yap(max(a, b)); yap(abs(a)); yap(abs(0 - 2.5)); yap(min(2, 1.5));"
+            "yap(abs(0 - big - 1)); yap(max([4, 8, 1]));"
+            "yap(1 << 62); yap((1 << 62) >> 1); yap((1 << 62) & 1); yap((1 << 63) | 1);"
+            "let i = 0; let s = 0;"
+            "while (i < 100) { s = s + (i % 7) + (i & 3) + (i ^ 1) + max(i, 50) - min(i, 50) + abs(50 - i); i = i + 1; }"
+            "yap(s);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 19, "intrinsics: should print nineteen times");
+        assert_int_value(test_output[0], -2, "intrinsics: the remainder takes the dividend's sign");
+        assert_int_value(test_output[1], 2, "intrinsics: 17 % 5");
+        assert_value(test_output[2], "1.5", "intrinsics: remainder of doubles");
+        assert_int_value(test_output[3], 14, "intrinsics: (-17 & 12) | (5 ^ 3)");
+        assert_int_value(test_output[4], -5, "intrinsics: >> is arithmetic");
+        assert_value(test_output[5], "11529215046068469760", "intrinsics: << past 63 bits gives a bigint");
+        assert_int_value(test_output[6], -136, "intrinsics: << of a negative");
+        assert_int_value(test_output[7], -17, "intrinsics: min");
+        assert_int_value(test_output[8], 5, "intrinsics: max");
+        assert_int_value(test_output[9], 17, "intrinsics: abs");
+        assert_value(test_output[10], "2.5", "intrinsics: abs of a double");
+        assert_value(test_output[11], "1.5", "intrinsics: min of an int and a double");
+        assert_value(test_output[12], "4611686018427387904", "intrinsics: abs of the smallest int");
+        assert_int_value(test_output[13], 8, "intrinsics: max of an array is still the builtin");
+        assert_value(test_output[14], "4611686018427387904", "intrinsics: 1 << 62 is the first bigint");
+        assert_int_value(test_output[15], (int64_t)1 << 61, "intrinsics: >> of a bigint");
+        assert_int_value(test_output[16], 0, "intrinsics: & of a bigint");
+        assert_value(test_output[17], "9223372036854775809", "intrinsics: | of 1 << 63");
+        assert_int_value(test_output[18], 295 + 150 + 4950 + 2500 + 2500, "intrinsics: in a loop");
+        print_pass("remainder, bitwise operators and intrinsics");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 18: && and || skip their right side once the left decides,
+    // both in conditions and as values, and ! yields 1 or 0
+    {
+        test_output_count = 0;
+        const char* src =
+            "let n = 0; fn tick(v) { n = n + 1; return v; }"
+            "let a = [3, 1, 4, 0, 5]; let i = 0;"
+            "while (i < len(a) && a[i] != 0) { i = i + 1; } yap(i);"
+            "let j = 10; if (j < len(a) && a[j] > 0) { yap(0); } else { yap(1); }"
+            "yap(tick(0) && tick(1)); yap(tick(2) || tick(3)); yap(n);"
+            "yap(!\"\" && !0 && \"s\"); yap(!tick(5));"
+            "let hits = 0; let k = 0;"
+            "while (k < 30) { if (!(k % 3 == 0 || k % 5 == 0) && k != 7) { hits = hits + 1; } k = k + 1; }"
+            "yap(hits);";
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 8, "logical: should print eight times");
+        assert_int_value(test_output[0], 3, "logical: && guards the element read");
+        assert_int_value(test_output[1], 1, "logical: an out-of-range index is never read");
+        assert_int_value(test_output[2], 0, "logical: && of a falsy left side");
+        assert_int_value(test_output[3], 1, "logical: || of a truthy left side");
+        assert_int_value(test_output[4], 2, "logical: the right sides were skipped");
+        assert_int_value(test_output[5], 1, "logical: strings and ints as conditions");
+        assert_int_value(test_output[6], 0, "logical: ! of a truthy value");
+        assert_int_value(test_output[7], 15, "logical: nested conditions in a loop");
+        print_pass("short-circuit logical operators");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
+    // Test 19: Recursion that is not a tail call runs as deep as its
+    // frames fit on the operand stack: 5000 calls of two slots each, then
+    // as many one-slot calls as leave room for the last one's 300 pending
+    // temporaries
+    {
+        test_output_count = 0;
+        static char src[4096];
+        int len = snprintf(src, sizeof(src), "fn deep(n) { if (n == 0) { return ");
+        for (int i = 0; i < 300; i++) len += snprintf(src + len, sizeof(src) - len, "n + (");
+        len += snprintf(src + len, sizeof(src) - len, "1");
+        for (int i = 0; i < 300; i++) len += snprintf(src + len, sizeof(src) - len, ")");
+        len += snprintf(src + len, sizeof(src) - len, "; } return deep(n - 1) + 1; }");
+
+        // The depth that fits follows from the frame size of deep
+        int tcount;
+        Token* tokens = tokenize(src, &tcount);
+        int scount;
+        Stmt** stmts = parse(tokens, tcount, &scount);
+        Bytecode* bc = compile(stmts, scount);
+        compile_function(bc, 0);
+        int slots = bc->functions[0].local_count;
+        int temporaries = bc->functions[0].max_stack;
+        assert_int(slots, 1, "deep recursion: one slot per frame");
+        assert_int(temporaries > 256, 1, "deep recursion: more than 256 temporaries");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+
+        int depth = VM_STACK_SIZE - slots - temporaries;
+        snprintf(src + len, sizeof(src) - len,
+            "fn two(n) { if (n == 0) { return 0; } return 1 + two(n - 1); } yap(two(5000));"
+            "yap(deep(%d));", depth);
+        tokens = tokenize(src, &tcount);
+        stmts = parse(tokens, tcount, &scount);
+        bc = compile(stmts, scount);
+        run(bc);
+        assert_int(test_output_count, 2, "deep recursion: should print twice");
+        assert_int_value(test_output[0], 5000, "deep recursion: 5000 frames");
+        assert_int_value(test_output[1], depth + 1, "deep recursion: a full operand stack");
+        print_pass("deep recursion");
+        free_bytecode(bc);
+        free_ast(stmts, scount);
+        free_tokens(tokens, tcount);
+    }
+
     printf("\n🎉 All VM tests passed!\n");
     return 0;
 }
@@ -0,0 +1,427 @@
+/**
+ * @file value.c
+ * @brief Tagged value representation for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * This file implements the parts of the value representation that are
+ * too large for macros: boxing of doubles, generic arithmetic and
+ * comparison (the slow paths behind the VM's int fast paths), and
+ * formatting. Integers beyond 63 bits are handed to bigint.c, and the
+ * text of strings to str.c.
+ *
+ * Immediate Double Encoding:
+ * 1. Rotate the IEEE bits left by one: exponent(11) mantissa(52) sign(1)
+ * 2. Subtract 896 from the exponent, leaving an 8-bit exponent
+ * 3. Shift left by three and add the 100 tag
+ * Decoding reverses the steps. Both zeros are encoded without rebasing,
+ * so they are the only immediates whose upper 61 bits are 0 or 1.
+ * The encoding itself is inline in value.h so the VM's float paths
+ * avoid a call; only boxing lives here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "value.h"
+#include "object.h"
+#include "bigint.h"
+#include "str.h"
+#include "map.h"
+#include "allocator.h"
+
+// ----------------------------
+// Numbers
+// ----------------------------
+Value box_double(double number) {
+    return OBJ_VAL(new_float(number));
+}
+
+double unbox_double(Value value) {
+    return AS_FLOAT_OBJ(value)->value;
+}
+
+int is_boxed_double(Value value) {
+    return IS_FLOAT_OBJ(value);
+}
+
+Value int64_value(int64_t number) {
+    if (number < INT_VALUE_MIN || number > INT_VALUE_MAX) return bigint_from_int64(number);
+    return INT_VAL(number);
+}
+
+int is_truthy(Value value) {
+    if (IS_INT(value)) return AS_INT(value) != 0;
+    if (IS_BOOL(value)) return AS_BOOL(value);
+    if (is_double(value)) return as_double(value) != 0.0;
+    if (IS_STRING_OBJ(value)) return AS_STRING_OBJ(value)->length != 0;
+    return 1;
+}
+
+// ----------------------------
+// Comparison
+// ----------------------------
+int values_equal(Value a, Value b) {
+    if (IS_INT(a) && IS_INT(b)) return a == b;
+    if (is_integer(a) && is_integer(b)) return bigint_compare(a, b) == 0;
+    if (is_number(a) && is_number(b)) return to_double(a) == to_double(b);
+    if (IS_STRING_OBJ(a) && IS_STRING_OBJ(b)) return strings_equal(AS_STRING_OBJ(a), AS_STRING_OBJ(b));
+    return a == b;
+}
+
+static void require_numbers(Value a, Value b) {
+    if (!is_number(a) || !is_number(b)) {
+        fprintf(stderr, "Runtime error: operands must be numbers\n");
+        exit(1);
+    }
+}
+
+int compare_values(Value a, Value b) {
+    if (IS_INT(a) && IS_INT(b)) {
+        return (AS_INT(a) > AS_INT(b)) - (AS_INT(a) < AS_INT(b));
+    }
+    if (is_integer(a) && is_integer(b)) return bigint_compare(a, b);
+    require_numbers(a, b);
+    double x = to_double(a);
+    double y = to_double(b);
+    if (x < y) return -1;
+    if (x > y) return 1;
+    if (x == y) return 0;
+    return 2;  // NaN
+}
+
+// ----------------------------
+// Arithmetic
+// ----------------------------
+// The other operand of a string concatenation, converted as yap prints it
+static ObjString* concat_operand(Value value) {
+    if (IS_STRING_OBJ(value)) return AS_STRING_OBJ(value);
+    if (IS_ARRAY_OBJ(value) || IS_MAP_OBJ(value) || IS_RECORD_OBJ(value)) {
+        fprintf(stderr, "Runtime error: cannot add an array, map or record to a string\n");
+        exit(1);
+    }
+    if (is_bigint(value)) {
+        char* text = bigint_to_string(value);
+        ObjString* string = copy_string(text, (int)strlen(text));
+        jm_free(text);
+        return string;
+    }
+    char buffer[64];
+    int length = format_value(value, buffer, sizeof(buffer));
+    return copy_string(buffer, length);
+}
+
+Value add_values(Value a, Value b) {
+    if (IS_STRING_OBJ(a) || IS_STRING_OBJ(b)) {
+        return OBJ_VAL(concat_strings(concat_operand(a), concat_operand(b)));
+    }
+    // 63-bit operands cannot overflow 64 bits
+    if (IS_INT(a) && IS_INT(b)) return int64_value(AS_INT(a) + AS_INT(b));
+    if (is_integer(a) && is_integer(b)) return bigint_add(a, b);
+    require_numbers(a, b);
+    return double_value(to_double(a) + to_double(b));
+}
+
+Value subtract_values(Value a, Value b) {
+    if (IS_INT(a) && IS_INT(b)) return int64_value(AS_INT(a) - AS_INT(b));
+    if (is_integer(a) && is_integer(b)) return bigint_subtract(a, b);
+    require_numbers(a, b);
+    return double_value(to_double(a) - to_double(b));
+}
+
+Value multiply_values(Value a, Value b) {
+    if (IS_INT(a) && IS_INT(b)) {
+        int64_t result;
+        if (!__builtin_mul_overflow(AS_INT(a), AS_INT(b), &result)) return int64_value(result);
+    }
+    if (is_integer(a) && is_integer(b)) return bigint_multiply(a, b);
+    require_numbers(a, b);
+    return double_value(to_double(a) * to_double(b));
+}
+
+Value divide_values(Value a, Value b) {
+    if (is_integer(a) && is_integer(b)) {
+        // Bigints are never zero
+        if (b == INT_VAL(0)) {
+            fprintf(stderr, "Runtime error: division by zero\n");
+            exit(1);
+        }
+        // Only INT_VALUE_MIN / -1 leaves the range, and int64_value handles it
+        if (IS_INT(a) && IS_INT(b)) return int64_value(AS_INT(a) / AS_INT(b));
+        return bigint_divide(a, b);
+    }
+    require_numbers(a, b);
+    return double_value(to_double(a) / to_double(b));
+}
+
+Value modulo_values(Value a, Value b) {
+    if (is_integer(a) && is_integer(b)) {
+        if (b == INT_VAL(0)) {
+            fprintf(stderr, "Runtime error: division by zero\n");
+            exit(1);
+        }
+        // 63-bit operands never reach INT64_MIN % -1
+        if (IS_INT(a) && IS_INT(b)) return INT_VAL(AS_INT(a) % AS_INT(b));
+        return subtract_values(a, multiply_values(divide_values(a, b), b));
+    }
+    require_numbers(a, b);
+    return double_value(fmod(to_double(a), to_double(b)));
+}
+
+// ----------------------------
+// Bitwise operations
+// ----------------------------
+static void require_integers(Value a, Value b, const char* op) {
+    if (!is_integer(a) || !is_integer(b)) {
+        fprintf(stderr, "Runtime error: operands of '%s' must be integers\n", op);
+        exit(1);
+    }
+}
+
+Value and_values(Value a, Value b) {
+    require_integers(a, b, "&");
+    if (IS_INT(a) && IS_INT(b)) return INT_VAL(AS_INT(a) & AS_INT(b));
+    return bigint_and(a, b);
+}
+
+Value or_values(Value a, Value b) {
+    require_integers(a, b, "|");
+    if (IS_INT(a) && IS_INT(b)) return INT_VAL(AS_INT(a) | AS_INT(b));
+    return bigint_or(a, b);
+}
+
+Value xor_values(Value a, Value b) {
+    require_integers(a, b, "^");
+    if (IS_INT(a) && IS_INT(b)) return INT_VAL(AS_INT(a) ^ AS_INT(b));
+    return bigint_xor(a, b);
+}
+
+static int shift_count(Value a, Value b, const char* op) {
+    require_integers(a, b, op);
+    if (!IS_INT(b) || AS_INT(b) < 0 || AS_INT(b) > 63) {
+        char* text = bigint_to_string(b);
+        fprintf(stderr, "Runtime error: shift count %s out of range\n", text);
+        jm_free(text);
+        exit(1);
+    }
+    return (int)AS_INT(b);
+}
+
+Value shift_left_values(Value a, Value b) {
+    int count = shift_count(a, b, "<<");
+    if (IS_INT(a) && count < 63) {
+        int64_t number = AS_INT(a);
+        int64_t shifted = (int64_t)((uint64_t)number << count);
+        if (shifted >> count == number) return int64_value(shifted);
+    }
+    return bigint_shift_left(a, count);
+}
+
+Value shift_right_values(Value a, Value b) {
+    int count = shift_count(a, b, ">>");
+    if (IS_INT(a)) return INT_VAL(AS_INT(a) >> count);
+    return bigint_shift_right(a, count);
+}
+
+// ----------------------------
+// Intrinsics
+// ----------------------------
+Value min_values(Value a, Value b) {
+    return compare_values(a, b) == 1 ? b : a;
+}
+
+Value max_values(Value a, Value b) {
+    return compare_values(a, b) == -1 ? b : a;
+}
+
+Value abs_value(Value a) {
+    if (IS_INT(a)) {
+        int64_t number = AS_INT(a);
+        int64_t sign = number >> 63;  // 0 or -1
+        return int64_value((number ^ sign) - sign);
+    }
+    if (is_bigint(a)) return compare_values(a, INT_VAL(0)) < 0 ? subtract_values(INT_VAL(0), a) : a;
+    if (!is_number(a)) {
+        fprintf(stderr, "Runtime error: abs() expects a number\n");
+        exit(1);
+    }
+    return double_value(fabs(as_double(a)));
+}
+
+// ----------------------------
+// Formatting
+// ----------------------------
+// Arrays, maps and records nested deeper than this print as [...] or {...}, which
+// also stops cycles
+#define MAX_PRINT_DEPTH 8
+
+static int format_nested(Value value, char* buffer, size_t size, int depth);
+
+// Formats an array as [a, b, c], stopping once the buffer is full
+static int format_array(ObjArray* array, char* buffer, size_t size, int depth) {
+    if (depth >= MAX_PRINT_DEPTH) return snprintf(buffer, size, "[...]");
+    size_t length = snprintf(buffer, size, "[");
+    for (int i = 0; i < array->count && length < size; i++) {
+        if (i > 0) length += snprintf(buffer + length, size - length, ", ");
+        if (length >= size) break;
+        length += format_nested(array->items[i], buffer + length, size - length, depth + 1);
+    }
+    if (length < size) length += snprintf(buffer + length, size - length, "]");
+    return (int)length;
+}
+
+// Formats a map as {k: v, ...} in slot order, stopping once the buffer is full
+static int format_map(ObjMap* map, char* buffer, size_t size, int depth) {
+    if (depth >= MAX_PRINT_DEPTH) return snprintf(buffer, size, "{...}");
+    size_t length = snprintf(buffer, size, "{");
+    int written = 0;
+    for (int i = 0; i < map->capacity && length < size; i++) {
+        if (map->control[i] == MAP_EMPTY) continue;
+        if (written++ > 0) length += snprintf(buffer + length, size - length, ", ");
+        if (length >= size) break;
+        length += format_nested(map->keys[i], buffer + length, size - length, depth + 1);
+        if (length < size) length += snprintf(buffer + length, size - length, ": ");
+        if (length >= size) break;
+        length += format_nested(map->values[i], buffer + length, size - length, depth + 1);
+    }
+    if (length < size) length += snprintf(buffer + length, size - length, "}");
+    return (int)length;
+}
+
+// Formats a record as {name: v, ...} in field order, stopping once the buffer is full
+static int format_record(ObjRecord* record, char* buffer, size_t size, int depth) {
+    if (depth >= MAX_PRINT_DEPTH) return snprintf(buffer, size, "{...}");
+    size_t length = snprintf(buffer, size, "{");
+    for (int i = 0; i < record->shape->field_count && length < size; i++) {
+        if (i > 0) length += snprintf(buffer + length, size - length, ", ");
+        if (length >= size) break;
+        length += snprintf(buffer + length, size - length, "%s: ", string_chars(record->shape->fields[i]));
+        if (length >= size) break;
+        length += format_nested(record->fields[i], buffer + length, size - length, depth + 1);
+    }
+    if (length < size) length += snprintf(buffer + length, size - length, "}");
+    return (int)length;
+}
+
+int format_value(Value value, char* buffer, size_t size) {
+    return format_nested(value, buffer, size, 0);
+}
+
+static int format_nested(Value value, char* buffer, size_t size, int depth) {
+    if (IS_INT(value)) return snprintf(buffer, size, "%lld", (long long)AS_INT(value));
+    if (IS_BOOL(value)) return snprintf(buffer, size, "%s", AS_BOOL(value) ? "true" : "false");
+    if (is_bigint(value)) {
+        char* text = bigint_to_string(value);
+        int length = snprintf(buffer, size, "%s", text);
+        jm_free(text);
+        return length;
+    }
+    if (IS_ARRAY_OBJ(value)) return format_array(AS_ARRAY_OBJ(value), buffer, size, depth);
+    if (IS_MAP_OBJ(value)) return format_map(AS_MAP_OBJ(value), buffer, size, depth);
+    if (IS_RECORD_OBJ(value)) return format_record(AS_RECORD_OBJ(value), buffer, size, depth);
+    if (IS_STRING_OBJ(value)) {
+        // Strings inside arrays and maps are quoted so ["1"] and [1] differ
+        const char* quote = depth > 0 ? "\"" : "";
+        return snprintf(buffer, size, "%s%s%s", quote, string_chars(AS_STRING_OBJ(value)), quote);
+    }
+    if (is_double(value)) {
+        double number = as_double(value);
+
+        // Shortest precision that reads back as the same double
+        int length = 0;
+        for (int precision = 1; precision <= 17; precision++) {
+            length = snprintf(buffer, size, "%.*g", precision, number);
+            if (strtod(buffer, NULL) == number) break;
+        }
+
+        // Keep doubles recognizable: 2.0 rather than 2
+        if (strspn(buffer, "-0123456789") == (size_t)length && (size_t)length + 2 < size) {
+            memcpy(buffer + length, ".0", 3);
+            length += 2;
+        }
+        return length;
+    }
+    if (IS_CLOSURE_OBJ(value)) return snprintf(buffer, size, "<fn %s>", string_chars(AS_CLOSURE_OBJ(value)->name));
+    return snprintf(buffer, size, "<object %p>", (void*)AS_OBJ(value));
+}
+
+static void print_nested(Value value, int depth) {
+    if (IS_ARRAY_OBJ(value) && depth < MAX_PRINT_DEPTH) {
+        // Elements are printed one by one, so long arrays are not truncated
+        ObjArray* array = AS_ARRAY_OBJ(value);
+        fputc('[', stdout);
+        for (int i = 0; i < array->count; i++) {
+            if (i > 0) fputs(", ", stdout);
+            print_nested(array->items[i], depth + 1);
+        }
+        fputc(']', stdout);
+        return;
+    }
+    if (IS_MAP_OBJ(value) && depth < MAX_PRINT_DEPTH) {
+        ObjMap* map = AS_MAP_OBJ(value);
+        int written = 0;
+        fputc('{', stdout);
+        for (int i = 0; i < map->capacity; i++) {
+            if (map->control[i] == MAP_EMPTY) continue;
+            if (written++ > 0) fputs(", ", stdout);
+            print_nested(map->keys[i], depth + 1);
+            fputs(": ", stdout);
+            print_nested(map->values[i], depth + 1);
+        }
+        fputc('}', stdout);
+        return;
+    }
+    if (IS_RECORD_OBJ(value) && depth < MAX_PRINT_DEPTH) {
+        // Field names print bare, as in the literal
+        ObjRecord* record = AS_RECORD_OBJ(value);
+        fputc('{', stdout);
+        for (int i = 0; i < record->shape->field_count; i++) {
+            if (i > 0) fputs(", ", stdout);
+            print_string(record->shape->fields[i], stdout);
+            fputs(": ", stdout);
+            print_nested(record->fields[i], depth + 1);
+        }
+        fputc('}', stdout);
+        return;
+    }
+    if (IS_STRING_OBJ(value)) {
+        // Ropes are written piece by piece rather than flattened
+        if (depth > 0) fputc('"', stdout);
+        print_string(AS_STRING_OBJ(value), stdout);
+        if (depth > 0) fputc('"', stdout);
+        return;
+    }
+    if (is_bigint(value)) {
+        char* text = bigint_to_string(value);
+        fputs(text, stdout);
+        jm_free(text);
+        return;
+    }
+    char buffer[64];
+    format_nested(value, buffer, sizeof(buffer), depth);
+    fputs(buffer, stdout);
+}
+
+void print_value(Value value) {
+    print_nested(value, 0);
+}
+
+// ----------------------------
+// Literals
+// ----------------------------
+Value literal_value(Token token) {
+    switch (token.type) {
+        case TOKEN_TRUE: return TRUE_VAL;
+        case TOKEN_FALSE: return FALSE_VAL;
+        case TOKEN_FLOAT: return double_value(strtod(token.lexeme, NULL));
+        case TOKEN_STRING: return OBJ_VAL(copy_string(token.lexeme, (int)strlen(token.lexeme)));
+        default: {
+            errno = 0;
+            long long number = strtoll(token.lexeme, NULL, 10);
+            if (errno == ERANGE || number < INT_VALUE_MIN || number > INT_VALUE_MAX) return bigint_parse(token.lexeme);
+            return INT_VAL(number);
+        }
+    }
+}
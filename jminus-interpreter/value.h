@@ -0,0 +1,277 @@
+/**
+ * @file value.h
+ * @brief Tagged value representation for the jminus runtime
+ * @author Joey Zhang
+ * @version 1.0.0
+ *
+ * Every runtime value (VM stack slots, constants, variables) is a single
+ * 64-bit word. The low three bits tell what the word holds:
+ *
+ * Tag Layout:
+ * - xx1: Integer, the upper 63 bits hold the signed value
+ * - 000: Reference to a heap object (Obj*, at least 8-byte aligned):
+ *   boxed doubles, bigints, arrays, strings, maps and records (see object.h)
+ * - 010: Special constant (false = 0x02, true = 0x0A)
+ * - 100: Immediate double (see below)
+ *
+ * Integers:
+ * - Adding two tagged ints is one machine add plus a correction, so the
+ *   VM keeps its int fast paths without unpacking (see vm.c)
+ * - Results outside the 63-bit range become heap bigints (see bigint.h);
+ *   integer arithmetic is always exact
+ *
+ * Doubles:
+ * - Doubles with a binary exponent in [-126, 128] (about 1e-38 to 3e38
+ *   in magnitude) and both zeros are stored in the word itself: the sign
+ *   is rotated to the low end and the 11-bit exponent rebased to 8 bits
+ * - Anything else (huge, tiny, infinity, NaN) is boxed in an ObjFloat
+ * - Both forms behave identically; as_double() reads either
+ *
+ * Truthiness:
+ * - false, the integer 0, 0.0 and the empty string are false; everything
+ *   else is true
+ *
+ * Error Handling:
+ * - Arithmetic and ordering on non-numbers report a runtime error and exit
+ * - Integer division by zero reports a runtime error and exits
+ */
+
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "lexer.h"
+
+typedef struct Obj Obj;
+
+/**
+ * @brief A tagged runtime value
+ */
+typedef uint64_t Value;
+
+#define TAG_MASK    ((Value)7)
+#define TAG_OBJ     ((Value)0)
+#define TAG_SPECIAL ((Value)2)
+#define TAG_FLOAT   ((Value)4)
+
+#define FALSE_VAL   ((Value)0x02)
+#define TRUE_VAL    ((Value)0x0A)
+
+/// Range of integers that fit in a tagged value
+#define INT_VALUE_MIN (-((int64_t)1 << 62))
+#define INT_VALUE_MAX (((int64_t)1 << 62) - 1)
+
+#define IS_INT(v)    (((v) & 1) != 0)
+#define IS_BOOL(v)   ((v) == TRUE_VAL || (v) == FALSE_VAL)
+#define IS_OBJ(v)    (((v) & TAG_MASK) == TAG_OBJ)
+#define IS_IMMEDIATE_FLOAT(v) (((v) & TAG_MASK) == TAG_FLOAT)
+
+/// Arithmetic shift recovers the sign of the 63-bit integer
+#define AS_INT(v)    ((int64_t)(v) >> 1)
+#define AS_BOOL(v)   ((v) == TRUE_VAL)
+#define AS_OBJ(v)    ((Obj*)(uintptr_t)(v))
+
+/// The argument must be within [INT_VALUE_MIN, INT_VALUE_MAX]
+#define INT_VAL(i)   (((Value)(int64_t)(i) << 1) | 1)
+#define BOOL_VAL(b)  ((b) ? TRUE_VAL : FALSE_VAL)
+#define OBJ_VAL(o)   ((Value)(uintptr_t)(o))
+
+// Exponent rebasing for immediate doubles, applied after rotating the
+// IEEE bits left by one (exponent at bit 53); see value.c
+#define FLOAT_EXPONENT_OFFSET ((uint64_t)896 << 53)
+
+/**
+ * @brief Boxes a double that has no immediate encoding
+ */
+Value box_double(double number);
+
+/**
+ * @brief Reads the double inside a boxed float object
+ */
+double unbox_double(Value value);
+
+/**
+ * @brief Checks whether a value is a boxed double
+ */
+int is_boxed_double(Value value);
+
+/**
+ * @brief Checks whether a value is a bigint
+ */
+int is_bigint(Value value);
+
+/**
+ * @brief Converts a bigint to the nearest double (infinity if too large)
+ */
+double bigint_to_double(Value value);
+
+/**
+ * @brief Converts a double to a value, boxing it if it is out of the immediate range
+ * @param number The double to store
+ * @return Immediate or boxed double value
+ */
+static inline Value double_value(double number) {
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    uint64_t rotated = (bits << 1) | (bits >> 63);
+
+    // +0.0 and -0.0
+    if (rotated <= 1) return (rotated << 3) | TAG_FLOAT;
+
+    uint64_t exponent = (bits >> 52) & 0x7FF;
+    if (exponent > 896 && exponent < 896 + 256) {
+        return ((rotated - FLOAT_EXPONENT_OFFSET) << 3) | TAG_FLOAT;
+    }
+    return box_double(number);
+}
+
+/**
+ * @brief Reads a double value (immediate or boxed)
+ * @param value A value for which is_double() holds
+ */
+static inline double as_double(Value value) {
+    if (IS_OBJ(value)) return unbox_double(value);
+
+    uint64_t rotated = value >> 3;
+    if (rotated > 1) rotated += FLOAT_EXPONENT_OFFSET;
+    uint64_t bits = (rotated >> 1) | (rotated << 63);
+    double number;
+    memcpy(&number, &bits, sizeof(number));
+    return number;
+}
+
+/**
+ * @brief Checks whether a value holds a double (immediate or boxed)
+ */
+static inline int is_double(Value value) {
+    return IS_IMMEDIATE_FLOAT(value) || is_boxed_double(value);
+}
+
+/**
+ * @brief Checks whether a value is an integer (tagged or bigint)
+ */
+static inline int is_integer(Value value) {
+    return IS_INT(value) || is_bigint(value);
+}
+
+/**
+ * @brief Checks whether a value is an integer or a double
+ */
+static inline int is_number(Value value) {
+    return IS_INT(value) || is_double(value) || is_bigint(value);
+}
+
+/**
+ * @brief Converts a number to double
+ * @param value A value for which is_number() holds
+ */
+static inline double to_double(Value value) {
+    if (IS_INT(value)) return (double)AS_INT(value);
+    if (is_bigint(value)) return bigint_to_double(value);
+    return as_double(value);
+}
+
+/**
+ * @brief Converts a 64-bit integer result to a value
+ * @param number The integer
+ * @return Tagged integer, or a bigint if it does not fit in 63 bits
+ */
+Value int64_value(int64_t number);
+
+/**
+ * @brief Tests a value for truthiness (false, 0, 0.0 and "" are false)
+ */
+int is_truthy(Value value);
+
+/**
+ * @brief Compares two values for equality
+ * @return Nonzero if equal; numbers compare by numeric value (1 == 1.0)
+ * and strings by their text
+ */
+int values_equal(Value a, Value b);
+
+/**
+ * @brief Orders two numbers
+ * @return -1, 0 or 1, or 2 if unordered (a NaN is involved)
+ *
+ * Exits with a runtime error if either operand is not a number.
+ */
+int compare_values(Value a, Value b);
+
+/**
+ * @brief Generic arithmetic used when the int fast paths do not apply
+ *
+ * Integer operands (tagged or bigint) give an exact integer, promoted to
+ * a bigint when it leaves the 63-bit range. Any double operand makes the
+ * operation a double operation. Non-numbers are a runtime error, except
+ * that add_values() concatenates when either operand is a string, turning
+ * a number or boolean operand into the text yap would print for it.
+ */
+Value add_values(Value a, Value b);
+Value subtract_values(Value a, Value b);
+Value multiply_values(Value a, Value b);
+Value divide_values(Value a, Value b);
+
+/**
+ * @brief Remainder, bitwise operations and shifts
+ *
+ * modulo_values() truncates like divide_values(), so the remainder takes
+ * the sign of the dividend and a == (a / b) * b + a % b; on doubles it is
+ * fmod(). The bitwise operators take integers of any size, acting on
+ * their two's complement, and shifts take counts from 0 to 63: >> is
+ * arithmetic, and a << result beyond 63 bits becomes a bigint that the
+ * other operators take again. Anything else is a runtime error.
+ */
+Value modulo_values(Value a, Value b);
+Value and_values(Value a, Value b);
+Value or_values(Value a, Value b);
+Value xor_values(Value a, Value b);
+Value shift_left_values(Value a, Value b);
+Value shift_right_values(Value a, Value b);
+
+/**
+ * @brief The min, max and abs intrinsics on numbers
+ *
+ * min_values() and max_values() return one operand unchanged, the first
+ * when they are equal or unordered. abs_value() of the smallest int gives
+ * a bigint. Non-numbers are a runtime error.
+ */
+Value min_values(Value a, Value b);
+Value max_values(Value a, Value b);
+Value abs_value(Value a);
+
+/**
+ * @brief Formats a value as text
+ * @param value Value to format
+ * @param buffer Output buffer
+ * @param size Size of the output buffer
+ * @return Number of characters written (excluding the terminator)
+ *
+ * Doubles use the shortest form that reads back to the same double and
+ * always show a decimal point or exponent, so 2.0 prints as "2.0".
+ * Arrays print as [1, 2, 3] (nesting beyond eight levels as [...]).
+ * Maps print as {k: v, ...} in no particular order. Strings print as their
+ * text, quoted when inside an array or map.
+ * Bigints and arrays longer than the buffer are truncated; print_value
+ * has no limit.
+ */
+int format_value(Value value, char* buffer, size_t size);
+
+/**
+ * @brief Prints a value to stdout (no newline)
+ */
+void print_value(Value value);
+
+/**
+ * @brief Converts a literal token (INT, FLOAT, STRING, TRUE, FALSE) to a value
+ * @param token The literal token
+ * @return The literal's value
+ *
+ * Integer literals beyond 63 bits become bigints; string literals give
+ * the string of the token's (unescaped) text.
+ */
+Value literal_value(Token token);
+
+#endif // VALUE_H
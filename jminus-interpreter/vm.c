@@ -4,26 +4,125 @@
 #include "vm.h"
 #include "interpreter.h"
 #include "environment.h"
+#include "array.h"
+#include "map.h"
+#include "record.h"
+#include "str.h"
+#include "builtins.h"
+#include "native.h"
+#include "gc.h"
 
-#define STACK_SIZE 1024
+// Guard misses after which an arithmetic or comparison site stays generic
+#define QUICKEN_DEOPT_LIMIT 4
 
-static int stack[STACK_SIZE];
+/**
+ * Bookkeeping for one active call. Arguments and locals are not stored
+ * here: they live on the operand stack starting at the frame base.
+ */
+typedef struct {
+    int return_ip;  // Instruction to resume in the caller
+    int base;       // Caller's frame base, restored on return
+} CallFrame;
+
+static Value stack[VM_STACK_SIZE];
 static int sp = 0;  // stack pointer
+static CallFrame frames[VM_FRAMES_MAX];
+static int frame_count = 0;
 static Environment* vm_env = NULL;  // VM's environment
+static Bytecode* running = NULL;     // Bytecode being run, for its constants
 
 // Output function pointer for BC_PRINT
-void vm_default_output(int value) { printf("%d\n", value); }
-void (*vm_output)(int value) = vm_default_output;
+void vm_default_output(Value value) {
+    print_value(value);
+    printf("\n");
+}
+void (*vm_output)(Value value) = vm_default_output;
+
+VMStats vm_stats;
+
+// ----------------------------
+// Quickening
+// ----------------------------
+// A generic arithmetic or comparison op rewrites its own instruction into
+// the int or float variant for the operand types it saw. The variant
+// guards those types and, on a miss, turns the site back into the generic
+// op (counting the miss in the instruction's operand) and re-executes it.
+// Sites that keep missing are left generic, as are bigint operations,
+// which have no specialized variant.
+static void quicken(Instruction* site, Value a, Value b, OpCode int_op, OpCode float_op) {
+    if (site->operand >= QUICKEN_DEOPT_LIMIT) return;
+    if (IS_INT(a) && IS_INT(b)) {
+        site->opcode = int_op;
+    } else if (is_number(a) && is_number(b) && (is_double(a) || is_double(b))) {
+        site->opcode = float_op;
+    } else {
+        return;
+    }
+    vm_stats.quickenings++;
+}
+
+// Indexing sites quicken on the object type alone
+static void quicken_index(Instruction* site, OpCode map_op) {
+    if (site->operand >= QUICKEN_DEOPT_LIMIT) return;
+    site->opcode = map_op;
+    vm_stats.quickenings++;
+}
+
+static void deoptimize(Instruction* site, OpCode generic) {
+    site->opcode = generic;
+    site->operand++;
+    vm_stats.deoptimizations++;
+}
+
+// Used inside a quickened handler: restore the generic op and run it.
+// A plain block rather than do/while, so that continue reaches the
+// dispatch loop
+#define DEOPTIMIZE(generic) { \
+        deoptimize(&code[ip - 1], generic); \
+        ip--; \
+        continue; \
+    }
+
+/**
+ * Reads the operands of a float site. Two integers are a guard miss,
+ * since the generic ops keep integer arithmetic exact.
+ */
+static inline int float_operands(Value a, Value b, double* x, double* y) {
+    if (IS_IMMEDIATE_FLOAT(a) && IS_IMMEDIATE_FLOAT(b)) {
+        *x = as_double(a);
+        *y = as_double(b);
+        return 1;
+    }
+    if ((!is_double(a) && !is_double(b)) || !is_number(a) || !is_number(b)) return 0;
+    *x = to_double(a);
+    *y = to_double(b);
+    return 1;
+}
 
 void run(Bytecode* bytecode) {
     Instruction* code = bytecode->instructions;
     int ip = 0;
+    int base = 0;  // Frame base of the running function (0 for top-level code)
     sp = 0;
+    frame_count = 0;
+    vm_stats.quickenings = 0;
+    vm_stats.deoptimizations = 0;
+    vm_stats.field_cache_misses = 0;
+    vm_stats.closures = 0;
+    vm_stats.upvalues = 0;
+
+    // Top-level code has a frame of its own for the slots of inlined calls
+    if (bytecode->local_count + bytecode->max_stack > VM_STACK_SIZE) {
+        fprintf(stderr, "Stack overflow in top-level code\n");
+        exit(1);
+    }
+    while (sp < bytecode->local_count) stack[sp++] = INT_VAL(0);
     
     // Initialize VM environment if not already done
     if (!vm_env) {
         vm_env = new_environment(NULL);
     }
+    running = bytecode;
 
     while (1) {
         Instruction instr = code[ip++];
@@ -31,114 +130,725 @@ void run(Bytecode* bytecode) {
         switch (instr.opcode) {
             case BC_CONST: {
                 // Push a literal constant
-                int value = bytecode->constants[instr.operand];
-                stack[sp++] = value;
+                stack[sp++] = bytecode->constants[instr.operand];
                 break;
             }
 
+            // Generic arithmetic: the int fast paths work on the tagged
+            // words directly: (2a+1) + 2b = 2(a+b)+1, and 64-bit overflow of
+            // the tagged result is exactly 63-bit overflow of the integer.
+            // Each generic op then specializes its site for the operand
+            // types it just saw (see quicken)
             case BC_ADD: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = a + b;
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int64_t result;
+                if (IS_INT(a) && IS_INT(b) &&
+                    !__builtin_add_overflow((int64_t)a, (int64_t)(b - 1), &result)) {
+                    stack[sp - 1] = (Value)result;
+                } else {
+                    stack[sp - 1] = add_values(a, b);
+                }
+                quicken(&code[ip - 1], a, b, BC_ADD_INT, BC_ADD_FLOAT);
                 break;
             }
             case BC_SUB: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = a - b;
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int64_t result;
+                if (IS_INT(a) && IS_INT(b) &&
+                    !__builtin_sub_overflow((int64_t)a, (int64_t)(b - 1), &result)) {
+                    stack[sp - 1] = (Value)result;
+                } else {
+                    stack[sp - 1] = subtract_values(a, b);
+                }
+                quicken(&code[ip - 1], a, b, BC_SUB_INT, BC_SUB_FLOAT);
                 break;
             }
             case BC_MUL: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = a * b;
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int64_t result;
+                // a * 2b = 2ab, then retag
+                if (IS_INT(a) && IS_INT(b) &&
+                    !__builtin_mul_overflow(AS_INT(a), (int64_t)(b - 1), &result)) {
+                    stack[sp - 1] = (Value)result | 1;
+                } else {
+                    stack[sp - 1] = multiply_values(a, b);
+                }
+                quicken(&code[ip - 1], a, b, BC_MUL_INT, BC_MUL_FLOAT);
                 break;
             }
             case BC_DIV: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = a / b;
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                stack[sp - 1] = divide_values(a, b);
+                quicken(&code[ip - 1], a, b, BC_DIV_INT, BC_DIV_FLOAT);
+                break;
+            }
+
+            // Remainder, bitwise operations and shifts are int operations,
+            // so they check their tags inline rather than quickening.
+            // On tagged words (2a+1) & (2b+1) = 2(a&b)+1, likewise for |,
+            // and (2a+1) ^ (2b+1) = 2(a^b), which only needs its tag back
+            case BC_MOD: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                if (IS_INT(a & b) && b != INT_VAL(0)) {
+                    stack[sp - 1] = INT_VAL(AS_INT(a) % AS_INT(b));
+                } else {
+                    stack[sp - 1] = modulo_values(a, b);
+                }
+                break;
+            }
+            case BC_BIT_AND: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                stack[sp - 1] = IS_INT(a & b) ? a & b : and_values(a, b);
+                break;
+            }
+            case BC_BIT_OR: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                stack[sp - 1] = IS_INT(a & b) ? a | b : or_values(a, b);
+                break;
+            }
+            case BC_BIT_XOR: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                stack[sp - 1] = IS_INT(a & b) ? (a ^ b) | 1 : xor_values(a, b);
+                break;
+            }
+            case BC_SHIFT_LEFT: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                // Fast when the shifted word keeps every bit: shifting back restores it
+                if (IS_INT(a & b) && (uint64_t)AS_INT(b) < 63) {
+                    int count = (int)AS_INT(b);
+                    int64_t shifted = (int64_t)((uint64_t)(a - 1) << count);
+                    if (shifted >> count == (int64_t)(a - 1)) {
+                        stack[sp - 1] = (Value)shifted | 1;
+                        break;
+                    }
+                }
+                stack[sp - 1] = shift_left_values(a, b);
+                break;
+            }
+            case BC_SHIFT_RIGHT: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                if (IS_INT(a & b) && (uint64_t)AS_INT(b) <= 63) {
+                    stack[sp - 1] = INT_VAL(AS_INT(a) >> AS_INT(b));
+                } else {
+                    stack[sp - 1] = shift_right_values(a, b);
+                }
                 break;
             }
 
+            // Intrinsics: on two ints, min and max select with a mask
+            // rather than a branch (tagged ints order like their values),
+            // and abs flips the bits of negatives the same way
+            case BC_MIN: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                if (IS_INT(a & b)) {
+                    Value mask = (Value)0 - (Value)((int64_t)b < (int64_t)a);
+                    stack[sp - 1] = a ^ ((a ^ b) & mask);
+                } else {
+                    stack[sp - 1] = min_values(a, b);
+                }
+                break;
+            }
+            case BC_MAX: {
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                if (IS_INT(a & b)) {
+                    Value mask = (Value)0 - (Value)((int64_t)b > (int64_t)a);
+                    stack[sp - 1] = a ^ ((a ^ b) & mask);
+                } else {
+                    stack[sp - 1] = max_values(a, b);
+                }
+                break;
+            }
+            case BC_ABS: {
+                Value a = stack[sp - 1];
+                if (IS_INT(a) && a != INT_VAL(INT_VALUE_MIN)) {
+                    int64_t sign = (int64_t)a >> 63;  // 0 or -1
+                    // 2|x| from the untagged 2x, then the tag back
+                    int64_t number = ((int64_t)(a - 1) ^ sign) - sign;
+                    stack[sp - 1] = (Value)number | 1;
+                } else {
+                    stack[sp - 1] = abs_value(a);
+                }
+                break;
+            }
+
+            // Generic comparisons yield the integers 1 and 0; tagged ints
+            // order like the integers they hold
+            case BC_NOT: {
+                Value a = stack[sp - 1];
+                int result = IS_INT(a) ? a == INT_VAL(0) : !is_truthy(a);
+                stack[sp - 1] = INT_VAL(result);
+                break;
+            }
+            case BC_IS_INTEGER:
+                stack[sp - 1] = INT_VAL(is_integer(stack[sp - 1]));
+                break;
             case BC_EQUAL: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = (a == b);
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int result = IS_INT(a) && IS_INT(b) ? a == b : values_equal(a, b);
+                stack[sp - 1] = INT_VAL(result);
+                quicken(&code[ip - 1], a, b, BC_EQUAL_INT, BC_EQUAL_FLOAT);
                 break;
             }
             case BC_NOT_EQUAL: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = (a != b);
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int result = IS_INT(a) && IS_INT(b) ? a != b : !values_equal(a, b);
+                stack[sp - 1] = INT_VAL(result);
+                quicken(&code[ip - 1], a, b, BC_NOT_EQUAL_INT, BC_NOT_EQUAL_FLOAT);
                 break;
             }
             case BC_LESS: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = (a < b);
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int result = IS_INT(a) && IS_INT(b) ? (int64_t)a < (int64_t)b : compare_values(a, b) == -1;
+                stack[sp - 1] = INT_VAL(result);
+                quicken(&code[ip - 1], a, b, BC_LESS_INT, BC_LESS_FLOAT);
                 break;
             }
             case BC_LESS_EQUAL: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = (a <= b);
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int result = IS_INT(a) && IS_INT(b) ? (int64_t)a <= (int64_t)b : compare_values(a, b) <= 0;
+                stack[sp - 1] = INT_VAL(result);
+                quicken(&code[ip - 1], a, b, BC_LESS_EQUAL_INT, BC_LESS_EQUAL_FLOAT);
                 break;
             }
             case BC_GREATER: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = (a > b);
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int result = IS_INT(a) && IS_INT(b) ? (int64_t)a > (int64_t)b : compare_values(a, b) == 1;
+                stack[sp - 1] = INT_VAL(result);
+                quicken(&code[ip - 1], a, b, BC_GREATER_INT, BC_GREATER_FLOAT);
                 break;
             }
             case BC_GREATER_EQUAL: {
-                int b = stack[--sp];
-                int a = stack[--sp];
-                stack[sp++] = (a >= b);
+                Value b = stack[--sp];
+                Value a = stack[sp - 1];
+                int result;
+                if (IS_INT(a) && IS_INT(b)) {
+                    result = (int64_t)a >= (int64_t)b;
+                } else {
+                    int order = compare_values(a, b);
+                    result = order == 0 || order == 1;
+                }
+                stack[sp - 1] = INT_VAL(result);
+                quicken(&code[ip - 1], a, b, BC_GREATER_EQUAL_INT, BC_GREATER_EQUAL_FLOAT);
                 break;
             }
 
+            // Quickened int arithmetic: one combined tag test, no calls.
+            // Operands are only popped once the guard holds; on a miss
+            // (a non-int, or a result that needs the generic overflow
+            // handling) the site is rewritten back and re-executed
+            case BC_ADD_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                int64_t result;
+                if (!IS_INT(a & b) ||
+                    __builtin_add_overflow((int64_t)a, (int64_t)(b - 1), &result)) {
+                    DEOPTIMIZE(BC_ADD);
+                }
+                stack[--sp - 1] = (Value)result;
+                break;
+            }
+            case BC_SUB_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                int64_t result;
+                if (!IS_INT(a & b) ||
+                    __builtin_sub_overflow((int64_t)a, (int64_t)(b - 1), &result)) {
+                    DEOPTIMIZE(BC_SUB);
+                }
+                stack[--sp - 1] = (Value)result;
+                break;
+            }
+            case BC_MUL_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                int64_t result;
+                if (!IS_INT(a & b) ||
+                    __builtin_mul_overflow(AS_INT(a), (int64_t)(b - 1), &result)) {
+                    DEOPTIMIZE(BC_MUL);
+                }
+                stack[--sp - 1] = (Value)result | 1;
+                break;
+            }
+            case BC_DIV_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                // Division by zero and INT_VALUE_MIN / -1 are left to the generic op
+                if (!IS_INT(a & b) || b == INT_VAL(0) ||
+                    (a == INT_VAL(INT_VALUE_MIN) && b == INT_VAL(-1))) {
+                    DEOPTIMIZE(BC_DIV);
+                }
+                stack[--sp - 1] = INT_VAL(AS_INT(a) / AS_INT(b));
+                break;
+            }
+
+            // Quickened float arithmetic: any mix of ints and doubles with
+            // at least one double, which the generic ops compute as doubles
+            case BC_ADD_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_ADD);
+                stack[--sp - 1] = double_value(x + y);
+                break;
+            }
+            case BC_SUB_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_SUB);
+                stack[--sp - 1] = double_value(x - y);
+                break;
+            }
+            case BC_MUL_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_MUL);
+                stack[--sp - 1] = double_value(x * y);
+                break;
+            }
+            case BC_DIV_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_DIV);
+                stack[--sp - 1] = double_value(x / y);
+                break;
+            }
+
+            // Quickened comparisons; the C operators treat NaN the way
+            // compare_values does (every ordering false, != true)
+            case BC_EQUAL_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                if (!IS_INT(a & b)) DEOPTIMIZE(BC_EQUAL);
+                stack[--sp - 1] = INT_VAL(a == b);
+                break;
+            }
+            case BC_NOT_EQUAL_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                if (!IS_INT(a & b)) DEOPTIMIZE(BC_NOT_EQUAL);
+                stack[--sp - 1] = INT_VAL(a != b);
+                break;
+            }
+            case BC_LESS_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                if (!IS_INT(a & b)) DEOPTIMIZE(BC_LESS);
+                stack[--sp - 1] = INT_VAL((int64_t)a < (int64_t)b);
+                break;
+            }
+            case BC_LESS_EQUAL_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                if (!IS_INT(a & b)) DEOPTIMIZE(BC_LESS_EQUAL);
+                stack[--sp - 1] = INT_VAL((int64_t)a <= (int64_t)b);
+                break;
+            }
+            case BC_GREATER_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                if (!IS_INT(a & b)) DEOPTIMIZE(BC_GREATER);
+                stack[--sp - 1] = INT_VAL((int64_t)a > (int64_t)b);
+                break;
+            }
+            case BC_GREATER_EQUAL_INT: {
+                Value b = stack[sp - 1];
+                Value a = stack[sp - 2];
+                if (!IS_INT(a & b)) DEOPTIMIZE(BC_GREATER_EQUAL);
+                stack[--sp - 1] = INT_VAL((int64_t)a >= (int64_t)b);
+                break;
+            }
+            case BC_EQUAL_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_EQUAL);
+                stack[--sp - 1] = INT_VAL(x == y);
+                break;
+            }
+            case BC_NOT_EQUAL_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_NOT_EQUAL);
+                stack[--sp - 1] = INT_VAL(x != y);
+                break;
+            }
+            case BC_LESS_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_LESS);
+                stack[--sp - 1] = INT_VAL(x < y);
+                break;
+            }
+            case BC_LESS_EQUAL_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_LESS_EQUAL);
+                stack[--sp - 1] = INT_VAL(x <= y);
+                break;
+            }
+            case BC_GREATER_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_GREATER);
+                stack[--sp - 1] = INT_VAL(x > y);
+                break;
+            }
+            case BC_GREATER_EQUAL_FLOAT: {
+                double x, y;
+                if (!float_operands(stack[sp - 2], stack[sp - 1], &x, &y)) DEOPTIMIZE(BC_GREATER_EQUAL);
+                stack[--sp - 1] = INT_VAL(x >= y);
+                break;
+            }
+
+            // Globals: the operand is the constant holding the interned name
             case BC_LOAD_VAR: {
-                // operand is the ASCII code of the single‐char var name
-                int var_id = instr.operand;
-                char name[2] = { (char)var_id, '\0' };
-                int value = lookup_var(vm_env, name);
-                stack[sp++] = value;
+                ObjString* name = AS_STRING_OBJ(bytecode->constants[instr.operand]);
+                stack[sp++] = lookup_var(vm_env, name);
                 break;
             }
             case BC_SET_VAR: {
-                int var_id = instr.operand;
-                int value = stack[--sp];
-                char name[2] = { (char)var_id, '\0' };
-                assign_var(vm_env, name, value);
+                ObjString* name = AS_STRING_OBJ(bytecode->constants[instr.operand]);
+                assign_var(vm_env, name, stack[--sp]);
                 break;
             }
             case BC_DEFINE_VAR: {
-                int var_id = instr.operand;
-                int value = stack[--sp];
-                char name[2] = { (char)var_id, '\0' };
-                define_var(vm_env, name, value);
+                ObjString* name = AS_STRING_OBJ(bytecode->constants[instr.operand]);
+                define_var(vm_env, name, stack[--sp]);
+                break;
+            }
+
+            case BC_LOAD_LOCAL: {
+                stack[sp++] = stack[base + instr.operand];
+                break;
+            }
+            case BC_SET_LOCAL: {
+                stack[base + instr.operand] = stack[--sp];
+                break;
+            }
+
+            case BC_CALL: {
+                if (gc_requested) gc_safepoint();
+                if (bytecode->functions[instr.operand].entry < 0) {
+                    // First call: compile the body, which may move the code
+                    // and, by declaring nested functions, the functions table
+                    compile_function(bytecode, instr.operand);
+                    code = bytecode->instructions;
+                }
+                Function* fn = &bytecode->functions[instr.operand];
+                int window = fn->arity + fn->capture_count;
+                if (frame_count >= VM_FRAMES_MAX || sp - window + fn->local_count + fn->max_stack > VM_STACK_SIZE) {
+                    fprintf(stderr, "Stack overflow in call to %s\n", fn->name);
+                    exit(1);
+                }
+                frames[frame_count].return_ip = ip;
+                frames[frame_count].base = base;
+                frame_count++;
+
+                // The arguments and captures already on the stack become
+                // the first slots
+                base = sp - window;
+                while (sp < base + fn->local_count) stack[sp++] = INT_VAL(0);
+                ip = fn->entry;
+                break;
+            }
+            case BC_TAIL_CALL: {
+                if (gc_requested) gc_safepoint();
+                if (bytecode->functions[instr.operand].entry < 0) {
+                    compile_function(bytecode, instr.operand);
+                    code = bytecode->instructions;
+                }
+                Function* fn = &bytecode->functions[instr.operand];
+                if (base + fn->local_count + fn->max_stack > VM_STACK_SIZE) {
+                    fprintf(stderr, "Stack overflow in call to %s\n", fn->name);
+                    exit(1);
+                }
+
+                // Slide the new arguments and captures down over the current
+                // frame's slots; the frame record (return address, caller
+                // base) is kept as is
+                int window = fn->arity + fn->capture_count;
+                int args = sp - window;
+                for (int i = 0; i < window; i++) {
+                    stack[base + i] = stack[args + i];
+                }
+                sp = base + window;
+                while (sp < base + fn->local_count) stack[sp++] = INT_VAL(0);
+                ip = fn->entry;
+                break;
+            }
+            case BC_RETURN: {
+                Value result = stack[--sp];
+                sp = base;
+                frame_count--;
+                ip = frames[frame_count].return_ip;
+                base = frames[frame_count].base;
+                stack[sp++] = result;
+                break;
+            }
+            case BC_CALL_BUILTIN: {
+                // The arguments are read in place, then replaced by the result
+                const Builtin* builtin = &builtins[instr.operand];
+                Value result = builtin->function(&stack[sp - builtin->arity]);
+                sp -= builtin->arity;
+                stack[sp++] = result;
+                break;
+            }
+
+            case BC_CALL_NATIVE: {
+                // Same calling convention as builtins: arguments in place
+                const Native* native = &natives[instr.operand];
+                Value result = native->function(&stack[sp - native->arity]);
+                sp -= native->arity;
+                stack[sp++] = result;
+                break;
+            }
+
+            // Closures: a closure call looks like a static call whose
+            // captures come from the closure rather than the caller
+            case BC_CLOSURE: {
+                Function* fn = &bytecode->functions[instr.operand];
+                int count = fn->capture_count;
+                ObjString* name = AS_STRING_OBJ(bytecode->constants[fn->constant]);
+                ObjClosure* closure = new_closure(bytecode->id, instr.operand, name, count);
+                for (int i = 0; i < count; i++) {
+                    closure->upvalues[i] = stack[sp - count + i];
+                }
+                sp -= count;
+                stack[sp++] = OBJ_VAL(closure);
+                vm_stats.closures++;
+                break;
+            }
+            case BC_CALL_CLOSURE: {
+                if (gc_requested) gc_safepoint();
+                int argc = instr.operand;
+                Value callee = stack[sp - argc - 1];
+                if (!IS_CLOSURE_OBJ(callee)) {
+                    fprintf(stderr, "Runtime error: can only call functions\n");
+                    exit(1);
+                }
+                ObjClosure* closure = AS_CLOSURE_OBJ(callee);
+                if (closure->program != bytecode->id) {
+                    fprintf(stderr, "Runtime error: function '%s' belongs to another program\n",
+                            string_chars(closure->name));
+                    exit(1);
+                }
+                if (bytecode->functions[closure->function].entry < 0) {
+                    compile_function(bytecode, closure->function);
+                    code = bytecode->instructions;
+                }
+                Function* fn = &bytecode->functions[closure->function];
+                if (fn->arity != argc) {
+                    fprintf(stderr, "Runtime error: function '%s' expects %d arguments but got %d\n",
+                            fn->name, fn->arity, argc);
+                    exit(1);
+                }
+                if (frame_count >= VM_FRAMES_MAX || sp - argc - 1 + fn->local_count + fn->max_stack > VM_STACK_SIZE) {
+                    fprintf(stderr, "Stack overflow in call to %s\n", fn->name);
+                    exit(1);
+                }
+                frames[frame_count].return_ip = ip;
+                frames[frame_count].base = base;
+                frame_count++;
+
+                // The arguments move down over the closure, then the
+                // captures are copied in after them
+                base = sp - argc - 1;
+                for (int i = 0; i < argc; i++) {
+                    stack[base + i] = stack[base + i + 1];
+                }
+                sp = base + argc;
+                for (int i = 0; i < closure->upvalue_count; i++) {
+                    stack[sp++] = closure->upvalues[i];
+                }
+                while (sp < base + fn->local_count) stack[sp++] = INT_VAL(0);
+                ip = fn->entry;
+                break;
+            }
+            case BC_NEW_UPVALUE: {
+                stack[sp - 1] = OBJ_VAL(new_upvalue(stack[sp - 1]));
+                vm_stats.upvalues++;
+                break;
+            }
+            case BC_LOAD_UPVALUE: {
+                stack[sp++] = AS_UPVALUE_OBJ(stack[base + instr.operand])->value;
+                break;
+            }
+            case BC_SET_UPVALUE: {
+                ObjUpvalue* cell = AS_UPVALUE_OBJ(stack[base + instr.operand]);
+                Value value = stack[--sp];
+                gc_write_barrier(&cell->obj, value);
+                cell->value = value;
+                break;
+            }
+            // A captured variable no escaping closure sees stays in its
+            // slot; the functions using it get the slot's stack index
+            case BC_REF_LOCAL: {
+                stack[sp++] = INT_VAL(base + instr.operand);
+                break;
+            }
+            case BC_LOAD_REF: {
+                stack[sp++] = stack[AS_INT(stack[base + instr.operand])];
+                break;
+            }
+            case BC_SET_REF: {
+                stack[AS_INT(stack[base + instr.operand])] = stack[--sp];
+                break;
+            }
+
+            // Arrays
+            case BC_ARRAY: {
+                int count = instr.operand;
+                ObjArray* array = new_array(count);
+                for (int i = 0; i < count; i++) {
+                    array->items[i] = stack[sp - count + i];
+                }
+                array->count = count;
+                sp -= count;
+                stack[sp++] = OBJ_VAL(array);
+                break;
+            }
+            // Checked indexing serves arrays and maps; a site that sees a
+            // map quickens into the map opcode, like the arithmetic above
+            case BC_INDEX_GET: {
+                Value index = stack[--sp];
+                Value object = stack[sp - 1];
+                if (IS_MAP_OBJ(object)) {
+                    stack[sp - 1] = map_get(AS_MAP_OBJ(object), index);
+                    quicken_index(&code[ip - 1], BC_MAP_GET);
+                    break;
+                }
+                stack[sp - 1] = array_get(object, index);
+                break;
+            }
+            case BC_INDEX_SET: {
+                Value value = stack[--sp];
+                Value index = stack[--sp];
+                Value object = stack[--sp];
+                if (IS_MAP_OBJ(object)) {
+                    map_set(AS_MAP_OBJ(object), index, value);
+                    quicken_index(&code[ip - 1], BC_MAP_SET);
+                    break;
+                }
+                array_set(object, index, value);
+                break;
+            }
+            case BC_INDEX_GET_UNCHECKED: {
+                // The compiler proved an in-bounds int index on an array
+                Value index = stack[--sp];
+                stack[sp - 1] = AS_ARRAY_OBJ(stack[sp - 1])->items[AS_INT(index)];
+                break;
+            }
+            case BC_INDEX_SET_UNCHECKED: {
+                Value value = stack[--sp];
+                Value index = stack[--sp];
+                ObjArray* array = AS_ARRAY_OBJ(stack[--sp]);
+                gc_array_barrier(array, (int)AS_INT(index), value);
+                array->items[AS_INT(index)] = value;
+                break;
+            }
+
+            // Maps
+            case BC_MAP_GET: {
+                if (!IS_MAP_OBJ(stack[sp - 2])) DEOPTIMIZE(BC_INDEX_GET);
+                Value key = stack[--sp];
+                stack[sp - 1] = map_get(AS_MAP_OBJ(stack[sp - 1]), key);
+                break;
+            }
+            case BC_MAP_SET: {
+                if (!IS_MAP_OBJ(stack[sp - 3])) DEOPTIMIZE(BC_INDEX_SET);
+                Value value = stack[--sp];
+                Value key = stack[--sp];
+                map_set(AS_MAP_OBJ(stack[--sp]), key, value);
+                break;
+            }
+            case BC_MAP_HAS: {
+                Value key = stack[--sp];
+                Value map = stack[sp - 1];
+                if (!IS_MAP_OBJ(map)) {
+                    fprintf(stderr, "Runtime error: has() expects a map\n");
+                    exit(1);
+                }
+                stack[sp - 1] = INT_VAL(map_contains(AS_MAP_OBJ(map), key));
+                break;
+            }
+
+            // Records: a field site whose cache holds the record's shape
+            // reads or writes the cached offset directly (see record.h)
+            case BC_RECORD: {
+                ObjShape* shape = (ObjShape*)AS_OBJ(bytecode->constants[instr.operand]);
+                int count = shape->field_count;
+                ObjRecord* record = new_record(shape);
+                for (int i = 0; i < count; i++) {
+                    record->fields[i] = stack[sp - count + i];
+                }
+                sp -= count;
+                stack[sp++] = OBJ_VAL(record);
+                break;
+            }
+            case BC_GET_FIELD: {
+                FieldCache* cache = &bytecode->field_caches[instr.operand];
+                Value object = stack[sp - 1];
+                if (IS_RECORD_OBJ(object) && AS_RECORD_OBJ(object)->shape == cache->shape) {
+                    stack[sp - 1] = AS_RECORD_OBJ(object)->fields[cache->offset];
+                    break;
+                }
+                cache->offset = record_field_offset(object, cache->name);
+                cache->shape = AS_RECORD_OBJ(object)->shape;
+                vm_stats.field_cache_misses++;
+                stack[sp - 1] = AS_RECORD_OBJ(object)->fields[cache->offset];
+                break;
+            }
+            case BC_SET_FIELD: {
+                FieldCache* cache = &bytecode->field_caches[instr.operand];
+                Value value = stack[--sp];
+                Value object = stack[--sp];
+                if (!IS_RECORD_OBJ(object) || AS_RECORD_OBJ(object)->shape != cache->shape) {
+                    cache->offset = record_field_offset(object, cache->name);
+                    cache->shape = AS_RECORD_OBJ(object)->shape;
+                    vm_stats.field_cache_misses++;
+                }
+                gc_write_barrier(AS_OBJ(object), value);
+                AS_RECORD_OBJ(object)->fields[cache->offset] = value;
+                break;
+            }
+
+            case BC_POP: {
+                sp--;
                 break;
             }
 
             case BC_PRINT: {
-                int value = stack[--sp];
-                vm_output(value);
+                vm_output(stack[--sp]);
                 break;
             }
 
             case BC_JUMP_IF_FALSE: {
                 int target = instr.operand;
-                int cond = stack[--sp];
-                if (!cond) ip = target;
+                Value cond = stack[--sp];
+                if (IS_INT(cond) ? cond == INT_VAL(0) : !is_truthy(cond)) ip = target;
+                break;
+            }
+            case BC_JUMP_IF_TRUE: {
+                int target = instr.operand;
+                Value cond = stack[--sp];
+                if (IS_INT(cond) ? cond != INT_VAL(0) : is_truthy(cond)) ip = target;
                 break;
             }
             case BC_JUMP: {
+                // Every loop jumps back, so collections are never far off
+                if (gc_requested) gc_safepoint();
                 ip = instr.operand;
                 break;
             }
 
             case BC_HALT:
+                running = NULL;
                 return;
 
             default:
@@ -147,3 +857,26 @@ void run(Bytecode* bytecode) {
         }
     }
 }
+
+void vm_trace_roots(void) {
+    if (vm_env) trace_environment(vm_env);
+    if (!running) return;
+    for (int i = 0; i < sp; i++) gc_trace(&stack[i]);
+    for (int i = 0; i < running->const_count; i++) gc_trace(&running->constants[i]);
+    for (int i = 0; i < running->field_cache_count; i++) {
+        FieldCache* cache = &running->field_caches[i];
+        Obj* name = &cache->name->obj;
+        gc_trace_object(&name);
+        cache->name = (ObjString*)name;
+        if (cache->shape) {
+            Obj* shape = &cache->shape->obj;
+            gc_trace_object(&shape);
+            cache->shape = (ObjShape*)shape;
+        }
+    }
+}
+
+void free_vm(void) {
+    if (vm_env) free_environment(vm_env);
+    vm_env = NULL;
+}
@@ -10,7 +10,8 @@
  * 
  * VM Architecture:
  * - Stack-based execution model
- * - Environment-based variable storage
+ * - Environment-based variable storage for globals
+ * - Call frames addressing arguments and locals as operand stack slots
  * - Instruction pointer for program flow
  * - Constants table for literal values
  * - Configurable output function for testing
@@ -23,17 +24,54 @@
  * 4. Advance: Move to next instruction (unless jumped)
  * 
  * Stack Operations:
- * - Values are pushed onto and popped from the operand stack
+ * - Tagged values (see value.h) are pushed onto and popped from the operand stack
+ * - Arithmetic and comparisons on two ints run on the tagged words
+ *   directly; other operands go through the generic value functions
  * - Binary operations consume two operands and produce one result
  * - Stack underflow is prevented by instruction validation
  * - Stack overflow is prevented by fixed stack size
  * 
+ * Quickening:
+ * - The first time a generic arithmetic or comparison op runs, it rewrites
+ *   its instruction to the int or float variant (e.g. BC_ADD_INT) for the
+ *   operand types it saw, so hot loops dispatch straight to handlers
+ *   without type dispatch or calls
+ * - A variant whose type guard fails rewrites the site back to the generic
+ *   op and re-executes it; the site may quicken again for the new types
+ * - Each site counts its guard misses in its operand and stays generic
+ *   after a few, so polymorphic sites do not keep flipping
+ * - vm_stats exposes the totals of the last run
+ * 
+ * Field Access:
+ * - Each obj.field site has an inline cache (FieldCache in compiler.h);
+ *   a record of the cached shape costs a shape compare and a load
+ * - A miss looks the field up in the record's shape and refills the
+ *   cache; misses are counted in vm_stats
+ * 
  * Variable Management:
  * - Variables are stored in an environment structure
  * - Single-character variable names (ASCII codes)
  * - Support for variable definition and assignment
  * - Environment lookup with parent chain support
  * 
+ * Function Calls:
+ * - BC_CALL pushes a frame recording the return address and caller base
+ * - The callee's arguments and locals form a window on the operand stack
+ * - BC_RETURN drops the window and pushes the result for the caller
+ * - BC_TAIL_CALL overwrites the current window in place, so tail
+ *   recursion runs in constant frame and operand stack space
+ * - Frames live in a fixed array, so calls never allocate memory
+ * - Recursion runs as deep as its windows fit in VM_STACK_SIZE slots,
+ *   with room above the last for its temporaries (max_stack); a call
+ *   that does not fit stops the program with "Stack overflow"
+ * - The first call to a function compiles its body (see compile_function),
+ *   so startup cost follows the code that actually runs
+ * - BC_CALL_CLOSURE calls a function value: the arguments slide down
+ *   over the closure and its captures follow them, so the callee sees
+ *   the same frame as from a direct call
+ * - Captured variables live in frame slots unless an escaping closure
+ *   may assign them, in which case the slot holds a cell (see capture.h)
+ * 
  * Control Flow:
  * - Absolute jumps for if statements and loops
  * - Conditional jumps based on stack values
@@ -52,6 +90,25 @@
 
 #include "compiler.h"
 
+/// Operand stack slots shared by the windows of every active call
+#define VM_STACK_SIZE (64 * 1024)
+
+/// Active calls, one per slot, so only calls that need no slots can reach it
+#define VM_FRAMES_MAX VM_STACK_SIZE
+
+/**
+ * @brief Quickening and closure counters for the most recent call to run()
+ */
+typedef struct {
+    long quickenings;      ///< Sites rewritten to an int or float variant
+    long deoptimizations;  ///< Guard misses that rewrote a site back
+    long field_cache_misses; ///< Field accesses that missed their inline cache
+    long closures;         ///< Closures created (capture-free functions have one, made at compile time)
+    long upvalues;         ///< Variables moved into heap cells
+} VMStats;
+
+extern VMStats vm_stats;
+
 /**
  * @brief Executes compiled bytecode on the virtual machine
  * @param bytecode The compiled program to execute
@@ -80,11 +137,13 @@
  * - BC_LOAD_VAR: Pushes variable value onto stack
  * - BC_SET_VAR: Stores top stack value into existing variable
  * - BC_DEFINE_VAR: Creates new variable with top stack value
- * - Variable names are single ASCII characters
+ * - Variable names are interned strings in the constants table, and the
+ *   global environment compares them by pointer
  * 
  * Control Flow:
  * - BC_JUMP: Sets instruction pointer to absolute target
  * - BC_JUMP_IF_FALSE: Jumps only if top stack value is false (0)
+ * - BC_JUMP_IF_TRUE: Jumps only if top stack value is true; both pop it
  * - Jump targets are validated to prevent out-of-bounds access
  * - Loops use backward jumps, conditionals use forward jumps
  * 
@@ -116,7 +175,7 @@ void run(Bytecode* bytecode);
  * Tests can override this to capture output for verification.
  * 
  * Function Signature:
- * - Parameter: int value - The value to output
+ * - Parameter: Value value - The tagged value to output (see value.h)
  * - Return: void - No return value needed
  * 
  * Usage:
@@ -129,7 +188,7 @@ void run(Bytecode* bytecode);
  * - Should be set once at program start
  * - Concurrent access should be avoided
  */
-extern void (*vm_output)(int value);
+extern void (*vm_output)(Value value);
 
 /**
  * @brief Default output function for the VM
@@ -138,6 +197,23 @@ extern void (*vm_output)(int value);
  * This function prints the given value to stdout followed by a newline.
  * It serves as the default implementation for vm_output.
  */
-void vm_default_output(int value);
+void vm_default_output(Value value);
+
+/**
+ * @brief Traces the VM's roots for the collector (see gc.h)
+ *
+ * The roots are the VM globals and, while run() is executing, the operand
+ * stack up to the stack pointer (every frame's arguments and locals) and
+ * the running bytecode's constants and field caches. A bytecode's
+ * constants are therefore only kept alive while it runs.
+ */
+void vm_trace_roots(void);
+
+/**
+ * @brief Frees the VM globals
+ *
+ * Called by free_objects(), since the values they hold are freed too.
+ */
+void free_vm(void);
 
 #endif // VM_H 
\ No newline at end of file